@@ -17,13 +17,18 @@
 #include <pcl/point_types.h>
 #include <visualization_msgs/Marker.h>
 
+#include <deque>
 #include <map>
+#include <memory>
+#include <set>
 #include <unordered_map>
 #include <vector>
 
 #include "kimera_pgmo/MeshDeformation.h"
+#include "kimera_pgmo/utils/AllocationStats.h"
 #include "kimera_pgmo/utils/CommonFunctions.h"
 #include "kimera_pgmo/utils/CommonStructs.h"
+#include "kimera_pgmo/utils/ControlPointStore.h"
 #include "kimera_pgmo/utils/RangeGenerator.h"
 
 namespace kimera_pgmo {
@@ -104,6 +109,119 @@ class DeformationEdgeFactor
 
 #undef JACOBIAN_DEFAULT
 
+/*! \brief Loop closure taken out of the active solve after GNC rejected it in
+ * consecutive optimizations. It is kept (and saved with the graph) so that it can
+ * be audited and added back with DeformationGraph::readmitLoopClosure.
+ */
+struct RetiredLoopClosure {
+  gtsam::NonlinearFactor::shared_ptr factor;
+  // consecutive optimizations that rejected it and its last GNC weight
+  size_t num_rejections = 0;
+  double weight = 0.0;
+};
+
+/*! \brief Content of a deformation graph (dgrf) file. It is parsed without
+ * touching any graph, so that several files can be read concurrently and then
+ * added to a graph at once.
+ */
+struct DeformationGraphFile {
+  gtsam::Values values;
+  gtsam::Values temp_values;
+  gtsam::NonlinearFactorGraph factors;
+  gtsam::NonlinearFactorGraph temp_factors;
+  gtsam::NonlinearFactorGraph consistency_factors;
+  std::map<char, std::deque<gtsam::Pose3>> initial_poses;
+  std::unordered_map<gtsam::Key, gtsam::Pose3> temp_initial_poses;
+  std::map<char, ControlPointStore> control_points;
+
+  // Solver state saved with the graph: converged is only set if the values
+  // are a converged solution of exactly the factors in the file (the hash of
+  // the factors when saved matches the factors read)
+  bool converged = false;
+  // GNC weights of the factors (in order), empty if not saved
+  gtsam::Vector gnc_weights;
+  // loop closures excluded from the solve (not part of the factors above)
+  std::vector<RetiredLoopClosure> retired_loop_closures;
+
+  /*! \brief Append the content of the file of another robot. Returns false
+   * (and leaves this file unchanged) if the keys or vertex prefixes of the two
+   * files overlap.
+   */
+  bool merge(const DeformationGraphFile& other);
+
+  /*! \brief Indices of the factors GNC considered inliers when saved
+   */
+  std::vector<size_t> inliers() const;
+};
+
+/*! \brief Parse a deformation graph file
+ * - filename: input file name
+ * - graph: parsed content
+ * - include_temp: also parse the temporary nodes and factors
+ * - set_robot_id: rekey the nodes and vertices to new_robot_id
+ * - new_robot_id: robot id assigned if set_robot_id
+ */
+bool ReadDeformationGraphFile(const std::string& filename,
+                              DeformationGraphFile* graph,
+                              bool include_temp = true,
+                              bool set_robot_id = false,
+                              size_t new_robot_id = 0);
+
+/*! \brief Nodes moved by an optimization: pose graph nodes and control points
+ * (mesh vertices nodes) that moved more than a translation or rotation
+ * tolerance. Nodes added by the optimization always count as moved.
+ */
+struct RegionOfInfluence {
+  std::vector<gtsam::Key> moved_poses;
+  // indices of the moved control points of each vertex prefix
+  std::map<char, std::vector<size_t>> moved_control_points;
+  size_t num_poses = 0;
+  size_t num_control_points = 0;
+
+  size_t numMovedControlPoints() const;
+};
+
+/*! \brief Compare the estimates before and after an optimization
+ * - before: values before the optimization
+ * - after: values after the optimization
+ * - translation_tol: translation (meters) above which a node moved
+ * - rotation_tol: rotation (radians) above which a node moved
+ */
+RegionOfInfluence computeRegionOfInfluence(const gtsam::Values& before,
+                                           const gtsam::Values& after,
+                                           double translation_tol,
+                                           double rotation_tol);
+
+/*! \brief Vertices of a mesh deformed by the last deformation
+ */
+struct DeformedVertices {
+  // all the vertices were deformed
+  bool full = true;
+  // cached vertices (before start) deformed again because a control point they
+  // are interpolated from moved (increasing)
+  std::vector<size_t> moved;
+  // vertices from start on are always deformed (new or within the horizon)
+  size_t start = 0;
+  size_t num_vertices = 0;
+  // deformations of the prefix so far: consecutive sequences mean that these
+  // vertices are the only ones changed since the previous deformation
+  uint64_t sequence = 0;
+
+  inline size_t size() const {
+    return full ? num_vertices : moved.size() + num_vertices - start;
+  }
+
+  /*! \brief Indices of all the deformed vertices (increasing)
+   */
+  std::vector<size_t> indices() const;
+};
+
+// Handle of a point set registered with the deformation graph
+using PointSetHandle = uint64_t;
+
+// Deformed mesh shared by all the consumers of a deformation
+using DeformedMeshConstPtr = std::shared_ptr<const pcl::PolygonMesh>;
+
 class DeformationGraph {
  public:
   /*! \brief Deformation graph class constructor
@@ -246,6 +364,19 @@ class DeformationGraph {
       std::vector<Timestamp>* added_index_stamps,
       double variance = 1e-4);
 
+  /*! \brief Add new mesh edges and nodes from a compact mesh graph msg, reading
+   * its packed arrays in place. The edges are anchored at the positions of the
+   * control points, so they can also connect to vertices added by earlier msgs.
+   *  - mesh_graph: new vertices and edges of the simplified mesh of one robot
+   *  - added_indices: indices of nodes that was successfully added
+   *  - added_index_stamps: stamps of the nodes that were added
+   *  - variance: covariance of the deformation graph edges
+   */
+  void addNewMeshEdgesAndNodes(const KimeraPgmoMeshGraph& mesh_graph,
+                               std::vector<size_t>* added_indices,
+                               std::vector<Timestamp>* added_index_stamps,
+                               double variance = 1e-4);
+
   /*! \brief Add single deformation edge factor to graph
    *  - key: Key of pose graph node
    *  - valence_key: Key of valence node
@@ -302,7 +433,8 @@ class DeformationGraph {
    */
   std::vector<gtsam::Pose3> getQueuedTrajectory(char prefix) const;
 
-  /*! \brief Deform a mesh based on the deformation graph
+  /*! \brief Deform a mesh based on the current estimate of the deformation graph
+   * (not cached: see deformMeshShared to share the result between callers)
    * - original_mesh: mesh to deform
    * - stamps: timestamp of vertices in mesh to deform
    * - prefix: the prefixes of the key of the nodes corresponding to mesh
@@ -318,6 +450,22 @@ class DeformationGraph {
                               size_t k = 4,
                               double tol_t = 10.0);
 
+  /*! \brief Deform a mesh with the current estimate, sharing the result between
+   * callers. The last deformed mesh of each prefix is cached and returned again
+   * without interpolating while the estimate (see getValuesVersion), the control
+   * points of the prefix and the mesh are unchanged.
+   * - mesh_version: version of the mesh, changed by the caller whenever the mesh
+   * changes (0 to identify the mesh by a hash of its contents)
+   * - other arguments: see deformMesh
+   */
+  DeformedMeshConstPtr deformMeshShared(const pcl::PolygonMesh& original_mesh,
+                                        const std::vector<Timestamp>& stamps,
+                                        const std::vector<int>& graph_indices,
+                                        char prefix,
+                                        size_t k = 4,
+                                        double tol_t = 10.0,
+                                        uint64_t mesh_version = 0);
+
   /*! \brief Deform a mesh based on the deformation graph
    * - original_mesh: mesh to deform
    * - stamps: timestamp of vertices in mesh to deform
@@ -380,13 +528,55 @@ class DeformationGraph {
                     int start_index_hint = -1,
                     std::vector<std::set<size_t>>* vertex_graph_map = nullptr);
 
+  /*! \brief Register a set of points (e.g. object detections or places) to
+   * deform consistently with the mesh of a prefix. The control points
+   * interpolating each point are found once, and all the registered points are
+   * deformed again after every optimization.
+   * - prefix: the prefix of the control points to deform the points with
+   * - points: undeformed points
+   * - stamps: timestamps of the points (empty to use every control point)
+   * - k: how many nearby nodes to use to interpolate each point
+   * - tol_t: largest difference in time such that a control point can be
+   * considered for association
+   * - outputs the handle to read the deformed points with
+   */
+  PointSetHandle registerPointSet(char prefix,
+                                  const std::vector<gtsam::Point3>& points,
+                                  const std::vector<Timestamp>& stamps = {},
+                                  size_t k = 4,
+                                  double tol_t = 10.0);
+
+  /*! \brief Stop deforming a registered point set. Returns false for unknown
+   * handles.
+   */
+  bool removePointSet(PointSetHandle handle);
+
+  inline size_t numPointSets() const { return point_sets_.size(); }
+
+  /*! \brief Points of a registered set deformed with the current estimate.
+   * Throws std::out_of_range for unknown handles.
+   */
+  const std::vector<gtsam::Point3>& getDeformedPointSet(PointSetHandle handle) const;
+
+  /*! \brief Deform all the registered point sets with the current estimate in one
+   * parallel pass (done after every optimization and update)
+   */
+  void deformPointSets();
+
+  /*! \brief Set the number of threads deforming the registered point sets (0 to
+   * use the hardware concurrency)
+   */
+  inline void setPointSetThreads(size_t num_threads) {
+    point_set_threads_ = num_threads;
+  }
+
   /*! \brief Get the number of loop closures processed by pgo
    */
   inline size_t getNumLoopclosures() const { return pgo_->getNumLC(); }
 
-  /*! \brief Get the GNC weights from optimization
+  /*! \brief Get the GNC weights from optimization (of getGtsamFactors, in order)
    */
-  inline gtsam::Vector getGncWeights() const { return pgo_->getGncWeights(); }
+  inline gtsam::Vector getGncWeights() const { return gnc_weights_; }
 
   inline gtsam::Vector getTempFactorGncWeights() const {
     return pgo_->getGncTempWeights();
@@ -394,12 +584,49 @@ class DeformationGraph {
 
   inline gtsam::Vector getAllGncWeights() const { return pgo_->getGncWeights(); }
 
+  /*! \brief Retire the loop closures GNC rejected in consecutive optimizations:
+   * they are removed from the active solve and archived (and saved with the
+   * graph) until readmitted
+   * - num_rejections: consecutive calls to optimize with a GNC weight below
+   * weight_threshold after which a loop closure is retired (0 to disable)
+   * - weight_threshold: GNC weight below which a loop closure is rejected
+   */
+  inline void setLoopClosureRetirement(size_t num_rejections, double weight_threshold) {
+    retire_after_rejections_ = num_rejections;
+    retirement_weight_threshold_ = weight_threshold;
+  }
+
+  /*! \brief Get the loop closures retired from the solve
+   */
+  inline const std::vector<RetiredLoopClosure>& getRetiredLoopClosures() const {
+    return retired_loop_closures_;
+  }
+
+  /*! \brief Add a retired loop closure back to the solve (with the next update or
+   * optimize). Its rejections are counted again from zero.
+   * - key_from: first node of the loop closure
+   * - key_to: second node of the loop closure
+   * - outputs false if no loop closure between the nodes is retired
+   */
+  bool readmitLoopClosure(const gtsam::Key& key_from, const gtsam::Key& key_to);
+
+  /*! \brief Add all the retired loop closures back to the solve
+   * - outputs the number of loop closures readmitted
+   */
+  size_t readmitLoopClosures();
+
+  /*! \brief True if the current estimate is a converged solution of all the
+   * factors in the graph (after optimize or after loading a converged graph
+   * file), i.e. optimizing again would not change it
+   */
+  bool hasConvergedEstimate() const;
+
   /*! \brief Get the number of mesh vertices nodes in the deformation graph
    * - outputs the number of mesh vertices nodes
    */
   inline size_t getNumVertices() const {
     size_t num_vertices = 0;
-    for (const auto& pfx_vertices : vertex_positions_) {
+    for (const auto& pfx_vertices : control_points_) {
       num_vertices += pfx_vertices.second.size();
     }
     return num_vertices;
@@ -410,6 +637,14 @@ class DeformationGraph {
    */
   inline const gtsam::Values& getGtsamValues() const { return values_; }
 
+  /*! \brief Version of the estimate, increased whenever it changes
+   */
+  inline uint64_t getValuesVersion() const { return values_version_; }
+
+  /*! \brief Drop the meshes cached by deformMeshShared
+   */
+  inline void clearDeformedMeshCache() { deformed_mesh_cache_.clear(); }
+
   /*! \brief Gets the factors added to the backend, minus the detected outliers
    *  - outputs the factors as a GTSAM NonlinearFactorGraph
    */
@@ -452,26 +687,50 @@ class DeformationGraph {
    */
   inline gtsam::Point3 getInitialPositionVertex(const char& prefix,
                                                 const size_t& index) const {
-    return vertex_positions_.at(prefix).at(index);
+    return control_points_.at(prefix).position(index);
   }
 
   /*! \brief Get the intial positions of the vertices corresponding to prefix
    */
   inline std::vector<gtsam::Point3> getInitialPositionsVertices(
       const char& prefix) const {
-    return vertex_positions_.at(prefix);
+    return control_points_.at(prefix).positions();
   }
 
-  inline bool hasVertexKey(char prefix) const {
-    return vertex_positions_.count(prefix);
+  /*! \brief Get the control points (initial positions and stamps of the vertices)
+   * corresponding to prefix
+   */
+  inline const ControlPointStore& getControlPoints(const char& prefix) const {
+    return control_points_.at(prefix);
   }
 
+  inline bool hasVertexKey(char prefix) const { return control_points_.count(prefix); }
+
   /*! \brief Set whether or not to force vertex recalculation
    */
   inline void setForceRecalculate(bool force_recalculate) {
     force_recalculate_ = force_recalculate;
   }
 
+  /*! \brief Only deform again the cached vertices interpolated from control
+   * points that moved after an optimization, instead of the whole mesh
+   * - translation_tol: translation (meters) above which a node moved (disabled
+   * if not positive)
+   * - rotation_tol: rotation (radians) above which a node moved
+   */
+  void setRegionOfInfluence(double translation_tol, double rotation_tol);
+
+  /*! \brief Nodes moved by the last optimization (only computed if the region of
+   * influence is enabled)
+   */
+  inline const RegionOfInfluence& getLastRegionOfInfluence() const {
+    return last_region_;
+  }
+
+  /*! \brief Vertices deformed by the last deformation of the mesh of a prefix
+   */
+  const DeformedVertices& getLastDeformedVertices(char prefix) const;
+
   /*! \brief Recalculate vertices getter
    */
   inline bool getRecalculateVertices() { return recalculate_vertices_; }
@@ -546,14 +805,23 @@ class DeformationGraph {
    */
   void save(const std::string& filename) const;
 
-  /*! \brief Load deformation graph from file
+  /*! \brief Load deformation graph from file. The graph is not changed if the
+   * file cannot be read.
    * - filename: input file name
+   * - returns false if the file cannot be read
    */
-  void load(const std::string& filename,
+  bool load(const std::string& filename,
             bool include_temp = true,
             bool set_robot_id = false,
             size_t new_robot_id = 0);
 
+  /*! \brief Add a parsed deformation graph file. A converged graph added to an
+   * empty graph is not optimized again; otherwise its saved estimate is the
+   * initial guess of the next optimization.
+   * - graph: parsed deformation graph file(s)
+   */
+  void load(const DeformationGraphFile& graph);
+
   inline bool hasPrefixPoses(char prefix) const {
     return pg_initial_poses_.count(prefix);
   }
@@ -575,20 +843,21 @@ class DeformationGraph {
                        const CloudIn& vertices,
                        const gtsam::Values& optimized_values,
                        const std::vector<int>& graph_indices,
+                       const std::vector<size_t>& candidates,
                        std::vector<size_t>& indices_to_deform,
-                       char prefix,
-                       size_t start_index);
+                       char prefix);
 
  private:
   bool verbose_;
 
   // Keep track of vertices not part of mesh
   // for embedding trajectory, etc.
-  std::map<char, std::vector<gtsam::Pose3>> pg_initial_poses_;
+  // (deque so that appending never moves the existing poses)
+  std::map<char, std::deque<gtsam::Pose3>> pg_initial_poses_;
   std::unordered_map<gtsam::Key, gtsam::Pose3> temp_pg_initial_poses_;
 
-  std::map<char, std::vector<gtsam::Point3>> vertex_positions_;
-  std::map<char, std::vector<Timestamp>> vertex_stamps_;
+  // Initial positions and stamps of the mesh vertices
+  std::map<char, ControlPointStore> control_points_;
 
   KimeraRPGO::RobustSolverParams pgo_params_;
   std::unique_ptr<KimeraRPGO::RobustSolver> pgo_;
@@ -597,17 +866,31 @@ class DeformationGraph {
   gtsam::NonlinearFactorGraph nfg_;
   // current estimate
   gtsam::Values values_;
+  // increased whenever values_ changes
+  uint64_t values_version_ = 0;
   // temp factors
   gtsam::NonlinearFactorGraph temp_nfg_;
   // current estimate for temp nodes
   gtsam::Values temp_values_;
   // gnc weights
   gtsam::Vector gnc_weights_;
+  // values_ is a converged solution of converged_num_factors_ factors (and
+  // temp factors)
+  bool estimate_converged_;
+  size_t converged_num_factors_;
 
   // new factors and values
   gtsam::NonlinearFactorGraph new_factors_;
   gtsam::Values new_values_;
 
+  // Loop closures rejected by GNC in retire_after_rejections_ consecutive
+  // optimizations are archived in retired_loop_closures_ (disabled if 0)
+  size_t retire_after_rejections_ = 0;
+  double retirement_weight_threshold_ = 0.1;
+  // consecutive rejections of the active loop closures, keyed by their nodes
+  std::map<std::pair<gtsam::Key, gtsam::Key>, size_t> loop_closure_rejections_;
+  std::vector<RetiredLoopClosure> retired_loop_closures_;
+
   //// Below separated factor types for debugging
   // factor graph encoding the mesh structure
   gtsam::NonlinearFactorGraph consistency_factors_;
@@ -618,6 +901,105 @@ class DeformationGraph {
   // Recalculate only if new measurements added
   bool recalculate_vertices_;
   std::map<char, pcl::PointCloud<pcl::PointXYZ>> last_calculated_vertices_;
+
+  // Region of influence tolerances (disabled if the translation is not positive)
+  double region_translation_tol_;
+  double region_rotation_tol_;
+  RegionOfInfluence last_region_;
+  // Poses of the control points of each prefix the cached vertices linked to
+  // them were deformed with: control points are moved with respect to these, so
+  // that small motions over several optimizations add up
+  struct DeformedControlPoints {
+    std::vector<gtsam::Pose3> poses;
+    std::vector<bool> known;
+  };
+  std::map<char, DeformedControlPoints> deformed_control_points_;
+
+  // Control points each cached vertex is interpolated from (compressed rows:
+  // the control points of vertex i are in [offsets[i], offsets[i + 1]))
+  struct ControlPointLinks {
+    bool valid = true;
+    std::vector<uint32_t> offsets{0};
+    std::vector<uint32_t> control_points;
+  };
+  std::map<char, ControlPointLinks> vertex_links_;
+  std::map<char, DeformedVertices> last_deformed_;
+
+  // Point sets deformed after every optimization
+  struct RegisteredPointSet {
+    char prefix;
+    size_t k;
+    double tol_t;
+    std::vector<gtsam::Point3> points;
+    std::vector<Timestamp> stamps;
+    deformation::InterpolationWeights weights;
+    std::vector<gtsam::Point3> deformed;
+  };
+  std::map<PointSetHandle, RegisteredPointSet> point_sets_;
+  PointSetHandle next_point_set_handle_ = 0;
+  size_t point_set_threads_ = 0;
+
+  // Last mesh of each prefix deformed by deformMeshShared and what it depends on
+  struct CachedDeformedMesh {
+    uint64_t values_version;
+    uint64_t mesh_version;
+    bool hashed_version;
+    size_t num_control_points;
+    size_t k;
+    double tol_t;
+    // every vertex was deformed with the estimate (not only the new ones)
+    bool full;
+    DeformedMeshConstPtr mesh;
+  };
+  std::map<char, CachedDeformedMesh> deformed_mesh_cache_;
+
+  /*! \brief Replace the current estimate (swapped with estimate), increasing
+   * the version of the estimate if it changed
+   */
+  void setEstimate(gtsam::Values& estimate);
+
+  /*! \brief Add a mesh node to the control points of its prefix. Returns false
+   * if the node was already added.
+   */
+  bool addMeshNode(char prefix,
+                   size_t index,
+                   const gtsam::Point3& position,
+                   Timestamp stamp);
+
+  /*! \brief Count the loop closures GNC rejected in the last optimization and
+   * retire the ones rejected retire_after_rejections_ times in a row. Returns
+   * false if the estimate is no longer a converged solution of the factors.
+   */
+  bool retireRejectedLoopClosures();
+
+  void updatePointSetWeights(RegisteredPointSet& point_set) const;
+
+  /*! \brief Cached vertices interpolated from control points that moved since
+   * they were deformed. Returns false if they are not known and the whole mesh
+   * has to be deformed.
+   * - values: values the vertices are deformed with
+   * - moved_control_points: control points that moved (by index)
+   * - moved: indices of the cached vertices to deform again
+   */
+  bool findMovedVertices(char prefix,
+                         size_t num_cached,
+                         const gtsam::Values& values,
+                         std::vector<bool>* moved_control_points,
+                         std::vector<size_t>* moved) const;
+
+  /*! \brief Record the poses of the control points the vertices of a prefix were
+   * deformed with: all of them after a full deformation, otherwise the ones that
+   * moved and the new ones
+   */
+  void updateDeformedControlPoints(char prefix,
+                                   const gtsam::Values& values,
+                                   bool full,
+                                   const std::vector<bool>& moved_control_points);
+
+  void updateVertexLinks(char prefix,
+                         size_t start_idx,
+                         const std::vector<std::set<size_t>>& links,
+                         bool valid);
 };
 
 typedef std::shared_ptr<DeformationGraph> DeformationGraphPtr;
@@ -651,12 +1033,14 @@ size_t DeformationGraph::findStartIndex(char prefix,
   }
 
   if (start_index_hint >= 0) {
-    return start_index_hint;
+    // points past the cache have never been deformed
+    return std::min(static_cast<size_t>(start_index_hint),
+                    last_calculated_vertices_.at(prefix).size());
   }
 
   Timestamp min_stamp =
       std::max(static_cast<Timestamp>(0),
-               vertex_stamps_.at(prefix).back() - stampFromSec(tol_t));
+               control_points_.at(prefix).lastStamp() - stampFromSec(tol_t));
 
   RangeGenerator gen(traits::num_vertices(cloud));
   auto bound = std::upper_bound(gen.begin(), gen.end(), min_stamp, [&](auto v, auto i) {
@@ -703,11 +1087,10 @@ void DeformationGraph::predeformPoints(CloudOut& new_vertices,
                                        const CloudIn& vertices,
                                        const gtsam::Values& optimized_values,
                                        const std::vector<int>& graph_indices,
+                                       const std::vector<size_t>& candidates,
                                        std::vector<size_t>& indices_to_deform,
-                                       char prefix,
-                                       size_t start_idx) {
-  const auto num_vertices = traits::num_vertices(vertices);
-  for (size_t i = start_idx; i < num_vertices; i++) {
+                                       char prefix) {
+  for (const size_t i : candidates) {
     const int index = graph_indices.at(i);
     if (index < 0 || !optimized_values.exists(gtsam::Symbol(prefix, index))) {
       // Have to check here because sometimes interpolation happen before mesh
@@ -720,7 +1103,7 @@ void DeformationGraph::predeformPoints(CloudOut& new_vertices,
     const auto vi = traits::get_vertex(vertices, i).template cast<double>();
     gtsam::Pose3 transform =
         optimized_values.at<gtsam::Pose3>(gtsam::Symbol(prefix, index));
-    gtsam::Point3 gindex = vertex_positions_[prefix].at(index);
+    gtsam::Point3 gindex = control_points_[prefix].position(index);
     gtsam::Point3 deformed_point =
         transform.rotation().rotate(vi - gindex) + transform.translation();
     traits::set_vertex(new_vertices, i, deformed_point.cast<float>());
@@ -737,28 +1120,58 @@ void DeformationGraph::deformPoints(CloudOut& vertices,
                                     const std::vector<int>* graph_indices,
                                     int start_index_hint,
                                     std::vector<std::set<size_t>>* vertex_graph_map) {
+  AllocationZone allocation_zone("DeformationGraph::deformPoints");
   // Cannot deform if no nodes in the deformation graph
-  if (vertex_positions_.find(prefix) == vertex_positions_.end()) {
+  if (control_points_.find(prefix) == control_points_.end()) {
     ROS_DEBUG("Deformation graph has no vertices for mesh prefix. No deformation.");
     return;
   }
 
+  // Cached vertices interpolated from control points that moved since they were
+  // deformed (only tracked with a region of influence)
+  const bool track_region = region_translation_tol_ > 0.0;
+  std::vector<size_t> moved;
+  std::vector<bool> moved_control_points;
+  if (!track_region) {
+    vertex_links_.erase(prefix);
+    deformed_control_points_.erase(prefix);
+  } else if (!recalculate_vertices_) {
+    const auto cached = last_calculated_vertices_.find(prefix);
+    if (cached != last_calculated_vertices_.end() &&
+        !findMovedVertices(prefix,
+                           cached->second.size(),
+                           optimized_values,
+                           &moved_control_points,
+                           &moved)) {
+      recalculate_vertices_ = true;
+    }
+  }
+
   const auto start_idx = findStartIndex(prefix, start_index_hint, old_vertices, tol_t);
   fillPreviousPoints(vertices, prefix, start_idx);
+  const size_t num_vertices = traits::num_vertices(vertices);
+  if (start_idx == 0) {
+    moved.clear();
+  }
+  while (!moved.empty() && moved.back() >= start_idx) {
+    moved.pop_back();
+  }
 
   std::vector<size_t> to_deform;
   if (start_idx != 0) {
+    std::vector<size_t> candidates = moved;
+    candidates.resize(moved.size() + num_vertices - start_idx);
+    std::iota(candidates.begin() + moved.size(), candidates.end(), start_idx);
     if (graph_indices) {
       predeformPoints(vertices,
                       old_vertices,
                       optimized_values,
                       *graph_indices,
+                      candidates,
                       to_deform,
-                      prefix,
-                      start_idx);
+                      prefix);
     } else {
-      to_deform.resize(traits::num_vertices(vertices) - start_idx);
-      std::iota(to_deform.begin(), to_deform.end(), start_idx);
+      to_deform = std::move(candidates);
     }
   }
 
@@ -768,8 +1181,7 @@ void DeformationGraph::deformPoints(CloudOut& vertices,
                             vertex_graph_map_deformed,
                             old_vertices,
                             prefix,
-                            vertex_positions_.at(prefix),
-                            vertex_stamps_.at(prefix),
+                            control_points_.at(prefix),
                             optimized_values,
                             k,
                             tol_t,
@@ -779,14 +1191,53 @@ void DeformationGraph::deformPoints(CloudOut& vertices,
     if (start_idx == 0) {
       *vertex_graph_map = vertex_graph_map_deformed;
     } else {
-      vertex_graph_map->resize(traits::num_vertices(vertices));
+      vertex_graph_map->resize(num_vertices);
       for (size_t i = 0; i < indices_ptr->size(); i++) {
         vertex_graph_map->at(indices_ptr->at(i)) = vertex_graph_map_deformed.at(i);
       }
     }
   }
 
+  // Control points of the vertices from start_idx on: the ones of the
+  // predeformed vertices are their graph vertex, the others were interpolated
+  // (the control points of a vertex are only known if every deformed vertex
+  // was interpolated)
+  if (track_region) {
+    const size_t num_interpolated = indices_ptr ? indices_ptr->size() : num_vertices;
+    const bool links_valid = vertex_graph_map_deformed.size() == num_interpolated;
+    std::vector<std::set<size_t>> links(num_vertices - start_idx);
+    if (links_valid) {
+      if (graph_indices && start_idx != 0) {
+        for (size_t i = start_idx; i < num_vertices; i++) {
+          if (graph_indices->at(i) >= 0) {
+            links[i - start_idx].insert(graph_indices->at(i));
+          }
+        }
+      }
+      for (size_t i = 0; i < num_interpolated; i++) {
+        const size_t index = indices_ptr ? indices_ptr->at(i) : i;
+        if (index >= start_idx) {
+          links[index - start_idx] = std::move(vertex_graph_map_deformed[i]);
+        }
+      }
+    }
+    updateVertexLinks(prefix, start_idx, links, links_valid);
+    updateDeformedControlPoints(
+        prefix, optimized_values, start_idx == 0, moved_control_points);
+  }
+
   cacheNewPoints(vertices, prefix, start_idx);
+  auto& cache = last_calculated_vertices_.at(prefix);
+  for (const size_t i : moved) {
+    traits::set_vertex(cache, i, traits::get_vertex(vertices, i));
+  }
+
+  DeformedVertices& deformed = last_deformed_[prefix];
+  deformed.full = start_idx == 0;
+  deformed.moved = std::move(moved);
+  deformed.start = start_idx;
+  deformed.num_vertices = num_vertices;
+  deformed.sequence++;
   recalculate_vertices_ = false;
 }
 
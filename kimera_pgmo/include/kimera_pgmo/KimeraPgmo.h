@@ -8,10 +8,18 @@
 #include "kimera_pgmo/AbsolutePoseStamped.h"
 #include "kimera_pgmo/KimeraPgmoInterface.h"
 #include "kimera_pgmo/KimeraPgmoMesh.h"
+#include "kimera_pgmo/KimeraPgmoMeshDelta.h"
 #include "kimera_pgmo/LoadGraphMesh.h"
+#include "kimera_pgmo/LoadSessions.h"
+#include "kimera_pgmo/OptimizedMeshUpdate.h"
+#include "kimera_pgmo/QueryMesh.h"
 #include "kimera_pgmo/RequestMeshFactors.h"
+#include "kimera_pgmo/utils/CoalescingQueue.h"
 #include "kimera_pgmo/utils/CommonFunctions.h"
+#include "kimera_pgmo/utils/MeshDecimation.h"
+#include "kimera_pgmo/utils/SharedMemoryExport.h"
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -38,7 +46,7 @@ class KimeraPgmo : public KimeraPgmoInterface {
   /*! \brief Get a pointer to the optimized mesh
    */
   inline pcl::PolygonMesh::ConstPtr getOptimizedMeshPtr() const {
-    return optimized_mesh_;
+    return getMeshSnapshot().mesh;
   }
 
   /*! \brief Get the current robot id
@@ -53,6 +61,12 @@ class KimeraPgmo : public KimeraPgmoInterface {
    */
   inline std::vector<Timestamp> getRobotTimestamps() const { return timestamps_; };
 
+  /*! \brief Get the counters of the full mesh hand-off queue
+   */
+  inline QueueStats getFullMeshQueueStats() const {
+    return full_mesh_queue_ ? full_mesh_queue_->stats() : QueueStats();
+  }
+
  protected:
   /*! \brief Start the thread doing the mesh graph / pose graph / path
    * subscription.
@@ -79,10 +93,108 @@ class KimeraPgmo : public KimeraPgmoInterface {
     return true;
   }
 
+  /*! \brief Optimized mesh and the timestamps of its vertices. The optimized
+   * mesh is replaced, never modified, so a snapshot taken with the interface lock
+   * can be published or exported after releasing it.
+   */
+  struct MeshSnapshot {
+    pcl::PolygonMesh::ConstPtr mesh;
+    std::shared_ptr<const std::vector<Timestamp>> vertex_stamps;
+    // deformation graph index of every vertex (only kept for the decimated mesh,
+    // empty if decimation is disabled or the indices are not known)
+    std::shared_ptr<const std::vector<int>> graph_indices;
+    // increased every time the optimized mesh is replaced
+    uint64_t version = 0;
+    // spatial index over the mesh (null if disabled via mesh_index_resolution)
+    std::shared_ptr<const MeshSpatialIndex> mesh_index;
+  };
+
+  /*! \brief Snapshot of the current optimized mesh (takes the interface lock)
+   */
+  MeshSnapshot getMeshSnapshot() const;
+
+  /*! \brief Replace the optimized mesh. The interface lock has to be held.
+   *  - mesh: new optimized mesh
+   *  - vertex_stamps: timestamps of its vertices
+   *  - graph_indices: deformation graph indices of its vertices (if known)
+   *  - outputs the snapshot of the new mesh
+   */
+  MeshSnapshot setOptimizedMesh(const pcl::PolygonMesh::Ptr& mesh,
+                                std::vector<Timestamp>&& vertex_stamps,
+                                const std::vector<int>& graph_indices = {});
+
+  /*! \brief Reset the state derived from the meshes received before loading
+   * sessions: the mirrored mesh waits for the next full mesh from the frontend
+   * (with its deformation graph indices) and the spatial index is rebuilt from
+   * the loaded optimized mesh. The interface lock has to be held.
+   */
+  void resetMeshStateAfterLoad();
+
   /*! \brief Publish the optimized mesh (stored after deformation)
    */
   bool publishOptimizedMesh() const;
 
+  /*! \brief Decimate an optimized mesh (only when decimation is enabled),
+   * keeping the timestamps and graph indices of the remaining vertices
+   *  - snapshot: optimized mesh to decimate
+   *  - mesh: decimated optimized mesh
+   *  - vertex_stamps: timestamps of the vertices of the decimated mesh
+   *  - graph_indices: deformation graph indices of the vertices of the
+   * decimated mesh (optional, empty if the snapshot has none)
+   */
+  bool decimateOptimizedMesh(const MeshSnapshot& snapshot,
+                             pcl::PolygonMesh* mesh,
+                             std::vector<Timestamp>* vertex_stamps,
+                             std::vector<int>* graph_indices = nullptr) const;
+
+  /*! \brief Publish the decimated optimized mesh if there are subscribers, at
+   * most once every decimation period (a snapshot skipped within the period is
+   * left to decimationTimerCallback)
+   *  - snapshot: optimized mesh to decimate
+   *  - header: header of the optimized mesh
+   */
+  void publishDecimatedMesh(const MeshSnapshot& snapshot,
+                            const std_msgs::Header& header) const;
+
+  /*! \brief Decimate the current optimized mesh if a newer mesh than the last
+   * decimated one was skipped because of the decimation period
+   */
+  void decimationTimerCallback(const ros::WallTimerEvent&);
+
+  /*! \brief Publish the positions of the optimized mesh vertices deformed again
+   * by the last deformation if there are subscribers (not if the whole mesh was
+   * deformed again)
+   *  - snapshot: optimized mesh after the deformation
+   *  - deformed: vertices deformed by the last deformation
+   *  - header: header of the optimized mesh
+   */
+  void publishMeshUpdate(const MeshSnapshot& snapshot,
+                         const DeformedVertices& deformed,
+                         const std_msgs::Header& header) const;
+
+  /*! \brief Write the optimized mesh to shared memory if the export is enabled
+   *  - snapshot: optimized mesh to export
+   *  - deformed: vertices deformed by the last deformation (null if the mesh
+   * was replaced otherwise, e.g. loaded)
+   */
+  void exportOptimizedMesh(const MeshSnapshot& snapshot,
+                           const DeformedVertices* deformed) const;
+
+  /*! \brief Publish the optimized mesh, its decimation, the vertices deformed
+   * again and export it
+   *  - snapshot: optimized mesh
+   *  - deformed: vertices deformed by the last deformation (null if the mesh
+   * was replaced otherwise, e.g. loaded)
+   *  - header: header of the optimized mesh
+   */
+  void publishMeshSnapshot(const MeshSnapshot& snapshot,
+                           const DeformedVertices* deformed,
+                           const std_msgs::Header& header) const;
+
+  /*! \brief Report how much of the mesh the last loop closure touched
+   */
+  void logMeshUpdate();
+
   /*! \brief Publish optimized trajectory (Currently unused, as trajectory can
    * be visualized with published pose graph)
    *  - robot_id: the robot for which the trajectory is to be published
@@ -104,6 +216,27 @@ class KimeraPgmo : public KimeraPgmoInterface {
    */
   void fullMeshCallback(const KimeraPgmoMesh::ConstPtr& mesh_msg);
 
+  /*! \brief Subscriber callback for the full mesh: only hands the message to
+   * the mesh thread according to the configured queue policy, so that meshes
+   * arriving faster than they can be deformed are coalesced instead of piling
+   * up
+   *  - mesh_msg: the full unoptimized mesh
+   */
+  void fullMeshQueueCallback(const KimeraPgmoMesh::ConstPtr& mesh_msg);
+
+  /*! \brief Subscribes to the full mesh deltas and applies them to the
+   * mirrored full mesh. The deformation itself happens in the mesh thread, so
+   * that several deltas arriving during a deformation are deformed at once.
+   *  - delta_msg: changes to the full unoptimized mesh
+   */
+  void meshDeltaCallback(const KimeraPgmoMeshDelta::ConstPtr& delta_msg);
+
+  /*! \brief Deform the mirrored full mesh (only where it changed or where new
+   * control points affect it) and publish the result
+   *  - header: header of the last delta applied to the mirror
+   */
+  void deformMirroredMesh(const std_msgs::Header& header);
+
   /*! \brief Publish the transform for each robot id based on the latest node in
    * pose graph
    */
@@ -118,6 +251,12 @@ class KimeraPgmo : public KimeraPgmoInterface {
   void incrementalMeshGraphCallback(
       const pose_graph_tools_msgs::PoseGraph::ConstPtr& mesh_graph_msg);
 
+  /*! \brief Same as incrementalMeshGraphCallback for the compact mesh graph msg
+   * (packed vertex positions and edge index pairs)
+   *  - mesh_graph_msg: new mesh vertices and edges to add to deformation graph
+   */
+  void compactMeshGraphCallback(const KimeraPgmoMeshGraph::ConstPtr& mesh_graph_msg);
+
   /*! \brief Subscribes to an optimized trajectory. The path should correspond
    * to the nodes of the pose graph received in the
    * incrementalPoseGraphCallback. Note that this should only be used in the
@@ -152,6 +291,12 @@ class KimeraPgmo : public KimeraPgmoInterface {
   bool loadGraphMeshCallback(kimera_pgmo::LoadGraphMesh::Request& request,
                              kimera_pgmo::LoadGraphMesh::Response& response);
 
+  /*! \brief Loads the deformation graphs and meshes of several robots
+   * concurrently. The mesh of this robot becomes the optimized mesh.
+   */
+  bool loadSessionsCallback(kimera_pgmo::LoadSessions::Request& request,
+                            kimera_pgmo::LoadSessions::Response& response);
+
   /*! \brief Requests the mesh related edges (pose-vertex, vertex-vertex) in the
    * deformation graph.
    */
@@ -159,28 +304,41 @@ class KimeraPgmo : public KimeraPgmoInterface {
       kimera_pgmo::RequestMeshFactors::Request& request,
       kimera_pgmo::RequestMeshFactors::Response& response);
 
+  /*! \brief Spatial query (bounding box, closest point or raycast) on the
+   * optimized mesh using the incrementally maintained index
+   */
+  bool queryMeshCallback(kimera_pgmo::QueryMesh::Request& request,
+                         kimera_pgmo::QueryMesh::Response& response);
+
   /*! \brief log the run-time stats such as pose graph size, mesh size, and run
-   * time
+   * time (takes the interface lock)
    */
   void logStats(const std::string filename) const;
 
   /*! \brief Clear and reset the deformation graph.
    */
   bool resetGraphCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&) {
+    std::unique_lock<std::mutex> lock(interface_mutex_);
     resetDeformationGraph();
     return true;
   }
 
  protected:
-  // optimized mesh for each robot
+  // optimized mesh for each robot (replaced with setOptimizedMesh, never
+  // modified in place)
   pcl::PolygonMesh::Ptr optimized_mesh_;
-  std::vector<Timestamp> mesh_vertex_stamps_;
+  std::shared_ptr<const std::vector<Timestamp>> mesh_vertex_stamps_;
+  std::shared_ptr<const std::vector<int>> mesh_graph_indices_;
+  uint64_t optimized_mesh_version_ = 0;
 
   PathPtr optimized_path_;
   ros::Time last_mesh_stamp_;
 
   // Publishers
   ros::Publisher optimized_mesh_pub_;
+  ros::Publisher decimated_mesh_pub_;
+  ros::Publisher decimated_pgmo_mesh_pub_;
+  ros::Publisher mesh_update_pub_;
   ros::Publisher optimized_path_pub_;  // Unused for now (TODO)
   ros::Publisher optimized_odom_pub_;  // Unused for now (TODO)
   ros::Publisher pose_graph_pub_;
@@ -193,6 +351,7 @@ class KimeraPgmo : public KimeraPgmoInterface {
   // Subscribers
   ros::Subscriber pose_graph_incremental_sub_;
   ros::Subscriber full_mesh_sub_;
+  ros::Subscriber mesh_delta_sub_;
   ros::Subscriber incremental_mesh_graph_sub_;
   ros::Subscriber path_callback_sub_;
   ros::Subscriber dpgmo_callback_sub_;
@@ -202,8 +361,10 @@ class KimeraPgmo : public KimeraPgmoInterface {
   ros::ServiceServer save_traj_srv_;
   ros::ServiceServer save_graph_srv_;
   ros::ServiceServer load_graph_mesh_srv_;
+  ros::ServiceServer load_sessions_srv_;
   ros::ServiceServer reset_srv_;
   ros::ServiceServer req_mesh_edges_srv_;
+  ros::ServiceServer query_mesh_srv_;
 
   // Trajectory
   Path trajectory_;
@@ -216,13 +377,46 @@ class KimeraPgmo : public KimeraPgmoInterface {
 
   std::unique_ptr<std::thread> graph_thread_;
   std::unique_ptr<std::thread> mesh_thread_;
-  std::mutex interface_mutex_;
-
-  // Time callback spin time
-  int inc_mesh_cb_time_;
-  int full_mesh_cb_time_;
-  int pg_cb_time_;
-  int path_cb_time_;
+  mutable std::mutex interface_mutex_;
+
+  // Full mesh hand-off between the subscriber and the mesh thread
+  QueuePolicy full_mesh_policy_;
+  int full_mesh_queue_size_;
+  std::unique_ptr<CoalescingQueue<KimeraPgmoMesh::ConstPtr>> full_mesh_queue_;
+
+  // Full mesh mirrored from the frontend deltas (instead of full meshes)
+  bool use_mesh_delta_;
+  // Subscribe to the compact mesh graph instead of the pose graph encoding
+  bool use_compact_mesh_graph_;
+  MeshDeltaMirror mesh_mirror_;
+  std::mutex mesh_mirror_mutex_;
+  // Headers of the applied deltas, only the latest one is deformed
+  std::unique_ptr<CoalescingQueue<std_msgs::Header>> mesh_delta_queue_;
+
+  // Reduced optimized mesh published alongside the full one
+  bool decimate_mesh_;
+  MeshDecimationConfig decimation_config_;
+  // minimum time between two decimations of the published mesh (seconds)
+  double decimation_period_;
+  mutable std::mutex decimation_mutex_;
+  mutable ros::WallTime last_decimation_time_;
+  mutable uint64_t last_decimated_version_;
+  // latest mesh skipped within the decimation period (and its header)
+  mutable uint64_t pending_decimation_version_;
+  mutable std_msgs::Header pending_decimation_header_;
+  ros::WallTimer decimation_timer_;
+
+  // Loop closures reported by logMeshUpdate
+  size_t num_logged_loop_closures_;
+
+  // Optional export of the optimized trajectory and mesh for local processes
+  std::unique_ptr<SharedMemoryExport> shared_memory_export_;
+
+  // Time callback spin time (the full mesh is deformed in the mesh thread)
+  std::atomic<int64_t> inc_mesh_cb_time_;
+  std::atomic<int64_t> full_mesh_cb_time_;
+  std::atomic<int64_t> pg_cb_time_;
+  std::atomic<int64_t> path_cb_time_;
 
   // Save output
   std::string output_prefix_;
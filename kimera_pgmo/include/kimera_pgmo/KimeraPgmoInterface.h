@@ -6,8 +6,11 @@
 #pragma once
 
 #include <map>
+#include <ostream>
 #include <queue>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <mesh_msgs/TriangleMeshStamped.h>
 #include <nav_msgs/Odometry.h>
@@ -27,6 +30,9 @@
 #include "kimera_pgmo/DeformationGraph.h"
 #include "kimera_pgmo/KimeraPgmoMesh.h"
 #include "kimera_pgmo/utils/CommonFunctions.h"
+#include "kimera_pgmo/utils/MeshDeltaTransport.h"
+#include "kimera_pgmo/utils/MeshSpatialIndex.h"
+#include "kimera_pgmo/utils/SparseKeyframes.h"
 
 namespace kimera_pgmo {
 
@@ -74,29 +80,77 @@ struct KimeraPgmoConfig {
   double gnc_weight_tol = 1.0e-4;
   bool lm_diagonal_damping = true;
   bool gnc_fix_prev_inliers = false;
+  // retire loop closures with a gnc weight below retire_weight_threshold in
+  // retire_after_rejections consecutive optimizations (0 to disable)
+  int retire_after_rejections = 0;
+  double retire_weight_threshold = 0.1;
   // sparsification
   bool b_enable_sparsify = false;
   double trans_sparse_dist = 1.0;
   double rot_sparse_dist = 1.2;
   // logging
   std::string log_path = "";
+  // spatial index over the optimized mesh (bucket size, 0 to disable)
+  double mesh_index_resolution = 1.0;
+  // only deform again the vertices near nodes an optimization moved by more than
+  // these tolerances (translation of 0 to disable)
+  double region_translation_tol = 0.0;
+  double region_rotation_tol = 0.01;
 };
 
-struct SparseKeyframe {
-  gtsam::Key key;
-  std::map<gtsam::Key, gtsam::Pose3> keyed_transforms;
-  bool active = true;
-  gtsam::Pose3 current_transform;
-  std::vector<pose_graph_tools_msgs::PoseGraphEdge> edges;
-
-  void initialize(const gtsam::Key& sparse_key,
-                  const size_t& robot_id,
-                  const size_t& pose_id);
-  bool addNewEdge(const pose_graph_tools_msgs::PoseGraphEdge& new_edge,
-                  double trans_threshold,
-                  double rot_threshold);
+/*! \brief How much of the mesh an optimization touched: the nodes it moved and
+ * the vertices deformed again because of them
+ */
+struct MeshUpdateStats {
+  size_t num_poses = 0;
+  size_t num_moved_poses = 0;
+  size_t num_control_points = 0;
+  size_t num_moved_control_points = 0;
+  size_t num_vertices = 0;
+  size_t num_deformed_vertices = 0;
+
+  inline double deformedFraction() const {
+    return num_vertices == 0
+               ? 0.0
+               : static_cast<double>(num_deformed_vertices) / num_vertices;
+  }
+};
+
+/*! \brief Read the full_to_sparse_frames mapping written by
+ * savePoseGraphSparseMapping (binary, or the older csv format)
+ * - input_path: name of the file to read from
+ * - mapping: sparse keyframes read
+ */
+bool ReadPoseGraphSparseMapping(const std::string& input_path,
+                                SparseKeyframes* mapping);
+
+/*! \brief Files of a saved session of one robot
+ */
+struct SessionFiles {
+  size_t robot_id = 0;
+  std::string ply_path;
+  std::string dgrf_path;
+  std::string sparse_mapping_path;  // empty if not sparsified
+  bool set_robot_id = false;        // rekey the graph to robot_id
 };
 
+/*! \brief Startup time breakdown of loading sessions (seconds). The read,
+ * parse graph and parse mapping times are summed over the sessions (they run
+ * concurrently, within the wall time of the read phase).
+ */
+struct SessionLoadTimes {
+  double read_phase = 0.0;
+  double read_mesh = 0.0;
+  double parse_graph = 0.0;
+  double parse_sparse_mapping = 0.0;
+  double merge = 0.0;
+  double optimize = 0.0;
+  double deform = 0.0;
+  double total = 0.0;
+};
+
+std::ostream& operator<<(std::ostream& out, const SessionLoadTimes& times);
+
 class KimeraPgmoInterface {
   friend class KimeraPgmoInterfaceTest;
 
@@ -146,6 +200,33 @@ class KimeraPgmoInterface {
    */
   inline void forceOptimize() { return deformation_graph_->optimize(); }
 
+  /*! \brief Deform a full mesh with the current estimate of the deformation graph.
+   * Callers deforming the same mesh message (same stamp and size, or same
+   * contents for messages without a stamp) with the same estimate share one
+   * deformed mesh instead of interpolating it again.
+   *  - mesh_msg: the full unoptimized mesh in KimeraPgmoMesh format
+   *  - mesh_vertex_stamps: timestamps of the mesh vertices
+   *  - outputs the deformed mesh (nullptr if the mesh is empty or cannot be
+   * deformed)
+   */
+  DeformedMeshConstPtr deformFullMesh(const KimeraPgmoMesh& mesh_msg,
+                                      std::vector<Timestamp>* mesh_vertex_stamps);
+
+  /*! \brief Region of the mesh touched by the last optimization
+   */
+  inline const MeshUpdateStats& getLastMeshUpdateStats() const {
+    return last_update_stats_;
+  }
+
+  /*! \brief Spatial index over the last optimized mesh (face indices refer to
+   * the polygons of that mesh). Null if disabled via mesh_index_resolution. A
+   * returned index is never modified afterwards, so it can be queried without
+   * holding the lock the interface is updated under.
+   */
+  inline std::shared_ptr<const MeshSpatialIndex> getOptimizedMeshIndex() const {
+    return optimized_mesh_index_;
+  }
+
   /*! \brief Get the optimized trajectory of a robot
    * - robot_id: id of the robot referred to in query
    */
@@ -162,23 +243,35 @@ class KimeraPgmoInterface {
     KimeraRPGO::RobustSolverParams pgo_params = deformation_graph_->getParams();
     deformation_graph_.reset(new DeformationGraph);
     deformation_graph_->initialize(pgo_params);
+    if (config_.mode != RunMode::DPGMO) {
+      deformation_graph_->setRegionOfInfluence(config_.region_translation_tol,
+                                               config_.region_rotation_tol);
+    }
   }
 
   /*! \brief Load deformation graph
    * - input: dgrf file (deformation graph file)
+   * - returns false if the file cannot be read
    */
-  void loadDeformationGraphFromFile(const std::string& input) {
-    deformation_graph_->load(input);
+  bool loadDeformationGraphFromFile(const std::string& input) {
+    if (!deformation_graph_->load(input)) {
+      return false;
+    }
     num_loop_closures_ = deformation_graph_->getNumLoopclosures();
+    return true;
   }
 
   /*! \brief Load deformation graph and assign specific robot id
    * - input: dgrf file (deformation graph file)
    * - robot_id: robot id
+   * - returns false if the file cannot be read
    */
-  void loadDeformationGraphFromFile(const std::string& input, const size_t& robot_id) {
-    deformation_graph_->load(input, true, true, robot_id);
+  bool loadDeformationGraphFromFile(const std::string& input, const size_t& robot_id) {
+    if (!deformation_graph_->load(input, true, true, robot_id)) {
+      return false;
+    }
     num_loop_closures_ = deformation_graph_->getNumLoopclosures();
+    return true;
   }
 
   /*! \brief Load deformation graph and mesh from file
@@ -196,6 +289,25 @@ class KimeraPgmoInterface {
                         std::vector<Timestamp>* mesh_vertex_stamps,
                         bool do_optimize);
 
+  /*! \brief Load the saved sessions of several robots into the deformation
+   * graph. The meshes, graphs and sparse mappings of all the sessions are read
+   * concurrently, then added to the graph in a single update, optimized once
+   * and the meshes deformed.
+   * - sessions: files of every session
+   * - optimized_meshes: deformed mesh of every session (null entries are
+   * allocated)
+   * - mesh_vertex_stamps: vertex timestamps of every mesh
+   * - do_optimize: toggle optimization
+   * - times: startup time breakdown (optional)
+   * - returns false if a file cannot be read or the graph of a session overlaps
+   * the graphs of the previous ones (that session is then skipped)
+   */
+  bool loadSessions(const std::vector<SessionFiles>& sessions,
+                    std::vector<pcl::PolygonMesh::Ptr>* optimized_meshes,
+                    std::vector<std::vector<Timestamp>>* mesh_vertex_stamps,
+                    bool do_optimize,
+                    SessionLoadTimes* times = nullptr);
+
  protected:
   bool initializeFromConfig();
 
@@ -260,6 +372,38 @@ class KimeraPgmoInterface {
                         std::vector<Timestamp>* mesh_vertex_stamps,
                         bool do_optimize);
 
+  /*! \brief Optimize the full mesh (and pose graph) using the deformation graph
+   * with the mesh mirrored from mesh deltas. Only vertices that changed since
+   * the last deformation, or that new control points can affect, are deformed
+   * again.
+   * - mirror: undeformed mesh kept up to date from the frontend deltas
+   * - robot_id: robot the mesh belongs to
+   * - optimized_mesh: ptr to optimized (deformed) mesh
+   * - do_optimize: call optimize. Optimize before deforming mesh.
+   */
+  bool optimizeFullMesh(const MeshDeltaMirror& mirror,
+                        size_t robot_id,
+                        pcl::PolygonMesh::Ptr optimized_mesh,
+                        std::vector<Timestamp>* mesh_vertex_stamps,
+                        bool do_optimize);
+
+  /*! \brief Update the spatial index to the new optimized mesh from the vertices
+   * changed by the last deformation
+   *  - mesh: new optimized mesh
+   *  - prefix: vertex prefix the mesh was deformed with
+   */
+  void updateOptimizedMeshIndex(const pcl::PolygonMesh& mesh, char prefix);
+
+  /*! \brief Spatial index to update in place. The index is copied first if a
+   * snapshot of it is still shared (see getOptimizedMeshIndex).
+   */
+  MeshSpatialIndex& writableOptimizedMeshIndex();
+
+  /*! \brief Record the region of the mesh of a robot deformed after an
+   * optimization
+   */
+  void updateMeshUpdateStats(size_t robot_id);
+
   /*! \brief Process the mesh graph that consists of the new mesh edges and mesh
    * nodes to be added to the deformation graph
    * - mesh_msg: partial mesh in mesh_msgs TriangleMeshStamped format
@@ -272,6 +416,32 @@ class KimeraPgmoInterface {
       const std::vector<Timestamp>& node_timestamps,
       std::queue<size_t>* unconnected_nodes);
 
+  /*! \brief Process a compact mesh graph msg (packed vertex positions and edge
+   * index pairs) with the new mesh edges and mesh nodes
+   * - mesh_graph_msg: new vertices and edges of the simplified mesh
+   * - node_timestamps: vector of the timestamps of each odometric node
+   * - unconnected_nodes: odometric nodes not yet connected to the mesh and
+   * still within the embed time window
+   */
+  ProcessMeshGraphStatus processIncrementalMeshGraph(
+      const KimeraPgmoMeshGraph::ConstPtr& mesh_graph_msg,
+      const std::vector<Timestamp>& node_timestamps,
+      std::queue<size_t>* unconnected_nodes);
+
+  /*! \brief Connect the mesh vertices just added to the deformation graph to
+   * the closest (in time) odometric nodes not yet connected to the mesh
+   * - robot_id: robot of the vertices and nodes
+   * - new_indices: vertices added to the deformation graph
+   * - new_index_stamps: stamps of the added vertices
+   * - node_timestamps: vector of the timestamps of each odometric node
+   * - unconnected_nodes: odometric nodes not yet connected to the mesh
+   */
+  void connectNewMeshVertices(size_t robot_id,
+                              const std::vector<size_t>& new_indices,
+                              const std::vector<Timestamp>& new_index_stamps,
+                              const std::vector<Timestamp>& node_timestamps,
+                              std::queue<size_t>* unconnected_nodes);
+
   /*! \brief Given an optimized trajectory, adjust the mesh. The path should
    * correspond to the nodes of the pose graph received in the
    * incrementalPoseGraphCallback. Note that this is currently only supported in
@@ -301,7 +471,8 @@ class KimeraPgmoInterface {
    */
   bool saveDeformationGraph(const std::string& dgrf_name);
 
-  /*! \brief Saves the full_to_sparse_frames mapping
+  /*! \brief Saves the sparse key-frames (full_to_sparse_frames mapping, transforms
+   * and loop closures) in binary format
    * - output_path: name of the file to write to
    */
   bool savePoseGraphSparseMapping(const std::string& output_path);
@@ -311,6 +482,11 @@ class KimeraPgmoInterface {
    */
   bool loadPoseGraphSparseMapping(const std::string& input_path);
 
+  /*! \brief Adds a full_to_sparse_frames mapping read from file
+   * - mapping: mapping to add
+   */
+  void addPoseGraphSparseMapping(const SparseKeyframes& mapping);
+
   /*! \brief Get the consistency factors as pose graph edges
    * - robot_id: the id of the robot in question
    * - pg_mesh_msg: pointer to the factors and initial values
@@ -362,13 +538,17 @@ class KimeraPgmoInterface {
   // DPGMO optimized values
   gtsam::Values dpgmo_values_;
 
-  // Sparse key frame mapping
-  std::unordered_map<gtsam::Key, gtsam::Key> full_sparse_frame_map_;
-  std::unordered_map<gtsam::Key, SparseKeyframe> sparse_frames_;
-  std::unordered_map<gtsam::Key, std::set<gtsam::Key>> loop_closures_;
+  // Sparse key frames, full to sparse frame mapping and loop closures between them
+  SparseKeyframes sparse_frames_;
 
   // Timestamp mapping
   std::unordered_map<gtsam::Key, Timestamp> keyed_stamps_;
+
+  // Spatial index over the last optimized mesh (copied on write when shared)
+  std::shared_ptr<MeshSpatialIndex> optimized_mesh_index_;
+
+  // Region of the mesh touched by the last optimization
+  MeshUpdateStats last_update_stats_;
 };
 
 }  // namespace kimera_pgmo
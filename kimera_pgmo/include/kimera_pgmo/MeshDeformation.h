@@ -15,6 +15,7 @@
 
 #include "kimera_pgmo/MeshTraits.h"
 #include "kimera_pgmo/utils/CommonStructs.h"
+#include "kimera_pgmo/utils/ControlPointStore.h"
 
 namespace kimera_pgmo {
 namespace deformation {
@@ -41,10 +42,113 @@ class SearchTree {
   std::unique_ptr<Impl> impl_;
 };
 
+/*! \brief Control points and weights interpolating a set of points, so that the
+ * points can be deformed again after every optimization without searching for
+ * their nearest control points
+ */
+struct InterpolationWeights {
+  // control points of point i are in [offsets[i], offsets[i + 1])
+  std::vector<uint32_t> offsets{0};
+  std::vector<uint32_t> control_points;
+  // weights of the control points (normalized per point)
+  std::vector<double> weights;
+  // point relative to the original position of each control point
+  std::vector<gtsam::Point3> relative_points;
+
+  inline size_t size() const { return offsets.size() - 1; }
+
+  /*! \brief Whether every point has control points to interpolate it from
+   */
+  bool complete() const;
+};
+
+/*! \brief Find the control points interpolating a set of points, as deformPoints
+ * would for the same control points and values
+ * - points: points to interpolate
+ * - stamps: timestamps of the points (empty to use every control point)
+ * - prefix: a char to distinguish the type of control points
+ * - control_points: original positions and timestamps of the control points
+ * - values: control points without a value are not used
+ * - k: how many nearby nodes to interpolate each point from
+ * - tol_t: time (in seconds) minimum difference in time that a control point
+ * can be used for interpolation
+ */
+InterpolationWeights computeInterpolationWeights(
+    const std::vector<gtsam::Point3>& points,
+    const std::vector<Timestamp>& stamps,
+    char prefix,
+    const ControlPointStore& control_points,
+    const gtsam::Values& values,
+    size_t k = 4,
+    double tol_t = 10.0);
+
+/*! \brief Find control points for the points of weights that have none (as
+ * computeInterpolationWeights would), keeping the weights of the other points.
+ * Returns how many points now have control points.
+ * - weights: weights of points (same size as points)
+ */
+size_t completeInterpolationWeights(InterpolationWeights& weights,
+                                    const std::vector<gtsam::Point3>& points,
+                                    const std::vector<Timestamp>& stamps,
+                                    char prefix,
+                                    const ControlPointStore& control_points,
+                                    const gtsam::Values& values,
+                                    size_t k = 4,
+                                    double tol_t = 10.0);
+
+/*! \brief Deform the points [begin, end) with their interpolation weights. Points
+ * without control points are not moved.
+ * - deformed: deformed points (same size as points)
+ */
+void interpolatePoints(const InterpolationWeights& weights,
+                       const std::vector<gtsam::Point3>& points,
+                       char prefix,
+                       const gtsam::Values& values,
+                       size_t begin,
+                       size_t end,
+                       std::vector<gtsam::Point3>& deformed);
+
+/*! \brief Control points given as plain vectors, with the accessors of
+ * ControlPointStore. Positions are read without copying and keep their double
+ * precision.
+ */
+class ControlPointVectors {
+ public:
+  /*! \brief Constructor (the vectors have to outlive the view)
+   *  - positions: control point positions
+   *  - stamps: control point stamps (if empty, all stamps are 0)
+   */
+  ControlPointVectors(const std::vector<gtsam::Point3>& positions,
+                      const std::vector<Timestamp>& stamps)
+      : positions_(positions), stamps_(stamps) {}
+
+  inline size_t size() const { return positions_.size(); }
+
+  inline const gtsam::Point3& position(size_t index) const {
+    return positions_.at(index);
+  }
+
+  inline Timestamp stamp(size_t index) const {
+    return stamps_.empty() ? 0 : stamps_.at(index);
+  }
+
+ private:
+  const std::vector<gtsam::Point3>& positions_;
+  const std::vector<Timestamp>& stamps_;
+};
+
 // Calculate new point location from k points
 traits::Pos interpPoint(std::set<size_t>& control_points_seen,
                         char prefix,
-                        const std::vector<gtsam::Point3>& control_points,
+                        const ControlPointStore& control_points,
+                        const gtsam::Values& values,
+                        const SearchTree& octree,
+                        size_t k,
+                        const traits::Pos& vi);
+
+traits::Pos interpPoint(std::set<size_t>& control_points_seen,
+                        char prefix,
+                        const ControlPointVectors& control_points,
                         const gtsam::Values& values,
                         const SearchTree& octree,
                         size_t k,
@@ -62,13 +166,13 @@ traits::Pos interpPoint(std::set<size_t>& control_points_seen,
  */
 template <typename CloudOut,
           typename CloudIn,
+          typename ControlPoints,
           std::enable_if_t<!traits::has_get_stamp<CloudIn>::value, bool> = true>
 void deformPoints(CloudOut& new_points,
                   std::vector<std::set<size_t>>& control_point_map,
                   const CloudIn& points,
                   char prefix,
-                  const std::vector<gtsam::Point3>& control_points,
-                  const std::vector<Timestamp>& /* control_point_stamps */,
+                  const ControlPoints& control_points,
                   const gtsam::Values& values,
                   size_t k = 4,
                   double /* tol_t */ = 10.0,
@@ -90,7 +194,8 @@ void deformPoints(CloudOut& new_points,
   // Build Octree
   SearchTree search_tree;
   for (size_t j = 0; j < control_points.size(); j++) {
-    search_tree.addPoint(control_points[j], values.exists(gtsam::Symbol(prefix, j)));
+    search_tree.addPoint(control_points.position(j),
+                         values.exists(gtsam::Symbol(prefix, j)));
   }
 
   if (search_tree.getLeafCount() < k) {
@@ -117,9 +222,9 @@ void deformPoints(CloudOut& new_points,
  * - original_points: set of points to deform
  * - stamps: timestamps of the points to deform
  * - prefix: a char to distinguish the type of control points
- * - control_points: original positions of the control points. In the case of
- * mesh vertices, these are the original positions of the simplified mesh.
- * - control_point_stamps: timestamps of the control points
+ * - control_points: original positions and timestamps of the control points. In
+ * the case of mesh vertices, these are the original positions of the simplified
+ * mesh.
  * - values: key-value pairs. Where each key should be gtsam::Symbol(prefix,
  * idx-in-control-points) from the previous two arguments.
  * - k: how many nearby nodes to use to adjust new position of vertices
@@ -128,13 +233,13 @@ void deformPoints(CloudOut& new_points,
  */
 template <typename CloudOut,
           typename CloudIn,
+          typename ControlPoints,
           std::enable_if_t<traits::has_get_stamp<CloudIn>::value, bool> = true>
 void deformPoints(CloudOut& new_points,
                   std::vector<std::set<size_t>>& control_point_map,
                   const CloudIn& points,
                   char prefix,
-                  const std::vector<gtsam::Point3>& control_points,
-                  const std::vector<Timestamp>& control_point_stamps,
+                  const ControlPoints& control_points,
                   const gtsam::Values& values,
                   size_t k = 4,
                   double tol_t = 10.0,
@@ -165,10 +270,10 @@ void deformPoints(CloudOut& new_points,
     // Add control points to octree until both
     // exceeds interpolate horizon and have enough points to deform
     while (ctrl_pt_idx < control_points.size() &&
-           (control_point_stamps[ctrl_pt_idx] <= stamp + stampFromSec(tol_t) ||
+           (control_points.stamp(ctrl_pt_idx) <= stamp + stampFromSec(tol_t) ||
             num_ctrl_pts < k + 1)) {
       const auto ctrl_valid = values.exists(gtsam::Symbol(prefix, ctrl_pt_idx));
-      search_tree.addPoint(control_points[ctrl_pt_idx], ctrl_valid);
+      search_tree.addPoint(control_points.position(ctrl_pt_idx), ctrl_valid);
       ctrl_pt_idx++;
       if (!ctrl_valid) {
         continue;
@@ -199,7 +304,7 @@ void deformPoints(CloudOut& new_points,
 
     size_t num_leaves = search_tree.getLeafCount();
     while (lower_ctrl_pt_idx < control_points.size() && num_leaves > k + 1 &&
-           control_point_stamps[lower_ctrl_pt_idx] < stamp - stampFromSec(tol_t)) {
+           control_points.stamp(lower_ctrl_pt_idx) < stamp - stampFromSec(tol_t)) {
       if (!values.exists(gtsam::Symbol(prefix, lower_ctrl_pt_idx))) {
         lower_ctrl_pt_idx++;
         continue;
@@ -212,5 +317,25 @@ void deformPoints(CloudOut& new_points,
   }
 }
 
+/*! \brief Deform points using control points given as plain vectors (see the
+ * ControlPointStore overloads). The control points are read in double precision
+ * and are not copied.
+ */
+template <typename CloudOut, typename CloudIn>
+void deformPoints(CloudOut& new_points,
+                  std::vector<std::set<size_t>>& control_point_map,
+                  const CloudIn& points,
+                  char prefix,
+                  const std::vector<gtsam::Point3>& control_points,
+                  const std::vector<Timestamp>& control_point_stamps,
+                  const gtsam::Values& values,
+                  size_t k = 4,
+                  double tol_t = 10.0,
+                  const std::vector<size_t>* indices = nullptr) {
+  const ControlPointVectors view(control_points, control_point_stamps);
+  deformPoints(
+      new_points, control_point_map, points, prefix, view, values, k, tol_t, indices);
+}
+
 }  // namespace deformation
 }  // namespace kimera_pgmo
@@ -19,6 +19,7 @@
 #include "kimera_pgmo/MeshTraits.h"
 #include "kimera_pgmo/PclMeshTraits.h"
 #include "kimera_pgmo/utils/CommonStructs.h"
+#include "kimera_pgmo/utils/LabelColumn.h"
 
 namespace kimera_pgmo {
 
@@ -46,6 +47,9 @@ class MeshDelta {
 
   MeshDelta(size_t vertex_start, size_t face_start);
 
+  /*! \brief Decode a delta msg. Throws std::invalid_argument if the semantic
+   * labels are not a valid run-length encoding.
+   */
   MeshDelta(const KimeraPgmoMeshDelta& msg);
 
   MeshDelta(const pcl::PointCloud<pcl::PointXYZRGBA>& vertices,
@@ -111,7 +115,7 @@ class MeshDelta {
 
   pcl::PointCloud<pcl::PointXYZRGBA>::Ptr vertex_updates;
   std::vector<Timestamp> stamp_updates;
-  std::vector<uint32_t> semantic_updates;
+  LabelColumn semantic_updates;
   std::vector<Face> face_updates;
   std::vector<Face> face_archive_updates;
   std::map<size_t, size_t> prev_to_curr;
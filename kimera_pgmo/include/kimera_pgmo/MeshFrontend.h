@@ -10,7 +10,10 @@
 #include <ros/ros.h>
 #include <voxblox_msgs/Mesh.h>
 
+#include <atomic>
+
 #include "kimera_pgmo/MeshFrontendInterface.h"
+#include "kimera_pgmo/utils/MeshDeltaTransport.h"
 
 namespace kimera_pgmo {
 
@@ -39,17 +42,53 @@ class MeshFrontendPublisher {
    */
   void publishFullMesh(const MeshFrontendInterface& frontend) const;
 
+  /*! \brief Publish the changes to the full mesh since the last published
+   * delta (and periodically the whole mesh so that the backend can recover
+   * from dropped deltas)
+   *  - stamp: timestamp
+   */
+  void publishMeshDelta(const MeshFrontendInterface& frontend, const ros::Time& stamp);
+
   /*! \brief Publish the simplified mesh (used as the mesh part of deformation
-   * graph)
+   * graph). The simplified mesh only grows, so the message is kept between
+   * calls and only the new vertices and faces are converted. When the deltas
+   * are published, the whole mesh is only sent when a subscriber connects and
+   * then once per resync period; otherwise it is sent on every update.
    *  - stamp: timestamp
    */
   void publishSimplifiedMesh(const MeshFrontendInterface& frontend,
-                             const ros::Time& stamp) const;
+                             const ros::Time& stamp);
+
+  /*! \brief Publish the vertices and faces added to the simplified mesh since
+   * the last published delta
+   *  - stamp: timestamp
+   */
+  void publishSimplifiedMeshDelta(const MeshFrontendInterface& frontend,
+                                  const ros::Time& stamp);
 
   ros::Publisher full_mesh_pub_;
   ros::Publisher simplified_mesh_pub_;
   ros::Publisher mesh_graph_pub_;  // publish the factors corresponding to the
                                    // edges of the simplified mesh
+  ros::Publisher compact_mesh_graph_pub_;  // same as packed arrays
+  ros::Publisher mesh_delta_pub_;
+  ros::Publisher simplified_mesh_delta_pub_;
+
+  bool publish_mesh_delta_;
+  MeshDeltaEncoder mesh_delta_encoder_;
+
+  // Minimum time between two simplified mesh messages (0 to publish every
+  // update)
+  double simplified_mesh_period_;
+  ros::Time last_simplified_mesh_stamp_;
+  mesh_msgs::TriangleMeshStamped simplified_mesh_msg_;
+  // Time between two whole simplified meshes when the deltas are published
+  double simplified_mesh_resync_period_;
+  // Set when a subscriber connects to the whole simplified mesh
+  std::atomic<bool> simplified_mesh_requested_;
+  bool publish_simplified_mesh_delta_;
+  ros::Time last_simplified_mesh_delta_stamp_;
+  MeshDeltaEncoder simplified_mesh_delta_encoder_;
 };
 
 class MeshFrontend : public MeshFrontendInterface {
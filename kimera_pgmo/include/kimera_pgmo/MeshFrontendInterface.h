@@ -13,6 +13,7 @@
 #include <voxblox_msgs/Mesh.h>
 
 #include "kimera_pgmo/compression/MeshCompression.h"
+#include "kimera_pgmo/utils/CommonFunctions.h"
 #include "kimera_pgmo/utils/CommonStructs.h"
 
 namespace kimera_pgmo {
@@ -31,6 +32,7 @@ struct MeshFrontendConfig {
   double d_graph_resolution = 3.0;
   double mesh_resolution = 0.2;
   std::string frame_id = "world";
+  std::string state_path = "";  // restore compression state from here if it exists
 };
 
 class MeshFrontendInterface {
@@ -89,7 +91,7 @@ class MeshFrontendInterface {
    *  /returns Indices of the mesh that mesh compression has deleted
    */
   inline const std::vector<size_t>& getInvalidIndices() const {
-    return invalid_indices_;
+    return full_mesh_compression_->getInvalidIndices();
   }
 
   /*! \brief Get the time horizion (in seconds) of the mesh compression
@@ -114,12 +116,37 @@ class MeshFrontendInterface {
     return *mesh_to_graph_idx_;
   }
 
+  /*! \brief Get the number of leading full mesh vertices that later messages
+   * can no longer modify
+   */
+  inline size_t getNumFixedFullMeshVertices() const {
+    return full_mesh_compression_->getNumFixedVertices();
+  }
+
+  /*! \brief Get the number of leading full mesh faces that later messages can
+   * no longer modify
+   */
+  inline size_t getNumFixedFullMeshFaces() const {
+    return full_mesh_compression_->getNumFixedPolygons();
+  }
+
+  /*! \brief Get the smallest full mesh vertex that got a graph index in the
+   * last voxblox callback (max size_t if none)
+   */
+  inline size_t getFirstRemappedVertex() const { return first_remapped_vertex_; }
+
   /*! \brief Get last mesh graph created in voxblox callback
    */
-  inline pose_graph_tools_msgs::PoseGraph getLastProcessedMeshGraph() const {
+  inline const KimeraPgmoMeshGraph& getLastMeshGraph() const {
     return last_mesh_graph_;
   }
 
+  /*! \brief Get last mesh graph created in voxblox callback as a pose graph
+   */
+  inline pose_graph_tools_msgs::PoseGraph getLastProcessedMeshGraph() const {
+    return MeshGraphToPoseGraph(last_mesh_graph_, *graph_vertices_);
+  }
+
   /*! \brief Process the latest incremental mesh from the
    * callback and add the partial mesh to the graph mesh and compress
    *  - msg: mesh msg from Voxblox or Kimera Semantics
@@ -146,7 +173,32 @@ class MeshFrontendInterface {
                         double time_in_sec,
                         const std::string& frame_id = "world");
 
+  /*! \brief Write the compression state (both compressors, the simplified mesh
+   * graph and the index mappings) to a binary file so that a restarted
+   * frontend can resume indexing where it stopped
+   *  - filename: path of the state file
+   */
+  bool saveState(const std::string& filename) const;
+
+  /*! \brief Restore the compression state from a file written by saveState.
+   * Must be called after initialize with the same compression methods and
+   * resolutions.
+   *  - filename: path of the state file
+   */
+  bool loadState(const std::string& filename);
+
+  inline const MeshFrontendConfig& getConfig() const { return config_; }
+
  protected:
+  /*! \brief Create empty compressors according to the config and clear all
+   * index bookkeeping
+   */
+  bool resetCompression();
+
+  /*! \brief Copy the stored mesh of both compressors into the output members
+   */
+  void updateMeshOutputs();
+
   /*! \brief Process the latest incremental mesh from the
    * callback and add the partial mesh to the full mesh and compress
    *  - msg: mesh msg from Voxblox or Kimera Semantics
@@ -191,21 +243,36 @@ class MeshFrontendInterface {
   pcl::PointCloud<pcl::PointXYZRGBA>::Ptr graph_vertices_;
   // Triangles of the simplified mesh used for the deformation graph
   std::shared_ptr<std::vector<pcl::Vertices>> graph_triangles_;
-
-  // Last pose graph msg created for testing purposes
-  pose_graph_tools_msgs::PoseGraph last_mesh_graph_;
+  // Vertices time stamps of the simplified mesh
+  std::shared_ptr<std::vector<Timestamp>> graph_vertex_stamps_;
+
+  // New vertices, triangles and indices returned by a compressor, kept between
+  // messages so that their capacity is reused
+  struct CompressionOutput {
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr vertices{
+        new pcl::PointCloud<pcl::PointXYZRGBA>};
+    std::shared_ptr<std::vector<pcl::Vertices>> triangles{
+        new std::vector<pcl::Vertices>};
+    std::shared_ptr<std::vector<size_t>> indices{new std::vector<size_t>};
+  };
+  // One per compressor, as the full and graph meshes are processed concurrently
+  CompressionOutput full_mesh_output_;
+  CompressionOutput graph_output_;
+
+  // Last mesh graph msg created (new graph vertices and edges)
+  KimeraPgmoMeshGraph last_mesh_graph_;
 
   // Book keeping for indices
   std::shared_ptr<VoxbloxIndexMapping> vxblx_msg_to_graph_idx_;
   std::shared_ptr<VoxbloxIndexMapping> vxblx_msg_to_mesh_idx_;
   std::shared_ptr<IndexMapping> mesh_to_graph_idx_;
   std::vector<BlockIndex> latest_blocks_;
+  size_t first_remapped_vertex_;
 
   bool init_graph_log_;
   bool init_full_log_;
 
   std::vector<size_t> active_indices_;
-  std::vector<size_t> invalid_indices_;
   std::vector<OutputCallback> output_callbacks_;
 };
 
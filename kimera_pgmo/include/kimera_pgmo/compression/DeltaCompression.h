@@ -90,14 +90,33 @@ class DeltaCompression {
 
   bool canBeArchived(const Face& face) const;
 
+  void setCarriedIndex(size_t prev_index, size_t curr_index);
+
+  size_t getCarriedIndex(size_t prev_index) const;
+
  protected:
+  // vertex observed by the latest message
+  struct DirtyVertex {
+    VertexInfo* info;
+    // index in the previous delta (if the vertex is not new)
+    size_t prev_index;
+    // index in the current delta
+    size_t mesh_index;
+  };
+
   double resolution_;
   double index_scale_;
 
   MeshDelta::Ptr delta_;
   MeshDelta::Ptr archive_delta_;
 
-  std::vector<size_t> active_remapping_;
+  // vertices and blocks observed by the latest message
+  std::vector<DirtyVertex> dirty_vertices_;
+  voxblox::BlockIndexList dirty_blocks_;
+  // dense prev_to_curr for the active vertices of the previous delta
+  std::vector<size_t> carry_remapping_;
+  size_t prev_active_start_;
+  size_t num_prev_active_;
   BlockInfoMap block_info_map_;
   BlockInfoMap archived_block_info_map_;
   VoxelInfoMap vertices_map_;
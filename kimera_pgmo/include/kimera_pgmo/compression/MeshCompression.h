@@ -19,8 +19,11 @@
 #include <unordered_map>
 #include <vector>
 
+#include "kimera_pgmo/utils/AllocationStats.h"
+#include "kimera_pgmo/utils/BinarySerialization.h"
 #include "kimera_pgmo/utils/CommonStructs.h"
 #include "kimera_pgmo/utils/MeshInterface.h"
+#include "kimera_pgmo/utils/MessageArena.h"
 
 namespace kimera_pgmo {
 
@@ -29,7 +32,8 @@ typedef pcl::PointCloud<pcl::PointXYZ> PointCloudXYZ;
 
 class MeshCompression {
  public:
-  MeshCompression(double resolution) : resolution_(resolution) {}
+  MeshCompression(double resolution)
+      : resolution_(resolution), temp_new_vertices_(new PointCloudXYZ) {}
 
   virtual ~MeshCompression() = default;
 
@@ -77,6 +81,19 @@ class MeshCompression {
     return active_vertices_index_;
   }
 
+  /*! \brief Usage of the scratch arena by the last compressed message
+   */
+  inline const MessageArena::Stats& getLastArenaStats() const {
+    return arena_.lastStats();
+  }
+
+  /*! \brief Heap allocations made while compressing the last message (only
+   * counted when built with KIMERA_PGMO_COUNT_ALLOCATIONS)
+   */
+  inline const AllocationCount& getLastHeapAllocations() const {
+    return last_heap_allocations_;
+  }
+
   /*! \brief Compress and integrate with the full compressed mesh
    *  - input: input mesh in polygon mesh type
    *  - new_vertices: new vertices added after compression
@@ -173,13 +190,43 @@ class MeshCompression {
 
   /*! \brief Get invalid vertice indices (if any)
    */
-  virtual std::vector<size_t> getInvalidIndices() const { return {}; }
+  virtual const std::vector<size_t>& getInvalidIndices() const {
+    static const std::vector<size_t> no_invalid_indices;
+    return no_invalid_indices;
+  }
 
   /*! \brief Archive blocks outside active window
    */
   virtual void clearArchivedBlocks(const voxblox_msgs::Mesh&) {}
 
+  /*! \brief Get the number of leading vertices of the stored mesh that later
+   * updates can no longer modify (new vertices are only ever appended)
+   */
+  virtual size_t getNumFixedVertices() const { return all_vertices_.size(); }
+
+  /*! \brief Get the number of leading polygons of the stored mesh that later
+   * updates can no longer modify
+   */
+  virtual size_t getNumFixedPolygons() const { return polygons_.size(); }
+
+  /*! \brief Write the full compression state (stored mesh and active window)
+   *  - writer: binary writer to append to
+   */
+  virtual void saveState(BinaryWriter& writer) const;
+
+  /*! \brief Restore a state written by saveState and rebuild the lookup
+   * structure for the active vertices
+   *  - reader: binary reader positioned at the start of the state
+   *  - returns false if the state is truncated or was written with a different
+   * resolution
+   */
+  virtual bool loadState(BinaryReader& reader);
+
  protected:
+  void saveBaseState(BinaryWriter& writer) const;
+
+  bool loadBaseState(BinaryReader& reader);
+
   // Vertices in octree (vertices of "active" part of mesh)
   PointCloudXYZ::Ptr active_vertices_xyz_;
   // All verices
@@ -196,6 +243,13 @@ class MeshCompression {
   std::vector<double> active_vertex_stamps_;  // timestamps of active vertices
 
   double resolution_;
+
+  // Scratch memory for the temporaries of a single compressAndIntegrate call
+  MessageArena arena_;
+  // Reused between messages so that their capacity is kept
+  PointCloudXYZ::Ptr temp_new_vertices_;
+  PointCloud parsed_points_;
+  AllocationCount last_heap_allocations_;
 };
 
 typedef std::shared_ptr<MeshCompression> MeshCompressionPtr;
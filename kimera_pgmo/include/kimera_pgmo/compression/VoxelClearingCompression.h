@@ -10,6 +10,8 @@
 #include <voxblox/core/common.h>
 #include <voxblox/mesh/mesh.h>
 
+#include <queue>
+
 #include "kimera_pgmo/compression/MeshCompression.h"
 
 namespace kimera_pgmo {
@@ -63,13 +65,48 @@ class VoxelClearingCompression : public MeshCompression {
     throw std::logic_error("not implemented");
   }
 
-  inline std::vector<size_t> getInvalidIndices() const override { return empty_slots_; }
+  inline const std::vector<size_t> &getInvalidIndices() const override {
+    return empty_slots_;
+  }
 
   void clearArchivedBlocks(const voxblox_msgs::Mesh &mesh) override;
 
+  // every vertex still tracked by a voxel can be moved or cleared
+  inline size_t getNumFixedVertices() const override {
+    return indices_to_inactive_refs_.empty() ? all_vertices_.size()
+                                             : indices_to_inactive_refs_.begin()->first;
+  }
+
+  inline size_t getNumFixedPolygons() const override { return archived_polygon_size_; }
+
+  void saveState(BinaryWriter &writer) const override;
+
+  bool loadState(BinaryReader &reader) override;
+
  protected:
+  friend class VoxelClearingCompressionTest;
+
+  // Block update, ordered by time (and by order of the updates for equal times)
+  struct BlockExpiry {
+    double stamp_in_sec;
+    uint64_t sequence;
+    voxblox::BlockIndex block_index;
+  };
+
+  struct LaterExpiry {
+    inline bool operator()(const BlockExpiry &lhs, const BlockExpiry &rhs) const {
+      return lhs.stamp_in_sec == rhs.stamp_in_sec ? lhs.sequence > rhs.sequence
+                                                  : lhs.stamp_in_sec > rhs.stamp_in_sec;
+    }
+  };
+
+  using BlockExpiryQueue =
+      std::priority_queue<BlockExpiry, std::vector<BlockExpiry>, LaterExpiry>;
+
   void pruneMeshBlocks(const BlockIndexList &to_clear);
 
+  void setBlockUpdateTime(const voxblox::BlockIndex &block_index, double stamp_in_sec);
+
   void updateRemapping(const voxblox_msgs::Mesh &mesh,
                        double stamp_in_sec,
                        std::shared_ptr<VoxbloxIndexMapping> remapping);
@@ -83,11 +120,18 @@ class VoxelClearingCompression : public MeshCompression {
   BlockMap prev_meshes_;
   BlockFaceMap block_face_map_;
   BlockTimeMap block_update_times_;
+  // every block update, so that expired blocks can be found without a pass over all
+  // the blocks. Entries older than the latest update of their block are stale
+  BlockExpiryQueue block_expiry_queue_;
+  uint64_t num_block_updates_ = 0;
 
   VoxelToMeshIndex vertices_map_;
   std::map<size_t, size_t> indices_to_active_refs_;
   std::map<size_t, size_t> indices_to_inactive_refs_;
 
+  // vertices no longer active since the last update of the active indices
+  std::vector<size_t> removed_active_indices_;
+
   std::vector<size_t> empty_slots_;
   size_t max_index_ = 0;
   size_t archived_polygon_size_ = 0;
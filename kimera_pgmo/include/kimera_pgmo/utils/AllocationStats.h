@@ -0,0 +1,83 @@
+/**
+ * @file   AllocationStats.h
+ * @brief  Optional per-thread heap allocation counters
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace kimera_pgmo {
+
+struct AllocationCount {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+
+  AllocationCount operator-(const AllocationCount& other) const {
+    return {allocations - other.allocations, bytes - other.bytes};
+  }
+
+  AllocationCount& operator+=(const AllocationCount& other) {
+    allocations += other.allocations;
+    bytes += other.bytes;
+    return *this;
+  }
+};
+
+/*! \brief Whether the library was built with KIMERA_PGMO_COUNT_ALLOCATIONS, i.e.
+ * whether global operator new is instrumented. Counts are always zero
+ * otherwise.
+ */
+bool allocationCountingEnabled();
+
+/*! \brief Heap allocations made by the calling thread since it started
+ */
+AllocationCount threadAllocationCount();
+
+/*! \brief Heap allocations attributed to a profiling zone, over all its calls
+ * and threads
+ */
+struct ZoneAllocationStats {
+  std::string name;
+  uint64_t calls = 0;
+  AllocationCount total;  // including nested zones
+  AllocationCount self;   // excluding nested zones
+  // largest growth of the heap in use by the thread during a single call
+  uint64_t peak_bytes = 0;
+};
+
+/*! \brief Attributes the heap allocations of the calling thread to a named
+ * pipeline stage (e.g. "DeltaCompression::update") until it goes out of scope.
+ * Zones nest: allocations count towards the self stats of the innermost zone
+ * and the total stats of all enclosing ones. Does nothing unless the library
+ * was built with KIMERA_PGMO_COUNT_ALLOCATIONS.
+ * - name: zone name, must outlive the zone (typically a string literal)
+ */
+class AllocationZone {
+ public:
+  explicit AllocationZone(const char* name);
+  ~AllocationZone();
+
+  AllocationZone(const AllocationZone&) = delete;
+  AllocationZone& operator=(const AllocationZone&) = delete;
+
+ private:
+  bool active_;
+};
+
+/*! \brief Stats of all zones exited so far, sorted by decreasing self bytes
+ */
+std::vector<ZoneAllocationStats> allocationZoneStats();
+
+void resetAllocationZoneStats();
+
+/*! \brief Writes the zone stats as a table. In profiling builds this is also
+ * written on shutdown, to the file named by the KIMERA_PGMO_ALLOCATION_REPORT
+ * environment variable or to stderr.
+ */
+void writeAllocationZoneReport(std::ostream& out);
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,165 @@
+/**
+ * @file   BinarySerialization.h
+ * @brief  Compact binary writer / memory-mapped reader used for state files
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <pcl/Vertices.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "kimera_pgmo/utils/CommonStructs.h"
+#include "kimera_pgmo/utils/LabelColumn.h"
+
+namespace kimera_pgmo {
+
+/*! \brief Sequential little-endian (host order) binary writer for plain data
+ */
+class BinaryWriter {
+ public:
+  explicit BinaryWriter(const std::string& filename);
+
+  BinaryWriter(const BinaryWriter&) = delete;
+  BinaryWriter& operator=(const BinaryWriter&) = delete;
+
+  /*! \brief Whether the file is open and every write so far succeeded
+   */
+  bool ok() const { return static_cast<bool>(out_); }
+
+  void writeBytes(const void* data, size_t num_bytes);
+
+  template <typename T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable types can be written directly");
+    writeBytes(&value, sizeof(T));
+  }
+
+  template <typename T>
+  void writeVector(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable types can be written directly");
+    write<uint64_t>(values.size());
+    writeBytes(values.data(), values.size() * sizeof(T));
+  }
+
+  void writeString(const std::string& value);
+
+ private:
+  std::ofstream out_;
+};
+
+/*! \brief Sequential binary reader over a read-only memory mapping of a file.
+ * All reads are bounds checked; once a read fails the reader stays failed.
+ */
+class BinaryReader {
+ public:
+  explicit BinaryReader(const std::string& filename);
+
+  BinaryReader(const uint8_t* data, size_t num_bytes);
+
+  ~BinaryReader();
+
+  BinaryReader(const BinaryReader&) = delete;
+  BinaryReader& operator=(const BinaryReader&) = delete;
+
+  /*! \brief Whether the file was mapped and every read so far succeeded
+   */
+  bool ok() const { return data_ != nullptr && !failed_; }
+
+  /*! \brief Number of unread bytes
+   */
+  size_t remaining() const { return failed_ ? 0 : size_ - pos_; }
+
+  bool readBytes(void* data, size_t num_bytes);
+
+  template <typename T>
+  bool read(T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable types can be read directly");
+    return readBytes(&value, sizeof(T));
+  }
+
+  template <typename T>
+  bool readVector(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable types can be read directly");
+    uint64_t size;
+    if (!read(size) || size > remaining() / sizeof(T)) {
+      failed_ = true;
+      return false;
+    }
+
+    values.resize(size);
+    return readBytes(values.data(), size * sizeof(T));
+  }
+
+  bool readString(std::string& value);
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_;
+  bool failed_;
+  void* mapping_;
+};
+
+// Helpers for the container types shared by the compression and frontend state
+
+void writeCloud(BinaryWriter& writer, const pcl::PointCloud<pcl::PointXYZRGBA>& cloud);
+
+bool readCloud(BinaryReader& reader, pcl::PointCloud<pcl::PointXYZRGBA>& cloud);
+
+void writeCloud(BinaryWriter& writer, const pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+bool readCloud(BinaryReader& reader, pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+void writePolygons(BinaryWriter& writer, const std::vector<pcl::Vertices>& polygons);
+
+bool readPolygons(BinaryReader& reader, std::vector<pcl::Vertices>& polygons);
+
+/*! \brief Write a label column as its dictionary and runs (or as runs with
+ * their labels if the column is wide)
+ */
+void writeLabelColumn(BinaryWriter& writer, const LabelColumn& labels);
+
+bool readLabelColumn(BinaryReader& reader, LabelColumn& labels);
+
+void writeIndexMapping(BinaryWriter& writer, const IndexMapping& mapping);
+
+bool readIndexMapping(BinaryReader& reader, IndexMapping& mapping);
+
+void writeVoxbloxIndexMapping(BinaryWriter& writer, const VoxbloxIndexMapping& mapping);
+
+bool readVoxbloxIndexMapping(BinaryReader& reader, VoxbloxIndexMapping& mapping);
+
+/*! \brief Write a voxblox block or voxel index as three 64 bit integers
+ */
+template <typename Index>
+void writeVoxbloxIndex(BinaryWriter& writer, const Index& index) {
+  const int64_t values[3] = {index.x(), index.y(), index.z()};
+  writer.writeBytes(values, sizeof(values));
+}
+
+template <typename Index>
+bool readVoxbloxIndex(BinaryReader& reader, Index& index) {
+  int64_t values[3];
+  if (!reader.readBytes(values, sizeof(values))) {
+    return false;
+  }
+
+  using Scalar = typename Index::Scalar;
+  index = Index(static_cast<Scalar>(values[0]),
+                static_cast<Scalar>(values[1]),
+                static_cast<Scalar>(values[2]));
+  return true;
+}
+
+}  // namespace kimera_pgmo
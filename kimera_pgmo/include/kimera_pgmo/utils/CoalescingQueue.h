@@ -0,0 +1,144 @@
+/**
+ * @file   CoalescingQueue.h
+ * @brief  Bounded hand-off queue between a subscriber and a worker thread that
+ * can coalesce pending messages down to the newest one
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace kimera_pgmo {
+
+enum class QueuePolicy {
+  LATEST,  // only keep the newest pending message, drop superseded ones
+  FIFO     // keep up to capacity messages in order, drop the oldest when full
+};
+
+/*! \brief Parse a queue policy name ("latest" or "fifo")
+ *  - name: policy name
+ *  - policy: parsed policy (unchanged on failure)
+ */
+inline bool parseQueuePolicy(const std::string& name, QueuePolicy* policy) {
+  if (name == "latest") {
+    *policy = QueuePolicy::LATEST;
+    return true;
+  }
+  if (name == "fifo") {
+    *policy = QueuePolicy::FIFO;
+    return true;
+  }
+  return false;
+}
+
+struct QueueStats {
+  uint64_t received = 0;
+  uint64_t processed = 0;
+  uint64_t dropped = 0;
+  int64_t last_latency_us = 0;  // time spent waiting in the queue (mu-s)
+  int64_t max_latency_us = 0;
+};
+
+template <typename T>
+class CoalescingQueue {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit CoalescingQueue(QueuePolicy policy = QueuePolicy::LATEST,
+                           size_t capacity = 1)
+      : policy_(policy), capacity_(capacity == 0 ? 1 : capacity) {}
+
+  /*! \brief Add a message, dropping superseded / overflowing messages
+   *  - msg: message to add
+   *  - returns the number of messages dropped to make room
+   */
+  size_t push(const T& msg) {
+    size_t num_dropped = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.received;
+      const size_t limit = policy_ == QueuePolicy::LATEST ? 1 : capacity_;
+      while (pending_.size() >= limit) {
+        pending_.pop_front();
+        ++num_dropped;
+      }
+      pending_.push_back({msg, Clock::now()});
+      stats_.dropped += num_dropped;
+    }
+
+    cv_.notify_one();
+    return num_dropped;
+  }
+
+  /*! \brief Wait for the next message and account its queue latency
+   *  - timeout: maximum time to wait
+   *  - returns the message if one arrived before the timeout or shutdown
+   */
+  std::optional<T> pop(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!cv_.wait_for(lock, timeout, [this] { return !pending_.empty() || shutdown_; }) ||
+        pending_.empty()) {
+      return std::nullopt;
+    }
+
+    Entry entry = std::move(pending_.front());
+    pending_.pop_front();
+
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - entry.received);
+    stats_.last_latency_us = latency.count();
+    if (stats_.last_latency_us > stats_.max_latency_us) {
+      stats_.max_latency_us = stats_.last_latency_us;
+    }
+    ++stats_.processed;
+    return std::move(entry.msg);
+  }
+
+  /*! \brief Wake up any waiting consumer and refuse to block afterwards
+   */
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  bool isShutdown() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return shutdown_;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+  }
+
+  QueueStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  struct Entry {
+    T msg;
+    Clock::time_point received;
+  };
+
+  const QueuePolicy policy_;
+  const size_t capacity_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Entry> pending_;
+  QueueStats stats_;
+  bool shutdown_ = false;
+};
+
+}  // namespace kimera_pgmo
@@ -12,6 +12,7 @@
 #include <gtsam/nonlinear/NonlinearFactorGraph.h>
 #include <gtsam/nonlinear/Values.h>
 #include <kimera_pgmo/KimeraPgmoMesh.h>
+#include <kimera_pgmo/KimeraPgmoMeshGraph.h>
 #include <pcl/PolygonMesh.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
@@ -222,6 +223,18 @@ GraphMsgPtr GtsamGraphToRos(const gtsam::NonlinearFactorGraph& factors,
                             const gtsam::Vector& gnc_weights = gtsam::Vector(),
                             const std::string& frame_id = "world");
 
+/*! \brief Convert a compact mesh graph msg to the equivalent pose graph msg (one
+ * node and one MESH edge per vertex and edge, for subscribers of the older
+ * format). Edges to vertices that are neither in the msg nor in graph_vertices
+ * are dropped.
+ *  - mesh_graph: new vertices and edges of the simplified mesh
+ *  - graph_vertices: all vertices of the simplified mesh, for the positions of
+ * the edge endpoints that are not new
+ */
+pose_graph_tools_msgs::PoseGraph MeshGraphToPoseGraph(
+    const KimeraPgmoMeshGraph& mesh_graph,
+    const pcl::PointCloud<pcl::PointXYZRGBA>& graph_vertices);
+
 /*! \brief Check if a surface exist based on previous tracked adjacent surfaces
  *  - new_surface: new surface to be inserted
  *  - adjacent_surfaces: vertex to adjacent surfaces (should correspond exactly
@@ -20,6 +20,9 @@
 
 namespace kimera_pgmo {
 
+class BinaryWriter;
+class BinaryReader;
+
 typedef uint64_t Vertex;
 typedef std::vector<Vertex> Vertices;
 typedef std::map<Vertex, Vertices> Edges;
@@ -118,6 +121,17 @@ class Graph {
    */
   void print(std::string header) const;
 
+  /*! \brief Write the vertices and edges of the graph
+   *  - writer: binary writer to append to
+   */
+  void save(BinaryWriter& writer) const;
+
+  /*! \brief Replace the graph with one previously written by save
+   *  - reader: binary reader positioned at the start of the graph
+   *  - returns false if the data was truncated
+   */
+  bool load(BinaryReader& reader);
+
  private:
   Vertices vertices_;
   Edges edges_;
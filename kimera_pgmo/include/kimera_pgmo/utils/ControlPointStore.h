@@ -0,0 +1,94 @@
+/**
+ * @file   ControlPointStore.h
+ * @brief  Compact chunked storage for the deformation graph control points
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <gtsam/geometry/Point3.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "kimera_pgmo/MeshTypes.h"
+
+namespace kimera_pgmo {
+
+/*! \brief Append-only store of control point positions and timestamps. Points
+ * are kept in fixed size chunks so that appending never moves existing points.
+ * Each chunk keeps the position of its first point in double precision and the
+ * remaining points as single precision offsets from it. Stamps are stored as
+ * exact deltas (microseconds + nanosecond remainder) from the first stamp of
+ * the chunk.
+ */
+class ControlPointStore {
+ public:
+  static constexpr size_t kChunkSize = 256;
+
+  ControlPointStore() = default;
+
+  /*! \brief Build a store from the (position, stamp) pairs of the vectors
+   *  - positions: control point positions
+   *  - stamps: control point stamps (if empty, all stamps are 0)
+   */
+  ControlPointStore(const std::vector<gtsam::Point3>& positions,
+                    const std::vector<traits::Timestamp>& stamps);
+
+  inline size_t size() const { return size_; }
+
+  inline bool empty() const { return size_ == 0; }
+
+  void clear();
+
+  /*! \brief Add a control point at the end of the store
+   *  - position: position of the control point
+   *  - stamp: timestamp of the control point
+   */
+  void push_back(const gtsam::Point3& position, traits::Timestamp stamp);
+
+  /*! \brief Position of a control point (throws std::out_of_range)
+   */
+  gtsam::Point3 position(size_t index) const;
+
+  /*! \brief Timestamp of a control point (throws std::out_of_range)
+   */
+  traits::Timestamp stamp(size_t index) const;
+
+  /*! \brief Timestamp of the last control point (store cannot be empty)
+   */
+  inline traits::Timestamp lastStamp() const { return stamp(size_ - 1); }
+
+  /*! \brief Expanded copy of all positions
+   */
+  std::vector<gtsam::Point3> positions() const;
+
+  /*! \brief Expanded copy of all stamps
+   */
+  std::vector<traits::Timestamp> stamps() const;
+
+  inline size_t numChunks() const { return chunks_.size(); }
+
+  /*! \brief Approximate number of bytes used by the stored points
+   */
+  size_t memoryUsage() const;
+
+ private:
+  // Marks a stamp that did not fit in the delta encoding of its chunk
+  static constexpr int32_t kFarStamp = INT32_MIN;
+
+  struct Chunk {
+    gtsam::Point3 origin;
+    traits::Timestamp first_stamp;
+    std::vector<float> offsets;  // xyz offsets from origin
+    std::vector<int32_t> stamp_us;
+    std::vector<uint16_t> stamp_ns;
+    std::vector<traits::Timestamp> far_stamps;  // in order of appearance
+  };
+
+  const Chunk& chunkAt(size_t index) const;
+
+  std::vector<Chunk> chunks_;
+  size_t size_ = 0;
+};
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,141 @@
+/**
+ * @file   LabelColumn.h
+ * @brief  Run-length and dictionary encoded column of vertex labels
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace kimera_pgmo {
+
+/*! \brief Column of per-vertex semantic labels stored as runs of equal labels.
+ * Labels are spatially coherent, so consecutive vertices mostly share a label:
+ * every run only stores where it ends and the index of its label in a
+ * dictionary of the distinct labels. A sparse index of the run containing
+ * every kIndexStride-th entry makes random access constant time. Columns with
+ * more than kMaxDictionarySize distinct labels switch to storing the label of
+ * every run directly (see wide()).
+ */
+class LabelColumn {
+ public:
+  using RunLength = uint32_t;
+  using LabelIndex = uint16_t;
+
+  static constexpr size_t kIndexStride = 256;
+  static constexpr size_t kMaxDictionarySize = 1 << 16;
+
+  LabelColumn() = default;
+
+  explicit LabelColumn(const std::vector<uint32_t>& labels);
+
+  LabelColumn& operator=(const std::vector<uint32_t>& labels);
+
+  /*! \brief Append a label
+   */
+  void push_back(uint32_t label);
+
+  /*! \brief Label of entry i (no bounds check)
+   */
+  uint32_t operator[](size_t i) const;
+
+  /*! \brief Label of entry i. Throws std::out_of_range when i >= size().
+   */
+  uint32_t at(size_t i) const;
+
+  inline size_t size() const { return run_ends_.empty() ? 0 : run_ends_.back(); }
+
+  inline bool empty() const { return run_ends_.empty(); }
+
+  void clear();
+
+  void reserve(size_t num_runs);
+
+  /*! \brief Expand the column to one label per entry
+   */
+  std::vector<uint32_t> toVector() const;
+
+  inline size_t numRuns() const { return run_ends_.size(); }
+
+  /*! \brief True if the column has too many distinct labels for dictionary
+   * indices: the runs store their labels and the column has no dictionary
+   */
+  inline bool wide() const { return wide_; }
+
+  /*! \brief Distinct labels, in order of first appearance (empty if wide)
+   */
+  inline const std::vector<uint32_t>& dictionary() const { return dictionary_; }
+
+  /*! \brief Encoded columns for serialization. Returns false (and leaves the
+   * outputs empty) if the column is wide.
+   *  - run_lengths: number of consecutive entries of each run
+   *  - run_labels: index in the dictionary of the label of each run
+   */
+  bool encode(std::vector<RunLength>* run_lengths,
+              std::vector<LabelIndex>* run_labels) const;
+
+  /*! \brief Runs of the column with their labels (for wide columns)
+   *  - run_lengths: number of consecutive entries of each run
+   *  - run_labels: label of each run
+   */
+  void encodeRuns(std::vector<RunLength>* run_lengths,
+                  std::vector<uint32_t>* run_labels) const;
+
+  /*! \brief Rebuild the column from its encoded form. Leaves the column empty
+   * and returns false if the encoding is not consistent.
+   *  - dictionary: distinct labels
+   *  - run_lengths: number of consecutive entries of each run
+   *  - run_labels: index in the dictionary of the label of each run
+   */
+  bool decode(const std::vector<uint32_t>& dictionary,
+              const std::vector<RunLength>& run_lengths,
+              const std::vector<LabelIndex>& run_labels);
+
+  /*! \brief Rebuild the column from runs with their labels. Leaves the column
+   * empty and returns false if the runs are not consistent.
+   *  - run_lengths: number of consecutive entries of each run
+   *  - run_labels: label of each run
+   */
+  bool decodeRuns(const std::vector<RunLength>& run_lengths,
+                  const std::vector<uint32_t>& run_labels);
+
+  /*! \brief Approximate number of bytes used by the column
+   */
+  size_t memoryUsage() const;
+
+  bool operator==(const LabelColumn& other) const;
+
+  inline bool operator!=(const LabelColumn& other) const { return !(*this == other); }
+
+ private:
+  // false if the dictionary is full
+  bool dictionaryIndex(uint32_t label, LabelIndex* index);
+
+  // switch to storing the label of every run
+  void widen();
+
+  inline uint32_t runLabel(size_t run) const {
+    return wide_ ? wide_run_labels_[run] : dictionary_[run_labels_[run]];
+  }
+
+  void appendRun(uint32_t label, size_t length);
+
+  size_t findRun(size_t i) const;
+
+  std::vector<uint32_t> dictionary_;
+  std::unordered_map<uint32_t, LabelIndex> dictionary_lookup_;
+  // exclusive end of every run (increasing)
+  std::vector<uint32_t> run_ends_;
+  // dictionary index of every run
+  std::vector<LabelIndex> run_labels_;
+  // label of every run (instead of the dictionary when wide)
+  bool wide_ = false;
+  std::vector<uint32_t> wide_run_labels_;
+  // run containing entry k * kIndexStride
+  std::vector<uint32_t> index_;
+};
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,120 @@
+/**
+ * @file   MeshDecimation.h
+ * @brief  Quadric error edge collapse simplification of meshes
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "kimera_pgmo/MeshTraits.h"
+
+namespace kimera_pgmo {
+
+struct MeshDecimationConfig {
+  size_t max_vertices = 0;  // vertex budget of the decimated mesh (0 for none)
+  double max_error = 0.0;   // max distance of a kept vertex to the planes of the
+                            // original faces (and borders) collapsed into it
+                            // (meters, 0 for none)
+  double tile_size = 10.0;  // side length of the tiles (columns over the xy plane)
+                            // decimated in parallel
+  size_t num_threads = 0;   // number of threads (0 for one per core)
+};
+
+/*! \brief Decimated mesh as a subset of the vertices of the input mesh: every
+ * edge collapse keeps one of its two vertices, so the attributes of the kept
+ * vertices (color, stamp, graph index...) carry over as they are.
+ */
+struct DecimationResult {
+  static constexpr size_t INVALID = std::numeric_limits<size_t>::max();
+
+  // index in the input mesh of every vertex of the decimated mesh (increasing)
+  std::vector<size_t> vertices;
+  // faces of the decimated mesh (indexing vertices)
+  std::vector<traits::Face> faces;
+  // decimated vertex every input vertex was collapsed into (INVALID for the
+  // vertices that are not part of any face)
+  std::vector<size_t> vertex_map;
+};
+
+/*! \brief Simplify a mesh by collapsing the edges of least quadric error until
+ * the vertex budget is met or every remaining collapse exceeds the error bound.
+ * The mesh is split into tiles that are decimated in parallel; vertices of faces
+ * spanning several tiles are kept so that the tiles stay connected.
+ *  - vertices: vertex positions
+ *  - faces: triangles (faces with repeated vertices are dropped)
+ *  - config: decimation targets
+ */
+DecimationResult decimateMesh(const std::vector<traits::Pos>& vertices,
+                              const std::vector<traits::Face>& faces,
+                              const MeshDecimationConfig& config);
+
+/*! \brief Decimate any mesh implementing the vertex and face traits
+ *  - vertices: mesh vertices
+ *  - faces: mesh faces
+ *  - config: decimation targets
+ */
+template <typename Vertices, typename Faces>
+DecimationResult decimateMesh(const Vertices& vertices,
+                              const Faces& faces,
+                              const MeshDecimationConfig& config) {
+  std::vector<traits::Pos> positions(traits::num_vertices(vertices));
+  for (size_t i = 0; i < positions.size(); ++i) {
+    positions[i] = traits::get_vertex(vertices, i);
+  }
+
+  std::vector<traits::Face> triangles(traits::num_faces(faces));
+  for (size_t i = 0; i < triangles.size(); ++i) {
+    triangles[i] = traits::get_face(faces, i);
+  }
+  return decimateMesh(positions, triangles, config);
+}
+
+/*! \brief Copy the vertices (with all their attributes) and faces of the
+ * decimated mesh
+ *  - result: output of decimateMesh
+ *  - vertices: vertices of the mesh that was decimated
+ *  - decimated_vertices: vertices of the decimated mesh
+ *  - decimated_faces: faces of the decimated mesh
+ */
+template <typename Vertices, typename OutVertices, typename OutFaces>
+void extractDecimatedMesh(const DecimationResult& result,
+                          const Vertices& vertices,
+                          OutVertices& decimated_vertices,
+                          OutFaces& decimated_faces) {
+  traits::resize_vertices(decimated_vertices, result.vertices.size());
+  for (size_t i = 0; i < result.vertices.size(); ++i) {
+    std::optional<traits::Color> color;
+    std::optional<uint8_t> alpha;
+    std::optional<traits::Timestamp> stamp;
+    std::optional<traits::Label> label;
+    const auto pos = traits::get_vertex(
+        vertices, result.vertices[i], &color, &alpha, &stamp, &label);
+    traits::set_vertex(decimated_vertices, i, pos, color, alpha, stamp, label);
+  }
+
+  traits::resize_faces(decimated_faces, result.faces.size());
+  for (size_t i = 0; i < result.faces.size(); ++i) {
+    traits::set_face(decimated_faces, i, result.faces[i]);
+  }
+}
+
+/*! \brief Copy a vertex attribute the mesh traits do not cover (e.g. the
+ * deformation graph indices) for the vertices of the decimated mesh
+ *  - result: output of decimateMesh
+ *  - values: attribute of every vertex of the mesh that was decimated
+ */
+template <typename T>
+std::vector<T> extractDecimatedValues(const DecimationResult& result,
+                                      const std::vector<T>& values) {
+  std::vector<T> decimated_values;
+  decimated_values.reserve(result.vertices.size());
+  for (const size_t v : result.vertices) {
+    decimated_values.push_back(values.at(v));
+  }
+  return decimated_values;
+}
+
+}  // namespace kimera_pgmo
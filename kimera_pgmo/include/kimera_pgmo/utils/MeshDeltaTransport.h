@@ -0,0 +1,143 @@
+/**
+ * @file   MeshDeltaTransport.h
+ * @brief  Incremental transport of the full mesh from the frontend to the
+ * backend as mesh deltas
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <pcl/Vertices.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "kimera_pgmo/KimeraPgmoMeshDelta.h"
+#include "kimera_pgmo/utils/CommonStructs.h"
+
+namespace kimera_pgmo {
+
+/*! \brief Encodes the changes of the full mesh since the last published
+ * version as a mesh delta. Only the part of the mesh that the compression can
+ * still modify is kept to find the first changed vertex and face, and every
+ * resync period a delta carrying the whole mesh is sent so that a receiver
+ * that missed a delta can recover.
+ */
+class MeshDeltaEncoder {
+ public:
+  /*! \brief Constructor
+   *  - resync_period: time (seconds, in message time) between deltas carrying
+   * the whole mesh. Non-positive to only send the whole mesh on request.
+   */
+  explicit MeshDeltaEncoder(double resync_period = 30.0);
+
+  /*! \brief Encode the changes to the mesh since the last call
+   *  - vertices: current vertices of the full mesh
+   *  - stamps: current timestamps of the vertices
+   *  - faces: current faces of the full mesh
+   *  - graph_mapping: mesh vertex to deformation graph vertex mapping
+   *  - num_fixed_vertices: number of leading vertices that can no longer change
+   *  - num_fixed_faces: number of leading faces that can no longer change
+   *  - first_remapped_vertex: smallest vertex whose graph mapping was added
+   * since the last call
+   *  - stamp_ns: message time
+   */
+  KimeraPgmoMeshDelta encode(
+      const pcl::PointCloud<pcl::PointXYZRGBA>& vertices,
+      const std::vector<Timestamp>& stamps,
+      const std::vector<pcl::Vertices>& faces,
+      const IndexMapping& graph_mapping,
+      size_t num_fixed_vertices,
+      size_t num_fixed_faces,
+      size_t first_remapped_vertex = std::numeric_limits<size_t>::max(),
+      Timestamp stamp_ns = 0);
+
+  /*! \brief Send the whole mesh with the next delta
+   */
+  inline void requestResync() { resync_requested_ = true; }
+
+  inline uint64_t getSequence() const { return sequence_; }
+
+ private:
+  // graph_indices start at vertex graph_start
+  size_t firstChangedVertex(const pcl::PointCloud<pcl::PointXYZRGBA>& vertices,
+                            const std::vector<Timestamp>& stamps,
+                            const std::vector<int>& graph_indices,
+                            size_t graph_start) const;
+
+  size_t firstChangedFace(const std::vector<pcl::Vertices>& faces) const;
+
+  Timestamp resync_period_ns_;
+  bool resync_requested_;
+  Timestamp last_resync_ns_;
+  uint64_t sequence_;
+
+  // Last published mesh, only from the first vertex / face that could change
+  size_t num_prev_vertices_;
+  size_t prev_vertex_offset_;
+  pcl::PointCloud<pcl::PointXYZRGBA> prev_vertices_;
+  std::vector<Timestamp> prev_stamps_;
+  std::vector<int> prev_graph_indices_;
+  size_t num_prev_faces_;
+  size_t prev_face_offset_;
+  std::vector<pcl::Vertices> prev_faces_;
+};
+
+/*! \brief Copy of the full (undeformed) mesh kept up to date from mesh deltas.
+ * Tracks the first vertex that changed since the last deformation so that
+ * only the new or changed vertices have to be deformed again.
+ */
+class MeshDeltaMirror {
+ public:
+  enum class Status {
+    APPLIED,     // delta applied on top of the mirror
+    RESYNCED,    // mirror recovered from a delta carrying the whole mesh
+    OUT_OF_SYNC  // delta dropped, waiting for a delta carrying the whole mesh
+  };
+
+  MeshDeltaMirror();
+
+  /*! \brief Apply a delta to the mirror
+   *  - msg: mesh delta from the frontend
+   */
+  Status update(const KimeraPgmoMeshDelta& msg);
+
+  inline bool synced() const { return synced_; }
+
+  inline size_t numVertices() const { return vertices_.size(); }
+
+  inline const pcl::PointCloud<pcl::PointXYZRGBA>& vertices() const {
+    return vertices_;
+  }
+
+  inline const std::vector<Timestamp>& stamps() const { return stamps_; }
+
+  inline const std::vector<pcl::Vertices>& faces() const { return faces_; }
+
+  inline const std::vector<int>& graphIndices() const { return graph_indices_; }
+
+  /*! \brief First vertex added or modified since the last call to
+   * clearChanges (the number of vertices if there is none)
+   */
+  inline size_t firstChangedVertex() const {
+    return std::min(first_changed_vertex_, vertices_.size());
+  }
+
+  inline void clearChanges() { first_changed_vertex_ = vertices_.size(); }
+
+  void clear();
+
+ private:
+  bool synced_;
+  uint64_t last_sequence_;
+  size_t first_changed_vertex_;
+
+  pcl::PointCloud<pcl::PointXYZRGBA> vertices_;
+  std::vector<Timestamp> stamps_;
+  std::vector<pcl::Vertices> faces_;
+  std::vector<int> graph_indices_;
+};
+
+}  // namespace kimera_pgmo
@@ -14,6 +14,7 @@
 
 #include "kimera_pgmo/MeshTraits.h"
 #include "kimera_pgmo/utils/CommonStructs.h"
+#include "kimera_pgmo/utils/LabelColumn.h"
 
 namespace kimera_pgmo {
 
@@ -27,7 +28,8 @@ struct IOData {
   std::vector<uint8_t> b;
   std::vector<uint8_t> a;
   std::vector<Timestamp> stamps;
-  std::vector<uint32_t> labels;
+  // stored as label runs ("label_dictionary" and "label_run" elements)
+  LabelColumn labels;
   std::vector<std::vector<uint32_t>> faces;
 
   static IOData::Ptr load(const std::string& filename);
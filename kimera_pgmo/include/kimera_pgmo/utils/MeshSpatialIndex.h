@@ -0,0 +1,155 @@
+/**
+ * @file   MeshSpatialIndex.h
+ * @brief  Voxel bucket index over the faces of a mesh for spatial queries
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <pcl/PolygonMesh.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "kimera_pgmo/MeshTypes.h"
+
+namespace kimera_pgmo {
+
+/*! \brief Index of the faces of a mesh in uniform voxel buckets. Updating the
+ * index with a new version of the mesh only re-buckets the faces that were
+ * added or that moved to different voxels, so the index can be kept up to date
+ * with the deformed mesh at little cost. Faces with a non-finite vertex or
+ * spanning more than kMaxFaceVoxels voxels along an axis (e.g. faces to
+ * placeholder vertices) are kept but not indexed.
+ */
+class MeshSpatialIndex {
+ public:
+  static constexpr int kMaxFaceVoxels = 64;
+
+  struct SurfacePoint {
+    traits::Pos point;  // closest point on the surface
+    size_t face;        // index of the face containing the point
+    float distance;     // distance from the query point
+  };
+
+  struct RayHit {
+    traits::Pos point;  // intersection point
+    size_t face;        // index of the face hit
+    float range;        // distance along the ray
+  };
+
+  /*! \brief Constructor
+   *  - resolution: side length of the voxel buckets (meters)
+   */
+  explicit MeshSpatialIndex(double resolution = 1.0);
+
+  inline double resolution() const { return resolution_; }
+
+  inline size_t numVertices() const { return vertices_.size(); }
+
+  inline size_t numFaces() const { return faces_.size(); }
+
+  inline size_t numBuckets() const { return buckets_.size(); }
+
+  inline const std::vector<traits::Pos>& vertices() const { return vertices_; }
+
+  inline const std::vector<traits::Face>& faces() const { return faces_; }
+
+  void clear();
+
+  /*! \brief Update the index to a new version of the mesh. Faces are matched by
+   * index with the previous version.
+   *  - mesh: new mesh (only the vertex positions and triangles are used)
+   *  - returns the number of faces inserted or moved between buckets
+   */
+  size_t update(const pcl::PolygonMesh& mesh);
+
+  /*! \brief Update the index to a new version of the mesh in which only some
+   * vertices changed (e.g. the vertices deformed again by the last deformation).
+   * Only the changed vertices are read and only the faces that use them or that
+   * changed are re-bucketed.
+   *  - mesh: new mesh (only the vertex positions and triangles are used)
+   *  - moved: changed vertices before start
+   *  - start: every vertex from start on may have changed
+   *  - returns the number of faces inserted or moved between buckets
+   */
+  size_t update(const pcl::PolygonMesh& mesh,
+                const std::vector<size_t>& moved,
+                size_t start);
+
+  size_t update(const std::vector<traits::Pos>& vertices,
+                const std::vector<traits::Face>& faces);
+
+  /*! \brief Faces whose bounding box overlaps an axis aligned box
+   *  - min: minimum corner of the box
+   *  - max: maximum corner of the box
+   *  - returns the indices of the faces in increasing order
+   */
+  std::vector<size_t> facesInBox(const traits::Pos& min, const traits::Pos& max) const;
+
+  /*! \brief Closest point on the mesh surface within a maximum distance
+   *  - query: query point
+   *  - max_distance: search radius
+   *  - result: closest surface point (if one was found)
+   */
+  bool closestPoint(const traits::Pos& query,
+                    double max_distance,
+                    SurfacePoint* result) const;
+
+  /*! \brief First intersection of a ray with the mesh surface
+   *  - origin: start of the ray
+   *  - direction: direction of the ray (does not need to be normalized)
+   *  - max_range: maximum distance along the ray
+   *  - hit: first intersection (if there is one)
+   */
+  bool raycast(const traits::Pos& origin,
+               const traits::Pos& direction,
+               double max_range,
+               RayHit* hit) const;
+
+ private:
+  using BucketKey = int64_t;
+
+  struct VoxelRange {
+    Eigen::Vector3i min;
+    Eigen::Vector3i max;
+
+    bool operator==(const VoxelRange& other) const {
+      return min == other.min && max == other.max;
+    }
+  };
+
+  Eigen::Vector3i voxelIndex(const traits::Pos& point) const;
+
+  static BucketKey bucketKey(const Eigen::Vector3i& index);
+
+  VoxelRange faceRange(const traits::Face& face) const;
+
+  // Re-bucket face f if its range changed, returns true if it was re-bucketed
+  bool updateFace(size_t f, bool existed);
+
+  void insertFace(size_t face, const VoxelRange& range);
+
+  void removeFace(size_t face, const VoxelRange& range);
+
+  // Closest face point over the faces of one bucket
+  void searchBucket(const Eigen::Vector3i& index,
+                    const traits::Pos& query,
+                    SurfacePoint* best) const;
+
+  double resolution_;
+  std::vector<traits::Pos> vertices_;
+  std::vector<traits::Face> faces_;
+  std::vector<VoxelRange> face_ranges_;
+  std::unordered_map<BucketKey, std::vector<uint32_t>> buckets_;
+};
+
+/*! \brief Extract the given faces of a mesh (and the vertices they use) as a new
+ * mesh with the same point fields
+ *  - mesh: mesh to extract from
+ *  - faces: indices of the faces to extract
+ */
+pcl::PolygonMesh extractSubmesh(const pcl::PolygonMesh& mesh,
+                                const std::vector<size_t>& faces);
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,101 @@
+/**
+ * @file   MessageArena.h
+ * @brief  Monotonic arena for temporaries that only live for one message
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+namespace kimera_pgmo {
+
+/*! \brief Monotonic (release-all-at-once) memory resource for per-message
+ * scratch containers. The backing buffer grows to the high-water mark of the
+ * messages seen so far, so steady-state messages are served without touching
+ * the heap. A buffer grown past the capacity cap by a burst of large messages
+ * is released back to the cap once enough messages in a row fit in the cap.
+ */
+class MessageArena {
+ public:
+  struct Stats {
+    size_t capacity = 0;               // size of the backing buffer (bytes)
+    size_t used_bytes = 0;             // bytes requested by the message
+    size_t overflow_bytes = 0;         // bytes requested beyond the buffer
+    size_t overflow_allocations = 0;   // heap allocations beyond the buffer
+  };
+
+  /*! \brief Constructor
+   *  - initial_capacity: initial size of the backing buffer (bytes)
+   *  - capacity_cap: size the buffer is released back to (bytes)
+   *  - quiet_messages: number of messages in a row fitting in the cap after
+   * which a larger buffer is released (0 to never release it)
+   */
+  explicit MessageArena(size_t initial_capacity = 64 * 1024,
+                        size_t capacity_cap = 16 * 1024 * 1024,
+                        size_t quiet_messages = 100);
+
+  MessageArena(const MessageArena&) = delete;
+  MessageArena& operator=(const MessageArena&) = delete;
+
+  /*! \brief Resource to construct the scratch containers of a message with
+   */
+  std::pmr::memory_resource* resource() { return &used_; }
+
+  /*! \brief Release everything allocated since the last reset. All containers
+   * using the arena must be destroyed before calling this.
+   */
+  void reset();
+
+  /*! \brief Stats of the last message (before the most recent reset)
+   */
+  const Stats& lastStats() const { return last_stats_; }
+
+  /*! \brief Current size of the backing buffer (bytes)
+   */
+  inline size_t capacity() const { return buffer_.size(); }
+
+ private:
+  // Counts the requests forwarded to the upstream resource
+  class CountingResource : public std::pmr::memory_resource {
+   public:
+    std::pmr::memory_resource* upstream = nullptr;
+    size_t bytes = 0;
+    size_t allocations = 0;
+
+   protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+  };
+
+  size_t capacity_cap_;
+  size_t quiet_messages_;
+  // messages in a row that fit in the cap while the buffer exceeds it
+  size_t num_quiet_;
+
+  std::vector<std::byte> buffer_;
+  CountingResource overflow_;  // what the monotonic resource needs past the buffer
+  std::optional<std::pmr::monotonic_buffer_resource> monotonic_;
+  CountingResource used_;      // what the message requests from the arena
+  Stats last_stats_;
+};
+
+/*! \brief Resets the arena when the message has been processed. Declare it
+ * before the scratch containers so that they are destroyed first.
+ */
+class MessageArenaScope {
+ public:
+  explicit MessageArenaScope(MessageArena& arena) : arena_(arena) {}
+  ~MessageArenaScope() { arena_.reset(); }
+
+  MessageArenaScope(const MessageArenaScope&) = delete;
+  MessageArenaScope& operator=(const MessageArenaScope&) = delete;
+
+ private:
+  MessageArena& arena_;
+};
+
+}  // namespace kimera_pgmo
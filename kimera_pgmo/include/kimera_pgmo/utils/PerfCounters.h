@@ -0,0 +1,114 @@
+/**
+ * @file   PerfCounters.h
+ * @brief  Optional per-thread hardware performance counters (perf_event_open)
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include "kimera_pgmo/utils/AllocationStats.h"
+
+namespace kimera_pgmo {
+
+struct PerfCounts {
+  enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, NUM };
+
+  // Event values; only meaningful for the events marked in has
+  std::array<uint64_t, NUM> values{};
+  std::array<bool, NUM> has{};
+
+  bool valid() const;
+  uint64_t operator[](Event event) const { return values[event]; }
+
+  PerfCounts operator-(const PerfCounts& other) const;
+  PerfCounts& operator+=(const PerfCounts& other);
+};
+
+/*! \brief JSON name of a counter event (e.g. "llc_misses")
+ */
+const char* perfEventName(PerfCounts::Event event);
+
+/*! \brief Writes the counts as a JSON object, or null if no event was counted
+ */
+void writePerfCountsJson(std::ostream& out, const PerfCounts& counts);
+
+/*! \brief Hardware counters of the calling thread (cycles, instructions, L1d and
+ * LLC misses, branch misses), opened as one perf_event_open group so that all
+ * events are scheduled together. Only the thread that opened the counters is
+ * counted: work handed to other threads (e.g. the parallel tiles of the mesh
+ * decimation or the session loading tasks) is missing from the counts, while
+ * the wall time includes it. Group reads cannot be combined with inherited
+ * counters, so such stages have to be measured single-threaded or with one
+ * PerfCounters per worker. Opening fails gracefully, e.g. in containers
+ * without perf access or on non-Linux systems: available() is false, error()
+ * says why and read() returns invalid counts. Events that the CPU does not
+ * support are left out individually.
+ */
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  bool available() const { return leader_fd_ >= 0; }
+
+  const std::string& error() const { return error_; }
+
+  /*! \brief Counts since the counters were opened, scaled for multiplexing
+   */
+  PerfCounts read() const;
+
+ private:
+  int leader_fd_ = -1;
+  std::array<int, PerfCounts::NUM> fds_;
+  std::array<uint64_t, PerfCounts::NUM> ids_;  // kernel ids in group reads
+  std::string error_;
+};
+
+/*! \brief Wall time, (if available) hardware counters and heap allocations
+ * accumulated over all executions of a benchmark zone. Counters and
+ * allocations are those of the thread running the zone.
+ */
+struct ZoneStats {
+  size_t count = 0;
+  double wall_ms = 0.0;
+  PerfCounts counters;
+  // only counted when built with KIMERA_PGMO_COUNT_ALLOCATIONS
+  AllocationCount allocations;
+};
+
+/*! \brief Adds the wall time, counters and heap allocations of its scope to
+ * the zone stats. If named, the scope is also an AllocationZone, so that its
+ * allocations appear (nested with the other zones) in the allocation report.
+ * - counters: counters of the calling thread, or null to only time the zone
+ * - stats: zone to accumulate into
+ * - name: allocation zone name (optional, must outlive the zone)
+ */
+class ScopedZone {
+ public:
+  ScopedZone(const PerfCounters* counters,
+             ZoneStats* stats,
+             const char* name = nullptr);
+  ~ScopedZone();
+
+  ScopedZone(const ScopedZone&) = delete;
+  ScopedZone& operator=(const ScopedZone&) = delete;
+
+ private:
+  const PerfCounters* counters_;
+  ZoneStats* stats_;
+  std::optional<AllocationZone> allocation_zone_;
+  std::chrono::steady_clock::time_point start_;
+  PerfCounts start_counts_;
+  AllocationCount start_allocations_;
+};
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,71 @@
+/**
+ * @file   SharedMemoryExport.h
+ * @brief  Export of the optimized trajectory and mesh to shared memory
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <gtsam/geometry/Pose3.h>
+#include <pcl/PolygonMesh.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "kimera_pgmo/utils/CommonStructs.h"
+#include "kimera_pgmo/utils/SharedMemorySegment.h"
+
+namespace kimera_pgmo {
+
+struct DeformedVertices;
+
+/*! \brief Writes the optimized trajectory to the segment <prefix>_trajectory
+ * (SHARED_POSES) and the optimized mesh to <prefix>_mesh (SHARED_VERTICES,
+ * SHARED_TRIANGLES, SHARED_VERTEX_STAMPS). Local consumers read them with
+ * SharedSegmentReader instead of deserializing the published messages.
+ */
+class SharedMemoryExport {
+ public:
+  /*! \brief Create the segments
+   * - prefix: name prefix of the segments (e.g. "/kimera_pgmo")
+   */
+  explicit SharedMemoryExport(const std::string& prefix);
+
+  bool ok() const { return trajectory_.ok() && mesh_.ok(); }
+
+  /*! \brief Export the optimized trajectory of a robot
+   * - path: optimized poses
+   * - stamps: timestamps of the poses
+   * - robot_id: robot the poses belong to (for their keys)
+   */
+  bool writeTrajectory(const std::vector<gtsam::Pose3>& path,
+                       const std::vector<Timestamp>& stamps,
+                       size_t robot_id);
+
+  /*! \brief Export the optimized mesh. Versions older than the last exported
+   * one are skipped.
+   * - mesh: optimized mesh
+   * - stamps: timestamps of the mesh vertices
+   * - version: version of the optimized mesh (increased by one every time the
+   * mesh is replaced)
+   * - deformed: vertices moved by the deformation that produced the mesh. Only
+   * these vertices are written if the mesh and the deformation directly follow
+   * the last exported ones and the mesh has the same size
+   */
+  bool writeMesh(const pcl::PolygonMesh& mesh,
+                 const std::vector<Timestamp>& stamps,
+                 uint64_t version,
+                 const DeformedVertices* deformed = nullptr);
+
+ private:
+  std::mutex trajectory_mutex_;
+  SharedSegmentWriter trajectory_;
+  std::mutex mesh_mutex_;
+  SharedSegmentWriter mesh_;
+  // last exported mesh version and deformation sequence (0 if not deformed)
+  bool has_mesh_ = false;
+  uint64_t last_mesh_version_ = 0;
+  uint64_t last_deformation_ = 0;
+};
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,218 @@
+/**
+ * @file   SharedMemorySegment.h
+ * @brief  Seqlock-protected POSIX shared memory segments to hand the optimized
+ * trajectory and mesh to processes on the same host without serialization
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace kimera_pgmo {
+
+// Elements of the exported arrays (native endianness, same host only)
+struct SharedPose {
+  uint64_t stamp_ns;
+  uint64_t key;  // gtsam key of the pose
+  double x, y, z;
+  double qw, qx, qy, qz;
+};
+
+struct SharedVertex {
+  float x, y, z;
+  uint8_t r, g, b, a;
+};
+
+struct SharedTriangle {
+  uint32_t v[3];
+};
+
+// Arrays of the trajectory segment
+enum SharedTrajectoryArray : size_t { SHARED_POSES = 0 };
+
+// Arrays of the mesh segment
+enum SharedMeshArray : size_t {
+  SHARED_VERTICES = 0,
+  SHARED_TRIANGLES = 1,
+  SHARED_VERTEX_STAMPS = 2
+};
+
+constexpr size_t kSharedSegmentArrays = 4;
+
+/*! \brief Header at the start of every segment. Everything after sequence (and
+ * the array data) is only consistent between two equal even reads of sequence.
+ */
+struct SharedSegmentHeader {
+  static constexpr uint64_t kMagic = 0x4f4d4750415245ULL;
+  static constexpr uint32_t kLayoutVersion = 1;
+
+  // set last when the segment is created
+  std::atomic<uint64_t> magic;
+  uint32_t layout_version;
+  // set by the writer before it removes the segment, readers have to reopen
+  std::atomic<uint32_t> stale;
+  std::atomic<uint64_t> segment_bytes;
+  // odd while the writer is updating the segment
+  std::atomic<uint64_t> sequence;
+  // number of completed writes
+  std::atomic<uint64_t> version;
+  std::atomic<uint64_t> stamp_ns;
+  std::array<std::atomic<uint64_t>, kSharedSegmentArrays> counts;
+  std::array<std::atomic<uint64_t>, kSharedSegmentArrays> element_bytes;
+  // byte offsets from the start of the segment
+  std::array<std::atomic<uint64_t>, kSharedSegmentArrays> offsets;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared segments need lock-free 64 bit atomics");
+
+/*! \brief Single writer of a shared segment. The segment is created (replacing
+ * a leftover one with the same name) on construction, grows as needed and is
+ * removed on destruction. Writes are not synchronized with each other: callers
+ * writing from several threads have to serialize them.
+ */
+class SharedSegmentWriter {
+ public:
+  /*! \brief Fills the arrays of a new version
+   * - arrays: start of each array in the segment
+   * - previous_contents: whether the arrays still hold the previous version
+   * (same counts), so that only the changed elements need to be written
+   */
+  using Fill =
+      std::function<void(const std::array<uint8_t*, kSharedSegmentArrays>& arrays,
+                         bool previous_contents)>;
+
+  /*! \brief Create the segment
+   * - name: POSIX shared memory name (e.g. "/kimera_pgmo_mesh")
+   * - initial_bytes: initial segment size
+   */
+  explicit SharedSegmentWriter(const std::string& name,
+                               size_t initial_bytes = 1 << 20);
+  ~SharedSegmentWriter();
+
+  SharedSegmentWriter(const SharedSegmentWriter&) = delete;
+  SharedSegmentWriter& operator=(const SharedSegmentWriter&) = delete;
+
+  bool ok() const { return header_ != nullptr; }
+
+  const std::string& name() const { return name_; }
+
+  /*! \brief Publish a new version of the arrays
+   * - stamp_ns: stamp of the data
+   * - counts: number of elements of each array
+   * - element_bytes: size of the elements of each array
+   * - fill: writes the elements (called while readers are locked out)
+   */
+  bool write(uint64_t stamp_ns,
+             const std::array<size_t, kSharedSegmentArrays>& counts,
+             const std::array<size_t, kSharedSegmentArrays>& element_bytes,
+             const Fill& fill);
+
+ private:
+  bool map(size_t bytes);
+
+  std::string name_;
+  int fd_ = -1;
+  SharedSegmentHeader* header_ = nullptr;
+  size_t mapped_bytes_ = 0;
+  std::array<size_t, kSharedSegmentArrays> last_counts_{};
+  bool has_contents_ = false;
+};
+
+/*! \brief Zero-copy reader of a shared segment written by another process.
+ *
+ * Usage:
+ *   SharedSegmentReader::Snapshot snapshot;
+ *   if (reader.snapshot(&snapshot)) {
+ *     const SharedVertex* vertices = snapshot.array<SharedVertex>(SHARED_VERTICES);
+ *     ... use vertices[0 ... snapshot.counts[SHARED_VERTICES] - 1] ...
+ *     if (!reader.valid(snapshot)) { discard what was read and retry }
+ *   }
+ */
+class SharedSegmentReader {
+ public:
+  struct Snapshot {
+    uint64_t sequence = 0;
+    uint64_t version = 0;
+    uint64_t stamp_ns = 0;
+    std::array<const uint8_t*, kSharedSegmentArrays> arrays{};
+    std::array<size_t, kSharedSegmentArrays> counts{};
+    std::array<size_t, kSharedSegmentArrays> element_bytes{};
+
+    /*! \brief Elements of an array, or null if they are not of type T
+     */
+    template <typename T>
+    const T* array(size_t index) const {
+      if (element_bytes[index] != sizeof(T)) {
+        return nullptr;
+      }
+      return reinterpret_cast<const T*>(arrays[index]);
+    }
+  };
+
+  explicit SharedSegmentReader(const std::string& name);
+  ~SharedSegmentReader();
+
+  SharedSegmentReader(const SharedSegmentReader&) = delete;
+  SharedSegmentReader& operator=(const SharedSegmentReader&) = delete;
+
+  /*! \brief Map the segment if it is not mapped yet (or was replaced). False
+   * if the writer has not created it.
+   */
+  bool open();
+
+  /*! \brief View of the latest complete version, pointing into the segment
+   * (valid until the next call, which may remap it). Returns false if the
+   * segment is not available or the writer kept it busy for all attempts.
+   */
+  bool snapshot(Snapshot* snapshot, size_t max_attempts = 1000);
+
+  /*! \brief Whether the writer has not started a new version since the
+   * snapshot was taken, i.e. whether everything read from it is consistent
+   */
+  bool valid(const Snapshot& snapshot) const;
+
+  /*! \brief Consistent copy of one array of the latest version
+   * - index: array to copy
+   * - values: copied elements
+   * - version: version of the copied data (optional)
+   */
+  template <typename T>
+  bool copy(size_t index, std::vector<T>* values, uint64_t* version = nullptr) {
+    for (size_t attempt = 0; attempt < 100; ++attempt) {
+      Snapshot view;
+      if (!snapshot(&view)) {
+        return false;
+      }
+      const T* begin = view.array<T>(index);
+      if (!begin) {
+        return false;
+      }
+      values->assign(begin, begin + view.counts[index]);
+      if (valid(view)) {
+        if (version) {
+          *version = view.version;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  void close();
+  bool map(size_t bytes);
+
+  std::string name_;
+  int fd_ = -1;
+  const SharedSegmentHeader* header_ = nullptr;
+  size_t mapped_bytes_ = 0;
+};
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,186 @@
+/**
+ * @file   SparseKeyframes.h
+ * @brief  Flat storage of the sparse keyframes of the pose graphs
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "kimera_pgmo/utils/BinarySerialization.h"
+
+namespace kimera_pgmo {
+
+/*! \brief Sparse keyframes of the pose graphs of all robots. With sparsification,
+ * consecutive odometry poses are absorbed into a keyframe until they move too far
+ * from it, and the keyframe keeps the transform of every absorbed pose relative to
+ * itself. The poses and keyframes of a robot have dense key indices, so the
+ * transforms and the pose to keyframe mapping are stored in vectors indexed by the
+ * key index instead of in maps. Loop closures between keyframes are kept in one
+ * sorted vector for deduplication.
+ */
+class SparseKeyframes {
+ public:
+  SparseKeyframes() = default;
+
+  /*! \brief Start a new keyframe holding a single pose at its origin. Returns
+   * false if the keyframe or the pose already exists.
+   *  - sparse_key: key of the keyframe
+   *  - full_key: key of the first pose of the keyframe
+   */
+  bool addKeyframe(gtsam::Key sparse_key, gtsam::Key full_key);
+
+  /*! \brief Accumulate the odometry to the pose following the last pose of an
+   * active keyframe. Returns true if the keyframe can absorb the new pose, and
+   * false (deactivating the keyframe) if it moved beyond the thresholds or the
+   * odometry cannot be added to the keyframe.
+   *  - sparse_key: keyframe
+   *  - to_key: new pose, following the last pose of the keyframe
+   *  - measure: odometry from the last pose of the keyframe to the new pose
+   *  - trans_threshold: maximum translation from the keyframe
+   *  - rot_threshold: maximum rotation from the keyframe
+   */
+  bool addOdometry(gtsam::Key sparse_key,
+                   gtsam::Key to_key,
+                   const gtsam::Pose3& measure,
+                   double trans_threshold,
+                   double rot_threshold);
+
+  /*! \brief Absorb a pose into a keyframe at the accumulated odometry of the
+   * keyframe. Returns false if the pose already exists.
+   */
+  bool absorbPose(gtsam::Key sparse_key, gtsam::Key full_key);
+
+  /*! \brief Add a pose with a known transform in its keyframe (e.g. read from
+   * file), creating the keyframe if needed. Returns false if the pose exists.
+   */
+  bool insert(gtsam::Key full_key,
+              gtsam::Key sparse_key,
+              const gtsam::Pose3& transform);
+
+  /*! \brief Add the poses, keyframes and loop closures of other that are not
+   * known yet
+   */
+  void merge(const SparseKeyframes& other);
+
+  bool hasPose(gtsam::Key full_key) const;
+
+  bool hasKeyframe(gtsam::Key sparse_key) const;
+
+  /*! \brief Keyframe a pose was absorbed into. Throws std::out_of_range for
+   * unknown poses.
+   */
+  gtsam::Key getKeyframe(gtsam::Key full_key) const;
+
+  /*! \brief Transform of a pose in its keyframe. Throws std::out_of_range for
+   * unknown poses.
+   */
+  const gtsam::Pose3& getTransform(gtsam::Key full_key) const;
+
+  /*! \brief Odometry accumulated by a keyframe, including the odometry that made
+   * it inactive. Throws std::out_of_range for unknown keyframes.
+   */
+  const gtsam::Pose3& getCurrentTransform(gtsam::Key sparse_key) const;
+
+  /*! \brief Whether a keyframe can still absorb poses
+   */
+  bool isActive(gtsam::Key sparse_key) const;
+
+  void deactivate(gtsam::Key sparse_key);
+
+  /*! \brief Call function(full_key, transform) for the poses of a keyframe in
+   * key order. Throws std::out_of_range for unknown keyframes.
+   */
+  template <typename Function>
+  void forEachPose(gtsam::Key sparse_key, const Function& function) const {
+    const gtsam::Symbol sparse_symb(sparse_key);
+    const RobotKeyframes* robot = findRobot(sparse_symb.chr());
+    const Keyframe* keyframe = findKeyframe(sparse_key);
+    if (keyframe == nullptr) {
+      throw std::out_of_range("unknown sparse keyframe " +
+                              gtsam::DefaultKeyFormatter(sparse_key));
+    }
+    for (size_t i = keyframe->begin; i < keyframe->end; ++i) {
+      if (robot->pose_keyframes[i] == sparse_symb.index()) {
+        function(gtsam::Symbol(sparse_symb.chr(), i).key(), robot->transforms[i]);
+      }
+    }
+  }
+
+  /*! \brief Record a loop closure between two keyframes. Returns false if a loop
+   * closure between them was already recorded, in either direction.
+   */
+  bool addLoopClosure(gtsam::Key from_sparse_key, gtsam::Key to_sparse_key);
+
+  bool hasLoopClosure(gtsam::Key from_sparse_key, gtsam::Key to_sparse_key) const;
+
+  inline size_t numPoses() const { return num_poses_; }
+
+  inline size_t numKeyframes() const { return num_keyframes_; }
+
+  inline size_t numLoopClosures() const { return loop_closures_.size(); }
+
+  inline bool empty() const { return num_poses_ == 0; }
+
+  void clear();
+
+  /*! \brief Approximate number of bytes used by the keyframes
+   */
+  size_t memoryUsage() const;
+
+  void save(BinaryWriter& writer) const;
+
+  /*! \brief Read keyframes written by save. Leaves the keyframes empty and
+   * returns false if the data is not consistent.
+   */
+  bool load(BinaryReader& reader);
+
+ private:
+  static constexpr uint32_t kNoKeyframe = std::numeric_limits<uint32_t>::max();
+
+  // Poses [begin, end) of a robot that map to this keyframe belong to it
+  struct Keyframe {
+    size_t begin = 0;
+    size_t end = 0;
+    bool active = true;
+    gtsam::Pose3 current_transform;
+
+    inline bool valid() const { return begin < end; }
+  };
+
+  struct RobotKeyframes {
+    // keyframe index of every pose index (kNoKeyframe for unknown poses)
+    std::vector<uint32_t> pose_keyframes;
+    // transform of every pose in its keyframe
+    std::vector<gtsam::Pose3> transforms;
+    std::vector<Keyframe> keyframes;
+  };
+
+  const RobotKeyframes* findRobot(char prefix) const;
+
+  const Keyframe* findKeyframe(gtsam::Key sparse_key) const;
+
+  Keyframe* findKeyframe(gtsam::Key sparse_key);
+
+  Keyframe& getOrCreateKeyframe(gtsam::Key sparse_key);
+
+  void setPose(gtsam::Key full_key,
+               gtsam::Key sparse_key,
+               const gtsam::Pose3& transform);
+
+  std::map<char, RobotKeyframes> robots_;
+  // (smaller key, larger key) of every loop closure, sorted
+  std::vector<std::array<gtsam::Key, 2>> loop_closures_;
+  size_t num_poses_ = 0;
+  size_t num_keyframes_ = 0;
+};
+
+}  // namespace kimera_pgmo
@@ -10,6 +10,8 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <algorithm>
+
 #include "kimera_pgmo/MeshTraits.h"
 
 namespace kimera_pgmo {
@@ -36,25 +38,25 @@ mesh_msgs::TriangleMesh PolygonMeshToTriangleMeshMsg(
 pcl::PolygonMesh TriangleMeshMsgToPolygonMesh(const mesh_msgs::TriangleMesh& mesh_msg);
 
 /**
- * @brief Fill mesh_msgs::TriangleMesh message from mesh
+ * @brief Append the vertices and faces of an append-only mesh that are not yet
+ * in a mesh_msgs::TriangleMesh message (i.e. past the number of vertices and
+ * triangles of the message)
  * @param vertices Mesh vertices to export
  * @param faces Mesh faces to export
- * @param msg Message to fill
+ * @param msg Message to extend
  */
 template <typename Vertices, typename Faces>
-void fillTriangleMeshMsg(const Vertices& vertices,
-                         const Faces& faces,
-                         mesh_msgs::TriangleMesh& msg) {
+void appendToTriangleMeshMsg(const Vertices& vertices,
+                             const Faces& faces,
+                             mesh_msgs::TriangleMesh& msg) {
   constexpr float color_conv_factor = 1.0f / std::numeric_limits<uint8_t>::max();
   const auto num_vertices = traits::num_vertices(vertices);
-  if (!num_vertices) {
-    return;
-  }
+  const size_t vertex_start = msg.vertices.size();
 
   // Convert vertices
-  msg.vertices.resize(num_vertices);
-  msg.vertex_colors.resize(num_vertices);
-  for (size_t i = 0; i < num_vertices; ++i) {
+  msg.vertices.resize(std::max<size_t>(num_vertices, vertex_start));
+  msg.vertex_colors.resize(msg.vertices.size());
+  for (size_t i = vertex_start; i < num_vertices; ++i) {
     std::optional<traits::Color> color;
     std::optional<uint8_t> alpha;
     const auto pos = traits::get_vertex(vertices, i, &color, &alpha);
@@ -80,8 +82,9 @@ void fillTriangleMeshMsg(const Vertices& vertices,
 
   // Convert polygons
   const auto num_faces = traits::num_faces(faces);
-  msg.triangles.resize(num_faces);
-  for (size_t i = 0; i < num_faces; i++) {
+  const size_t face_start = msg.triangles.size();
+  msg.triangles.resize(std::max<size_t>(num_faces, face_start));
+  for (size_t i = face_start; i < num_faces; i++) {
     auto& triangle = msg.triangles[i];
     const auto face = traits::get_face(faces, i);
     triangle.vertex_indices[0] = face[0];
@@ -90,6 +93,26 @@ void fillTriangleMeshMsg(const Vertices& vertices,
   }
 }
 
+/**
+ * @brief Fill mesh_msgs::TriangleMesh message from mesh
+ * @param vertices Mesh vertices to export
+ * @param faces Mesh faces to export
+ * @param msg Message to fill
+ */
+template <typename Vertices, typename Faces>
+void fillTriangleMeshMsg(const Vertices& vertices,
+                         const Faces& faces,
+                         mesh_msgs::TriangleMesh& msg) {
+  if (!traits::num_vertices(vertices)) {
+    return;
+  }
+
+  msg.vertices.clear();
+  msg.vertex_colors.clear();
+  msg.triangles.clear();
+  appendToTriangleMeshMsg(vertices, faces, msg);
+}
+
 /**
  * @brief Fill mesh_msgs::TriangleMesh message from mesh
  * @param mesh Mesh to export
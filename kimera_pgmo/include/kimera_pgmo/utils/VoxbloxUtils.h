@@ -6,7 +6,12 @@
 
 #pragma once
 
+#include <cstring>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <pcl/PolygonMesh.h>
 #include <pcl/point_cloud.h>
@@ -27,6 +32,43 @@ struct less<BlockIndex> {
 }  // namespace std
 
 namespace kimera_pgmo {
+/*! \brief Bit pattern of the position of a vertex. Two vertices have the same
+ * key iff their coordinates compare equal (+0 and -0 share a key).
+ */
+struct VertexPositionKey {
+  uint32_t x;
+  uint32_t y;
+  uint32_t z;
+
+  inline bool operator==(const VertexPositionKey& other) const {
+    return x == other.x && y == other.y && z == other.z;
+  }
+};
+
+template <class point_type>
+inline VertexPositionKey MakeVertexPositionKey(const point_type& point) {
+  // adding +0 maps -0 to +0
+  const float coords[3] = {point.x + 0.0f, point.y + 0.0f, point.z + 0.0f};
+  VertexPositionKey key;
+  std::memcpy(&key.x, &coords[0], sizeof(uint32_t));
+  std::memcpy(&key.y, &coords[1], sizeof(uint32_t));
+  std::memcpy(&key.z, &coords[2], sizeof(uint32_t));
+  return key;
+}
+
+struct VertexPositionKeyHash {
+  inline size_t operator()(const VertexPositionKey& key) const {
+    // same mixing as voxblox's AnyIndexHash, over the bit patterns
+    return static_cast<size_t>(key.x) * 73856093u ^
+           static_cast<size_t>(key.y) * 19349669u ^
+           static_cast<size_t>(key.z) * 83492791u;
+  }
+};
+
+// Vertex position to vertex index, used to find duplicated vertices
+typedef std::unordered_map<VertexPositionKey, size_t, VertexPositionKeyHash>
+    VertexPositionMap;
+
 /*! \brief Extract point in pcl format from voxblox mesh block
  *  - mesh_block: voxblox mesh block to update mesh with
  *  - block_edge_length: block_edge_length as given in voxblox msg
@@ -94,12 +136,31 @@ void VoxbloxMeshBlockToPolygonMesh(
     std::shared_ptr<std::vector<pcl::Vertices> > triangles,
     const bool& check_duplicates_full = false);
 
+/*! \brief Convert a voxblox mesh block to a polygon mesh, finding duplicated
+ * vertices with a hash of the vertex positions instead of a scan of vertices
+ *  - mesh_block: voxblox mesh block input
+ *  - vertices: pointcloud of generated vertices
+ *  - msg_vertex_map: mapping from msg (mesh block) index to vertex index
+ *  - triangles: vector of triplet indices inidicating the connections
+ *  - vertex_positions: positions of the vertices to check for duplicates,
+ * updated with the added vertices
+ */
+void VoxbloxMeshBlockToPolygonMesh(
+    const voxblox_msgs::MeshBlock& mesh_block,
+    float block_edge_length,
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr vertices,
+    std::shared_ptr<std::map<size_t, size_t> > msg_vertex_map,
+    std::shared_ptr<std::vector<pcl::Vertices> > triangles,
+    VertexPositionMap* vertex_positions);
+
 /*! \brief Convert a voxblox mesh ~ consisted of many mesh blocks, to a polygon
- * mesh
+ * mesh. The blocks are converted in parallel and then merged, removing the
+ * vertices duplicated between blocks
  *  - mesh: voxblox mesh msg input
+ *  - num_threads: number of threads converting blocks (0 for one per core)
  */
-pcl::PolygonMesh VoxbloxToPolygonMesh(
-    const voxblox_msgs::Mesh::ConstPtr& voxblox_mesh);
+pcl::PolygonMesh VoxbloxToPolygonMesh(const voxblox_msgs::Mesh::ConstPtr& voxblox_mesh,
+                                      size_t num_threads = 0);
 
 /*! \brief Convert a pcl point to a voxblox longindex type for voxblox cell
  * hashing
@@ -16,8 +16,12 @@
 #include <ros/console.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
 #include <numeric>
+#include <stdexcept>
+#include <thread>
 
 #include "kimera_pgmo/PclMeshTraits.h"
 
@@ -25,11 +29,77 @@ using pcl::PolygonMesh;
 
 namespace kimera_pgmo {
 
+namespace {
+
+// FNV-1a over 64-bit words (the trailing bytes are zero padded)
+uint64_t hashBytes(const void* data, size_t num_bytes, uint64_t hash) {
+  constexpr uint64_t kPrime = 1099511628211ull;
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < num_bytes; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    std::memcpy(&word, bytes + i, std::min(sizeof(uint64_t), num_bytes - i));
+    hash = (hash ^ word) * kPrime;
+  }
+  return hash;
+}
+
+uint64_t hashMesh(const pcl::PolygonMesh& mesh,
+                  const std::vector<Timestamp>& stamps,
+                  const std::vector<int>& graph_indices) {
+  uint64_t hash = 14695981039346656037ull;
+  hash = hashBytes(mesh.cloud.data.data(), mesh.cloud.data.size(), hash);
+  hash = hashBytes(stamps.data(), stamps.size() * sizeof(Timestamp), hash);
+  hash = hashBytes(graph_indices.data(), graph_indices.size() * sizeof(int), hash);
+  for (const auto& polygon : mesh.polygons) {
+    const auto& vertices = polygon.vertices;
+    const uint64_t num_vertices = vertices.size();
+    hash = hashBytes(&num_vertices, sizeof(num_vertices), hash);
+    hash = hashBytes(vertices.data(), vertices.size() * sizeof(vertices[0]), hash);
+  }
+  return hash;
+}
+
+// Whether a node moved more than a translation or rotation tolerance
+bool poseMoved(const gtsam::Pose3& before,
+               const gtsam::Pose3& after,
+               double translation_tol,
+               double rotation_tol) {
+  const double translation = (after.translation() - before.translation()).norm();
+  const double rotation =
+      gtsam::Rot3::Logmap(before.rotation().between(after.rotation())).norm();
+  return translation > translation_tol || rotation > rotation_tol;
+}
+
+// Between factor of the pose graph that is not odometry (between consecutive
+// nodes of a robot)
+const gtsam::BetweenFactor<gtsam::Pose3>* castLoopClosure(
+    const gtsam::NonlinearFactor::shared_ptr& factor) {
+  auto between = dynamic_cast<const gtsam::BetweenFactor<gtsam::Pose3>*>(factor.get());
+  if (!between) {
+    return nullptr;
+  }
+  const gtsam::Symbol from(between->key1());
+  const gtsam::Symbol to(between->key2());
+  if (!robot_prefix_to_id.count(from.chr()) || !robot_prefix_to_id.count(to.chr())) {
+    return nullptr;
+  }
+  if (from.chr() == to.chr() && to.index() == from.index() + 1) {
+    return nullptr;
+  }
+  return between;
+}
+
+}  // namespace
+
 DeformationGraph::DeformationGraph()
     : verbose_(true),
       pgo_(nullptr),
+      estimate_converged_(false),
+      converged_num_factors_(0),
       force_recalculate_(true),
-      recalculate_vertices_(false) {}
+      recalculate_vertices_(false),
+      region_translation_tol_(0.0),
+      region_rotation_tol_(0.0) {}
 DeformationGraph::~DeformationGraph() {}
 
 bool DeformationGraph::initialize(const KimeraRPGO::RobustSolverParams& params) {
@@ -67,7 +137,7 @@ void DeformationGraph::addNodeValence(const gtsam::Key& key,
     }
     const gtsam::Pose3& node_pose = pg_initial_poses_[prefix].at(idx);
     const gtsam::Pose3 vertex_pose(gtsam::Rot3(),
-                                   vertex_positions_[valence_prefix].at(v));
+                                   control_points_[valence_prefix].position(v));
 
     // Define noise. Hardcoded for now
     static const gtsam::SharedNoiseModel& noise =
@@ -97,7 +167,7 @@ void DeformationGraph::addTempNodeValence(const gtsam::Key& key,
 
     const gtsam::Pose3& node_pose = temp_pg_initial_poses_.at(key);
     const gtsam::Pose3 vertex_pose(gtsam::Rot3(),
-                                   vertex_positions_[valence_prefix].at(v));
+                                   control_points_[valence_prefix].position(v));
 
     // Define noise. Hardcoded for now
     static const gtsam::SharedNoiseModel& noise =
@@ -148,6 +218,7 @@ void DeformationGraph::addNodeMeasurements(
       }
     } else {
       values_.update(keyed_pose.first, keyed_pose.second);
+      values_version_++;
     }
     gtsam::Vector6 variances;
     variances.head<3>().setConstant(1e-02 * variance);
@@ -204,10 +275,13 @@ void DeformationGraph::addNewBetween(const gtsam::Key& key_from,
       gtsam::noiseModel::Diagonal::Variances(variances);
   new_factors_.add(gtsam::BetweenFactor<gtsam::Pose3>(key_from, key_to, meas, noise));
 
-  // if it's a loop closure factor
+  // if it's a loop closure factor (the region of influence of the optimization
+  // is deformed instead if enabled)
   if (key_to != key_from + 1) {
     ROS_INFO("DeformationGraph: Added loop closure. ");
-    recalculate_vertices_ = true;
+    if (region_translation_tol_ <= 0.0) {
+      recalculate_vertices_ = true;
+    }
   }
   return;
 }
@@ -303,42 +377,14 @@ void DeformationGraph::addNewMeshEdgesAndNodes(
   // Iterate and add the new mesh nodes not yet in graph
   // Note that the keys are in increasing order by construction from gtsam
   for (auto k : mesh_nodes.keys()) {
-    char node_prefix = gtsam::Symbol(k).chr();
-    size_t node_idx = gtsam::Symbol(k).index();
+    const gtsam::Symbol node_symb(k);
     const gtsam::Pose3& node_pose = mesh_nodes.at<gtsam::Pose3>(k);
-    try {
-      if (node_idx > vertex_positions_.at(node_prefix).size()) {
-        ROS_ERROR_STREAM(
-            "Adding new mesh edges and nodes: node index does not match index "
-            "in vertex position vector. Likely to have dropped packets from "
-            "frontend. "
-            << node_idx << " vs. " << vertex_positions_.at(node_prefix).size());
-        while (vertex_positions_.at(node_prefix).size() < node_idx) {
-          // Place at inifinity to ignore
-          vertex_positions_[node_prefix].push_back(gtsam::Point3(0, 0, 0));
-          vertex_stamps_[node_prefix].push_back(node_stamps.at(k));
-        }
-      }
-      if (node_idx == vertex_positions_.at(node_prefix).size()) {
-        // Only add nodes that has not previously been added
-        vertex_positions_[node_prefix].push_back(node_pose.translation());
-        vertex_stamps_[node_prefix].push_back(node_stamps.at(k));
-        new_mesh_nodes.insert(k, node_pose);
-        added_indices->push_back(node_idx);
-        added_index_stamps->push_back(node_stamps.at(k));
-      }
-    } catch (const std::out_of_range& e) {
-      if (verbose_) {
-        ROS_INFO_STREAM("New prefix "
-                        << node_prefix
-                        << " detected when adding new mesh edges and nodes. ");
-      }
-      vertex_positions_[node_prefix] = std::vector<gtsam::Point3>();
-      vertex_stamps_[node_prefix] = std::vector<Timestamp>();
-      vertex_positions_[node_prefix].push_back(node_pose.translation());
-      vertex_stamps_[node_prefix].push_back(node_stamps.at(k));
+    if (addMeshNode(node_symb.chr(),
+                    node_symb.index(),
+                    node_pose.translation(),
+                    node_stamps.at(k))) {
       new_mesh_nodes.insert(k, node_pose);
-      added_indices->push_back(node_idx);
+      added_indices->push_back(node_symb.index());
       added_index_stamps->push_back(node_stamps.at(k));
     }
   }
@@ -350,8 +396,8 @@ void DeformationGraph::addNewMeshEdgesAndNodes(
   for (auto e : mesh_edges) {
     const gtsam::Symbol& from = gtsam::Symbol(e.first);
     const gtsam::Symbol& to = gtsam::Symbol(e.second);
-    if (from.index() >= vertex_positions_.at(from.chr()).size() ||
-        to.index() >= vertex_positions_.at(to.chr()).size())
+    if (from.index() >= control_points_.at(from.chr()).size() ||
+        to.index() >= control_points_.at(to.chr()).size())
       continue;
     if ((!values_.exists(from) && !new_values_.exists(from) &&
          !new_mesh_nodes.exists(from)) ||
@@ -370,6 +416,101 @@ void DeformationGraph::addNewMeshEdgesAndNodes(
   new_values_.insert(new_mesh_nodes);
 }
 
+void DeformationGraph::addNewMeshEdgesAndNodes(
+    const KimeraPgmoMeshGraph& mesh_graph,
+    std::vector<size_t>* added_indices,
+    std::vector<Timestamp>* added_index_stamps,
+    double variance) {
+  const size_t num_nodes = mesh_graph.node_indices.size();
+  if (mesh_graph.node_positions.size() != 3 * num_nodes ||
+      mesh_graph.node_stamps.size() != num_nodes || mesh_graph.edges.size() % 2 != 0) {
+    ROS_ERROR("Adding new mesh edges and nodes: inconsistent array sizes in mesh "
+              "graph msg.");
+    return;
+  }
+
+  const char prefix = GetVertexPrefix(mesh_graph.robot_id);
+  gtsam::Values new_mesh_nodes;
+  for (size_t i = 0; i < num_nodes; ++i) {
+    const float* position = &mesh_graph.node_positions[3 * i];
+    const gtsam::Point3 node_pos(position[0], position[1], position[2]);
+    const size_t node_idx = mesh_graph.node_indices[i];
+    if (addMeshNode(prefix, node_idx, node_pos, mesh_graph.node_stamps[i])) {
+      new_mesh_nodes.insert(gtsam::Symbol(prefix, node_idx),
+                            gtsam::Pose3(gtsam::Rot3(), node_pos));
+      added_indices->push_back(node_idx);
+      added_index_stamps->push_back(mesh_graph.node_stamps[i]);
+    }
+  }
+
+  const auto control_points = control_points_.find(prefix);
+  if (control_points == control_points_.end()) {
+    return;
+  }
+
+  static const gtsam::SharedNoiseModel& edge_noise =
+      gtsam::noiseModel::Isotropic::Variance(3, variance);
+  gtsam::NonlinearFactorGraph new_mesh_factors;
+  for (size_t i = 0; i + 1 < mesh_graph.edges.size(); i += 2) {
+    const size_t from_idx = mesh_graph.edges[i];
+    const size_t to_idx = mesh_graph.edges[i + 1];
+    if (from_idx >= control_points->second.size() ||
+        to_idx >= control_points->second.size()) {
+      continue;
+    }
+    const gtsam::Symbol from(prefix, from_idx);
+    const gtsam::Symbol to(prefix, to_idx);
+    if ((!values_.exists(from) && !new_values_.exists(from) &&
+         !new_mesh_nodes.exists(from)) ||
+        (!values_.exists(to) && !new_values_.exists(to) && !new_mesh_nodes.exists(to)))
+      continue;
+    const gtsam::Pose3 pose_from(gtsam::Rot3(),
+                                 control_points->second.position(from_idx));
+    const DeformationEdgeFactor new_edge(
+        from, to, pose_from, control_points->second.position(to_idx), edge_noise);
+    new_mesh_factors.add(new_edge);
+    consistency_factors_.add(new_edge);
+  }
+
+  new_factors_.add(new_mesh_factors);
+  new_values_.insert(new_mesh_nodes);
+}
+
+bool DeformationGraph::addMeshNode(char prefix,
+                                   size_t index,
+                                   const gtsam::Point3& position,
+                                   Timestamp stamp) {
+  auto control_points = control_points_.find(prefix);
+  if (control_points == control_points_.end()) {
+    if (verbose_) {
+      ROS_INFO_STREAM("New prefix " << prefix
+                                    << " detected when adding new mesh edges and "
+                                       "nodes. ");
+    }
+    control_points_[prefix].push_back(position, stamp);
+    return true;
+  }
+
+  ControlPointStore& store = control_points->second;
+  if (index > store.size()) {
+    ROS_ERROR_STREAM(
+        "Adding new mesh edges and nodes: node index does not match index "
+        "in vertex position vector. Likely to have dropped packets from "
+        "frontend. "
+        << index << " vs. " << store.size());
+    while (store.size() < index) {
+      // Place at inifinity to ignore
+      store.push_back(gtsam::Point3(0, 0, 0), stamp);
+    }
+  }
+  if (index != store.size()) {
+    // Only add nodes that has not previously been added
+    return false;
+  }
+  store.push_back(position, stamp);
+  return true;
+}
+
 void DeformationGraph::addNewNode(const gtsam::Key& key,
                                   const gtsam::Pose3& initial_pose,
                                   bool add_prior,
@@ -378,7 +519,7 @@ void DeformationGraph::addNewNode(const gtsam::Key& key,
   const char& prefix = gtsam::Symbol(key).chr();
   const size_t& idx = gtsam::Symbol(key).index();
   if (idx == 0) {
-    pg_initial_poses_[prefix] = std::vector<gtsam::Pose3>{initial_pose};
+    pg_initial_poses_[prefix] = std::deque<gtsam::Pose3>{initial_pose};
   } else {
     if (idx != pg_initial_poses_[prefix].size()) {
       ROS_ERROR("DeformationGraph: Nodes skipped in pose graph nodes. ");
@@ -464,7 +605,7 @@ void DeformationGraph::addNewTempNodesValences(
 
       const gtsam::Pose3& node_pose = initial_poses[i];
       const gtsam::Pose3 vertex_pose(gtsam::Rot3(),
-                                     vertex_positions_[valence_prefix].at(v));
+                                     control_points_[valence_prefix].position(v));
 
       // Define noise. Hardcoded for now
       static const gtsam::SharedNoiseModel& noise =
@@ -487,8 +628,11 @@ void DeformationGraph::addNewTempNodesValences(
 
 void DeformationGraph::removePriorsWithPrefix(const char& prefix) {
   pgo_->removePriorFactorsWithPrefix(prefix);
-  values_ = pgo_->calculateEstimate();
+  gtsam::Values estimate = pgo_->calculateEstimate();
+  setEstimate(estimate);
   nfg_ = pgo_->getFactorsUnsafe();
+  gnc_weights_ = pgo_->getGncWeights();
+  estimate_converged_ = false;
   recalculate_vertices_ = true;
   return;
 }
@@ -502,6 +646,59 @@ pcl::PolygonMesh DeformationGraph::deformMesh(const pcl::PolygonMesh& original_m
   return deformMesh(original_mesh, stamps, graph_indices, prefix, values_, k, tol_t);
 }
 
+DeformedMeshConstPtr DeformationGraph::deformMeshShared(
+    const pcl::PolygonMesh& original_mesh,
+    const std::vector<Timestamp>& stamps,
+    const std::vector<int>& graph_indices,
+    char prefix,
+    size_t k,
+    double tol_t,
+    uint64_t mesh_version) {
+  const bool hashed_version = mesh_version == 0;
+  if (hashed_version) {
+    mesh_version = hashMesh(original_mesh, stamps, graph_indices);
+  }
+  const auto control_points = control_points_.find(prefix);
+  const size_t num_control_points =
+      control_points == control_points_.end() ? 0 : control_points->second.size();
+
+  // a forced recalculation changes the vertices of an incremental deformation
+  const auto cached = deformed_mesh_cache_.find(prefix);
+  if (cached != deformed_mesh_cache_.end() &&
+      (cached->second.full || !recalculate_vertices_)) {
+    const CachedDeformedMesh& entry = cached->second;
+    if (entry.values_version == values_version_ &&
+        entry.mesh_version == mesh_version &&
+        entry.hashed_version == hashed_version &&
+        entry.num_control_points == num_control_points && entry.k == k &&
+        entry.tol_t == tol_t) {
+      // no vertex was deformed again
+      const size_t num_vertices =
+          original_mesh.cloud.width * original_mesh.cloud.height;
+      DeformedVertices& deformed = last_deformed_[prefix];
+      deformed.full = false;
+      deformed.moved.clear();
+      deformed.start = num_vertices;
+      deformed.num_vertices = num_vertices;
+      deformed.sequence++;
+      return entry.mesh;
+    }
+  }
+
+  DeformedMeshConstPtr mesh = std::make_shared<const pcl::PolygonMesh>(deformMesh(
+      original_mesh, stamps, graph_indices, prefix, values_, k, tol_t));
+  CachedDeformedMesh& entry = deformed_mesh_cache_[prefix];
+  entry.values_version = values_version_;
+  entry.mesh_version = mesh_version;
+  entry.hashed_version = hashed_version;
+  entry.num_control_points = num_control_points;
+  entry.k = k;
+  entry.tol_t = tol_t;
+  entry.full = getLastDeformedVertices(prefix).full;
+  entry.mesh = mesh;
+  return mesh;
+}
+
 pcl::PolygonMesh DeformationGraph::deformMesh(const pcl::PolygonMesh& original_mesh,
                                               const std::vector<Timestamp>& stamps,
                                               const std::vector<int>& graph_indices,
@@ -614,34 +811,163 @@ void DeformationGraph::getGtsamTempFactorsFiltered(gtsam::NonlinearFactorGraph*
 }
 
 void DeformationGraph::optimize() {
+  AllocationZone allocation_zone("DeformationGraph::optimize");
+  const bool track_region = region_translation_tol_ > 0.0;
   pgo_->forceUpdate(new_factors_, new_values_);
-  if (force_recalculate_) {
+  if (force_recalculate_ && !track_region) {
     recalculate_vertices_ = true;
   }
-  values_ = pgo_->calculateEstimate();
+  gtsam::Values estimate = pgo_->calculateEstimate();
+  if (track_region) {
+    last_region_ = computeRegionOfInfluence(
+        values_, estimate, region_translation_tol_, region_rotation_tol_);
+  }
+  setEstimate(estimate);
   nfg_ = pgo_->getFactorsUnsafe();
   gnc_weights_ = pgo_->getGncWeights();
   temp_values_ = pgo_->getTempValues();
   temp_nfg_ = pgo_->getTempFactorsUnsafe();
   new_factors_ = gtsam::NonlinearFactorGraph();
   new_values_ = gtsam::Values();
+  estimate_converged_ = retireRejectedLoopClosures();
+  converged_num_factors_ = nfg_.size() + temp_nfg_.size();
+  deformPointSets();
+}
+
+bool DeformationGraph::retireRejectedLoopClosures() {
+  if (retire_after_rejections_ == 0 ||
+      static_cast<size_t>(gnc_weights_.size()) != nfg_.size()) {
+    return true;
+  }
+
+  gtsam::NonlinearFactorGraph active_factors;
+  std::vector<double> active_weights;
+  std::map<std::pair<gtsam::Key, gtsam::Key>, size_t> rejections;
+  for (size_t i = 0; i < nfg_.size(); i++) {
+    const double weight = gnc_weights_(i);
+    const auto loop_closure = castLoopClosure(nfg_[i]);
+    // accepted loop closures start counting again from zero
+    if (!loop_closure || weight >= retirement_weight_threshold_) {
+      active_factors.push_back(nfg_[i]);
+      active_weights.push_back(weight);
+      continue;
+    }
+
+    const auto keys = std::make_pair(loop_closure->key1(), loop_closure->key2());
+    const auto prev = loop_closure_rejections_.find(keys);
+    const size_t num_rejections =
+        (prev == loop_closure_rejections_.end() ? 0 : prev->second) + 1;
+    if (num_rejections < retire_after_rejections_) {
+      rejections[keys] = num_rejections;
+      active_factors.push_back(nfg_[i]);
+      active_weights.push_back(weight);
+      continue;
+    }
+
+    RetiredLoopClosure retired;
+    retired.factor = nfg_[i];
+    retired.num_rejections = num_rejections;
+    retired.weight = weight;
+    retired_loop_closures_.push_back(retired);
+    if (verbose_) {
+      ROS_INFO_STREAM("DeformationGraph: retired loop closure "
+                      << gtsam::DefaultKeyFormatter(keys.first) << " - "
+                      << gtsam::DefaultKeyFormatter(keys.second) << " (weight "
+                      << weight << " in " << num_rejections << " optimizations)");
+    }
+  }
+  loop_closure_rejections_.swap(rejections);
+  if (active_factors.size() == nfg_.size()) {
+    return true;
+  }
+
+  // RPGO cannot remove single factors: the solver is rebuilt without the retired
+  // loop closures, starting from the current estimate (as when loading a graph).
+  // Their weights were close to zero, so the estimate is still converged.
+  gtsam::Values values = values_;
+  for (const auto& key_value : temp_values_) {
+    if (values.exists(key_value.key)) {
+      values.erase(key_value.key);
+    }
+  }
+  pgo_.reset(new KimeraRPGO::RobustSolver(pgo_params_));
+  pgo_->updateTempFactorsValues(temp_nfg_, temp_values_);
+  pgo_->update(active_factors, values, false);
+  nfg_ = pgo_->getFactorsUnsafe();
+  temp_nfg_ = pgo_->getTempFactorsUnsafe();
+  temp_values_ = pgo_->getTempValues();
+  if (nfg_.size() != active_factors.size()) {
+    // the rebuilt solver changed the factors, so the estimate has to be optimized
+    // again before it is a converged solution
+    gnc_weights_ = pgo_->getGncWeights();
+    return false;
+  }
+  gnc_weights_ =
+      Eigen::Map<const gtsam::Vector>(active_weights.data(), active_weights.size());
+  return true;
+}
+
+bool DeformationGraph::readmitLoopClosure(const gtsam::Key& key_from,
+                                          const gtsam::Key& key_to) {
+  for (auto it = retired_loop_closures_.begin(); it != retired_loop_closures_.end();
+       ++it) {
+    const auto& keys = it->factor->keys();
+    if (keys.size() == 2 && keys[0] == key_from && keys[1] == key_to) {
+      new_factors_.push_back(it->factor);
+      retired_loop_closures_.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t DeformationGraph::readmitLoopClosures() {
+  const size_t num_readmitted = retired_loop_closures_.size();
+  for (const auto& retired : retired_loop_closures_) {
+    new_factors_.push_back(retired.factor);
+  }
+  retired_loop_closures_.clear();
+  return num_readmitted;
+}
+
+bool DeformationGraph::hasConvergedEstimate() const {
+  if (!estimate_converged_ || !new_factors_.empty() || !new_values_.empty()) {
+    return false;
+  }
+  // temporary factors are added to the solver directly
+  return nfg_.size() + temp_nfg_.size() == converged_num_factors_;
 }
 
 void DeformationGraph::update() {
+  AllocationZone allocation_zone("DeformationGraph::update");
   pgo_->update(new_factors_, new_values_);
-  values_ = pgo_->calculateEstimate();
+  gtsam::Values estimate = pgo_->calculateEstimate();
+  setEstimate(estimate);
   nfg_ = pgo_->getFactorsUnsafe();
   gnc_weights_ = pgo_->getGncWeights();
   temp_values_ = pgo_->getTempValues();
   temp_nfg_ = pgo_->getTempFactorsUnsafe();
   new_factors_ = gtsam::NonlinearFactorGraph();
   new_values_ = gtsam::Values();
+  estimate_converged_ = false;
+  deformPointSets();
 }
 
 void DeformationGraph::updateValues(const gtsam::Values& updates) {
   pgo_->updateValues(updates);
-  values_ = pgo_->calculateEstimate();
+  gtsam::Values estimate = pgo_->calculateEstimate();
+  setEstimate(estimate);
   temp_values_ = pgo_->getTempValues();
+  estimate_converged_ = false;
+  deformPointSets();
+}
+
+void DeformationGraph::setEstimate(gtsam::Values& estimate) {
+  // re-optimizing an unchanged graph keeps the deformed meshes valid
+  if (!estimate.equals(values_, 1.0e-9)) {
+    values_version_++;
+  }
+  values_.swap(estimate);
 }
 
 void DeformationGraph::setParams(const KimeraRPGO::RobustSolverParams& params) {
@@ -649,6 +975,284 @@ void DeformationGraph::setParams(const KimeraRPGO::RobustSolverParams& params) {
   pgo_.reset(new KimeraRPGO::RobustSolver(pgo_params_));
 }
 
+size_t RegionOfInfluence::numMovedControlPoints() const {
+  size_t num_moved = 0;
+  for (const auto& prefix_indices : moved_control_points) {
+    num_moved += prefix_indices.second.size();
+  }
+  return num_moved;
+}
+
+RegionOfInfluence computeRegionOfInfluence(const gtsam::Values& before,
+                                           const gtsam::Values& after,
+                                           double translation_tol,
+                                           double rotation_tol) {
+  RegionOfInfluence region;
+  for (const auto& key_value : after) {
+    const gtsam::Symbol key(key_value.key);
+    const bool is_control_point = vertex_prefix_to_id.count(key.chr()) > 0;
+    if (is_control_point) {
+      region.num_control_points++;
+    } else {
+      region.num_poses++;
+    }
+
+    bool moved = true;
+    if (before.exists(key)) {
+      moved = poseMoved(before.at<gtsam::Pose3>(key),
+                        after.at<gtsam::Pose3>(key),
+                        translation_tol,
+                        rotation_tol);
+    }
+    if (!moved) {
+      continue;
+    }
+
+    if (is_control_point) {
+      region.moved_control_points[key.chr()].push_back(key.index());
+    } else {
+      region.moved_poses.push_back(key);
+    }
+  }
+  return region;
+}
+
+std::vector<size_t> DeformedVertices::indices() const {
+  std::vector<size_t> all(size());
+  if (full) {
+    std::iota(all.begin(), all.end(), 0);
+    return all;
+  }
+  std::copy(moved.begin(), moved.end(), all.begin());
+  std::iota(all.begin() + moved.size(), all.end(), start);
+  return all;
+}
+
+void DeformationGraph::setRegionOfInfluence(double translation_tol,
+                                            double rotation_tol) {
+  region_translation_tol_ = translation_tol;
+  region_rotation_tol_ = rotation_tol;
+}
+
+PointSetHandle DeformationGraph::registerPointSet(
+    char prefix,
+    const std::vector<gtsam::Point3>& points,
+    const std::vector<Timestamp>& stamps,
+    size_t k,
+    double tol_t) {
+  const PointSetHandle handle = next_point_set_handle_++;
+  RegisteredPointSet& point_set = point_sets_[handle];
+  point_set.prefix = prefix;
+  point_set.k = k;
+  point_set.tol_t = tol_t;
+  point_set.points = points;
+  point_set.stamps = stamps;
+  updatePointSetWeights(point_set);
+  point_set.deformed.resize(points.size());
+  deformation::interpolatePoints(
+      point_set.weights, points, prefix, values_, 0, points.size(), point_set.deformed);
+  return handle;
+}
+
+bool DeformationGraph::removePointSet(PointSetHandle handle) {
+  return point_sets_.erase(handle) > 0;
+}
+
+const std::vector<gtsam::Point3>& DeformationGraph::getDeformedPointSet(
+    PointSetHandle handle) const {
+  const auto iter = point_sets_.find(handle);
+  if (iter == point_sets_.end()) {
+    throw std::out_of_range("unknown point set " + std::to_string(handle));
+  }
+  return iter->second.deformed;
+}
+
+void DeformationGraph::updatePointSetWeights(RegisteredPointSet& point_set) const {
+  const auto control_points = control_points_.find(point_set.prefix);
+  if (control_points == control_points_.end()) {
+    point_set.weights = deformation::InterpolationWeights();
+    point_set.weights.offsets.resize(point_set.points.size() + 1, 0);
+    return;
+  }
+
+  if (point_set.weights.size() == point_set.points.size()) {
+    // only the points without control points are interpolated again
+    deformation::completeInterpolationWeights(point_set.weights,
+                                              point_set.points,
+                                              point_set.stamps,
+                                              point_set.prefix,
+                                              control_points->second,
+                                              values_,
+                                              point_set.k,
+                                              point_set.tol_t);
+    return;
+  }
+
+  point_set.weights = deformation::computeInterpolationWeights(point_set.points,
+                                                               point_set.stamps,
+                                                               point_set.prefix,
+                                                               control_points->second,
+                                                               values_,
+                                                               point_set.k,
+                                                               point_set.tol_t);
+  if (point_set.weights.size() != point_set.points.size()) {
+    point_set.weights.offsets.assign(point_set.points.size() + 1, 0);
+  }
+}
+
+void DeformationGraph::deformPointSets() {
+  if (point_sets_.empty()) {
+    return;
+  }
+
+  // Points registered before there were enough control points around them are
+  // interpolated again (keeping the weights of the others), then the points of all
+  // the sets are split in chunks
+  constexpr size_t kChunkSize = 4096;
+  struct PointRange {
+    RegisteredPointSet* point_set;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<PointRange> ranges;
+  for (auto& handle_set : point_sets_) {
+    RegisteredPointSet& point_set = handle_set.second;
+    if (!point_set.weights.complete()) {
+      updatePointSetWeights(point_set);
+    }
+
+    point_set.deformed.resize(point_set.points.size());
+    for (size_t begin = 0; begin < point_set.points.size(); begin += kChunkSize) {
+      ranges.push_back(
+          {&point_set, begin, std::min(begin + kChunkSize, point_set.points.size())});
+    }
+  }
+
+  const size_t max_threads =
+      point_set_threads_ > 0 ? point_set_threads_ : std::thread::hardware_concurrency();
+  const size_t num_threads =
+      std::max<size_t>(1, std::min<size_t>(ranges.size(), max_threads));
+  std::atomic<size_t> next_range(0);
+  auto worker = [&]() {
+    for (size_t r = next_range++; r < ranges.size(); r = next_range++) {
+      const PointRange& range = ranges[r];
+      deformation::interpolatePoints(range.point_set->weights,
+                                     range.point_set->points,
+                                     range.point_set->prefix,
+                                     values_,
+                                     range.begin,
+                                     range.end,
+                                     range.point_set->deformed);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+const DeformedVertices& DeformationGraph::getLastDeformedVertices(char prefix) const {
+  static const DeformedVertices empty;
+  const auto iter = last_deformed_.find(prefix);
+  return iter == last_deformed_.end() ? empty : iter->second;
+}
+
+bool DeformationGraph::findMovedVertices(char prefix,
+                                         size_t num_cached,
+                                         const gtsam::Values& values,
+                                         std::vector<bool>* moved_control_points,
+                                         std::vector<size_t>* moved) const {
+  const auto links_iter = vertex_links_.find(prefix);
+  const auto deformed_iter = deformed_control_points_.find(prefix);
+  if (links_iter == vertex_links_.end() || !links_iter->second.valid ||
+      links_iter->second.offsets.size() != num_cached + 1 ||
+      deformed_iter == deformed_control_points_.end()) {
+    return false;
+  }
+
+  // control points unknown when the vertices were deformed are not linked to
+  // any cached vertex
+  const DeformedControlPoints& deformed = deformed_iter->second;
+  auto& moved_points = *moved_control_points;
+  moved_points.assign(deformed.poses.size(), false);
+  bool any_moved = false;
+  for (size_t i = 0; i < deformed.poses.size(); i++) {
+    const gtsam::Symbol key(prefix, i);
+    if (!deformed.known[i] || !values.exists(key)) {
+      continue;
+    }
+    moved_points[i] = poseMoved(deformed.poses[i],
+                                values.at<gtsam::Pose3>(key),
+                                region_translation_tol_,
+                                region_rotation_tol_);
+    any_moved = any_moved || moved_points[i];
+  }
+  if (!any_moved) {
+    return true;
+  }
+
+  const auto& links = links_iter->second;
+  for (size_t i = 0; i < num_cached; i++) {
+    for (size_t j = links.offsets[i]; j < links.offsets[i + 1]; j++) {
+      const size_t control_point = links.control_points[j];
+      if (control_point < moved_points.size() && moved_points[control_point]) {
+        moved->push_back(i);
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+void DeformationGraph::updateDeformedControlPoints(
+    char prefix,
+    const gtsam::Values& values,
+    bool full,
+    const std::vector<bool>& moved_control_points) {
+  DeformedControlPoints& deformed = deformed_control_points_[prefix];
+  const size_t num_control_points = control_points_.at(prefix).size();
+  deformed.poses.resize(num_control_points);
+  deformed.known.resize(num_control_points, false);
+  for (size_t i = 0; i < num_control_points; i++) {
+    const bool moved = i < moved_control_points.size() && moved_control_points[i];
+    if (!full && !moved && deformed.known[i]) {
+      continue;
+    }
+    const gtsam::Symbol key(prefix, i);
+    deformed.known[i] = values.exists(key);
+    if (deformed.known[i]) {
+      deformed.poses[i] = values.at<gtsam::Pose3>(key);
+    }
+  }
+}
+
+void DeformationGraph::updateVertexLinks(char prefix,
+                                         size_t start_idx,
+                                         const std::vector<std::set<size_t>>& links,
+                                         bool valid) {
+  ControlPointLinks& vertex_links = vertex_links_[prefix];
+  if (start_idx == 0) {
+    vertex_links = ControlPointLinks();
+  } else if (start_idx >= vertex_links.offsets.size()) {
+    // vertices before start_idx were never linked
+    vertex_links.valid = false;
+    vertex_links.offsets.resize(start_idx + 1, vertex_links.offsets.back());
+  }
+  vertex_links.valid = vertex_links.valid && valid;
+  vertex_links.offsets.resize(start_idx + 1);
+  vertex_links.control_points.resize(vertex_links.offsets.back());
+  for (const auto& control_points : links) {
+    vertex_links.control_points.insert(vertex_links.control_points.end(),
+                                       control_points.begin(),
+                                       control_points.end());
+    vertex_links.offsets.push_back(vertex_links.control_points.size());
+  }
+}
+
 void fillDeformationGraphMarkers(const DeformationGraph& graph,
                                  const ros::Time& stamp,
                                  visualization_msgs::Marker& mesh_mesh_viz,
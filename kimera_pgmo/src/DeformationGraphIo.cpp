@@ -8,6 +8,9 @@
 #include <gtsam/slam/PriorFactor.h>
 
 #include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
 #include <stdexcept>
 
 #include "kimera_pgmo/DeformationGraph.h"
@@ -19,11 +22,32 @@ template <typename T, typename Ptr>
 const T* cast_to_ptr(const Ptr& ptr) {
   return dynamic_cast<const T*>(ptr.get());
 }
+
+// Digits needed for saved doubles to load back unchanged, so that a converged
+// estimate is still converged after loading
+constexpr int kSavePrecision = std::numeric_limits<double>::max_digits10;
+
+// GNC weight above which a factor is an inlier
+constexpr double kInlierWeight = 0.5;
+
+// FNV-1a over the factor lines of a file, to detect whether the factors changed
+// since the solver state was saved
+constexpr uint64_t kFactorHashSeed = 14695981039346656037ull;
+
+void hashFactorLine(const std::string& line, uint64_t* hash) {
+  for (const char c : line) {
+    *hash ^= static_cast<uint8_t>(c);
+    *hash *= 1099511628211ull;
+  }
+  // line separator
+  *hash ^= '\n';
+  *hash *= 1099511628211ull;
+}
 }  // namespace
 
 void streamValue(const gtsam::Key& key,
                  const gtsam::Pose3& pose,
-                 std::ofstream& stream) {
+                 std::ostream& stream) {
   const gtsam::Point3 t = pose.translation();
   const auto q = pose.rotation().toQuaternion();
   stream << key << " " << t.x() << " " << t.y() << " " << t.z() << " " << q.x() << " "
@@ -31,7 +55,7 @@ void streamValue(const gtsam::Key& key,
 }
 
 void streamBetweenFactor(const gtsam::BetweenFactor<gtsam::Pose3>& between,
-                         std::ofstream& stream) {
+                         std::ostream& stream) {
   std::string str;
   gtsam::SharedNoiseModel model = between.noiseModel();
   auto gaussianModel = cast_to_ptr<gtsam::noiseModel::Gaussian>(model);
@@ -54,7 +78,7 @@ void streamBetweenFactor(const gtsam::BetweenFactor<gtsam::Pose3>& between,
   }
 }
 
-void streamDedgeFactor(const DeformationEdgeFactor& dedge, std::ofstream& stream) {
+void streamDedgeFactor(const DeformationEdgeFactor& dedge, std::ostream& stream) {
   std::string str;
   gtsam::SharedNoiseModel model = dedge.noiseModel();
   auto gaussianModel = cast_to_ptr<gtsam::noiseModel::Gaussian>(model);
@@ -79,7 +103,7 @@ void streamDedgeFactor(const DeformationEdgeFactor& dedge, std::ofstream& stream
 }
 
 void streamPriorFactor(const gtsam::PriorFactor<gtsam::Pose3>& prior,
-                       std::ofstream& stream) {
+                       std::ostream& stream) {
   std::string str;
   gtsam::SharedNoiseModel model = prior.noiseModel();
   auto gaussianModel = cast_to_ptr<gtsam::noiseModel::Gaussian>(model);
@@ -102,20 +126,20 @@ void streamPriorFactor(const gtsam::PriorFactor<gtsam::Pose3>& prior,
 }
 
 void streamVertices(const char& prefix,
-                    const std::vector<gtsam::Point3>& positions,
-                    const std::vector<Timestamp>& stamps,
-                    std::ofstream& stream) {
-  assert(positions.size() == stamps.size());
-  for (size_t index = 0; index < positions.size(); index++) {
+                    const ControlPointStore& control_points,
+                    std::ostream& stream) {
+  for (size_t index = 0; index < control_points.size(); index++) {
     gtsam::Key key = gtsam::Symbol(prefix, index);
-    stream << "VERTEX " << key << " " << stamps[index] << " " << positions[index].x()
-           << " " << positions[index].y() << " " << positions[index].z() << std::endl;
+    const gtsam::Point3 position = control_points.position(index);
+    stream << "VERTEX " << key << " " << control_points.stamp(index) << " "
+           << position.x() << " " << position.y() << " " << position.z() << std::endl;
   }
 }
 
 void DeformationGraph::save(const std::string& filename) const {
   std::ofstream stream;
   stream.open(filename);
+  stream << std::setprecision(kSavePrecision);
   // save values
   for (const auto& key_value : values_) {
     const gtsam::Pose3& pose = values_.at<gtsam::Pose3>(key_value.key);
@@ -131,53 +155,81 @@ void DeformationGraph::save(const std::string& filename) const {
     stream << std::endl;
   }
 
-  // save factors
-  for (const auto& factor : nfg_) {
+  // save factors (and hash them, so that the solver state is only used if they
+  // did not change)
+  uint64_t factor_hash = kFactorHashSeed;
+  const bool save_weights = static_cast<size_t>(gnc_weights_.size()) == nfg_.size();
+  std::vector<double> saved_weights;
+  for (size_t i = 0; i < nfg_.size(); i++) {
+    const auto& factor = nfg_[i];
+    std::ostringstream line;
+    line << std::setprecision(kSavePrecision);
     auto between = cast_to_ptr<gtsam::BetweenFactor<gtsam::Pose3>>(factor);
-    if (between) {
-      stream << "BETWEEN ";
-      streamBetweenFactor(*between, stream);
-      stream << std::endl;
-    }
-
     auto dedge = cast_to_ptr<DeformationEdgeFactor>(factor);
-    if (dedge) {
-      stream << "DEDGE ";
-      streamDedgeFactor(*dedge, stream);
-      stream << std::endl;
-    }
-
     auto prior = cast_to_ptr<gtsam::PriorFactor<gtsam::Pose3>>(factor);
-    if (prior) {
-      stream << "PRIOR ";
-      streamPriorFactor(*prior, stream);
-      stream << std::endl;
+    if (between) {
+      line << "BETWEEN ";
+      streamBetweenFactor(*between, line);
+    } else if (dedge) {
+      line << "DEDGE ";
+      streamDedgeFactor(*dedge, line);
+    } else if (prior) {
+      line << "PRIOR ";
+      streamPriorFactor(*prior, line);
+    } else {
+      continue;
+    }
+    hashFactorLine(line.str(), &factor_hash);
+    stream << line.str() << std::endl;
+    if (save_weights) {
+      saved_weights.push_back(gnc_weights_(i));
     }
   }
 
   // save temporary factors
   for (const auto& factor : temp_nfg_) {
+    std::ostringstream line;
+    line << std::setprecision(kSavePrecision);
     auto between = cast_to_ptr<gtsam::BetweenFactor<gtsam::Pose3>>(factor);
+    auto dedge = cast_to_ptr<DeformationEdgeFactor>(factor);
     if (between) {
-      stream << "BETWEEN_TEMP ";
-      streamBetweenFactor(*between, stream);
-      stream << std::endl;
+      line << "BETWEEN_TEMP ";
+      streamBetweenFactor(*between, line);
+    } else if (dedge) {
+      line << "DEDGE_TEMP ";
+      streamDedgeFactor(*dedge, line);
+    } else {
+      continue;
     }
+    hashFactorLine(line.str(), &factor_hash);
+    stream << line.str() << std::endl;
+  }
 
-    auto dedge = cast_to_ptr<DeformationEdgeFactor>(factor);
-    if (dedge) {
-      stream << "DEDGE_TEMP ";
-      streamDedgeFactor(*dedge, stream);
-      stream << std::endl;
+  // save the retired loop closures (not hashed: they are not part of the solve)
+  for (const auto& retired : retired_loop_closures_) {
+    auto between = cast_to_ptr<gtsam::BetweenFactor<gtsam::Pose3>>(retired.factor);
+    if (!between) {
+      continue;
     }
+    stream << "BETWEEN_RETIRED ";
+    streamBetweenFactor(*between, stream);
+    stream << " " << retired.num_rejections << " " << retired.weight << std::endl;
   }
 
   // save the initial positions and timestamps of the mesh vertices
-  for (const auto& pfx_vertices : vertex_positions_) {
-    streamVertices(pfx_vertices.first,
-                   pfx_vertices.second,
-                   vertex_stamps_.at(pfx_vertices.first),
-                   stream);
+  for (const auto& pfx_vertices : control_points_) {
+    streamVertices(pfx_vertices.first, pfx_vertices.second, stream);
+  }
+
+  // save the solver state: whether the values are a converged solution of the
+  // factors above and their GNC weights
+  stream << "STATE " << factor_hash << " " << hasConvergedEstimate() << std::endl;
+  if (!saved_weights.empty()) {
+    stream << "GNC_WEIGHTS";
+    for (const double weight : saved_weights) {
+      stream << " " << weight;
+    }
+    stream << std::endl;
   }
   stream.close();
 }
@@ -194,20 +246,110 @@ gtsam::Key rekey(gtsam::Symbol key, size_t robot_id) {
   return key;
 }
 
-// TODO(Yun) clean up / move to another file
-void DeformationGraph::load(const std::string& filename,
-                            bool include_temp,
-                            bool set_robot_id,
-                            size_t new_robot_id) {
-  gtsam::Values new_vals, new_temp_vals;
-  gtsam::NonlinearFactorGraph new_factors, new_temp_factors;
+bool DeformationGraphFile::merge(const DeformationGraphFile& other) {
+  // gtsam::Values::insert throws on existing keys, so overlaps are rejected first
+  auto has_key = [this](const gtsam::Key& key) {
+    return values.exists(key) || temp_values.exists(key);
+  };
+  for (const auto* other_values : {&other.values, &other.temp_values}) {
+    for (const auto& key_value : *other_values) {
+      if (has_key(key_value.key)) {
+        ROS_ERROR_STREAM("DeformationGraphFile: cannot merge graphs sharing node "
+                         << gtsam::DefaultKeyFormatter(key_value.key));
+        return false;
+      }
+    }
+  }
+  for (const auto& prefix_points : other.control_points) {
+    if (control_points.count(prefix_points.first)) {
+      ROS_ERROR_STREAM("DeformationGraphFile: cannot merge graphs sharing the "
+                       "vertex prefix "
+                       << prefix_points.first);
+      return false;
+    }
+  }
+
+  // the union of converged graphs with disjoint keys is converged
+  if (factors.empty() && values.empty()) {
+    converged = other.converged;
+    gnc_weights = other.gnc_weights;
+  } else {
+    converged = converged && other.converged;
+    if (gnc_weights.size() == 0 || other.gnc_weights.size() == 0) {
+      gnc_weights = gtsam::Vector();
+    } else {
+      gtsam::Vector weights(gnc_weights.size() + other.gnc_weights.size());
+      weights << gnc_weights, other.gnc_weights;
+      gnc_weights = weights;
+    }
+  }
 
+  values.insert(other.values);
+  temp_values.insert(other.temp_values);
+  retired_loop_closures.insert(retired_loop_closures.end(),
+                               other.retired_loop_closures.begin(),
+                               other.retired_loop_closures.end());
+  factors.push_back(other.factors);
+  temp_factors.push_back(other.temp_factors);
+  consistency_factors.push_back(other.consistency_factors);
+  for (const auto& prefix_poses : other.initial_poses) {
+    auto& poses = initial_poses[prefix_poses.first];
+    poses.insert(poses.end(), prefix_poses.second.begin(), prefix_poses.second.end());
+  }
+  temp_initial_poses.insert(other.temp_initial_poses.begin(),
+                            other.temp_initial_poses.end());
+  for (const auto& prefix_points : other.control_points) {
+    control_points[prefix_points.first] = prefix_points.second;
+  }
+  return true;
+}
+
+std::vector<size_t> DeformationGraphFile::inliers() const {
+  std::vector<size_t> indices;
+  for (int i = 0; i < gnc_weights.size(); i++) {
+    if (gnc_weights(i) > kInlierWeight) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
+
+// TODO(Yun) clean up / move to another file
+bool ReadDeformationGraphFile(const std::string& filename,
+                              DeformationGraphFile* graph,
+                              bool include_temp,
+                              bool set_robot_id,
+                              size_t new_robot_id) {
   std::ifstream infile(filename);
+  if (!infile.is_open()) {
+    return false;
+  }
+
+  gtsam::Values& new_vals = graph->values;
+  gtsam::Values& new_temp_vals = graph->temp_values;
+  gtsam::NonlinearFactorGraph& new_factors = graph->factors;
+  gtsam::NonlinearFactorGraph& new_temp_factors = graph->temp_factors;
+  // factors are hashed as they are read, including the skipped temp factors
+  uint64_t factor_hash = kFactorHashSeed;
+  size_t num_factors = 0;
+  bool skipped_temp = false;
+  bool has_state = false;
+  uint64_t saved_hash = 0;
+  bool saved_converged = false;
+  std::vector<double> saved_weights;
   std::string line;
   while (std::getline(infile, line)) {
     std::stringstream ss(line);
     std::string tag;
     ss >> tag;
+    if (tag == "BETWEEN" || tag == "DEDGE" || tag == "PRIOR") {
+      hashFactorLine(line, &factor_hash);
+      num_factors++;
+    } else if (tag == "BETWEEN_TEMP" || tag == "DEDGE_TEMP") {
+      hashFactorLine(line, &factor_hash);
+      skipped_temp |= !include_temp;
+    }
+
     if (tag == "NODE" || tag == "NODE_TEMP") {
       size_t key;
       double x, y, z, qx, qy, qz, qw;
@@ -220,17 +362,14 @@ void DeformationGraph::load(const std::string& filename,
       if (tag == "NODE") {
         new_vals.insert(gtsam_key, pose);
         // TODO this is different from the initial pose before save
-        char node_prefix = gtsam_key.chr();
-        if (pg_initial_poses_.count(node_prefix) == 0) {
-          pg_initial_poses_[node_prefix] = std::vector<gtsam::Pose3>();
-        }
         // Implicit assumption that node is in order
-        pg_initial_poses_[node_prefix].push_back(pose);
+        graph->initial_poses[gtsam_key.chr()].push_back(pose);
       } else if (include_temp) {
         new_temp_vals.insert(gtsam_key, pose);
-        temp_pg_initial_poses_[gtsam_key] = pose;
+        graph->temp_initial_poses[gtsam_key] = pose;
       }
-    } else if (tag == "BETWEEN" || tag == "BETWEEN_TEMP") {
+    } else if (tag == "BETWEEN" || tag == "BETWEEN_TEMP" ||
+               tag == "BETWEEN_RETIRED") {
       size_t key1, key2;
       double x, y, z, qx, qy, qz, qw;
       gtsam::Matrix6 m;
@@ -254,6 +393,12 @@ void DeformationGraph::load(const std::string& filename,
       if (tag == "BETWEEN") {
         new_factors.add(
             gtsam::BetweenFactor<gtsam::Pose3>(gtsam_key1, gtsam_key2, meas, noise));
+      } else if (tag == "BETWEEN_RETIRED") {
+        RetiredLoopClosure retired;
+        retired.factor.reset(new gtsam::BetweenFactor<gtsam::Pose3>(
+            gtsam_key1, gtsam_key2, meas, noise));
+        ss >> retired.num_rejections >> retired.weight;
+        graph->retired_loop_closures.push_back(retired);
       } else if (include_temp) {
         new_temp_factors.add(
             gtsam::BetweenFactor<gtsam::Pose3>(gtsam_key1, gtsam_key2, meas, noise));
@@ -283,7 +428,7 @@ void DeformationGraph::load(const std::string& filename,
       if (tag == "DEDGE") {
         new_factors.add(
             DeformationEdgeFactor(gtsam_key1, gtsam_key2, from_pose, to_point, noise));
-        consistency_factors_.add(
+        graph->consistency_factors.add(
             DeformationEdgeFactor(gtsam_key1, gtsam_key2, from_pose, to_point, noise));
       } else if (include_temp) {
         new_temp_factors.add(
@@ -320,23 +465,94 @@ void DeformationGraph::load(const std::string& filename,
         vertex_prefix = kimera_pgmo::robot_id_to_vertex_prefix.at(new_robot_id);
       }
       size_t vertex_index = vertex_symb.index();
+      auto& control_points = graph->control_points[vertex_prefix];
       if (vertex_index == 0) {
-        vertex_positions_[vertex_prefix] = std::vector<gtsam::Point3>{};
-        vertex_stamps_[vertex_prefix] = std::vector<Timestamp>{};
+        control_points.clear();
+      }
+      assert(vertex_index == control_points.size());
+      control_points.push_back(gtsam::Point3(x, y, z), n_sec);
+    } else if (tag == "STATE") {
+      has_state = static_cast<bool>(ss >> saved_hash >> saved_converged);
+    } else if (tag == "GNC_WEIGHTS") {
+      double weight;
+      while (ss >> weight) {
+        saved_weights.push_back(weight);
       }
-      assert(vertex_index == vertex_positions_[vertex_prefix].size());
-      vertex_positions_[vertex_prefix].push_back(gtsam::Point3(x, y, z));
-      vertex_stamps_[vertex_prefix].push_back(n_sec);
     } else {
       std::invalid_argument("DeformationGraph load: unknown tag. ");
     }
   }
-  pgo_->updateTempFactorsValues(new_temp_factors, new_temp_vals);
-  pgo_->update(new_factors, new_vals);
-  values_ = pgo_->calculateEstimate();
+
+  // Files saved without a state, edited since or read without their temporary
+  // factors are optimized again
+  graph->converged =
+      has_state && saved_converged && saved_hash == factor_hash && !skipped_temp;
+  if (has_state && saved_hash == factor_hash && saved_weights.size() == num_factors) {
+    graph->gnc_weights = Eigen::Map<const gtsam::Vector>(saved_weights.data(),
+                                                         saved_weights.size());
+  }
+  return true;
+}
+
+bool DeformationGraph::load(const std::string& filename,
+                            bool include_temp,
+                            bool set_robot_id,
+                            size_t new_robot_id) {
+  DeformationGraphFile graph;
+  if (!ReadDeformationGraphFile(
+          filename, &graph, include_temp, set_robot_id, new_robot_id)) {
+    ROS_ERROR_STREAM("DeformationGraph: failed to read " << filename);
+    return false;
+  }
+  load(graph);
+  return true;
+}
+
+void DeformationGraph::load(const DeformationGraphFile& graph) {
+  for (const auto& prefix_poses : graph.initial_poses) {
+    auto& poses = pg_initial_poses_[prefix_poses.first];
+    poses.insert(poses.end(), prefix_poses.second.begin(), prefix_poses.second.end());
+  }
+  for (const auto& key_pose : graph.temp_initial_poses) {
+    temp_pg_initial_poses_[key_pose.first] = key_pose.second;
+  }
+  // files always list the vertices of a prefix from the first one
+  for (const auto& prefix_points : graph.control_points) {
+    control_points_[prefix_points.first] = prefix_points.second;
+  }
+  consistency_factors_.push_back(graph.consistency_factors);
+  // retired loop closures stay out of the solve until readmitted
+  retired_loop_closures_.insert(retired_loop_closures_.end(),
+                                graph.retired_loop_closures.begin(),
+                                graph.retired_loop_closures.end());
+
+  // A converged graph loaded on its own is already the solution: the factors
+  // are added without optimizing. Otherwise the saved values are the initial
+  // guess of the optimization.
+  const bool skip_optimization = graph.converged && nfg_.empty() && values_.empty();
+  pgo_->updateTempFactorsValues(graph.temp_factors, graph.temp_values);
+  pgo_->update(graph.factors, graph.values, !skip_optimization);
+  gtsam::Values estimate = pgo_->calculateEstimate();
+  setEstimate(estimate);
   nfg_ = pgo_->getFactorsUnsafe();
   temp_nfg_ = pgo_->getTempFactorsUnsafe();
   temp_values_ = pgo_->getTempValues();
+
+  // the solution is only kept if outlier rejection kept all the factors
+  if (skip_optimization && nfg_.size() == graph.factors.size()) {
+    const bool has_weights =
+        static_cast<size_t>(graph.gnc_weights.size()) == nfg_.size();
+    gnc_weights_ = has_weights ? graph.gnc_weights : pgo_->getGncWeights();
+    estimate_converged_ = true;
+    converged_num_factors_ = nfg_.size() + temp_nfg_.size();
+  } else {
+    gnc_weights_ = pgo_->getGncWeights();
+    estimate_converged_ = false;
+  }
+  // the loaded control points and values replace what the cached vertices and
+  // registered point sets were deformed with
+  recalculate_vertices_ = true;
+  deformPointSets();
 }
 
 }  // namespace kimera_pgmo
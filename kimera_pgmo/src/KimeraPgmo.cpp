@@ -7,11 +7,14 @@
 
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/TransformStamped.h>
+#include <pcl/common/io.h>
 #include <visualization_msgs/Marker.h>
 
 #include <chrono>
 #include <cmath>
+#include <cstring>
 
+#include "kimera_pgmo/PclMeshTraits.h"
 #include "kimera_pgmo/utils/MeshIO.h"
 
 namespace kimera_pgmo {
@@ -19,13 +22,31 @@ namespace kimera_pgmo {
 // Constructor
 KimeraPgmo::KimeraPgmo()
     : optimized_mesh_(new pcl::PolygonMesh),
+      mesh_vertex_stamps_(new std::vector<Timestamp>),
       optimized_path_(new Path),
       inc_mesh_cb_time_(0),
       full_mesh_cb_time_(0),
       pg_cb_time_(0),
-      path_cb_time_(0) {}
+      path_cb_time_(0),
+      full_mesh_policy_(QueuePolicy::LATEST),
+      full_mesh_queue_size_(1),
+      use_mesh_delta_(false),
+      use_compact_mesh_graph_(false),
+      decimate_mesh_(false),
+      decimation_period_(1.0),
+      last_decimated_version_(0),
+      pending_decimation_version_(0),
+      num_logged_loop_closures_(0) {}
 
 KimeraPgmo::~KimeraPgmo() {
+  if (full_mesh_queue_) {
+    full_mesh_queue_->shutdown();
+  }
+
+  if (mesh_delta_queue_) {
+    mesh_delta_queue_->shutdown();
+  }
+
   if (graph_thread_) {
     graph_thread_->join();
     graph_thread_.reset();
@@ -47,6 +68,11 @@ bool KimeraPgmo::initialize(const ros::NodeHandle& n) {
     ROS_ERROR("KimeraPgmo: Failed to create publishers.");
   }
 
+  full_mesh_queue_.reset(new CoalescingQueue<KimeraPgmoMesh::ConstPtr>(
+      full_mesh_policy_, full_mesh_queue_size_));
+  mesh_delta_queue_.reset(
+      new CoalescingQueue<std_msgs::Header>(QueuePolicy::LATEST, 1));
+
   // Log header to file
   if (log_output_) {
     std::string log_file = config_.log_path + std::string("/kimera_pgmo_log.csv");
@@ -71,6 +97,52 @@ bool KimeraPgmo::loadParameters(const ros::NodeHandle& n) {
   if (!n.getParam("frame_id", frame_id_)) return false;
   if (!n.getParam("robot_id", robot_id_)) return false;
 
+  std::string full_mesh_policy = "latest";
+  n.getParam("full_mesh_queue_policy", full_mesh_policy);
+  if (!parseQueuePolicy(full_mesh_policy, &full_mesh_policy_)) {
+    ROS_ERROR_STREAM("KimeraPgmo: Invalid full mesh queue policy "
+                     << full_mesh_policy << " (expected latest or fifo)");
+    return false;
+  }
+  n.getParam("full_mesh_queue_size", full_mesh_queue_size_);
+  if (full_mesh_queue_size_ < 1) {
+    ROS_ERROR("KimeraPgmo: full_mesh_queue_size must be positive");
+    return false;
+  }
+  n.getParam("use_mesh_delta", use_mesh_delta_);
+  n.getParam("use_compact_mesh_graph", use_compact_mesh_graph_);
+
+  std::string shared_memory_prefix;
+  n.getParam("shared_memory_prefix", shared_memory_prefix);
+  if (!shared_memory_prefix.empty()) {
+    shared_memory_export_.reset(new SharedMemoryExport(shared_memory_prefix));
+    if (!shared_memory_export_->ok()) {
+      return false;
+    }
+    ROS_INFO_STREAM("KimeraPgmo: exporting to shared memory segments "
+                    << shared_memory_prefix << "_trajectory and _mesh");
+  }
+
+  n.getParam("decimate_mesh", decimate_mesh_);
+  int decimation_max_vertices = 0;
+  n.getParam("decimation_max_vertices", decimation_max_vertices);
+  n.getParam("decimation_max_error", decimation_config_.max_error);
+  n.getParam("decimation_tile_size", decimation_config_.tile_size);
+  int decimation_num_threads = 0;
+  n.getParam("decimation_num_threads", decimation_num_threads);
+  n.getParam("decimation_period", decimation_period_);
+  if (decimation_max_vertices < 0 || decimation_num_threads < 0) {
+    ROS_ERROR("KimeraPgmo: decimation vertex budget and threads must not be negative");
+    return false;
+  }
+  decimation_config_.max_vertices = decimation_max_vertices;
+  decimation_config_.num_threads = decimation_num_threads;
+  if (decimate_mesh_ && decimation_config_.max_vertices == 0 &&
+      decimation_config_.max_error <= 0.0) {
+    ROS_WARN("KimeraPgmo: mesh decimation enabled without vertex budget or "
+             "error bound, the decimated mesh is the full mesh");
+  }
+
   if (config_.log_path != "") {
     ROS_INFO_STREAM("Saving optimized data to: "
                     << config_.log_path << "/ mesh_pgmo.ply and traj_pgmo.csv");
@@ -88,6 +160,12 @@ bool KimeraPgmo::createPublishers(const ros::NodeHandle& n) {
   ros::NodeHandle nl(n);
   optimized_mesh_pub_ =
       nl.advertise<mesh_msgs::TriangleMeshStamped>("optimized_mesh", 1, false);
+  decimated_mesh_pub_ = nl.advertise<mesh_msgs::TriangleMeshStamped>(
+      "optimized_mesh_decimated", 1, false);
+  decimated_pgmo_mesh_pub_ = nl.advertise<kimera_pgmo::KimeraPgmoMesh>(
+      "optimized_mesh_decimated_pgmo", 1, false);
+  mesh_update_pub_ = nl.advertise<kimera_pgmo::OptimizedMeshUpdate>(
+      "optimized_mesh_update", 10, false);
   optimized_odom_pub_ = nl.advertise<nav_msgs::Odometry>("optimized_odom", 1, false);
   pose_graph_pub_ =
       nl.advertise<pose_graph_tools_msgs::PoseGraph>("pose_graph", 1, false);
@@ -102,8 +180,16 @@ bool KimeraPgmo::createPublishers(const ros::NodeHandle& n) {
 // Initialize callbacks
 void KimeraPgmo::startGraphProcess(const ros::NodeHandle& n) {
   ros::NodeHandle nl(n);
-  incremental_mesh_graph_sub_ = nl.subscribe(
-      "mesh_graph_incremental", 5000, &KimeraPgmo::incrementalMeshGraphCallback, this);
+  if (use_compact_mesh_graph_) {
+    incremental_mesh_graph_sub_ = nl.subscribe(
+        "mesh_graph", 5000, &KimeraPgmo::compactMeshGraphCallback, this);
+  } else {
+    incremental_mesh_graph_sub_ =
+        nl.subscribe("mesh_graph_incremental",
+                     5000,
+                     &KimeraPgmo::incrementalMeshGraphCallback,
+                     this);
+  }
 
   pose_graph_incremental_sub_ = nl.subscribe(
       "pose_graph_incremental", 5000, &KimeraPgmo::incrementalPoseGraphCallback, this);
@@ -125,6 +211,8 @@ void KimeraPgmo::startGraphProcess(const ros::NodeHandle& n) {
   // Initialize save deformation graph service
   load_graph_mesh_srv_ =
       nl.advertiseService("load_graph_mesh", &KimeraPgmo::loadGraphMeshCallback, this);
+  load_sessions_srv_ =
+      nl.advertiseService("load_sessions", &KimeraPgmo::loadSessionsCallback, this);
 
   // Reset the deformation graph service
   reset_srv_ =
@@ -138,11 +226,96 @@ void KimeraPgmo::startGraphProcess(const ros::NodeHandle& n) {
 // Initialize callbacks
 void KimeraPgmo::startMeshProcess(const ros::NodeHandle& n) {
   ros::NodeHandle nl(n);
-  full_mesh_sub_ = nl.subscribe("full_mesh", 1, &KimeraPgmo::fullMeshCallback, this);
+  if (use_mesh_delta_) {
+    // every delta has to be applied, so they are not coalesced before that
+    mesh_delta_sub_ =
+        nl.subscribe("mesh_delta", 100, &KimeraPgmo::meshDeltaCallback, this);
+  } else {
+    full_mesh_sub_ = nl.subscribe(
+        "full_mesh", full_mesh_queue_size_, &KimeraPgmo::fullMeshQueueCallback, this);
+  }
 
   // Initialize save mesh service
   save_mesh_srv_ =
       nl.advertiseService("save_mesh", &KimeraPgmo::saveMeshCallback, this);
+
+  // Initialize spatial query service on the optimized mesh
+  query_mesh_srv_ =
+      nl.advertiseService("query_mesh", &KimeraPgmo::queryMeshCallback, this);
+
+  // Decimate the meshes skipped by the decimation period once it expires
+  if (decimate_mesh_ && decimation_period_ > 0.0) {
+    decimation_timer_ = nl.createWallTimer(ros::WallDuration(decimation_period_),
+                                           &KimeraPgmo::decimationTimerCallback,
+                                           this);
+  }
+
+  // Deform meshes off the spinner thread so that superseded meshes can be
+  // dropped while a deformation is running
+  if (use_mesh_delta_) {
+    while (ros::ok() && !mesh_delta_queue_->isShutdown()) {
+      const auto header = mesh_delta_queue_->pop(std::chrono::milliseconds(100));
+      if (header) {
+        deformMirroredMesh(*header);
+      }
+    }
+    return;
+  }
+
+  while (ros::ok() && !full_mesh_queue_->isShutdown()) {
+    const auto mesh_msg = full_mesh_queue_->pop(std::chrono::milliseconds(100));
+    if (mesh_msg) {
+      fullMeshCallback(*mesh_msg);
+    }
+  }
+}
+
+KimeraPgmo::MeshSnapshot KimeraPgmo::getMeshSnapshot() const {
+  std::unique_lock<std::mutex> lock(interface_mutex_);
+  MeshSnapshot snapshot;
+  snapshot.mesh = optimized_mesh_;
+  snapshot.vertex_stamps = mesh_vertex_stamps_;
+  snapshot.graph_indices = mesh_graph_indices_;
+  snapshot.version = optimized_mesh_version_;
+  snapshot.mesh_index = getOptimizedMeshIndex();
+  return snapshot;
+}
+
+KimeraPgmo::MeshSnapshot KimeraPgmo::setOptimizedMesh(
+    const pcl::PolygonMesh::Ptr& mesh,
+    std::vector<Timestamp>&& vertex_stamps,
+    const std::vector<int>& graph_indices) {
+  optimized_mesh_ = mesh;
+  optimized_mesh_version_++;
+  mesh_vertex_stamps_ =
+      std::make_shared<const std::vector<Timestamp>>(std::move(vertex_stamps));
+  // only the decimated mesh reads the graph indices
+  mesh_graph_indices_.reset();
+  if (decimate_mesh_ && graph_indices.size() == mesh_vertex_stamps_->size()) {
+    mesh_graph_indices_ = std::make_shared<const std::vector<int>>(graph_indices);
+  }
+  MeshSnapshot snapshot;
+  snapshot.mesh = optimized_mesh_;
+  snapshot.vertex_stamps = mesh_vertex_stamps_;
+  snapshot.graph_indices = mesh_graph_indices_;
+  snapshot.version = optimized_mesh_version_;
+  snapshot.mesh_index = getOptimizedMeshIndex();
+  return snapshot;
+}
+
+void KimeraPgmo::resetMeshStateAfterLoad() {
+  {  // start mirror critical section
+    std::unique_lock<std::mutex> mirror_lock(mesh_mirror_mutex_);
+    mesh_mirror_.clear();
+  }  // end mirror critical section
+  if (config_.mesh_index_resolution > 0.0) {
+    // the sessions were indexed one after the other while deformed
+    MeshSpatialIndex& index = writableOptimizedMeshIndex();
+    index.clear();
+    if (optimized_mesh_) {
+      index.update(*optimized_mesh_);
+    }
+  }
 }
 
 // To publish optimized mesh
@@ -150,10 +323,188 @@ bool KimeraPgmo::publishOptimizedMesh() const {
   std_msgs::Header msg_header;
   msg_header.stamp = last_mesh_stamp_;
   msg_header.frame_id = frame_id_;
-  publishMesh(*optimized_mesh_, msg_header, &optimized_mesh_pub_);
+  publishMesh(*getMeshSnapshot().mesh, msg_header, &optimized_mesh_pub_);
   return true;
 }
 
+void KimeraPgmo::publishMeshSnapshot(const MeshSnapshot& snapshot,
+                                     const DeformedVertices* deformed,
+                                     const std_msgs::Header& header) const {
+  if (optimized_mesh_pub_.getNumSubscribers() > 0) {
+    publishMesh(*snapshot.mesh, header, &optimized_mesh_pub_);
+  }
+  if (deformed) {
+    publishMeshUpdate(snapshot, *deformed, header);
+  }
+  publishDecimatedMesh(snapshot, header);
+  exportOptimizedMesh(snapshot, deformed);
+}
+
+bool KimeraPgmo::decimateOptimizedMesh(const MeshSnapshot& snapshot,
+                                       pcl::PolygonMesh* mesh,
+                                       std::vector<Timestamp>* vertex_stamps,
+                                       std::vector<int>* graph_indices) const {
+  if (!decimate_mesh_ || snapshot.mesh->polygons.empty()) {
+    return false;
+  }
+
+  pcl::PointCloud<pcl::PointXYZRGBA> vertices;
+  pcl::fromPCLPointCloud2(snapshot.mesh->cloud, vertices);
+  if (snapshot.vertex_stamps->size() != vertices.size()) {
+    ROS_ERROR("KimeraPgmo: optimized mesh and vertex stamps size mismatch");
+    return false;
+  }
+
+  const DecimationResult result =
+      decimateMesh(vertices, snapshot.mesh->polygons, decimation_config_);
+
+  // The decimated mesh is a subset of the optimized vertices: stamps, colors
+  // and graph indices of the kept vertices carry over
+  pcl::PointCloud<pcl::PointXYZRGBA> decimated_vertices;
+  vertex_stamps->clear();
+  StampedCloud<pcl::PointXYZRGBA> decimated_cloud(decimated_vertices,
+                                                  *vertex_stamps);
+  extractDecimatedMesh(result,
+                       ConstStampedCloud<pcl::PointXYZRGBA>(
+                           vertices, *snapshot.vertex_stamps),
+                       decimated_cloud,
+                       mesh->polygons);
+  pcl::toPCLPointCloud2(decimated_vertices, mesh->cloud);
+  if (graph_indices) {
+    graph_indices->clear();
+    if (snapshot.graph_indices) {
+      *graph_indices = extractDecimatedValues(result, *snapshot.graph_indices);
+    }
+  }
+  return true;
+}
+
+void KimeraPgmo::publishDecimatedMesh(const MeshSnapshot& snapshot,
+                                      const std_msgs::Header& header) const {
+  if (!decimate_mesh_ || (decimated_mesh_pub_.getNumSubscribers() == 0 &&
+                          decimated_pgmo_mesh_pub_.getNumSubscribers() == 0)) {
+    return;
+  }
+
+  // The whole mesh is decimated again, so it is throttled instead of following
+  // every deformation
+  {  // start decimation critical section
+    std::unique_lock<std::mutex> lock(decimation_mutex_);
+    const ros::WallTime now = ros::WallTime::now();
+    if (snapshot.version <= last_decimated_version_) {
+      return;
+    }
+    if ((now - last_decimation_time_).toSec() < decimation_period_) {
+      // decimated by the timer once the period expires
+      if (snapshot.version > pending_decimation_version_) {
+        pending_decimation_version_ = snapshot.version;
+        pending_decimation_header_ = header;
+      }
+      return;
+    }
+    last_decimation_time_ = now;
+    last_decimated_version_ = snapshot.version;
+  }  // end decimation critical section
+
+  pcl::PolygonMesh decimated_mesh;
+  std::vector<Timestamp> decimated_stamps;
+  std::vector<int> decimated_graph_indices;
+  if (!decimateOptimizedMesh(
+          snapshot, &decimated_mesh, &decimated_stamps, &decimated_graph_indices)) {
+    return;
+  }
+  if (decimated_mesh_pub_.getNumSubscribers() > 0) {
+    publishMesh(decimated_mesh, header, &decimated_mesh_pub_);
+  }
+  if (decimated_pgmo_mesh_pub_.getNumSubscribers() > 0) {
+    KimeraPgmoMesh msg = PolygonMeshToPgmoMeshMsg(
+        robot_id_, decimated_mesh, decimated_stamps, header.frame_id);
+    msg.header = header;
+    msg.vertex_indices = std::move(decimated_graph_indices);
+    decimated_pgmo_mesh_pub_.publish(msg);
+  }
+}
+
+void KimeraPgmo::decimationTimerCallback(const ros::WallTimerEvent&) {
+  std_msgs::Header header;
+  {  // start decimation critical section
+    std::unique_lock<std::mutex> lock(decimation_mutex_);
+    if (pending_decimation_version_ <= last_decimated_version_) {
+      return;
+    }
+    header = pending_decimation_header_;
+  }  // end decimation critical section
+  // the latest mesh is at least as recent as the skipped one
+  publishDecimatedMesh(getMeshSnapshot(), header);
+}
+
+void KimeraPgmo::publishMeshUpdate(const MeshSnapshot& snapshot,
+                                   const DeformedVertices& deformed,
+                                   const std_msgs::Header& header) const {
+  if (deformed.full || mesh_update_pub_.getNumSubscribers() == 0) {
+    return;
+  }
+
+  // Read the positions straight from the serialized cloud
+  const pcl::PCLPointCloud2& cloud = snapshot.mesh->cloud;
+  const int x_idx = pcl::getFieldIndex(cloud, "x");
+  const int y_idx = pcl::getFieldIndex(cloud, "y");
+  const int z_idx = pcl::getFieldIndex(cloud, "z");
+  const size_t num_vertices = cloud.width * cloud.height;
+  if (x_idx < 0 || y_idx < 0 || z_idx < 0 || num_vertices != deformed.num_vertices) {
+    return;
+  }
+  const auto read = [&](size_t i, int field) {
+    float value;
+    std::memcpy(&value,
+                &cloud.data[i * cloud.point_step + cloud.fields[field].offset],
+                sizeof(float));
+    return value;
+  };
+
+  kimera_pgmo::OptimizedMeshUpdate msg;
+  msg.header = header;
+  msg.num_vertices = num_vertices;
+  msg.indices.reserve(deformed.size());
+  msg.vertices.reserve(deformed.size());
+  for (const size_t i : deformed.indices()) {
+    msg.indices.push_back(i);
+    geometry_msgs::Point point;
+    point.x = read(i, x_idx);
+    point.y = read(i, y_idx);
+    point.z = read(i, z_idx);
+    msg.vertices.push_back(point);
+  }
+  mesh_update_pub_.publish(msg);
+}
+
+void KimeraPgmo::exportOptimizedMesh(const MeshSnapshot& snapshot,
+                                     const DeformedVertices* deformed) const {
+  if (shared_memory_export_) {
+    shared_memory_export_->writeMesh(
+        *snapshot.mesh, *snapshot.vertex_stamps, snapshot.version, deformed);
+  }
+}
+
+void KimeraPgmo::logMeshUpdate() {
+  const size_t num_loop_closures = deformation_graph_->getNumLoopclosures();
+  if (num_loop_closures <= num_logged_loop_closures_) {
+    return;
+  }
+  num_logged_loop_closures_ = num_loop_closures;
+
+  const MeshUpdateStats& stats = getLastMeshUpdateStats();
+  ROS_INFO("KimeraPgmo: loop closure moved %zu/%zu poses and %zu/%zu control "
+           "points, deformed %zu/%zu vertices (%.1f%%)",
+           stats.num_moved_poses,
+           stats.num_poses,
+           stats.num_moved_control_points,
+           stats.num_control_points,
+           stats.num_deformed_vertices,
+           stats.num_vertices,
+           100.0 * stats.deformedFraction());
+}
+
 // To publish optimized trajectory
 bool KimeraPgmo::publishOptimizedPath() const {
   if (optimized_path_->size() == 0) return false;
@@ -162,6 +513,9 @@ bool KimeraPgmo::publishOptimizedPath() const {
   msg_header.stamp.fromNSec(timestamps_.back());
   msg_header.frame_id = frame_id_;
   publishPath(*optimized_path_, msg_header, &optimized_path_pub_);
+  if (shared_memory_export_) {
+    shared_memory_export_->writeTrajectory(*optimized_path_, timestamps_, robot_id_);
+  }
 
   if (optimized_odom_pub_.getNumSubscribers() > 0) {
     // Publish also the optimized odometry
@@ -196,11 +550,17 @@ void KimeraPgmo::incrementalPoseGraphCallback(
   // Start timer
   auto start = std::chrono::high_resolution_clock::now();
 
+  GraphMsgPtr pose_graph_ptr;
   {  // start interface critical section
     std::unique_lock<std::mutex> lock(interface_mutex_);
     processIncrementalPoseGraph(msg, &trajectory_, &unconnected_nodes_, &timestamps_);
     // Update optimized path
     *optimized_path_ = getOptimizedTrajectory(robot_id_);
+    if (pose_graph_pub_.getNumSubscribers() > 0) {
+      std::map<size_t, std::vector<Timestamp> > id_timestamps;
+      id_timestamps[robot_id_] = timestamps_;
+      pose_graph_ptr = deformation_graph_->getPoseGraph(id_timestamps);
+    }
   }  // end interface critical section
   // Update transforms
   publishTransforms();
@@ -217,11 +577,8 @@ void KimeraPgmo::incrementalPoseGraphCallback(
     logStats(log_file);
   }
 
-  if (pose_graph_pub_.getNumSubscribers() > 0) {
+  if (pose_graph_ptr) {
     // Publish pose graph
-    std::map<size_t, std::vector<Timestamp> > id_timestamps;
-    id_timestamps[robot_id_] = timestamps_;
-    const GraphMsgPtr& pose_graph_ptr = deformation_graph_->getPoseGraph(id_timestamps);
     pose_graph_pub_.publish(*pose_graph_ptr);
   }
 
@@ -251,32 +608,106 @@ void KimeraPgmo::optimizedPathCallback(const nav_msgs::Path::ConstPtr& path_msg)
   }
 }
 
+void KimeraPgmo::fullMeshQueueCallback(
+    const kimera_pgmo::KimeraPgmoMesh::ConstPtr& mesh_msg) {
+  const size_t num_dropped = full_mesh_queue_->push(mesh_msg);
+  if (num_dropped > 0) {
+    ROS_DEBUG_STREAM("KimeraPgmo: dropped " << num_dropped
+                                            << " superseded full mesh message(s)");
+  }
+}
+
 void KimeraPgmo::fullMeshCallback(
     const kimera_pgmo::KimeraPgmoMesh::ConstPtr& mesh_msg) {
   auto start = std::chrono::high_resolution_clock::now();
   bool opt_mesh;
+  DeformedVertices deformed;
+  MeshSnapshot snapshot;
   {  // start interface critical section
     std::unique_lock<std::mutex> lock(interface_mutex_);
     // Optimization always happen here only to ensure that the full mesh is
     // always optimized when published
-    opt_mesh = optimizeFullMesh(*mesh_msg, optimized_mesh_, &mesh_vertex_stamps_, true);
+    pcl::PolygonMesh::Ptr mesh(new pcl::PolygonMesh);
+    std::vector<Timestamp> vertex_stamps;
+    opt_mesh = optimizeFullMesh(*mesh_msg, mesh, &vertex_stamps, true);
+    if (opt_mesh) {
+      snapshot =
+          setOptimizedMesh(mesh, std::move(vertex_stamps), mesh_msg->vertex_indices);
+      deformed =
+          deformation_graph_->getLastDeformedVertices(GetVertexPrefix(mesh_msg->id));
+      logMeshUpdate();
+    }
+    // Publish deformation graph edges visualization
+    visualizeDeformationGraphMeshEdges(&viz_mesh_mesh_edges_pub_,
+                                       &viz_pose_mesh_edges_pub_);
   }  // end interface critical section
-  if (opt_mesh && optimized_mesh_pub_.getNumSubscribers() > 0) {
-    std_msgs::Header msg_header = mesh_msg->header;
-    publishMesh(*optimized_mesh_, msg_header, &optimized_mesh_pub_);
+  if (opt_mesh) {
+    publishMeshSnapshot(snapshot, &deformed, mesh_msg->header);
   }
   // Stop timer and save
   auto stop = std::chrono::high_resolution_clock::now();
   auto spin_duration =
       std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
   full_mesh_cb_time_ = spin_duration.count();
-
-  // Publish deformation graph edges visualization
-  visualizeDeformationGraphMeshEdges(&viz_mesh_mesh_edges_pub_,
-                                     &viz_pose_mesh_edges_pub_);
   return;
 }
 
+void KimeraPgmo::meshDeltaCallback(
+    const kimera_pgmo::KimeraPgmoMeshDelta::ConstPtr& delta_msg) {
+  MeshDeltaMirror::Status status;
+  {  // start mirror critical section
+    std::unique_lock<std::mutex> lock(mesh_mirror_mutex_);
+    status = mesh_mirror_.update(*delta_msg);
+  }  // end mirror critical section
+
+  switch (status) {
+    case MeshDeltaMirror::Status::OUT_OF_SYNC:
+      ROS_WARN_THROTTLE(5.0,
+                        "KimeraPgmo: mesh deltas out of sync, waiting for full mesh");
+      return;
+    case MeshDeltaMirror::Status::RESYNCED:
+      ROS_INFO("KimeraPgmo: mirrored full mesh synchronized");
+      break;
+    default:
+      break;
+  }
+
+  mesh_delta_queue_->push(delta_msg->header);
+}
+
+void KimeraPgmo::deformMirroredMesh(const std_msgs::Header& header) {
+  auto start = std::chrono::high_resolution_clock::now();
+  bool opt_mesh;
+  DeformedVertices deformed;
+  MeshSnapshot snapshot;
+  {  // start interface critical section
+    std::unique_lock<std::mutex> lock(interface_mutex_);
+    std::unique_lock<std::mutex> mirror_lock(mesh_mirror_mutex_);
+    pcl::PolygonMesh::Ptr mesh(new pcl::PolygonMesh);
+    std::vector<Timestamp> vertex_stamps;
+    opt_mesh = optimizeFullMesh(mesh_mirror_, robot_id_, mesh, &vertex_stamps, true);
+    if (opt_mesh) {
+      snapshot = setOptimizedMesh(
+          mesh, std::move(vertex_stamps), mesh_mirror_.graphIndices());
+      mesh_mirror_.clearChanges();
+      deformed =
+          deformation_graph_->getLastDeformedVertices(GetVertexPrefix(robot_id_));
+      logMeshUpdate();
+    }
+    // Publish deformation graph edges visualization
+    visualizeDeformationGraphMeshEdges(&viz_mesh_mesh_edges_pub_,
+                                       &viz_pose_mesh_edges_pub_);
+  }  // end interface critical section
+  if (opt_mesh) {
+    publishMeshSnapshot(snapshot, &deformed, header);
+  }
+  // Stop timer and save
+  auto stop = std::chrono::high_resolution_clock::now();
+  auto spin_duration =
+      std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+  full_mesh_cb_time_ = spin_duration.count();
+}
+
 void KimeraPgmo::incrementalMeshGraphCallback(
     const pose_graph_tools_msgs::PoseGraph::ConstPtr& mesh_graph_msg) {
   // Start timer
@@ -295,6 +726,22 @@ void KimeraPgmo::incrementalMeshGraphCallback(
   return;
 }
 
+void KimeraPgmo::compactMeshGraphCallback(
+    const KimeraPgmoMeshGraph::ConstPtr& mesh_graph_msg) {
+  // Start timer
+  auto start = std::chrono::high_resolution_clock::now();
+
+  {  // start interface critical section
+    std::unique_lock<std::mutex> lock(interface_mutex_);
+    processIncrementalMeshGraph(mesh_graph_msg, timestamps_, &unconnected_nodes_);
+  }  // end interface critical section
+  // Stop timer and save
+  auto stop = std::chrono::high_resolution_clock::now();
+  auto spin_duration =
+      std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+  inc_mesh_cb_time_ = spin_duration.count();
+}
+
 void KimeraPgmo::dpgmoCallback(const pose_graph_tools_msgs::PoseGraph::ConstPtr& msg) {
   if (dpgmo_num_poses_last_req_.empty()) {
     ROS_ERROR("Mesh factors request queue empty.");
@@ -352,8 +799,17 @@ void KimeraPgmo::publishTransforms() {
 bool KimeraPgmo::saveMeshCallback(std_srvs::Empty::Request&,
                                   std_srvs::Empty::Response&) {
   // Save mesh
+  const MeshSnapshot snapshot = getMeshSnapshot();
   std::string ply_name = config_.log_path + std::string("/mesh_pgmo.ply");
-  WriteMeshWithStampsToPly(ply_name, *optimized_mesh_, mesh_vertex_stamps_);
+  WriteMeshWithStampsToPly(ply_name, *snapshot.mesh, *snapshot.vertex_stamps);
+
+  pcl::PolygonMesh decimated_mesh;
+  std::vector<Timestamp> decimated_stamps;
+  if (decimateOptimizedMesh(snapshot, &decimated_mesh, &decimated_stamps)) {
+    std::string decimated_ply_name =
+        config_.log_path + std::string("/mesh_pgmo_decimated.ply");
+    WriteMeshWithStampsToPly(decimated_ply_name, decimated_mesh, decimated_stamps);
+  }
   ROS_INFO("KimeraPgmo: Saved mesh to file.");
   return true;
 }
@@ -362,6 +818,7 @@ bool KimeraPgmo::saveTrajectoryCallback(std_srvs::Empty::Request&,
                                         std_srvs::Empty::Response&) {
   // Save trajectory
   std::string csv_name = config_.log_path + std::string("/traj_pgmo.csv");
+  std::unique_lock<std::mutex> lock(interface_mutex_);
   saveTrajectory(*optimized_path_, timestamps_, csv_name);
   ROS_INFO("KimeraPgmo: Saved trajectories to file.");
   return true;
@@ -372,9 +829,10 @@ bool KimeraPgmo::saveGraphCallback(std_srvs::Empty::Request&,
   // Save trajectory
   std::ofstream csvfile;
   std::string dgrf_name = config_.log_path + std::string("/pgmo.dgrf");
+  std::unique_lock<std::mutex> lock(interface_mutex_);
   saveDeformationGraph(dgrf_name);
   std::string sparse_mapping_name =
-      config_.log_path + std::string("/sparsification_mapping.txt");
+      config_.log_path + std::string("/sparsification_mapping.bin");
   savePoseGraphSparseMapping(sparse_mapping_name);
   ROS_INFO("KimeraPgmo: Saved deformation graph to file.");
   return true;
@@ -385,28 +843,157 @@ bool KimeraPgmo::loadGraphMeshCallback(kimera_pgmo::LoadGraphMesh::Request& requ
   ROS_INFO("Loading deformation graph file: %s and ply file: %s. ",
            request.dgrf_file.c_str(),
            request.ply_file.c_str());
+  MeshSnapshot snapshot;
   {  // start interface critical section
     std::unique_lock<std::mutex> lock(interface_mutex_);
+    pcl::PolygonMesh::Ptr mesh(new pcl::PolygonMesh);
+    std::vector<Timestamp> vertex_stamps;
     response.success = loadGraphAndMesh(request.robot_id,
                                         request.ply_file,
                                         request.dgrf_file,
                                         request.sparse_mapping_file,
-                                        optimized_mesh_,
-                                        &mesh_vertex_stamps_,
+                                        mesh,
+                                        &vertex_stamps,
                                         true);
+    if (response.success) {
+      snapshot = setOptimizedMesh(mesh, std::move(vertex_stamps));
+    }
+    resetMeshStateAfterLoad();
+    // the index was rebuilt after the snapshot was taken
+    snapshot.mesh_index = getOptimizedMeshIndex();
+  }  // end interface critical section
+  if (response.success) {
+    std_msgs::Header msg_header;
+    msg_header.frame_id = frame_id_;
+    msg_header.stamp = ros::Time::now();
+    publishMeshSnapshot(snapshot, nullptr, msg_header);
+  }
+  return response.success;
+}
+
+bool KimeraPgmo::loadSessionsCallback(kimera_pgmo::LoadSessions::Request& request,
+                                      kimera_pgmo::LoadSessions::Response& response) {
+  const size_t num_sessions = request.robot_ids.size();
+  if (request.dgrf_files.size() != num_sessions ||
+      request.ply_files.size() != num_sessions ||
+      (!request.sparse_mapping_files.empty() &&
+       request.sparse_mapping_files.size() != num_sessions)) {
+    ROS_ERROR("KimeraPgmo: load_sessions expects one file of each type per robot");
+    response.success = false;
+    return false;
+  }
+
+  // the mesh of this robot becomes the optimized mesh
+  std::vector<SessionFiles> sessions(num_sessions);
+  std::vector<pcl::PolygonMesh::Ptr> meshes(num_sessions);
+  pcl::PolygonMesh::Ptr robot_mesh(new pcl::PolygonMesh);
+  for (size_t i = 0; i < num_sessions; ++i) {
+    sessions[i].robot_id = request.robot_ids[i];
+    sessions[i].dgrf_path = request.dgrf_files[i];
+    sessions[i].ply_path = request.ply_files[i];
+    if (!request.sparse_mapping_files.empty()) {
+      sessions[i].sparse_mapping_path = request.sparse_mapping_files[i];
+    }
+    if (sessions[i].robot_id == static_cast<size_t>(robot_id_)) {
+      meshes[i] = robot_mesh;
+    }
+  }
+
+  SessionLoadTimes times;
+  std::vector<std::vector<Timestamp>> stamps;
+  MeshSnapshot snapshot;
+  {  // start interface critical section
+    std::unique_lock<std::mutex> lock(interface_mutex_);
+    response.success = loadSessions(sessions, &meshes, &stamps, true, &times);
+    for (size_t i = 0; i < num_sessions && response.success; ++i) {
+      if (meshes[i] == robot_mesh) {
+        snapshot = setOptimizedMesh(robot_mesh, std::move(stamps[i]));
+      }
+    }
+    if (response.success && !snapshot.mesh) {
+      snapshot.mesh = optimized_mesh_;
+      snapshot.vertex_stamps = mesh_vertex_stamps_;
+      snapshot.graph_indices = mesh_graph_indices_;
+      snapshot.version = optimized_mesh_version_;
+    }
+    resetMeshStateAfterLoad();
+    snapshot.mesh_index = getOptimizedMeshIndex();
   }  // end interface critical section
-  if (response.success && optimized_mesh_pub_.getNumSubscribers() > 0) {
+  response.read_time = times.read_phase;
+  response.merge_time = times.merge;
+  response.optimize_time = times.optimize;
+  response.deform_time = times.deform;
+  response.total_time = times.total;
+
+  if (response.success) {
     std_msgs::Header msg_header;
     msg_header.frame_id = frame_id_;
     msg_header.stamp = ros::Time::now();
-    publishMesh(*optimized_mesh_, msg_header, &optimized_mesh_pub_);
+    publishMeshSnapshot(snapshot, nullptr, msg_header);
   }
   return response.success;
 }
 
+bool KimeraPgmo::queryMeshCallback(kimera_pgmo::QueryMesh::Request& request,
+                                   kimera_pgmo::QueryMesh::Response& response) {
+  const traits::Pos min(request.min.x, request.min.y, request.min.z);
+  response.success = false;
+
+  // the snapshot is never modified, so the query runs without the interface lock
+  const MeshSnapshot snapshot = getMeshSnapshot();
+  if (config_.mesh_index_resolution <= 0.0 || !snapshot.mesh_index) {
+    ROS_ERROR("KimeraPgmo: mesh index disabled (mesh_index_resolution <= 0)");
+    return false;
+  }
+
+  switch (request.type) {
+    case kimera_pgmo::QueryMesh::Request::BOUNDING_BOX: {
+      const traits::Pos max(request.max.x, request.max.y, request.max.z);
+      const auto faces = snapshot.mesh_index->facesInBox(min, max);
+      response.mesh =
+          PolygonMeshToTriangleMeshMsg(extractSubmesh(*snapshot.mesh, faces));
+      response.success = true;
+      break;
+    }
+    case kimera_pgmo::QueryMesh::Request::CLOSEST_POINT: {
+      MeshSpatialIndex::SurfacePoint result;
+      if (snapshot.mesh_index->closestPoint(min, request.max_distance, &result)) {
+        response.point.x = result.point.x();
+        response.point.y = result.point.y();
+        response.point.z = result.point.z();
+        response.face_index = result.face;
+        response.distance = result.distance;
+        response.success = true;
+      }
+      break;
+    }
+    case kimera_pgmo::QueryMesh::Request::RAYCAST: {
+      const traits::Pos direction(
+          request.direction.x, request.direction.y, request.direction.z);
+      MeshSpatialIndex::RayHit hit;
+      if (snapshot.mesh_index->raycast(min, direction, request.max_distance, &hit)) {
+        response.point.x = hit.point.x();
+        response.point.y = hit.point.y();
+        response.point.z = hit.point.z();
+        response.face_index = hit.face;
+        response.distance = hit.range;
+        response.success = true;
+      }
+      break;
+    }
+    default:
+      ROS_ERROR_STREAM("KimeraPgmo: unknown mesh query type "
+                       << static_cast<int>(request.type));
+      return false;
+  }
+
+  return true;
+}
+
 bool KimeraPgmo::requestMeshEdgesCallback(
     kimera_pgmo::RequestMeshFactors::Request& request,
     kimera_pgmo::RequestMeshFactors::Response& response) {
+  std::unique_lock<std::mutex> lock(interface_mutex_);
   size_t offset_vertex_indices = 0;
   if (request.reindex_vertices) offset_vertex_indices = trajectory_.size();
   if (getConsistencyFactors(
@@ -418,6 +1005,7 @@ bool KimeraPgmo::requestMeshEdgesCallback(
 }
 
 void KimeraPgmo::logStats(const std::string filename) const {
+  std::unique_lock<std::mutex> lock(interface_mutex_);
   std::ofstream file;
 
   if (trajectory_.size() < 1) {
@@ -425,19 +1013,28 @@ void KimeraPgmo::logStats(const std::string filename) const {
     // file format
     file << "num-robots,num-keyframes,num-loop-closures,total-num-factors,num-"
             "vertices,num-vertices-simplified,inc-mesh-cb-time(mu-s),full-mesh-"
-            "cb-time(mu-s),pg-cb-time(mu-s),path-cb-time(mu-s)\n";
+            "cb-time(mu-s),pg-cb-time(mu-s),path-cb-time(mu-s),full-mesh-"
+            "received,full-mesh-processed,full-mesh-dropped,full-mesh-queue-"
+            "latency(mu-s),full-mesh-max-queue-latency(mu-s),num-deformed-"
+            "vertices,deformed-vertex-fraction\n";
     return;
   }
   // Number of keyframes
   size_t num_keyframes = trajectory_.size();
   // Number of vertices (total)
   size_t num_vertices = optimized_mesh_->cloud.width * optimized_mesh_->cloud.height;
+  const QueueStats queue_stats = getFullMeshQueueStats();
+  const MeshUpdateStats& update_stats = getLastMeshUpdateStats();
 
   file.open(filename, std::ofstream::out | std::ofstream::app);
   file << 1 << "," << num_keyframes << "," << num_loop_closures_ << ","
        << deformation_graph_->getGtsamFactors().size() << "," << num_vertices << ","
        << deformation_graph_->getNumVertices() << "," << inc_mesh_cb_time_ << ","
-       << full_mesh_cb_time_ << "," << pg_cb_time_ << "," << path_cb_time_ << std::endl;
+       << full_mesh_cb_time_ << "," << pg_cb_time_ << "," << path_cb_time_ << ","
+       << queue_stats.received << "," << queue_stats.processed << ","
+       << queue_stats.dropped << "," << queue_stats.last_latency_us << ","
+       << queue_stats.max_latency_us << "," << update_stats.num_deformed_vertices
+       << "," << update_stats.deformedFraction() << std::endl;
   file.close();
 }
 
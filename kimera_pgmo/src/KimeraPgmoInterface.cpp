@@ -9,14 +9,22 @@
 #include <geometry_msgs/TransformStamped.h>
 #include <visualization_msgs/Marker.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <functional>
 #include <limits>
+#include <thread>
 
+#include "kimera_pgmo/utils/AllocationStats.h"
 #include "kimera_pgmo/utils/MeshIO.h"
 
 namespace kimera_pgmo {
 
+constexpr uint32_t kSparseMappingMagic = 0x534d4750;  // "PGMS"
+constexpr uint32_t kSparseMappingVersion = 1;
+
 template <typename T>
 bool pgmoParseParam(const ros::NodeHandle& nh,
                     const std::string& name,
@@ -66,9 +74,20 @@ bool KimeraPgmoConfig::load(const ros::NodeHandle& nh) {
   pgmoParseParam(nh, "rpgo/gnc_weight_tolerance", gnc_weight_tol, false);
   pgmoParseParam(nh, "rpgo/gnc_fix_prev_inliers", gnc_fix_prev_inliers, false);
   pgmoParseParam(nh, "rpgo/lm_diagonal_damping", lm_diagonal_damping, false);
+  pgmoParseParam(nh, "rpgo/retire_after_rejections", retire_after_rejections, false);
+  pgmoParseParam(nh, "rpgo/retire_weight_threshold", retire_weight_threshold, false);
+  if (retire_after_rejections < 0) {
+    ROS_ERROR_STREAM("Invalid retire_after_rejections: " << retire_after_rejections);
+    valid = false;
+  }
   pgmoParseParam(nh, "trans_node_dist", trans_sparse_dist, false);
   pgmoParseParam(nh, "rot_node_dist", rot_sparse_dist, false);
   pgmoParseParam(nh, "output_prefix", log_path, false);
+  pgmoParseParam(nh, "mesh_index_resolution", mesh_index_resolution, false);
+  pgmoParseParam(
+      nh, "region_of_influence/translation_tolerance", region_translation_tol, false);
+  pgmoParseParam(
+      nh, "region_of_influence/rotation_tolerance", region_rotation_tol, false);
 
   return valid;
 }
@@ -100,48 +119,6 @@ KimeraRPGO::RobustSolverParams KimeraPgmoConfig::getRobustSolverParams() const {
   return params;
 }
 
-void SparseKeyframe::initialize(const gtsam::Key& sparse_key,
-                                const size_t& robot_id,
-                                const size_t& pose_id) {
-  const gtsam::Symbol key_symb(GetRobotPrefix(robot_id), pose_id);
-  key = sparse_key;
-  keyed_transforms.insert({key_symb, gtsam::Pose3()});
-}
-
-bool SparseKeyframe::addNewEdge(const pose_graph_tools_msgs::PoseGraphEdge& new_edge,
-                                double trans_threshold,
-                                double rot_threshold) {
-  if (!active) {
-    ROS_ERROR("Cannot add edge to inactive sparse key-frame.");
-    return false;
-  }
-  if (new_edge.type != pose_graph_tools_msgs::PoseGraphEdge::ODOM) {
-    ROS_ERROR("Trying to add non-ODOM edge to sparse key-frame.");
-    return false;
-  }
-
-  const gtsam::Symbol from_key(GetRobotPrefix(new_edge.robot_from), new_edge.key_from);
-  const gtsam::Symbol to_key(GetRobotPrefix(new_edge.robot_to), new_edge.key_to);
-
-  if (keyed_transforms.rbegin()->first != to_key - 1) {
-    ROS_ERROR("Attempting to insert non-consecutive nodes to sparse key-frame");
-    return false;
-  }
-  const gtsam::Pose3& measure = RosToGtsam(new_edge.pose);
-  current_transform = current_transform.compose(measure);
-  edges.push_back(new_edge);
-
-  double dist_total = current_transform.translation().norm();
-  double rot_total = current_transform.rotation().xyz().norm();
-  if (dist_total > trans_threshold || rot_total > rot_threshold) {
-    active = false;
-    return false;
-  }
-
-  keyed_transforms.insert({to_key, current_transform});
-  return true;
-}
-
 // Constructor
 KimeraPgmoInterface::KimeraPgmoInterface()
     : full_mesh_updated_(false),
@@ -173,6 +150,19 @@ bool KimeraPgmoInterface::initializeFromConfig() {
   // If inliers are not fixed, need to perform interpolation on whole mesh
   // everytime we optimize
   deformation_graph_->setForceRecalculate(!config_.gnc_fix_prev_inliers);
+  deformation_graph_->setLoopClosureRetirement(
+      static_cast<size_t>(config_.retire_after_rejections),
+      config_.retire_weight_threshold);
+  // The deformation with the dpgmo values does not follow the local optimization
+  if (config_.mode != RunMode::DPGMO) {
+    deformation_graph_->setRegionOfInfluence(config_.region_translation_tol,
+                                             config_.region_rotation_tol);
+  }
+
+  if (config_.mesh_index_resolution > 0.0) {
+    optimized_mesh_index_ =
+        std::make_shared<MeshSpatialIndex>(config_.mesh_index_resolution);
+  }
 
   return true;
 }
@@ -235,6 +225,7 @@ ProcessPoseGraphStatus KimeraPgmoInterface::processIncrementalPoseGraph(
     Path* initial_trajectory,
     std::queue<size_t>* unconnected_nodes,
     std::vector<Timestamp>* node_timestamps) {
+  AllocationZone allocation_zone("KimeraPgmoInterface::processIncrementalPoseGraph");
   // if first node initialize
   //// Note that we assume for all node ids that the keys start with 0
   if (msg->nodes.size() > 0 && msg->nodes[0].key == 0 &&
@@ -249,10 +240,7 @@ ProcessPoseGraphStatus KimeraPgmoInterface::processIncrementalPoseGraph(
         key_symb.key(), init_pose, config_.b_add_initial_prior, config_.prior_variance);
 
     // Create first sparse frame
-    SparseKeyframe init_sparse_frame;
-    init_sparse_frame.initialize(key_symb, msg->nodes[0].robot_id, msg->nodes[0].key);
-    sparse_frames_.insert({key_symb, init_sparse_frame});
-    full_sparse_frame_map_.insert({key_symb, key_symb});
+    sparse_frames_.addKeyframe(key_symb, key_symb);
     keyed_stamps_.insert({key_symb, msg->nodes[0].header.stamp.toNSec()});
 
     // Add to trajectory and timestamp map
@@ -286,31 +274,30 @@ ProcessPoseGraphStatus KimeraPgmoInterface::processIncrementalPoseGraph(
           return ProcessPoseGraphStatus::INVALID;
         }
 
-        if (!full_sparse_frame_map_.count(from_key)) {
+        if (!sparse_frames_.hasPose(from_key)) {
           ROS_ERROR("Missing from node %s in odometry edge.",
                     gtsam::DefaultKeyFormatter(from_key).c_str());
           return ProcessPoseGraphStatus::MISSING;
         }
-        if (full_sparse_frame_map_.count(from_key) &&
-            full_sparse_frame_map_.count(to_key)) {
+        if (sparse_frames_.hasPose(to_key)) {
           ROS_WARN("Duplicated edge. ");
           continue;
         }
-        gtsam::Key sparse_key = full_sparse_frame_map_.at(from_key);
-        bool add_to_sparse_frame = sparse_frames_[sparse_key].addNewEdge(
-            pg_edge, config_.trans_sparse_dist, config_.rot_sparse_dist);
+        gtsam::Key sparse_key = sparse_frames_.getKeyframe(from_key);
+        bool add_to_sparse_frame = sparse_frames_.addOdometry(sparse_key,
+                                                              to_key,
+                                                              measure,
+                                                              config_.trans_sparse_dist,
+                                                              config_.rot_sparse_dist);
         if (add_to_sparse_frame && config_.b_enable_sparsify) {
-          full_sparse_frame_map_.insert({to_key, sparse_key});
+          sparse_frames_.absorbPose(sparse_key, to_key);
           keyed_stamps_.insert({to_key, pg_edge.header.stamp.toNSec()});
           node_timestamps->back() = pg_edge.header.stamp.toNSec();
         } else {
-          sparse_frames_[sparse_key].active = false;
+          sparse_frames_.deactivate(sparse_key);
           sparse_key = sparse_key + 1;
-          full_sparse_frame_map_.insert({to_key, sparse_key});
+          sparse_frames_.addKeyframe(sparse_key, to_key);
           keyed_stamps_.insert({to_key, pg_edge.header.stamp.toNSec()});
-          SparseKeyframe new_sparse_frame;
-          new_sparse_frame.initialize(sparse_key, robot_from, current_node);
-          sparse_frames_[sparse_key] = new_sparse_frame;
 
           const Vertex current_sparse_node = gtsam::Symbol(sparse_key).index();
           if (initial_trajectory->size() != current_sparse_node) {
@@ -329,7 +316,7 @@ ProcessPoseGraphStatus KimeraPgmoInterface::processIncrementalPoseGraph(
           // Calculate pose of new node
           const gtsam::Pose3& new_pose =
               initial_trajectory->at(current_sparse_node - 1)
-                  .compose(sparse_frames_[sparse_key - 1].current_transform);
+                  .compose(sparse_frames_.getCurrentTransform(sparse_key - 1));
           // Add to trajectory and timestamp maps
           if (initial_trajectory->size() == current_sparse_node)
             initial_trajectory->push_back(new_pose);
@@ -342,30 +329,28 @@ ProcessPoseGraphStatus KimeraPgmoInterface::processIncrementalPoseGraph(
           deformation_graph_->addNewBetween(
               sparse_key - 1,
               sparse_key,
-              sparse_frames_[sparse_key - 1].current_transform,
+              sparse_frames_.getCurrentTransform(sparse_key - 1),
               new_pose,
               config_.odom_variance);
         }
       } else if (pg_edge.type == pose_graph_tools_msgs::PoseGraphEdge::LOOPCLOSE &&
                  config_.mode == RunMode::FULL) {
-        if (!full_sparse_frame_map_.count(from_key) ||
-            !full_sparse_frame_map_.count(to_key)) {
+        if (!sparse_frames_.hasPose(from_key) || !sparse_frames_.hasPose(to_key)) {
           ROS_ERROR("Caught loop closure between unknown nodes.");
           return ProcessPoseGraphStatus::LC_MISSING_NODES;
         }
-        gtsam::Key from_sparse_key = full_sparse_frame_map_.at(from_key);
-        gtsam::Key to_sparse_key = full_sparse_frame_map_.at(to_key);
+        gtsam::Key from_sparse_key = sparse_frames_.getKeyframe(from_key);
+        gtsam::Key to_sparse_key = sparse_frames_.getKeyframe(to_key);
         // measure = from_T_to. sparse_from_T_sparse_to = sparse_from_T_from * from_T_to
         // * (sparse_to_T_to)^(-1)
-        if (loop_closures_.count(from_sparse_key) &&
-            loop_closures_.at(from_sparse_key).count(to_sparse_key)) {
+        if (sparse_frames_.hasLoopClosure(from_sparse_key, to_sparse_key)) {
           // Loop closure already exists TODO(yun) add flag to toggle this check
           continue;
         }
 
         gtsam::Pose3 from_sparse_T_to_sparse =
-            sparse_frames_.at(from_sparse_key).keyed_transforms.at(from_key) * measure *
-            sparse_frames_.at(to_sparse_key).keyed_transforms.at(to_key).inverse();
+            sparse_frames_.getTransform(from_key) * measure *
+            sparse_frames_.getTransform(to_key).inverse();
         // Loop closure edge (only add if we are in full
         // optimization mode ) Add to deformation graph
         deformation_graph_->addNewBetween(from_sparse_key,
@@ -373,14 +358,7 @@ ProcessPoseGraphStatus KimeraPgmoInterface::processIncrementalPoseGraph(
                                           from_sparse_T_to_sparse,
                                           gtsam::Pose3(),
                                           config_.lc_variance);
-        if (!loop_closures_.count(from_sparse_key)) {
-          loop_closures_[from_sparse_key] = std::set<gtsam::Key>();
-        }
-        if (!loop_closures_.count(to_sparse_key)) {
-          loop_closures_[to_sparse_key] = std::set<gtsam::Key>();
-        }
-        loop_closures_[from_sparse_key].insert(to_sparse_key);
-        loop_closures_[to_sparse_key].insert(from_sparse_key);
+        sparse_frames_.addLoopClosure(from_sparse_key, to_sparse_key);
         ROS_INFO(
             "KimeraPgmo: Loop closure detected between robot %d node %d and "
             "robot %d node %d.",
@@ -413,23 +391,63 @@ void KimeraPgmoInterface::processOptimizedPath(const nav_msgs::Path::ConstPtr& p
   deformation_graph_->addNodeMeasurements(node_estimates, config_.prior_variance);
 }
 
+namespace {
+
+// Version of a full mesh for the deformed mesh cache of the deformation graph: the
+// frontend stamps every full mesh it publishes, and the sizes tell apart meshes
+// sent with the same stamp. Messages without a stamp are hashed instead (0)
+inline uint64_t fullMeshVersion(const KimeraPgmoMesh& mesh_msg) {
+  if (mesh_msg.header.stamp.isZero()) {
+    return 0;
+  }
+
+  const uint64_t version = mesh_msg.header.stamp.toNSec() ^
+                           (static_cast<uint64_t>(mesh_msg.vertices.size()) << 40) ^
+                           (static_cast<uint64_t>(mesh_msg.triangles.size()) << 20);
+  return version == 0 ? 1 : version;
+}
+
+}  // namespace
+
+DeformedMeshConstPtr KimeraPgmoInterface::deformFullMesh(
+    const KimeraPgmoMesh& mesh_msg, std::vector<Timestamp>* mesh_vertex_stamps) {
+  std::vector<int> mesh_vertex_graph_inds;
+  const pcl::PolygonMesh& input_mesh =
+      PgmoMeshMsgToPolygonMesh(mesh_msg, mesh_vertex_stamps, &mesh_vertex_graph_inds);
+  if (input_mesh.cloud.height * input_mesh.cloud.width == 0) {
+    return nullptr;
+  }
+
+  try {
+    return deformation_graph_->deformMeshShared(input_mesh,
+                                                *mesh_vertex_stamps,
+                                                mesh_vertex_graph_inds,
+                                                GetVertexPrefix(mesh_msg.id),
+                                                config_.num_interp_pts,
+                                                config_.interp_horizon,
+                                                fullMeshVersion(mesh_msg));
+  } catch (const std::out_of_range& e) {
+    ROS_ERROR("Failed to deform mesh. Out of range error. ");
+    return nullptr;
+  }
+}
+
 bool KimeraPgmoInterface::optimizeFullMesh(const KimeraPgmoMesh& mesh_msg,
                                            pcl::PolygonMesh::Ptr optimized_mesh,
                                            std::vector<Timestamp>* mesh_vertex_stamps,
                                            bool do_optimize) {
-  std::vector<int> mesh_vertex_graph_inds;
-  const pcl::PolygonMesh& input_mesh =
-      PgmoMeshMsgToPolygonMesh(mesh_msg, mesh_vertex_stamps, &mesh_vertex_graph_inds);
+  AllocationZone allocation_zone("KimeraPgmoInterface::optimizeFullMesh");
   // check if empty
-  if (input_mesh.cloud.height * input_mesh.cloud.width == 0) return false;
+  if (mesh_msg.vertices.empty()) return false;
 
   size_t robot_id = mesh_msg.id;
 
-  std_msgs::Header mesh_header = mesh_msg.header;
-
   // Optimize mesh
-  try {
-    if (config_.mode == RunMode::DPGMO) {
+  if (config_.mode == RunMode::DPGMO) {
+    std::vector<int> mesh_vertex_graph_inds;
+    const pcl::PolygonMesh& input_mesh =
+        PgmoMeshMsgToPolygonMesh(mesh_msg, mesh_vertex_stamps, &mesh_vertex_graph_inds);
+    try {
       // Here we are getting the optimized values from the dpgo solver
       *optimized_mesh = deformation_graph_->deformMesh(input_mesh,
                                                        *mesh_vertex_stamps,
@@ -438,30 +456,139 @@ bool KimeraPgmoInterface::optimizeFullMesh(const KimeraPgmoMesh& mesh_msg,
                                                        dpgmo_values_,
                                                        config_.num_interp_pts,
                                                        config_.interp_horizon);
-    } else {
-      if (do_optimize) {
-        deformation_graph_->optimize();
-      }
-      *optimized_mesh = deformation_graph_->deformMesh(input_mesh,
-                                                       *mesh_vertex_stamps,
-                                                       mesh_vertex_graph_inds,
-                                                       GetVertexPrefix(robot_id),
-                                                       config_.num_interp_pts,
-                                                       config_.interp_horizon);
+    } catch (const std::out_of_range& e) {
+      ROS_ERROR("Failed to deform mesh. Out of range error. ");
+      return false;
+    }
+  } else {
+    if (do_optimize) {
+      deformation_graph_->optimize();
+    }
+    const DeformedMeshConstPtr deformed = deformFullMesh(mesh_msg, mesh_vertex_stamps);
+    if (!deformed) {
+      return false;
+    }
+    *optimized_mesh = *deformed;
+    if (do_optimize) {
+      updateMeshUpdateStats(robot_id);
     }
+  }
+
+  // Only faces that moved to other buckets are re-indexed
+  if (config_.mesh_index_resolution > 0.0) {
+    updateOptimizedMeshIndex(*optimized_mesh, GetVertexPrefix(robot_id));
+  }
+
+  full_mesh_updated_ = true;
+  return true;
+}
+
+bool KimeraPgmoInterface::optimizeFullMesh(const MeshDeltaMirror& mirror,
+                                           size_t robot_id,
+                                           pcl::PolygonMesh::Ptr optimized_mesh,
+                                           std::vector<Timestamp>* mesh_vertex_stamps,
+                                           bool do_optimize) {
+  AllocationZone allocation_zone("KimeraPgmoInterface::optimizeFullMesh");
+  if (mirror.numVertices() == 0) return false;
+
+  const char prefix = GetVertexPrefix(robot_id);
+  if (config_.mode != RunMode::DPGMO && do_optimize) {
+    deformation_graph_->optimize();
+  }
+
+  // Unchanged vertices older than the interpolation horizon of the newest
+  // control point keep their cached deformation
+  size_t start_idx = mirror.firstChangedVertex();
+  if (deformation_graph_->hasVertexKey(prefix)) {
+    const Timestamp last_stamp =
+        deformation_graph_->getControlPoints(prefix).lastStamp();
+    const Timestamp horizon = stampFromSec(config_.interp_horizon);
+    const Timestamp min_stamp = last_stamp > horizon ? last_stamp - horizon : 0;
+    const auto& stamps = mirror.stamps();
+    const size_t stamp_start =
+        std::upper_bound(stamps.begin(), stamps.end(), min_stamp) - stamps.begin();
+    start_idx = std::min(start_idx, stamp_start);
+  }
+
+  // the cached vertices are deformed again without the deformed mesh cache, so a
+  // cached full mesh no longer matches what the mesh index and updates follow
+  deformation_graph_->clearDeformedMeshCache();
+  pcl::PointCloud<pcl::PointXYZRGBA> new_vertices = mirror.vertices();
+  try {
+    const gtsam::Values& values = config_.mode == RunMode::DPGMO
+                                      ? dpgmo_values_
+                                      : deformation_graph_->getGtsamValues();
+    deformation_graph_->deformPoints(new_vertices,
+                                     mirror.vertices(),
+                                     mirror.stamps(),
+                                     prefix,
+                                     values,
+                                     config_.num_interp_pts,
+                                     config_.interp_horizon,
+                                     &mirror.graphIndices(),
+                                     static_cast<int>(start_idx));
   } catch (const std::out_of_range& e) {
     ROS_ERROR("Failed to deform mesh. Out of range error. ");
     return false;
   }
 
+  optimized_mesh->polygons = mirror.faces();
+  pcl::toPCLPointCloud2(new_vertices, optimized_mesh->cloud);
+  *mesh_vertex_stamps = mirror.stamps();
+  if (config_.mode != RunMode::DPGMO && do_optimize) {
+    updateMeshUpdateStats(robot_id);
+  }
+
+  if (config_.mesh_index_resolution > 0.0) {
+    updateOptimizedMeshIndex(*optimized_mesh, prefix);
+  }
+
   full_mesh_updated_ = true;
   return true;
 }
 
+void KimeraPgmoInterface::updateOptimizedMeshIndex(const pcl::PolygonMesh& mesh,
+                                                   char prefix) {
+  // only the vertices deformed again are read
+  const DeformedVertices& deformed =
+      deformation_graph_->getLastDeformedVertices(prefix);
+  const size_t num_vertices = mesh.cloud.width * mesh.cloud.height;
+  MeshSpatialIndex& index = writableOptimizedMeshIndex();
+  if (deformed.full || deformed.num_vertices != num_vertices) {
+    index.update(mesh);
+  } else {
+    index.update(mesh, deformed.moved, deformed.start);
+  }
+}
+
+MeshSpatialIndex& KimeraPgmoInterface::writableOptimizedMeshIndex() {
+  // snapshots handed out are queried concurrently, only update an unshared index
+  if (!optimized_mesh_index_) {
+    optimized_mesh_index_ =
+        std::make_shared<MeshSpatialIndex>(config_.mesh_index_resolution);
+  } else if (optimized_mesh_index_.use_count() > 1) {
+    optimized_mesh_index_ = std::make_shared<MeshSpatialIndex>(*optimized_mesh_index_);
+  }
+  return *optimized_mesh_index_;
+}
+
+void KimeraPgmoInterface::updateMeshUpdateStats(size_t robot_id) {
+  const RegionOfInfluence& region = deformation_graph_->getLastRegionOfInfluence();
+  const DeformedVertices& deformed =
+      deformation_graph_->getLastDeformedVertices(GetVertexPrefix(robot_id));
+  last_update_stats_.num_poses = region.num_poses;
+  last_update_stats_.num_moved_poses = region.moved_poses.size();
+  last_update_stats_.num_control_points = region.num_control_points;
+  last_update_stats_.num_moved_control_points = region.numMovedControlPoints();
+  last_update_stats_.num_vertices = deformed.num_vertices;
+  last_update_stats_.num_deformed_vertices = deformed.size();
+}
+
 ProcessMeshGraphStatus KimeraPgmoInterface::processIncrementalMeshGraph(
     const pose_graph_tools_msgs::PoseGraph::ConstPtr& mesh_graph_msg,
     const std::vector<Timestamp>& node_timestamps,
     std::queue<size_t>* unconnected_nodes) {
+  AllocationZone allocation_zone("KimeraPgmoInterface::processIncrementalMeshGraph");
   if (mesh_graph_msg->edges.size() == 0 || mesh_graph_msg->nodes.size() == 0) {
     ROS_DEBUG("processIncrementalMeshGraph: 0 nodes or 0 edges in mesh graph msg. ");
     return ProcessMeshGraphStatus::EMPTY;
@@ -513,6 +640,51 @@ ProcessMeshGraphStatus KimeraPgmoInterface::processIncrementalMeshGraph(
                                               &new_index_stamps,
                                               config_.mesh_edge_variance);
   assert(new_indices.size() == new_index_stamps.size());
+  connectNewMeshVertices(
+      robot_id, new_indices, new_index_stamps, node_timestamps, unconnected_nodes);
+  return ProcessMeshGraphStatus::SUCCESS;
+}
+
+ProcessMeshGraphStatus KimeraPgmoInterface::processIncrementalMeshGraph(
+    const KimeraPgmoMeshGraph::ConstPtr& mesh_graph_msg,
+    const std::vector<Timestamp>& node_timestamps,
+    std::queue<size_t>* unconnected_nodes) {
+  AllocationZone allocation_zone("KimeraPgmoInterface::processIncrementalMeshGraph");
+  if (mesh_graph_msg->edges.size() == 0 || mesh_graph_msg->node_indices.size() == 0) {
+    ROS_DEBUG("processIncrementalMeshGraph: 0 nodes or 0 edges in mesh graph msg. ");
+    return ProcessMeshGraphStatus::EMPTY;
+  }
+  const size_t num_nodes = mesh_graph_msg->node_indices.size();
+  if (mesh_graph_msg->node_positions.size() != 3 * num_nodes ||
+      mesh_graph_msg->node_stamps.size() != num_nodes ||
+      mesh_graph_msg->edges.size() % 2 != 0) {
+    ROS_WARN(
+        "processIncrementalMeshGraph: inconsistent array sizes in mesh graph "
+        "msg. ");
+    return ProcessMeshGraphStatus::INVALID;
+  }
+
+  // Add to deformation graph directly from the packed arrays
+  std::vector<size_t> new_indices;
+  std::vector<Timestamp> new_index_stamps;
+  deformation_graph_->addNewMeshEdgesAndNodes(*mesh_graph_msg,
+                                              &new_indices,
+                                              &new_index_stamps,
+                                              config_.mesh_edge_variance);
+  connectNewMeshVertices(mesh_graph_msg->robot_id,
+                         new_indices,
+                         new_index_stamps,
+                         node_timestamps,
+                         unconnected_nodes);
+  return ProcessMeshGraphStatus::SUCCESS;
+}
+
+void KimeraPgmoInterface::connectNewMeshVertices(
+    size_t robot_id,
+    const std::vector<size_t>& new_indices,
+    const std::vector<Timestamp>& new_index_stamps,
+    const std::vector<Timestamp>& node_timestamps,
+    std::queue<size_t>* unconnected_nodes) {
   bool connection = false;
   if (!unconnected_nodes->empty() && new_indices.size() > 0) {
     std::map<size_t, std::vector<size_t>> node_valences;
@@ -558,8 +730,6 @@ ProcessMeshGraphStatus KimeraPgmoInterface::processIncrementalMeshGraph(
   if (!connection && new_indices.size() > 0) {
     ROS_WARN("KimeraPgmo: Partial mesh not connected to pose graph. ");
   }
-
-  return ProcessMeshGraphStatus::SUCCESS;
 }
 
 bool KimeraPgmoInterface::saveMesh(const pcl::PolygonMesh& mesh,
@@ -599,25 +769,27 @@ bool KimeraPgmoInterface::saveDeformationGraph(const std::string& dgrf_name) {
 }
 
 bool KimeraPgmoInterface::savePoseGraphSparseMapping(const std::string& output_path) {
-  std::ofstream outfile;
-  outfile.open(output_path);
-  outfile << "full-key,sparse-key,x,y,z,qw,qx,qy,qz\n";
-  // TODO this doesn't save all infromation of the sparse frames
-  for (const auto& mapping : full_sparse_frame_map_) {
-    outfile << std::to_string(mapping.first) << "," << std::to_string(mapping.second);
-    const auto& sparse_frame = sparse_frames_.at(mapping.second);
-    const gtsam::Pose3& rel_pose = sparse_frame.keyed_transforms.at(mapping.first);
-    const gtsam::Point3& pos = rel_pose.translation();
-    const gtsam::Quaternion& quat = rel_pose.rotation().toQuaternion();
-    outfile << "," << pos.x() << "," << pos.y() << "," << pos.z() << "," << quat.w()
-            << "," << quat.x() << "," << quat.y() << "," << quat.z() << "\n";
-  }
-  outfile.close();
+  BinaryWriter writer(output_path);
+  writer.write(kSparseMappingMagic);
+  writer.write(kSparseMappingVersion);
+  sparse_frames_.save(writer);
+  if (!writer.ok()) {
+    ROS_ERROR_STREAM("KimeraPgmo: failed to write sparse mapping to " << output_path);
+    return false;
+  }
   return true;
 }
 
-bool KimeraPgmoInterface::loadPoseGraphSparseMapping(const std::string& input_path) {
+namespace {
+
+// Older sparse mappings were saved as csv, one line per pose:
+// full-key,sparse-key,x,y,z,qw,qx,qy,qz
+bool ReadPoseGraphSparseMappingCsv(const std::string& input_path,
+                                   SparseKeyframes* mapping) {
   std::ifstream infile(input_path);
+  if (!infile.is_open()) {
+    return false;
+  }
 
   // Values that will be filled
   gtsam::Key full_key, sparse_key;
@@ -653,18 +825,48 @@ bool KimeraPgmoInterface::loadPoseGraphSparseMapping(const std::string& input_pa
     std::getline(ss, token, ',');
     qz = std::stod(token);
 
-    full_sparse_frame_map_.insert({full_key, sparse_key});
-    if (sparse_frames_.count(sparse_key) == 0) {
-      sparse_frames_.insert({sparse_key, SparseKeyframe()});
-    }
     gtsam::Pose3 transform =
         gtsam::Pose3(gtsam::Rot3(qw, qx, qy, qz), gtsam::Point3(tx, ty, tz));
-    sparse_frames_[sparse_key].keyed_transforms.insert({full_key, transform});
+    mapping->insert(full_key, sparse_key, transform);
   }
   infile.close();
   return true;
 }
 
+}  // namespace
+
+bool ReadPoseGraphSparseMapping(const std::string& input_path,
+                                SparseKeyframes* mapping) {
+  BinaryReader reader(input_path);
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  reader.read(magic);
+  reader.read(version);
+  if (!reader.ok() || magic != kSparseMappingMagic) {
+    return ReadPoseGraphSparseMappingCsv(input_path, mapping);
+  }
+
+  if (version != kSparseMappingVersion || !mapping->load(reader)) {
+    ROS_ERROR_STREAM("KimeraPgmo: " << input_path << " is not a valid sparse mapping");
+    return false;
+  }
+  return true;
+}
+
+void KimeraPgmoInterface::addPoseGraphSparseMapping(const SparseKeyframes& mapping) {
+  sparse_frames_.merge(mapping);
+}
+
+bool KimeraPgmoInterface::loadPoseGraphSparseMapping(const std::string& input_path) {
+  SparseKeyframes mapping;
+  if (!ReadPoseGraphSparseMapping(input_path, &mapping)) {
+    ROS_ERROR_STREAM("KimeraPgmo: failed to read sparse mapping " << input_path);
+    return false;
+  }
+  addPoseGraphSparseMapping(mapping);
+  return true;
+}
+
 bool KimeraPgmoInterface::getConsistencyFactors(
     const size_t& robot_id,
     pose_graph_tools_msgs::PoseGraph* pg_mesh_msg,
@@ -729,10 +931,10 @@ bool KimeraPgmoInterface::getConsistencyFactors(
     // poses/positions
     switch (pg_edge.type) {
       case pose_graph_tools_msgs::PoseGraphEdge::MESH: {
-        const gtsam::Point3& vertex_pos_from =
+        const gtsam::Point3 vertex_pos_from =
             deformation_graph_->getInitialPositionVertex(vertex_prefix,
                                                          pg_edge.key_from);
-        const gtsam::Point3& vertex_pos_to =
+        const gtsam::Point3 vertex_pos_to =
             deformation_graph_->getInitialPositionVertex(vertex_prefix, pg_edge.key_to);
         pg_edge.pose =
             GtsamToRos(gtsam::Pose3(gtsam::Rot3(), vertex_pos_to - vertex_pos_from));
@@ -746,7 +948,7 @@ bool KimeraPgmoInterface::getConsistencyFactors(
       case pose_graph_tools_msgs::PoseGraphEdge::POSE_MESH: {
         const gtsam::Pose3& pose_from =
             deformation_graph_->getInitialPose(robot_prefix, pg_edge.key_from);
-        const gtsam::Point3& vertex_pos_to =
+        const gtsam::Point3 vertex_pos_to =
             deformation_graph_->getInitialPositionVertex(vertex_prefix, pg_edge.key_to);
         pg_edge.pose =
             GtsamToRos(gtsam::Pose3(gtsam::Rot3(),
@@ -759,7 +961,7 @@ bool KimeraPgmoInterface::getConsistencyFactors(
         break;
       }
       case pose_graph_tools_msgs::PoseGraphEdge::MESH_POSE: {
-        const gtsam::Point3& vertex_pos_from =
+        const gtsam::Point3 vertex_pos_from =
             deformation_graph_->getInitialPositionVertex(vertex_prefix,
                                                          pg_edge.key_from);
         const gtsam::Pose3& pose_to =
@@ -777,14 +979,15 @@ bool KimeraPgmoInterface::getConsistencyFactors(
   if (pg_mesh_msg->edges.size() == 0) return false;
 
   // Get the nodes from the deformation graph
-  const std::vector<gtsam::Point3>& initial_positions =
-      deformation_graph_->getInitialPositionsVertices(vertex_prefix);
+  const ControlPointStore& initial_positions =
+      deformation_graph_->getControlPoints(vertex_prefix);
 
   for (size_t i = 0; i < initial_positions.size(); i++) {
     pose_graph_tools_msgs::PoseGraphNode pg_node;
     pg_node.robot_id = robot_id;
     pg_node.key = i + vertex_index_offset;
-    pg_node.pose = GtsamToRos(gtsam::Pose3(gtsam::Rot3(), initial_positions[i]));
+    pg_node.pose =
+        GtsamToRos(gtsam::Pose3(gtsam::Rot3(), initial_positions.position(i)));
     pg_mesh_msg->nodes.push_back(pg_node);
   }
   return true;
@@ -831,10 +1034,10 @@ Path KimeraPgmoInterface::getOptimizedTrajectory(const size_t& robot_id) const {
   Path optimized_traj_interpolated;
   for (size_t i = 0; i < optimized_traj.size(); i++) {
     gtsam::Key sparse_key = gtsam::Symbol(robot_prefix, i);
-    for (const auto& keyed_pose : sparse_frames_.at(sparse_key).keyed_transforms) {
-      optimized_traj_interpolated.push_back(
-          optimized_traj[i].compose(keyed_pose.second));
-    }
+    sparse_frames_.forEachPose(
+        sparse_key, [&](gtsam::Key, const gtsam::Pose3& transform) {
+          optimized_traj_interpolated.push_back(optimized_traj[i].compose(transform));
+        });
   }
   return optimized_traj_interpolated;
 }
@@ -847,9 +1050,9 @@ std::vector<Timestamp> KimeraPgmoInterface::getRobotTimestamps(
   Path optimized_traj = deformation_graph_->getOptimizedTrajectory(robot_prefix);
   for (size_t i = 0; i < optimized_traj.size(); i++) {
     gtsam::Key sparse_key = gtsam::Symbol(robot_prefix, i);
-    for (const auto& keyed_pose : sparse_frames_.at(sparse_key).keyed_transforms) {
-      stamps.push_back(keyed_stamps_.at(keyed_pose.first));
-    }
+    sparse_frames_.forEachPose(sparse_key, [&](gtsam::Key key, const gtsam::Pose3&) {
+      stamps.push_back(keyed_stamps_.at(key));
+    });
   }
   return stamps;
 }
@@ -861,19 +1064,194 @@ bool KimeraPgmoInterface::loadGraphAndMesh(const size_t& robot_id,
                                            pcl::PolygonMesh::Ptr optimized_mesh,
                                            std::vector<Timestamp>* mesh_vertex_stamps,
                                            bool do_optimize) {
-  pcl::PolygonMeshPtr mesh(new pcl::PolygonMesh());
-  kimera_pgmo::ReadMeshWithStampsFromPly(ply_path, mesh, mesh_vertex_stamps);
+  SessionFiles session;
+  session.robot_id = robot_id;
+  session.ply_path = ply_path;
+  session.dgrf_path = dgrf_path;
+  session.sparse_mapping_path = sparse_mapping_file_path;
+
+  std::vector<pcl::PolygonMesh::Ptr> optimized_meshes{optimized_mesh};
+  std::vector<std::vector<Timestamp>> stamps;
+  const bool success = loadSessions({session}, &optimized_meshes, &stamps, do_optimize);
+  *mesh_vertex_stamps = std::move(stamps.front());
+  return success;
+}
+
+namespace {
+
+using LoadClock = std::chrono::steady_clock;
 
-  KimeraPgmoMesh mesh_msg =
-      PolygonMeshToPgmoMeshMsg(robot_id, *mesh, *mesh_vertex_stamps, "world");
+inline double secondsSince(const LoadClock::time_point& start) {
+  return std::chrono::duration<double>(LoadClock::now() - start).count();
+}
 
-  loadPoseGraphSparseMapping(sparse_mapping_file_path);
-  loadDeformationGraphFromFile(dgrf_path);
+struct LoadedSession {
+  pcl::PolygonMesh mesh;
+  std::vector<Timestamp> stamps;
+  DeformationGraphFile graph;
+  SparseKeyframes sparse_mapping;
+  bool mesh_read = false;
+  bool graph_read = false;
+  bool sparse_mapping_read = true;  // sessions without a mapping are not sparsified
+  double read_mesh_time = 0.0;
+  double parse_graph_time = 0.0;
+  double parse_sparse_mapping_time = 0.0;
+};
+
+}  // namespace
+
+std::ostream& operator<<(std::ostream& out, const SessionLoadTimes& times) {
+  out << "read (wall): " << times.read_phase << " s [mesh: " << times.read_mesh
+      << " s, graph: " << times.parse_graph
+      << " s, sparse mapping: " << times.parse_sparse_mapping
+      << " s], merge: " << times.merge << " s, optimize: " << times.optimize
+      << " s, deform: " << times.deform << " s, total: " << times.total << " s";
+  return out;
+}
+
+bool KimeraPgmoInterface::loadSessions(
+    const std::vector<SessionFiles>& sessions,
+    std::vector<pcl::PolygonMesh::Ptr>* optimized_meshes,
+    std::vector<std::vector<Timestamp>>* mesh_vertex_stamps,
+    bool do_optimize,
+    SessionLoadTimes* times) {
+  const auto start = LoadClock::now();
+  SessionLoadTimes load_times;
+
+  // Read phase: every file of every session is read and parsed concurrently
+  std::vector<LoadedSession> loaded(sessions.size());
+  std::vector<std::function<void()>> tasks;
+  for (size_t i = 0; i < sessions.size(); ++i) {
+    const SessionFiles& files = sessions[i];
+    LoadedSession& session = loaded[i];
+    tasks.emplace_back([&files, &session]() {
+      const auto task_start = LoadClock::now();
+      try {
+        ReadMeshWithStampsFromPly(files.ply_path, session.mesh, &session.stamps);
+        session.mesh_read = true;
+      } catch (const std::exception& e) {
+        ROS_ERROR_STREAM("KimeraPgmo: failed to read " << files.ply_path << ": "
+                                                       << e.what());
+      }
+      session.read_mesh_time = secondsSince(task_start);
+    });
+    tasks.emplace_back([&files, &session]() {
+      const auto task_start = LoadClock::now();
+      session.graph_read = ReadDeformationGraphFile(files.dgrf_path,
+                                                    &session.graph,
+                                                    true,
+                                                    files.set_robot_id,
+                                                    files.robot_id);
+      session.parse_graph_time = secondsSince(task_start);
+    });
+    if (!files.sparse_mapping_path.empty()) {
+      tasks.emplace_back([&files, &session]() {
+        const auto task_start = LoadClock::now();
+        session.sparse_mapping_read = ReadPoseGraphSparseMapping(
+            files.sparse_mapping_path, &session.sparse_mapping);
+        session.parse_sparse_mapping_time = secondsSince(task_start);
+      });
+    }
+  }
+
+  const size_t num_threads = std::max<size_t>(
+      1, std::min<size_t>(tasks.size(), std::thread::hardware_concurrency()));
+  std::atomic<size_t> next_task(0);
+  auto worker = [&]() {
+    for (size_t t = next_task++; t < tasks.size(); t = next_task++) {
+      tasks[t]();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  load_times.read_phase = secondsSince(start);
+
+  // Merge phase: all the sessions are added to the graph in one update
+  const auto merge_start = LoadClock::now();
+  bool success = true;
+  DeformationGraphFile graph;
+  for (size_t i = 0; i < sessions.size(); ++i) {
+    LoadedSession& session = loaded[i];
+    load_times.read_mesh += session.read_mesh_time;
+    load_times.parse_graph += session.parse_graph_time;
+    load_times.parse_sparse_mapping += session.parse_sparse_mapping_time;
+    if (!session.graph_read) {
+      ROS_ERROR_STREAM("KimeraPgmo: failed to read " << sessions[i].dgrf_path);
+      success = false;
+      continue;
+    }
+    // the keyframes of the graph cannot be looked up without its mapping
+    if (!session.sparse_mapping_read) {
+      ROS_ERROR_STREAM("KimeraPgmo: failed to read sparse mapping "
+                       << sessions[i].sparse_mapping_path);
+      session.graph_read = false;
+      success = false;
+      continue;
+    }
+    if (!graph.merge(session.graph)) {
+      ROS_ERROR_STREAM("KimeraPgmo: cannot load " << sessions[i].dgrf_path
+                                                  << " with the other sessions");
+      session.graph_read = false;
+      success = false;
+      continue;
+    }
+    addPoseGraphSparseMapping(session.sparse_mapping);
+  }
+  deformation_graph_->load(graph);
+  num_loop_closures_ = deformation_graph_->getNumLoopclosures();
+  load_times.merge = secondsSince(merge_start);
   ROS_INFO_STREAM("Loaded new graph. Currently have "
                   << deformation_graph_->getNumVertices()
                   << "vertices in deformation graph and " << num_loop_closures_
                   << " loop closures.");
-  return optimizeFullMesh(mesh_msg, optimized_mesh, mesh_vertex_stamps, do_optimize);
+
+  // Optimize once for all the sessions, unless they were saved converged
+  const auto optimize_start = LoadClock::now();
+  if (do_optimize && config_.mode != RunMode::DPGMO) {
+    if (deformation_graph_->hasConvergedEstimate()) {
+      ROS_INFO("KimeraPgmo: loaded graph is converged, skipping optimization.");
+    } else {
+      deformation_graph_->optimize();
+    }
+  }
+  load_times.optimize = secondsSince(optimize_start);
+
+  const auto deform_start = LoadClock::now();
+  optimized_meshes->resize(sessions.size());
+  mesh_vertex_stamps->resize(sessions.size());
+  for (size_t i = 0; i < sessions.size(); ++i) {
+    LoadedSession& session = loaded[i];
+    auto& optimized_mesh = optimized_meshes->at(i);
+    if (!optimized_mesh) {
+      optimized_mesh.reset(new pcl::PolygonMesh());
+    }
+    auto& stamps = mesh_vertex_stamps->at(i);
+    stamps = std::move(session.stamps);
+    // the mesh of a session whose graph was not loaded cannot be deformed
+    if (!session.mesh_read || !session.graph_read) {
+      success = false;
+      continue;
+    }
+
+    const KimeraPgmoMesh mesh_msg =
+        PolygonMeshToPgmoMeshMsg(sessions[i].robot_id, session.mesh, stamps, "world");
+    success &= optimizeFullMesh(mesh_msg, optimized_mesh, &stamps, false);
+  }
+  load_times.deform = secondsSince(deform_start);
+  load_times.total = secondsSince(start);
+
+  ROS_INFO_STREAM("KimeraPgmo: loaded " << sessions.size() << " session(s) in "
+                                        << load_times);
+  if (times) {
+    *times = load_times;
+  }
+  return success;
 }
 
 }  // namespace kimera_pgmo
@@ -9,6 +9,9 @@
 #include <gtsam/geometry/Pose3.h>
 #include <pcl/octree/octree_search.h>
 
+#include <algorithm>
+#include <numeric>
+
 namespace kimera_pgmo {
 namespace deformation {
 
@@ -69,32 +72,54 @@ void SearchTree::search(const traits::Pos& point,
   impl_->search(point, k, nn_index, nn_sq_dist);
 }
 
-// Calculate new point location from k points
-traits::Pos interpPoint(std::set<size_t>& control_points_seen,
-                        char prefix,
-                        const std::vector<gtsam::Point3>& control_points,
-                        const gtsam::Values& values,
-                        const SearchTree& tree,
-                        size_t k,
-                        const traits::Pos& old_point) {
-  // Query octree
-  std::vector<int> nn_index;
+// Nearest k control points of a point (in the search tree) and their weights
+void nearestControlPoints(const SearchTree& tree,
+                          size_t k,
+                          const traits::Pos& point,
+                          std::vector<int>& nn_index,
+                          std::vector<double>& weights) {
   std::vector<float> nn_sq_dist;
-  tree.search(old_point, k + 1, nn_index, nn_sq_dist);
+  tree.search(point, k + 1, nn_index, nn_sq_dist);
+  weights.clear();
+  if (nn_index.size() < 2) {
+    nn_index.clear();
+    return;
+  }
 
   const double d_max = std::sqrt(nn_sq_dist[nn_index.size() - 1]);
   bool use_const_weight = std::sqrt(nn_sq_dist[0]) == d_max || d_max == 0;
 
+  // the farthest neighbor only sets the scale of the weights
+  nn_index.pop_back();
+  for (size_t j = 0; j < nn_index.size(); j++) {
+    weights.push_back(use_const_weight ? 1 : (1 - std::sqrt(nn_sq_dist[j]) / d_max));
+  }
+}
+
+// Calculate new point location from k points
+template <typename ControlPoints>
+traits::Pos interpPointImpl(std::set<size_t>& control_points_seen,
+                            char prefix,
+                            const ControlPoints& control_points,
+                            const gtsam::Values& values,
+                            const SearchTree& tree,
+                            size_t k,
+                            const traits::Pos& old_point) {
+  // Query octree
+  std::vector<int> nn_index;
+  std::vector<double> weights;
+  nearestControlPoints(tree, k, old_point, nn_index, weights);
+
   double weight_sum = 0;
   gtsam::Point3 new_point = gtsam::Point3::Zero();
   const gtsam::Point3 vi = old_point.cast<double>();
-  for (size_t j = 0; j < nn_index.size() - 1; j++) {
-    const auto& gj = control_points.at(nn_index[j]);
+  for (size_t j = 0; j < nn_index.size(); j++) {
+    const gtsam::Point3 gj = control_points.position(nn_index[j]);
 
-    double w = use_const_weight ? 1 : (1 - std::sqrt(nn_sq_dist[j]) / d_max);
+    const double w = weights[j];
     weight_sum += w;
     auto transform = values.at<gtsam::Pose3>(gtsam::Symbol(prefix, nn_index[j]));
-    const auto delta =
+    const gtsam::Point3 delta =
         w * (transform.rotation().rotate(vi - gj) + transform.translation());
 
     new_point += delta;
@@ -105,5 +130,246 @@ traits::Pos interpPoint(std::set<size_t>& control_points_seen,
   return new_point.cast<float>();
 }
 
+traits::Pos interpPoint(std::set<size_t>& control_points_seen,
+                        char prefix,
+                        const ControlPointStore& control_points,
+                        const gtsam::Values& values,
+                        const SearchTree& tree,
+                        size_t k,
+                        const traits::Pos& old_point) {
+  return interpPointImpl(
+      control_points_seen, prefix, control_points, values, tree, k, old_point);
+}
+
+traits::Pos interpPoint(std::set<size_t>& control_points_seen,
+                        char prefix,
+                        const ControlPointVectors& control_points,
+                        const gtsam::Values& values,
+                        const SearchTree& tree,
+                        size_t k,
+                        const traits::Pos& old_point) {
+  return interpPointImpl(
+      control_points_seen, prefix, control_points, values, tree, k, old_point);
+}
+
+bool InterpolationWeights::complete() const {
+  for (size_t i = 0; i < size(); ++i) {
+    if (offsets[i] == offsets[i + 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+InterpolationWeights computeInterpolationWeights(
+    const std::vector<gtsam::Point3>& points,
+    const std::vector<Timestamp>& stamps,
+    char prefix,
+    const ControlPointStore& control_points,
+    const gtsam::Values& values,
+    size_t k,
+    double tol_t) {
+  const bool use_stamps = !stamps.empty();
+  if (use_stamps && stamps.size() != points.size()) {
+    ROS_ERROR("computeInterpolationWeights: points and stamps sizes do not match.");
+    return {};
+  }
+
+  // control points and weights of every point, filled in stamp order
+  std::vector<std::vector<int>> point_control_points(points.size());
+  std::vector<std::vector<double>> point_weights(points.size());
+  auto interpolate = [&](const SearchTree& tree, size_t index, size_t num_neighbors) {
+    nearestControlPoints(tree,
+                         num_neighbors,
+                         points[index].cast<float>(),
+                         point_control_points[index],
+                         point_weights[index]);
+  };
+
+  SearchTree search_tree;
+  if (!use_stamps) {
+    for (size_t j = 0; j < control_points.size(); j++) {
+      search_tree.addPoint(control_points.position(j),
+                           values.exists(gtsam::Symbol(prefix, j)));
+    }
+
+    if (search_tree.getLeafCount() >= k) {
+      for (size_t i = 0; i < points.size(); ++i) {
+        interpolate(search_tree, i, k);
+      }
+    }
+  } else if (control_points.size() >= k) {
+    // same sliding time window over the control points as deformPoints
+    std::vector<size_t> order(points.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+      return stamps[lhs] < stamps[rhs];
+    });
+
+    size_t ctrl_pt_idx = 0;
+    size_t lower_ctrl_pt_idx = 0;
+    for (const size_t ii : order) {
+      const auto stamp = stamps[ii];
+      size_t num_ctrl_pts = search_tree.getLeafCount();
+      while (ctrl_pt_idx < control_points.size() &&
+             (control_points.stamp(ctrl_pt_idx) <= stamp + stampFromSec(tol_t) ||
+              num_ctrl_pts < k + 1)) {
+        const auto ctrl_valid = values.exists(gtsam::Symbol(prefix, ctrl_pt_idx));
+        search_tree.addPoint(control_points.position(ctrl_pt_idx), ctrl_valid);
+        ctrl_pt_idx++;
+        if (ctrl_valid) {
+          num_ctrl_pts++;
+        }
+      }
+
+      if (search_tree.getLeafCount() < k + 1) {
+        if (num_ctrl_pts > 1) {
+          k = num_ctrl_pts - 1;
+        } else {
+          continue;
+        }
+      }
+
+      interpolate(search_tree, ii, k);
+
+      size_t num_leaves = search_tree.getLeafCount();
+      while (lower_ctrl_pt_idx < control_points.size() && num_leaves > k + 1 &&
+             control_points.stamp(lower_ctrl_pt_idx) < stamp - stampFromSec(tol_t)) {
+        if (!values.exists(gtsam::Symbol(prefix, lower_ctrl_pt_idx))) {
+          lower_ctrl_pt_idx++;
+          continue;
+        }
+
+        search_tree.removePoint(lower_ctrl_pt_idx);
+        num_leaves--;
+        lower_ctrl_pt_idx++;
+      }
+    }
+  }
+
+  InterpolationWeights result;
+  result.offsets.reserve(points.size() + 1);
+  for (size_t i = 0; i < points.size(); ++i) {
+    const auto& nn_index = point_control_points[i];
+    const auto& weights = point_weights[i];
+    const double weight_sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+    for (size_t j = 0; j < nn_index.size(); ++j) {
+      result.control_points.push_back(nn_index[j]);
+      result.weights.push_back(weights[j] / weight_sum);
+      result.relative_points.push_back(points[i] -
+                                       control_points.position(nn_index[j]));
+    }
+    result.offsets.push_back(result.control_points.size());
+  }
+
+  return result;
+}
+
+size_t completeInterpolationWeights(InterpolationWeights& weights,
+                                    const std::vector<gtsam::Point3>& points,
+                                    const std::vector<Timestamp>& stamps,
+                                    char prefix,
+                                    const ControlPointStore& control_points,
+                                    const gtsam::Values& values,
+                                    size_t k,
+                                    double tol_t) {
+  if (weights.size() != points.size() ||
+      (!stamps.empty() && stamps.size() != points.size())) {
+    ROS_ERROR("completeInterpolationWeights: weights, points and stamps sizes do not "
+              "match.");
+    return 0;
+  }
+
+  std::vector<size_t> missing;
+  std::vector<gtsam::Point3> missing_points;
+  std::vector<Timestamp> missing_stamps;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    if (weights.offsets[i] != weights.offsets[i + 1]) {
+      continue;
+    }
+
+    missing.push_back(i);
+    missing_points.push_back(points[i]);
+    if (!stamps.empty()) {
+      missing_stamps.push_back(stamps[i]);
+    }
+  }
+
+  if (missing.empty()) {
+    return 0;
+  }
+
+  const auto found = computeInterpolationWeights(
+      missing_points, missing_stamps, prefix, control_points, values, k, tol_t);
+  if (found.size() != missing.size() || found.control_points.empty()) {
+    return 0;
+  }
+
+  // splice the control points of the missing points in between the others
+  InterpolationWeights result;
+  const size_t num_entries =
+      weights.control_points.size() + found.control_points.size();
+  result.offsets.reserve(weights.offsets.size());
+  result.control_points.reserve(num_entries);
+  result.weights.reserve(num_entries);
+  result.relative_points.reserve(num_entries);
+  size_t num_completed = 0;
+  size_t next_missing = 0;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    const InterpolationWeights* source = &weights;
+    size_t source_index = i;
+    if (next_missing < missing.size() && missing[next_missing] == i) {
+      source = &found;
+      source_index = next_missing;
+      ++next_missing;
+    }
+
+    const size_t begin = source->offsets[source_index];
+    const size_t end = source->offsets[source_index + 1];
+    if (source == &found && begin != end) {
+      ++num_completed;
+    }
+
+    result.control_points.insert(result.control_points.end(),
+                                 source->control_points.begin() + begin,
+                                 source->control_points.begin() + end);
+    result.weights.insert(result.weights.end(),
+                          source->weights.begin() + begin,
+                          source->weights.begin() + end);
+    result.relative_points.insert(result.relative_points.end(),
+                                  source->relative_points.begin() + begin,
+                                  source->relative_points.begin() + end);
+    result.offsets.push_back(result.control_points.size());
+  }
+
+  weights = std::move(result);
+  return num_completed;
+}
+
+void interpolatePoints(const InterpolationWeights& weights,
+                       const std::vector<gtsam::Point3>& points,
+                       char prefix,
+                       const gtsam::Values& values,
+                       size_t begin,
+                       size_t end,
+                       std::vector<gtsam::Point3>& deformed) {
+  for (size_t i = begin; i < end; ++i) {
+    if (weights.offsets[i] == weights.offsets[i + 1]) {
+      deformed[i] = points[i];
+      continue;
+    }
+
+    gtsam::Point3 new_point = gtsam::Point3::Zero();
+    for (size_t j = weights.offsets[i]; j < weights.offsets[i + 1]; ++j) {
+      const auto& transform =
+          values.at<gtsam::Pose3>(gtsam::Symbol(prefix, weights.control_points[j]));
+      new_point += weights.weights[j] * (transform.rotation().rotate(
+                                             weights.relative_points[j]) +
+                                         transform.translation());
+    }
+    deformed[i] = new_point;
+  }
+}
+
 }  // namespace deformation
 }  // namespace kimera_pgmo
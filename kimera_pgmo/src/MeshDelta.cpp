@@ -7,6 +7,7 @@
 #include "kimera_pgmo/MeshDelta.h"
 
 #include <numeric>
+#include <stdexcept>
 
 namespace kimera_pgmo {
 
@@ -95,10 +96,20 @@ MeshDelta::MeshDelta(size_t vertex_start, size_t face_start)
 MeshDelta::MeshDelta(const KimeraPgmoMeshDelta& msg)
     : vertex_start(msg.vertex_start),
       face_start(msg.face_start),
-      stamp_updates(msg.stamp_updates),
-      semantic_updates(msg.semantic_updates) {
+      stamp_updates(msg.stamp_updates) {
   assert(msg.vertex_updates.size() == msg.vertex_updates_colors.size());
 
+  if (!msg.semantic_run_lengths.empty()) {
+    if (!semantic_updates.decode(msg.semantic_dictionary,
+                                 msg.semantic_run_lengths,
+                                 msg.semantic_run_labels)) {
+      throw std::invalid_argument(
+          "MeshDelta: invalid run-length encoded semantic labels");
+    }
+  } else {
+    semantic_updates = msg.semantic_updates;
+  }
+
   vertex_updates.reset(new pcl::PointCloud<pcl::PointXYZRGBA>());
   vertex_updates->resize(msg.vertex_updates.size());
   constexpr float color_conv_factor = 1.0f * std::numeric_limits<uint8_t>::max();
@@ -329,7 +340,13 @@ KimeraPgmoMeshDelta MeshDelta::toRosMsg(uint64_t timestamp_ns) const {
   }
   mesh_delta_msg.stamp_updates = stamp_updates;
   if (hasSemantics()) {
-    mesh_delta_msg.semantic_updates = semantic_updates;
+    if (semantic_updates.encode(&mesh_delta_msg.semantic_run_lengths,
+                                &mesh_delta_msg.semantic_run_labels)) {
+      mesh_delta_msg.semantic_dictionary = semantic_updates.dictionary();
+    } else {
+      // too many distinct labels for the dictionary: one label per vertex
+      mesh_delta_msg.semantic_updates = semantic_updates.toVector();
+    }
   }
   mesh_delta_msg.deleted_indices.resize(deleted_indices.size());
   std::copy(deleted_indices.begin(),
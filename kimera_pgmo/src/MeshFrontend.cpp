@@ -7,8 +7,10 @@
 #include "kimera_pgmo/MeshFrontend.h"
 
 #include <chrono>
+#include <limits>
 
 #include "kimera_pgmo/KimeraPgmoMesh.h"
+#include "kimera_pgmo/PclMeshTraits.h"
 #include "kimera_pgmo/utils/CommonFunctions.h"
 
 namespace kimera_pgmo {
@@ -54,28 +56,65 @@ bool loadFrontendConfigFromROS(const ros::NodeHandle& n, MeshFrontendConfig& con
   }
 
   n.getParam("frame_id", config.frame_id);
+  n.getParam("state_path", config.state_path);
 
   return true;
 }
 
-MeshFrontendPublisher::MeshFrontendPublisher(const ros::NodeHandle& n) {
+MeshFrontendPublisher::MeshFrontendPublisher(const ros::NodeHandle& n)
+    : publish_mesh_delta_(false),
+      simplified_mesh_period_(0.0),
+      simplified_mesh_requested_(true),
+      publish_simplified_mesh_delta_(true) {
   ros::NodeHandle nl(n);
+  n.getParam("publish_mesh_delta", publish_mesh_delta_);
+  double resync_period = 30.0;
+  n.getParam("mesh_delta_resync_period", resync_period);
+  mesh_delta_encoder_ = MeshDeltaEncoder(resync_period);
+  n.getParam("simplified_mesh_publish_period", simplified_mesh_period_);
+  n.getParam("publish_simplified_mesh_delta", publish_simplified_mesh_delta_);
+  simplified_mesh_resync_period_ = resync_period;
+  simplified_mesh_delta_encoder_ = MeshDeltaEncoder(resync_period);
   full_mesh_pub_ = nl.advertise<kimera_pgmo::KimeraPgmoMesh>("full_mesh", 1, false);
-  simplified_mesh_pub_ =
-      nl.advertise<mesh_msgs::TriangleMeshStamped>("deformation_graph_mesh", 10, false);
+  if (publish_mesh_delta_) {
+    // deltas are only useful if none of them is dropped
+    mesh_delta_pub_ =
+        nl.advertise<kimera_pgmo::KimeraPgmoMeshDelta>("mesh_delta", 100, false);
+  }
+  // new subscribers get the whole simplified mesh with the next update
+  simplified_mesh_pub_ = nl.advertise<mesh_msgs::TriangleMeshStamped>(
+      "deformation_graph_mesh", 10, [this](const ros::SingleSubscriberPublisher&) {
+        simplified_mesh_requested_ = true;
+      });
+  if (publish_simplified_mesh_delta_) {
+    simplified_mesh_delta_pub_ = nl.advertise<kimera_pgmo::KimeraPgmoMeshDelta>(
+        "deformation_graph_mesh_delta", 100, false);
+  }
   mesh_graph_pub_ = nl.advertise<pose_graph_tools_msgs::PoseGraph>(
       "mesh_graph_incremental", 100, true);
+  compact_mesh_graph_pub_ =
+      nl.advertise<kimera_pgmo::KimeraPgmoMeshGraph>("mesh_graph", 100, true);
 }
 
 void MeshFrontendPublisher::publishOutput(const MeshFrontendInterface& frontend,
                                           const std_msgs::Header& header) {
-  // Publish edges and nodes if subscribed
+  // Publish edges and nodes if subscribed (the pose graph is only converted for
+  // subscribers of the older format)
+  if (compact_mesh_graph_pub_.getNumSubscribers() > 0) {
+    compact_mesh_graph_pub_.publish(frontend.last_mesh_graph_);
+  }
   if (mesh_graph_pub_.getNumSubscribers() > 0) {
-    mesh_graph_pub_.publish(frontend.last_mesh_graph_);
+    mesh_graph_pub_.publish(frontend.getLastProcessedMeshGraph());
   }
 
   publishFullMesh(frontend);
+  if (publish_mesh_delta_) {
+    publishMeshDelta(frontend, header.stamp);
+  }
   publishSimplifiedMesh(frontend, header.stamp);
+  if (publish_simplified_mesh_delta_) {
+    publishSimplifiedMeshDelta(frontend, header.stamp);
+  }
 }
 
 void MeshFrontendPublisher::publishFullMesh(
@@ -95,22 +134,93 @@ void MeshFrontendPublisher::publishFullMesh(
   return;
 }
 
+void MeshFrontendPublisher::publishMeshDelta(const MeshFrontendInterface& frontend,
+                                             const ros::Time& stamp) {
+  if (mesh_delta_pub_.getNumSubscribers() == 0) {
+    // whoever subscribes next needs the whole mesh
+    mesh_delta_encoder_.requestResync();
+    return;
+  }
+
+  KimeraPgmoMeshDelta delta_msg =
+      mesh_delta_encoder_.encode(*frontend.getFullMeshVertices(),
+                                 frontend.getFullMeshTimes(),
+                                 frontend.getFullMeshFaces(),
+                                 frontend.getFullMeshToGraphMapping(),
+                                 frontend.getNumFixedFullMeshVertices(),
+                                 frontend.getNumFixedFullMeshFaces(),
+                                 frontend.getFirstRemappedVertex(),
+                                 stamp.toNSec());
+  delta_msg.header.frame_id = frontend.config_.frame_id;
+  mesh_delta_pub_.publish(delta_msg);
+}
+
 void MeshFrontendPublisher::publishSimplifiedMesh(const MeshFrontendInterface& frontend,
-                                                  const ros::Time& stamp) const {
+                                                  const ros::Time& stamp) {
   if (simplified_mesh_pub_.getNumSubscribers() == 0) return;
-  // convert to triangle mesh msg
-  mesh_msgs::TriangleMesh mesh_msg = kimera_pgmo::PolygonMeshToTriangleMeshMsg(
-      *frontend.graph_vertices_, *frontend.graph_triangles_);
-
-  // Create msg
-  mesh_msgs::TriangleMeshStamped new_msg;
-  new_msg.header.stamp = stamp;
-  new_msg.header.frame_id = "world";
-  new_msg.mesh = mesh_msg;
-  simplified_mesh_pub_.publish(new_msg);
+  const double elapsed = (stamp - last_simplified_mesh_stamp_).toSec();
+  if (publish_simplified_mesh_delta_) {
+    // the deltas carry the updates, the whole mesh is only a resync
+    const bool resync = simplified_mesh_resync_period_ > 0.0 &&
+                        elapsed >= simplified_mesh_resync_period_;
+    if (!simplified_mesh_requested_ && !resync) {
+      return;
+    }
+  } else if (simplified_mesh_period_ > 0.0 && !last_simplified_mesh_stamp_.isZero() &&
+             elapsed < simplified_mesh_period_) {
+    return;
+  }
+  simplified_mesh_requested_ = false;
+
+  const auto& vertices = *frontend.graph_vertices_;
+  const auto& triangles = *frontend.graph_triangles_;
+  mesh_msgs::TriangleMesh& mesh_msg = simplified_mesh_msg_.mesh;
+  if (vertices.size() < mesh_msg.vertices.size() ||
+      triangles.size() < mesh_msg.triangles.size()) {
+    // the frontend was reset or restored from a different state
+    mesh_msg = mesh_msgs::TriangleMesh();
+  }
+  // convert the vertices and faces added since the last message
+  appendToTriangleMeshMsg(vertices, triangles, mesh_msg);
+
+  simplified_mesh_msg_.header.stamp = stamp;
+  simplified_mesh_msg_.header.frame_id = "world";
+  simplified_mesh_pub_.publish(simplified_mesh_msg_);
+  last_simplified_mesh_stamp_ = stamp;
   return;
 }
 
+void MeshFrontendPublisher::publishSimplifiedMeshDelta(
+    const MeshFrontendInterface& frontend,
+    const ros::Time& stamp) {
+  if (simplified_mesh_delta_pub_.getNumSubscribers() == 0) {
+    simplified_mesh_delta_encoder_.requestResync();
+    return;
+  }
+  if (simplified_mesh_period_ > 0.0 && !last_simplified_mesh_delta_stamp_.isZero() &&
+      (stamp - last_simplified_mesh_delta_stamp_).toSec() < simplified_mesh_period_) {
+    // the next delta carries the changes skipped here
+    return;
+  }
+
+  // The graph compression only appends vertices and faces: everything that was
+  // already sent is fixed
+  const auto& vertices = *frontend.graph_vertices_;
+  const auto& triangles = *frontend.graph_triangles_;
+  KimeraPgmoMeshDelta delta_msg =
+      simplified_mesh_delta_encoder_.encode(vertices,
+                                            *frontend.graph_vertex_stamps_,
+                                            triangles,
+                                            IndexMapping(),
+                                            vertices.size(),
+                                            triangles.size(),
+                                            std::numeric_limits<size_t>::max(),
+                                            stamp.toNSec());
+  delta_msg.header.frame_id = frontend.config_.frame_id;
+  simplified_mesh_delta_pub_.publish(delta_msg);
+  last_simplified_mesh_delta_stamp_ = stamp;
+}
+
 MeshFrontend::MeshFrontend() : MeshFrontendInterface(), voxblox_queue_size_(20) {}
 
 MeshFrontend::~MeshFrontend() {}
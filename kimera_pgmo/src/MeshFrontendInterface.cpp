@@ -7,6 +7,8 @@
 #include "kimera_pgmo/MeshFrontendInterface.h"
 
 #include <chrono>
+#include <fstream>
+#include <limits>
 #include <thread>
 
 #include "kimera_pgmo/compression/OctreeCompression.h"
@@ -14,24 +16,58 @@
 #include "kimera_pgmo/compression/VoxelClearingCompression.h"
 #include "kimera_pgmo/utils/VoxbloxMsgInterface.h"
 #include "kimera_pgmo/utils/VoxbloxMeshInterface.h"
+#include "kimera_pgmo/utils/AllocationStats.h"
+#include "kimera_pgmo/utils/BinarySerialization.h"
 #include "kimera_pgmo/utils/CommonFunctions.h"
 
 namespace kimera_pgmo {
 
+namespace {
+constexpr uint32_t kFrontendStateMagic = 0x464d4750;  // "PGMF"
+constexpr uint32_t kFrontendStateVersion = 1;
+}  // namespace
+
 MeshFrontendInterface::MeshFrontendInterface()
     : vertices_(new pcl::PointCloud<pcl::PointXYZRGBA>),
       triangles_(new std::vector<pcl::Vertices>),
       vertex_stamps_(new std::vector<Timestamp>),
       graph_vertices_(new pcl::PointCloud<pcl::PointXYZRGBA>),
       graph_triangles_(new std::vector<pcl::Vertices>),
+      graph_vertex_stamps_(new std::vector<Timestamp>),
       vxblx_msg_to_graph_idx_(new VoxbloxIndexMapping),
       vxblx_msg_to_mesh_idx_(new VoxbloxIndexMapping),
       mesh_to_graph_idx_(new IndexMapping),
+      first_remapped_vertex_(std::numeric_limits<size_t>::max()),
       init_graph_log_(false),
       init_full_log_(false) {}
 
 bool MeshFrontendInterface::initialize(const MeshFrontendConfig& config) {
   config_ = config;
+  if (!resetCompression()) {
+    return false;
+  }
+
+  if (!config_.state_path.empty() && std::ifstream(config_.state_path).good()) {
+    if (loadState(config_.state_path)) {
+      ROS_INFO_STREAM("MeshFrontend: restored state from " << config_.state_path);
+    } else {
+      ROS_ERROR_STREAM("MeshFrontend: failed to restore state from "
+                       << config_.state_path << ", starting from scratch");
+    }
+  }
+
+  // Log header to file
+  if (config_.log_output) {
+    logGraphProcess();
+    logFullProcess();
+    init_graph_log_ = true;
+    init_full_log_ = true;
+  }
+
+  return true;
+}
+
+bool MeshFrontendInterface::resetCompression() {
   switch (config_.graph_compression_method) {
     case 0:
       d_graph_compression_.reset(new OctreeCompression(config_.d_graph_resolution));
@@ -58,14 +94,85 @@ bool MeshFrontendInterface::initialize(const MeshFrontendConfig& config) {
       return false;
   }
 
-  // Log header to file
-  if (config_.log_output) {
-    logGraphProcess();
-    logFullProcess();
-    init_graph_log_ = true;
-    init_full_log_ = true;
+  simplified_mesh_graph_ = Graph();
+  vxblx_msg_to_graph_idx_->clear();
+  vxblx_msg_to_mesh_idx_->clear();
+  mesh_to_graph_idx_->clear();
+  updateMeshOutputs();
+  return true;
+}
+
+void MeshFrontendInterface::updateMeshOutputs() {
+  full_mesh_compression_->getVertices(vertices_);
+  full_mesh_compression_->getStoredPolygons(triangles_);
+  full_mesh_compression_->getTimestamps(vertex_stamps_);
+  active_indices_ = full_mesh_compression_->getActiveVerticesIndex();
+  d_graph_compression_->getVertices(graph_vertices_);
+  d_graph_compression_->getStoredPolygons(graph_triangles_);
+  d_graph_compression_->getTimestamps(graph_vertex_stamps_);
+}
+
+bool MeshFrontendInterface::saveState(const std::string& filename) const {
+  BinaryWriter writer(filename);
+  if (!writer.ok()) {
+    ROS_ERROR_STREAM("MeshFrontend: unable to open " << filename << " for writing");
+    return false;
+  }
+
+  writer.write(kFrontendStateMagic);
+  writer.write(kFrontendStateVersion);
+  writer.write<int32_t>(config_.robot_id);
+  writer.write<int32_t>(config_.full_compression_method);
+  writer.write<int32_t>(config_.graph_compression_method);
+  full_mesh_compression_->saveState(writer);
+  d_graph_compression_->saveState(writer);
+  simplified_mesh_graph_.save(writer);
+  writeVoxbloxIndexMapping(writer, *vxblx_msg_to_graph_idx_);
+  writeVoxbloxIndexMapping(writer, *vxblx_msg_to_mesh_idx_);
+  writeIndexMapping(writer, *mesh_to_graph_idx_);
+  return writer.ok();
+}
+
+bool MeshFrontendInterface::loadState(const std::string& filename) {
+  BinaryReader reader(filename);
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  int32_t robot_id = -1;
+  int32_t full_method = -1;
+  int32_t graph_method = -1;
+  reader.read(magic);
+  reader.read(version);
+  reader.read(robot_id);
+  reader.read(full_method);
+  reader.read(graph_method);
+  if (!reader.ok() || magic != kFrontendStateMagic ||
+      version != kFrontendStateVersion) {
+    ROS_ERROR_STREAM("MeshFrontend: " << filename << " is not a frontend state file");
+    return false;
+  }
+
+  if (robot_id != config_.robot_id ||
+      full_method != config_.full_compression_method ||
+      graph_method != config_.graph_compression_method) {
+    ROS_ERROR_STREAM("MeshFrontend: state in " << filename
+                                               << " was saved with a different "
+                                                  "robot id or compression method");
+    return false;
+  }
+
+  const bool success = full_mesh_compression_->loadState(reader) &&
+                       d_graph_compression_->loadState(reader) &&
+                       simplified_mesh_graph_.load(reader) &&
+                       readVoxbloxIndexMapping(reader, *vxblx_msg_to_graph_idx_) &&
+                       readVoxbloxIndexMapping(reader, *vxblx_msg_to_mesh_idx_) &&
+                       readIndexMapping(reader, *mesh_to_graph_idx_);
+  if (!success) {
+    // never leave a partially restored state behind
+    resetCompression();
+    return false;
   }
 
+  updateMeshOutputs();
   return true;
 }
 
@@ -77,6 +184,7 @@ void MeshFrontendInterface::voxbloxCallback(const voxblox_msgs::Mesh& msg) {
       &MeshFrontendInterface::processVoxbloxMeshGraph, this, msg);
 
   latest_blocks_.clear();
+  first_remapped_vertex_ = std::numeric_limits<size_t>::max();
   for (const auto& mesh_block : msg.mesh_blocks) {
     const voxblox::BlockIndex block_index(
         mesh_block.index[0], mesh_block.index[1], mesh_block.index[2]);
@@ -97,20 +205,19 @@ void MeshFrontendInterface::voxbloxCallback(const voxblox_msgs::Mesh& msg) {
 
 // Update full mesh
 void MeshFrontendInterface::processVoxbloxMeshFull(const voxblox_msgs::Mesh& msg) {
+  AllocationZone allocation_zone("MeshFrontendInterface::processVoxbloxMeshFull");
   // First prune the mesh blocks
   const double msg_time = msg.header.stamp.toSec();
   full_mesh_compression_->pruneStoredMesh(msg_time - config_.time_horizon);
 
   // Add to full mesh compressor
   auto f_comp_start = std::chrono::high_resolution_clock::now();
-  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr new_vertices(
-      new pcl::PointCloud<pcl::PointXYZRGBA>);
-  std::shared_ptr<std::vector<pcl::Vertices> > new_triangles =
-      std::make_shared<std::vector<pcl::Vertices> >();
-  std::shared_ptr<std::vector<size_t> > new_indices =
-      std::make_shared<std::vector<size_t> >();
-  full_mesh_compression_->compressAndIntegrate(
-      msg, new_vertices, new_triangles, new_indices, vxblx_msg_to_mesh_idx_, msg_time);
+  full_mesh_compression_->compressAndIntegrate(msg,
+                                               full_mesh_output_.vertices,
+                                               full_mesh_output_.triangles,
+                                               full_mesh_output_.indices,
+                                               vxblx_msg_to_mesh_idx_,
+                                               msg_time);
 
   auto f_comp_stop = std::chrono::high_resolution_clock::now();
   auto f_comp_duration =
@@ -123,7 +230,6 @@ void MeshFrontendInterface::processVoxbloxMeshFull(const voxblox_msgs::Mesh& msg
   assert(vertex_stamps_->size() == vertices_->size());
   // save the active indices
   active_indices_ = full_mesh_compression_->getActiveVerticesIndex();
-  invalid_indices_ = full_mesh_compression_->getInvalidIndices();
   if (config_.log_output) {
     logFullProcess(f_comp_duration.count());
   }
@@ -133,75 +239,44 @@ void MeshFrontendInterface::clearArchivedMeshFull(const voxblox_msgs::Mesh& msg)
   full_mesh_compression_->clearArchivedBlocks(msg);
 }
 
-/*! \brief Publish the factors corresponding to the new edges added to the
- * simplified mesh / deformation graph and also the initial values (positions
- * of the new vertices added to the simplified mesh)
+/*! \brief Pack the new edges added to the simplified mesh / deformation graph
+ * and the new vertices (positions and stamps) into a mesh graph msg
  *  - new_edges: new edges of type Edge (std::pair<Vertex, Vertex>)
  *  - new_indices: new vertices of type Vertex
  *  - graph_vertices: deformation graph vertices
  *  - header: current mesh header
  *  - robot_id: robot for the deformation graph
- *  returns: published pose graph
+ *  returns: mesh graph msg
  */
-pose_graph_tools_msgs::PoseGraph makePoseGraph(
+KimeraPgmoMeshGraph makeMeshGraph(
     const std::vector<Edge>& new_edges,
     const std::vector<size_t>& new_indices,
     const pcl::PointCloud<pcl::PointXYZRGBA>& graph_vertices,
     const std_msgs::Header& header,
     int robot_id) {
-  // Create message
-  pose_graph_tools_msgs::PoseGraph msg;
+  KimeraPgmoMeshGraph msg;
   msg.header = header;
+  msg.robot_id = robot_id;
 
-  // Encode the edges as factors
-  msg.edges.resize(new_edges.size());
-  for (size_t i = 0; i < new_edges.size(); i++) {
-    const Edge& e = new_edges[i];
-    pose_graph_tools_msgs::PoseGraphEdge pg_edge;
-    pg_edge.header = header;
-
-    const size_t& from_node = e.first;
-    const size_t& to_node = e.second;
-
-    pg_edge.robot_from = robot_id;
-    pg_edge.robot_to = robot_id;
-    pg_edge.key_from = from_node;
-    pg_edge.key_to = to_node;
-
-    gtsam::Point3 from_node_pos =
-        PclToGtsam<pcl::PointXYZRGBA>(graph_vertices.at(from_node));
-    gtsam::Point3 to_node_pos =
-        PclToGtsam<pcl::PointXYZRGBA>(graph_vertices.at(to_node));
-    pg_edge.pose = GtsamToRos(gtsam::Pose3(gtsam::Rot3(), to_node_pos - from_node_pos));
-
-    pg_edge.type = pose_graph_tools_msgs::PoseGraphEdge::MESH;
-
-    // Add edge to pose graph
-    msg.edges[i] = pg_edge;
+  msg.edges.reserve(2 * new_edges.size());
+  for (const Edge& e : new_edges) {
+    msg.edges.push_back(e.first);
+    msg.edges.push_back(e.second);
   }
 
-  // Encode the new vertices as nodes
-  msg.nodes.resize(new_indices.size());
-  for (size_t i = 0; i < new_indices.size(); i++) {
-    const size_t& n = new_indices[i];
-    pose_graph_tools_msgs::PoseGraphNode pg_node;
-    pg_node.header = header;
-    pg_node.robot_id = robot_id;
-
-    pg_node.key = n;
-
-    gtsam::Point3 node_pos = PclToGtsam<pcl::PointXYZRGBA>(graph_vertices.at(n));
-    pg_node.pose = GtsamToRos(gtsam::Pose3(gtsam::Rot3(), node_pos));
-
-    // Add node to pose graph
-    msg.nodes[i] = pg_node;
+  msg.node_indices.assign(new_indices.begin(), new_indices.end());
+  msg.node_positions.reserve(3 * new_indices.size());
+  for (const size_t n : new_indices) {
+    const pcl::PointXYZRGBA& point = graph_vertices.at(n);
+    msg.node_positions.insert(msg.node_positions.end(), {point.x, point.y, point.z});
   }
-
+  msg.node_stamps.assign(new_indices.size(), header.stamp.toNSec());
   return msg;
 }
 
 // Creates and update graph mesh and publish mesh graph
 void MeshFrontendInterface::processVoxbloxMeshGraph(const voxblox_msgs::Mesh& msg) {
+  AllocationZone allocation_zone("MeshFrontendInterface::processVoxbloxMeshGraph");
   // First prune the mesh blocks
   const double msg_time = msg.header.stamp.toSec();
   VoxbloxMsgInterface interface(&msg);
@@ -223,17 +298,13 @@ void MeshFrontendInterface::processMeshGraph(MeshInterface& mesh,
 
   // Add to deformation graph mesh compressor
   auto g_comp_start = std::chrono::high_resolution_clock::now();
-  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr new_graph_vertices(
-      new pcl::PointCloud<pcl::PointXYZRGBA>);
-  std::shared_ptr<std::vector<pcl::Vertices> > new_graph_triangles =
-      std::make_shared<std::vector<pcl::Vertices> >();
-  std::shared_ptr<std::vector<size_t> > new_graph_indices =
-      std::make_shared<std::vector<size_t> >();
-
+  // the compressor clears the outputs of the previous message
+  const std::vector<pcl::Vertices>& new_graph_triangles = *graph_output_.triangles;
+  const std::vector<size_t>& new_graph_indices = *graph_output_.indices;
   d_graph_compression_->compressAndIntegrate(mesh,
-                                             new_graph_vertices,
-                                             new_graph_triangles,
-                                             new_graph_indices,
+                                             graph_output_.vertices,
+                                             graph_output_.triangles,
+                                             graph_output_.indices,
                                              vxblx_msg_to_graph_idx_,
                                              msg_time);
 
@@ -244,24 +315,25 @@ void MeshFrontendInterface::processMeshGraph(MeshInterface& mesh,
   // Update the simplified mesh vertices and surfaces for class variables
   d_graph_compression_->getVertices(graph_vertices_);
   d_graph_compression_->getStoredPolygons(graph_triangles_);
+  d_graph_compression_->getTimestamps(graph_vertex_stamps_);
 
   std::vector<Edge> new_graph_edges;
-  if (new_graph_indices->size() > 0 && new_graph_triangles->size() > 0) {
+  if (new_graph_indices.size() > 0 && new_graph_triangles.size() > 0) {
     // Add nodes and edges to graph
-    new_graph_edges = simplified_mesh_graph_.addPointsAndSurfaces(
-        *new_graph_indices.get(), *new_graph_triangles.get());
+    new_graph_edges = simplified_mesh_graph_.addPointsAndSurfaces(new_graph_indices,
+                                                                  new_graph_triangles);
   }
 
   if (config_.log_output) {
     logGraphProcess(
-        g_comp_duration.count(), new_graph_indices->size(), new_graph_edges.size());
+        g_comp_duration.count(), new_graph_indices.size(), new_graph_edges.size());
   }
 
   std_msgs::Header msg_header;
   msg_header.stamp.fromSec(msg_time);
   msg_header.frame_id = frame_id;
-  last_mesh_graph_ = makePoseGraph(new_graph_edges,
-                                   *new_graph_indices,
+  last_mesh_graph_ = makeMeshGraph(new_graph_edges,
+                                   new_graph_indices,
                                    *graph_vertices_,
                                    msg_header,
                                    config_.robot_id);
@@ -275,8 +347,10 @@ void MeshFrontendInterface::updateMeshToGraphMappings(
       // mesh is disconnected and all contained within a block since we remove
       // degenerate faces
       if (vxblx_msg_to_graph_idx_->at(block).count(remap.first)) {
-        mesh_to_graph_idx_->insert(
-            {remap.second, vxblx_msg_to_graph_idx_->at(block).at(remap.first)});
+        const size_t graph_index = vxblx_msg_to_graph_idx_->at(block).at(remap.first);
+        if (mesh_to_graph_idx_->insert({remap.second, graph_index}).second) {
+          first_remapped_vertex_ = std::min(first_remapped_vertex_, remap.second);
+        }
       }
     }
   }
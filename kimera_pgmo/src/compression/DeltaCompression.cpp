@@ -7,7 +7,9 @@
 #include "kimera_pgmo/compression/DeltaCompression.h"
 
 #include <iterator>
+#include <limits>
 
+#include "kimera_pgmo/utils/AllocationStats.h"
 #include "kimera_pgmo/utils/CommonFunctions.h"
 #include "kimera_pgmo/utils/VoxbloxMsgInterface.h"
 
@@ -16,6 +18,8 @@ namespace kimera_pgmo {
 using voxblox::BlockIndex;
 using voxblox::BlockIndexList;
 
+constexpr size_t kNoIndex = std::numeric_limits<size_t>::max();
+
 struct RedunancyChecker {
   using SparseAdjacencyMatrix = std::map<size_t, std::set<size_t>>;
 
@@ -71,6 +75,8 @@ bool VertexInfo::shouldArchive() const { return active_refs <= 0; }
 DeltaCompression::DeltaCompression(double resolution)
     : resolution_(resolution),
       index_scale_(1.0 / resolution),
+      prev_active_start_(0),
+      num_prev_active_(0),
       num_archived_vertices_(0),
       num_archived_faces_(0) {}
 
@@ -98,9 +104,10 @@ void DeltaCompression::addPoint(const pcl::PointXYZRGBA& point,
     info.timestamp_ns = timestamp_ns;
     info.point = point;
     info.label = semantic_label;
-    const size_t prev_index = info.mesh_index;
-    info.mesh_index = active_remapping_.size();
-    active_remapping_.push_back(prev_index);  // cache previous index
+    // cache previous index and point to the dirty slot of the vertex until the vertex
+    // gets its index in the current delta
+    dirty_vertices_.push_back({&info, info.mesh_index, 0});
+    info.mesh_index = dirty_vertices_.size() - 1;
   }
   face_map.push_back(info.mesh_index);
   if (!curr_voxels.count(vertex_index)) {
@@ -145,6 +152,9 @@ void DeltaCompression::removeBlockObservations(const BlockIndex& /* block_index
 }
 
 void DeltaCompression::addActiveVertices(uint64_t timestamp_ns) {
+  // every active vertex is sent with the delta, but only the vertices observed by the
+  // latest message need book-keeping beyond their new index
+  carry_remapping_.assign(num_prev_active_, kNoIndex);
   for (auto& id_info_pair : vertices_map_) {
     // vertices here are guaranteed to be unique
     auto& info = id_info_pair.second;
@@ -152,73 +162,92 @@ void DeltaCompression::addActiveVertices(uint64_t timestamp_ns) {
         delta_->addVertex(info.timestamp_ns, info.point, info.label);
 
     if (info.timestamp_ns == timestamp_ns) {
-      if (!info.is_new) {
-        // we use the active remapping slot as temporary variable to cache
-        // the index in the previous delta
-        const size_t prev_mesh_index = active_remapping_[info.mesh_index];
-        delta_->prev_to_curr[prev_mesh_index] = mesh_index;
-      } else {
-        delta_->new_indices.insert(mesh_index);
-        info.is_new = false;
-      }
-      delta_->observed_indices.insert(mesh_index);
-
-      // set to correct delta index for face construction
-      active_remapping_[info.mesh_index] = mesh_index;
-    } else {
-      // if we haven't seen this vertex in this pass, add to prev_to_curr map
-      delta_->prev_to_curr[info.mesh_index] = mesh_index;
+      // mesh index is the dirty slot of the vertex
+      dirty_vertices_[info.mesh_index].mesh_index = mesh_index;
+      continue;
     }
 
+    // if we haven't seen this vertex in this pass, add to prev_to_curr map
+    delta_->prev_to_curr[info.mesh_index] = mesh_index;
+    setCarriedIndex(info.mesh_index, mesh_index);
     // set mesh index to point to the correct index in the current delta
     info.mesh_index = mesh_index;
   }
+
+  for (const auto& dirty : dirty_vertices_) {
+    auto& info = *dirty.info;
+    if (!info.is_new) {
+      delta_->prev_to_curr[dirty.prev_index] = dirty.mesh_index;
+      setCarriedIndex(dirty.prev_index, dirty.mesh_index);
+    } else {
+      delta_->new_indices.insert(dirty.mesh_index);
+      info.is_new = false;
+    }
+    delta_->observed_indices.insert(dirty.mesh_index);
+    info.mesh_index = dirty.mesh_index;
+  }
+}
+
+void DeltaCompression::setCarriedIndex(size_t prev_index, size_t curr_index) {
+  if (prev_index < prev_active_start_ ||
+      prev_index - prev_active_start_ >= num_prev_active_) {
+    return;
+  }
+
+  carry_remapping_[prev_index - prev_active_start_] = curr_index;
+}
+
+size_t DeltaCompression::getCarriedIndex(size_t prev_index) const {
+  if (prev_index >= prev_active_start_ &&
+      prev_index - prev_active_start_ < num_prev_active_) {
+    const size_t curr_index = carry_remapping_[prev_index - prev_active_start_];
+    if (curr_index != kNoIndex) {
+      return curr_index;
+    }
+  }
+
+  return delta_->prev_to_curr.at(prev_index);
 }
 
 void DeltaCompression::addActiveFaces(uint64_t timestamp_ns,
                                       VoxbloxIndexMapping* remapping) {
+  // for every block contained in the latest message we
+  //   - grab the new face indices from the dirty slots of the vertices
+  //   - store the remapping between every original vertex index in the latest message
+  //     and the compressed vertex index in the latest delta (as the remapping is now
+  //     fixed at this point, but was not when active vertices were being added)
+  for (const auto& block_index : dirty_blocks_) {
+    auto& indices = block_info_map_.at(block_index).indices;
+    IndexMapping* block_remap = nullptr;
+    if (remapping) {
+      block_remap = &(remapping->insert({block_index, {}}).first->second);
+    }
+
+    for (size_t i = 0; i < indices.size(); ++i) {
+      indices[i] = dirty_vertices_[indices[i]].mesh_index;
+      if (block_remap) {
+        block_remap->insert({i, indices[i]});
+      }
+    }
+  }
+
   // for every current tracked block we
   //   - iterate through every "face" (set of 3 vertex indices)
-  //   - if the face is from a block contained in the latest message, grab the new face
-  //     indices from the remapping between the latest indices and their positions in
-  //     the newest delta. Otherwise, carry any changes in indices between the last mesh
-  //     delta and the newest one forward
-  //  - store the remapping between every original vertex index in the latest message
-  //    and the compressed vertex index in the latest delta (as the remapping is now
-  //    fixed at this point, but was not when active vertices were being added)
+  //   - if the face is from a block that was not in the latest message, carry any
+  //     changes in indices between the last mesh delta and the newest one forward
   //  - add the face if it isn't degenerate or redundant
-  const auto& prev_to_curr = delta_->prev_to_curr;
   // note that we only need to check for duplicates per each "type" of face
   RedunancyChecker checker;
   for (auto& id_info_pair : block_info_map_) {
     auto& block_info = id_info_pair.second;
     const bool was_updated = block_info.update_time == timestamp_ns;
 
-    IndexMapping* block_remap = nullptr;
-    if (remapping && was_updated) {
-      block_remap = &(remapping->insert({id_info_pair.first, {}}).first->second);
-    }
-
     auto& indices = block_info.indices;
     for (size_t i = 0; i < indices.size(); i += 3) {
-      if (was_updated) {
-        // face points to active vertices, so grab actual delta index and add to
-        // remapping
-        indices[i] = active_remapping_[indices[i]];
-        indices[i + 1] = active_remapping_[indices[i + 1]];
-        indices[i + 2] = active_remapping_[indices[i + 2]];
-      } else {
-        indices[i] = prev_to_curr.at(indices[i]);
-        indices[i + 1] = prev_to_curr.at(indices[i + 1]);
-        indices[i + 2] = prev_to_curr.at(indices[i + 2]);
-      }
-
-      if (block_remap) {
-        // block_remap is only valid if remapping is provided and the block was updated
-        // from this compression pass
-        block_remap->insert({i, indices[i]});
-        block_remap->insert({i + 1, indices[i + 1]});
-        block_remap->insert({i + 2, indices[i + 2]});
+      if (!was_updated) {
+        indices[i] = getCarriedIndex(indices[i]);
+        indices[i + 1] = getCarriedIndex(indices[i + 1]);
+        indices[i + 2] = getCarriedIndex(indices[i + 2]);
       }
 
       const Face face(indices, i);
@@ -246,6 +275,7 @@ MeshDelta::Ptr DeltaCompression::update(const voxblox_msgs::Mesh& mesh,
 MeshDelta::Ptr DeltaCompression::update(MeshInterface& mesh,
                                         uint64_t timestamp_ns,
                                         VoxbloxIndexMapping* remapping) {
+  AllocationZone allocation_zone("DeltaCompression::update");
   while (timestamp_cache_.count(timestamp_ns)) {
     ++timestamp_ns;
   }
@@ -294,7 +324,9 @@ void DeltaCompression::updateRemapping(MeshInterface& mesh, uint64_t stamp_ns) {
   //   counts)
   //   - remove any previous observations from the block if the block isn't new (this
   //     decreases ref counts to be correct)
-  active_remapping_.clear();
+  dirty_vertices_.clear();
+  dirty_blocks_.clear();
+  voxblox::IndexSet seen_blocks;
   for (const auto& block_index : mesh.blockIndices()) {
     bool is_block_new = false;
     auto block_iter = block_info_map_.find(block_index);
@@ -303,7 +335,12 @@ void DeltaCompression::updateRemapping(MeshInterface& mesh, uint64_t stamp_ns) {
       block_iter = block_info_map_.insert({block_index, {{}, stamp_ns, {}}}).first;
     }
 
+    // every block of the message is dirty, but its indices are only converted once
+    // if the message repeats it
     auto& block_info = block_iter->second;
+    if (seen_blocks.insert(block_index).second) {
+      dirty_blocks_.push_back(block_index);
+    }
     block_info.update_time = stamp_ns;
     block_info.indices.clear();
 
@@ -332,6 +369,9 @@ void DeltaCompression::addActive(uint64_t stamp_ns, VoxbloxIndexMapping* remappi
   // updateRemapping is called. This means that anyone archiving blocks can directly use
   // the faces without doing any remapping
   addActiveFaces(stamp_ns, remapping);
+
+  prev_active_start_ = delta_->getTotalArchivedVertices();
+  num_prev_active_ = vertices_map_.size();
 }
 
 void DeltaCompression::pruneStoredMesh(uint64_t earliest_time_ns) {
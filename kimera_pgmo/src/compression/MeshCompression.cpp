@@ -8,6 +8,7 @@
 #include <pcl/conversions.h>
 
 #include <algorithm>
+#include <array>
 #include <iterator>
 #include <utility>
 
@@ -46,6 +47,7 @@ void MeshCompression::compressAndIntegrate(
     std::shared_ptr<std::vector<size_t> > new_indices,
     std::shared_ptr<std::unordered_map<size_t, size_t> > remapping,
     const double& stamp_in_sec) {
+  AllocationZone allocation_zone("MeshCompression::compressAndIntegrate");
   // If there are no surfaces, return
   if (input_vertices.size() < 3 || input_surfaces.size() == 0) {
     return;
@@ -62,21 +64,31 @@ void MeshCompression::compressAndIntegrate(
 
   const size_t num_original_vertices = all_vertices_.size();
 
+  // Per-message scratch containers live in the arena, which is released
+  // wholesale once they have been destroyed
+  const AllocationCount heap_start = threadAllocationCount();
+  MessageArenaScope arena_scope(arena_);
+  std::pmr::memory_resource* scratch = arena_.resource();
+
   // Remaps from index in input vertices to index in all_vertices_
-  std::unordered_map<size_t, size_t> reindex;
+  std::pmr::unordered_map<size_t, size_t> reindex(scratch);
+  reindex.reserve(input_vertices.size());
   // temporary reindex for all input vertices
-  std::vector<size_t> temp_reindex;
+  std::pmr::vector<size_t> temp_reindex(scratch);
+  temp_reindex.reserve(input_vertices.size());
 
   // Track possible new vertices
   // Vector mapping index in temp_new_vertices to index in input vertices
-  std::vector<size_t> potential_new_vertices;
-  std::vector<bool> potential_new_vertices_check;
+  std::pmr::vector<size_t> potential_new_vertices(scratch);
+  std::pmr::vector<bool> potential_new_vertices_check(scratch);
 
   // Vertices that end up on each other after compression
-  std::unordered_map<size_t, std::vector<size_t> > converged_vertices;
+  std::pmr::unordered_map<size_t, std::pmr::vector<size_t> > converged_vertices(
+      scratch);
 
   // Temporary octree / cell for the points not stored
-  PointCloudXYZ::Ptr temp_new_vertices(new PointCloudXYZ);
+  PointCloudXYZ::Ptr temp_new_vertices = temp_new_vertices_;
+  temp_new_vertices->clear();
   initializeTempStructure(temp_new_vertices);
   for (size_t i = 0; i < input_vertices.size(); i++) {
     const pcl::PointXYZRGBA& p = input_vertices.at(i);
@@ -93,7 +105,7 @@ void MeshCompression::compressAndIntegrate(
         potential_new_vertices.push_back(i);
         potential_new_vertices_check.push_back(false);
         temp_reindex.push_back(num_original_vertices + temp_new_vertices->size() - 1);
-        converged_vertices.insert({i, std::vector<size_t>()});
+        converged_vertices.try_emplace(i);
       } else {
         // Add reindex index
         temp_reindex.push_back(num_original_vertices + result_idx);
@@ -118,29 +130,29 @@ void MeshCompression::compressAndIntegrate(
     }
   }
   // First iteration through the faces to check the potential new vertices
+  std::pmr::vector<size_t> face_reindex(scratch);
   for (const auto& s : input_surfaces) {
-    pcl::Vertices reindex_s;
+    face_reindex.clear();
     bool has_new_vertex = false;
     for (size_t i : s.vertices) {
       if (temp_reindex.at(i) >= num_original_vertices) has_new_vertex = true;
-      reindex_s.vertices.push_back(temp_reindex.at(i));
+      face_reindex.push_back(temp_reindex.at(i));
     }
     if (!has_new_vertex) continue;  // no need to check
     // Now check if new surface is acceptable
-    if (reindex_s.vertices.size() < 3 ||
-        reindex_s.vertices[0] == reindex_s.vertices[1] ||
-        reindex_s.vertices[1] == reindex_s.vertices[2] ||
-        reindex_s.vertices[2] == reindex_s.vertices[0])
+    if (face_reindex.size() < 3 || face_reindex[0] == face_reindex[1] ||
+        face_reindex[1] == face_reindex[2] || face_reindex[2] == face_reindex[0])
       continue;  // degenerate
     // Passed degeneracy test so has at least one adjacent polygon. Pass check
-    for (size_t i : reindex_s.vertices) {
+    for (size_t i : face_reindex) {
       if (i >= num_original_vertices) {
         // This check is the main objective of this iteration through the faces
         potential_new_vertices_check[i - num_original_vertices] = true;
       }
     }
   }
-  *remapping = reindex;
+  remapping->clear();
+  remapping->insert(reindex.begin(), reindex.end());
   // Update reindex and the other structures
   for (size_t i = 0; i < potential_new_vertices.size(); i++) {
     if (potential_new_vertices_check[i]) {
@@ -173,14 +185,17 @@ void MeshCompression::compressAndIntegrate(
 
   // Second iteration through the faces to add to new_triangles and update
   // compressed mesh surfaces
-  for (auto s : input_surfaces) {
-    pcl::Vertices reindex_s;
+  // reused for every face, only faces that are kept get copied
+  pcl::Vertices reindex_s;
+  for (const auto& s : input_surfaces) {
+    reindex_s.vertices.clear();
     bool new_surface = false;
     for (size_t idx : s.vertices) {
       // Check if reindex key exists, if not, already pruned earlier
-      if (reindex.find(idx) == reindex.end()) break;
-      reindex_s.vertices.push_back(reindex[idx]);
-      if (reindex[idx] >= num_original_vertices) new_surface = true;
+      const auto iter = reindex.find(idx);
+      if (iter == reindex.end()) break;
+      reindex_s.vertices.push_back(iter->second);
+      if (iter->second >= num_original_vertices) new_surface = true;
     }
     if (reindex_s.vertices.size() < 3) continue;
 
@@ -209,6 +224,8 @@ void MeshCompression::compressAndIntegrate(
       }
     }
   }
+
+  last_heap_allocations_ = threadAllocationCount() - heap_start;
   return;
 }
 
@@ -231,6 +248,7 @@ void MeshCompression::compressAndIntegrate(
     std::shared_ptr<std::vector<size_t> > new_indices,
     std::shared_ptr<VoxbloxIndexMapping> remapping,
     const double& stamp_in_sec) {
+  AllocationZone allocation_zone("MeshCompression::compressAndIntegrate");
   // Avoid nullptr pointers
   assert(nullptr != new_vertices);
   assert(nullptr != new_triangles);
@@ -242,28 +260,38 @@ void MeshCompression::compressAndIntegrate(
 
   const size_t num_original_vertices = all_vertices_.size();
 
+  // Per-message scratch containers live in the arena, which is released
+  // wholesale once they have been destroyed
+  const AllocationCount heap_start = threadAllocationCount();
+  MessageArenaScope arena_scope(arena_);
+  std::pmr::memory_resource* scratch = arena_.resource();
+
   // Remaps from index in input vertices to index in all_vertices_
-  std::unordered_map<size_t, size_t> reindex;
+  std::pmr::unordered_map<size_t, size_t> reindex(scratch);
   // temporary reindex for all new input vertices
-  std::vector<size_t> temp_reindex;
+  std::pmr::vector<size_t> temp_reindex(scratch);
 
   // Track possible new vertices
   // Vector mapping index in temp_new_vertices to index in input vertices
-  std::vector<size_t> potential_new_vertices;
-  std::vector<bool> potential_new_vertices_check;
+  std::pmr::vector<size_t> potential_new_vertices(scratch);
+  std::pmr::vector<bool> potential_new_vertices_check(scratch);
 
-  std::vector<pcl::Vertices> input_surfaces;
+  // Faces of the input mesh (as indices into the parsed points) to integrate
+  std::pmr::vector<std::array<size_t, 3> > input_surfaces(scratch);
 
-  PointCloudXYZ::Ptr temp_new_vertices(new PointCloudXYZ);
+  PointCloudXYZ::Ptr temp_new_vertices = temp_new_vertices_;
+  temp_new_vertices->clear();
   initializeTempStructure(temp_new_vertices);
 
   size_t count = 0;
   // For book keeping track count to mesh block and index
-  std::unordered_map<size_t, VoxbloxBlockIndexPair> count_to_block;
-  PointCloud all_parsed_points;
+  std::pmr::unordered_map<size_t, VoxbloxBlockIndexPair> count_to_block(scratch);
+  PointCloud& all_parsed_points = parsed_points_;
+  all_parsed_points.clear();
 
   // Vertices that end up on each other after compression
-  std::unordered_map<size_t, std::vector<size_t> > converged_vertices;
+  std::pmr::unordered_map<size_t, std::pmr::vector<size_t> > converged_vertices(
+      scratch);
 
   // Iterate through the blocks
   for (const auto& block_index : mesh.blockIndices()) {
@@ -292,7 +320,7 @@ void MeshCompression::compressAndIntegrate(
           potential_new_vertices.push_back(count);
           potential_new_vertices_check.push_back(false);
           temp_reindex.push_back(num_original_vertices + temp_new_vertices->size() - 1);
-          converged_vertices.insert({count, std::vector<size_t>()});
+          converged_vertices.try_emplace(count);
         } else {
           // Add reindex index
           temp_reindex.push_back(num_original_vertices + result_idx);
@@ -343,11 +371,7 @@ void MeshCompression::compressAndIntegrate(
         }
 
         // Add to input surfaces
-        pcl::Vertices orig_s;
-        orig_s.vertices.push_back(count - 2);
-        orig_s.vertices.push_back(count - 1);
-        orig_s.vertices.push_back(count);
-        input_surfaces.push_back(orig_s);
+        input_surfaces.push_back({count - 2, count - 1, count});
 
         // Mark vertices as pass check (has at least one adjacent polygon)
         if (r_idx_0 >= num_original_vertices)
@@ -394,14 +418,17 @@ void MeshCompression::compressAndIntegrate(
 
   // Second iteration through the faces to add to new_triangles and update
   // compressed mesh surfaces
+  // reused for every face, only faces that are kept get copied
+  pcl::Vertices reindex_s;
   for (const auto& s : input_surfaces) {
-    pcl::Vertices reindex_s;
+    reindex_s.vertices.clear();
     bool new_surface = false;
-    for (size_t idx : s.vertices) {
+    for (size_t idx : s) {
       // Check if reindex key exists, if not, already pruned earlier
-      if (reindex.find(idx) == reindex.end()) break;
-      reindex_s.vertices.push_back(reindex[idx]);
-      if (reindex[idx] >= num_original_vertices) new_surface = true;
+      const auto iter = reindex.find(idx);
+      if (iter == reindex.end()) break;
+      reindex_s.vertices.push_back(iter->second);
+      if (iter->second >= num_original_vertices) new_surface = true;
     }
     if (reindex_s.vertices.size() < 3) continue;
 
@@ -429,6 +456,8 @@ void MeshCompression::compressAndIntegrate(
       }
     }
   }
+
+  last_heap_allocations_ = threadAllocationCount() - heap_start;
   return;
 }
 
@@ -480,4 +509,65 @@ void MeshCompression::pruneStoredMesh(const double& earliest_time_sec) {
   return;
 }
 
+void MeshCompression::saveState(BinaryWriter& writer) const { saveBaseState(writer); }
+
+bool MeshCompression::loadState(BinaryReader& reader) {
+  if (!loadBaseState(reader)) {
+    return false;
+  }
+
+  reInitializeStructure(active_vertices_xyz_);
+  return true;
+}
+
+void MeshCompression::saveBaseState(BinaryWriter& writer) const {
+  writer.write(resolution_);
+  writeCloud(writer, *active_vertices_xyz_);
+  writeCloud(writer, all_vertices_);
+  writer.writeVector(all_vertex_stamps_);
+  writer.writeVector(active_vertices_index_);
+  writePolygons(writer, polygons_);
+  writer.write<uint64_t>(adjacent_polygons_.size());
+  for (const auto& vertex_polygons : adjacent_polygons_) {
+    writer.write<uint64_t>(vertex_polygons.first);
+    writer.writeVector(vertex_polygons.second);
+  }
+  writer.writeVector(active_vertex_stamps_);
+}
+
+bool MeshCompression::loadBaseState(BinaryReader& reader) {
+  double resolution;
+  if (!reader.read(resolution)) {
+    return false;
+  }
+
+  if (resolution != resolution_) {
+    ROS_ERROR_STREAM("MeshCompression: stored resolution "
+                     << resolution << " does not match configured resolution "
+                     << resolution_);
+    return false;
+  }
+
+  if (!readCloud(reader, *active_vertices_xyz_) || !readCloud(reader, all_vertices_) ||
+      !reader.readVector(all_vertex_stamps_) ||
+      !reader.readVector(active_vertices_index_) || !readPolygons(reader, polygons_)) {
+    return false;
+  }
+
+  uint64_t num_adjacent;
+  if (!reader.read(num_adjacent)) {
+    return false;
+  }
+
+  adjacent_polygons_.clear();
+  for (size_t i = 0; i < num_adjacent; ++i) {
+    uint64_t index;
+    if (!reader.read(index) || !reader.readVector(adjacent_polygons_[index])) {
+      return false;
+    }
+  }
+
+  return reader.readVector(active_vertex_stamps_);
+}
+
 }  // namespace kimera_pgmo
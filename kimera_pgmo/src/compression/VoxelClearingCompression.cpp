@@ -4,6 +4,7 @@
  * @author Yun Chang
  * @author Nathan Hughes
  */
+#include <algorithm>
 #include <iterator>
 
 #include "kimera_pgmo/compression/VoxelClearingCompression.h"
@@ -37,6 +38,7 @@ void VoxelClearingCompression::compressAndIntegrate(
     std::shared_ptr<std::vector<size_t>> new_indices,
     std::shared_ptr<VoxbloxIndexMapping> remapping,
     const double &stamp_in_sec) {
+  AllocationZone allocation_zone("VoxelClearingCompression::compressAndIntegrate");
   // Avoid nullptr pointers
   assert(nullptr != new_vertices);
   assert(nullptr != new_triangles);
@@ -52,18 +54,62 @@ void VoxelClearingCompression::compressAndIntegrate(
 }
 
 void VoxelClearingCompression::updateActiveIndices() {
-  active_vertices_index_.clear();
-  active_vertices_index_.reserve(indices_to_active_refs_.size());
-  for (const auto &id_count_pair : indices_to_active_refs_) {
-    active_vertices_index_.push_back(id_count_pair.first);
+  // new vertices are appended to the (sorted) active indices as they are created, as
+  // they always have the largest index so far. Only removed vertices need a pass, and
+  // only over the indices starting at the smallest removed index
+  if (removed_active_indices_.empty()) {
+    return;
   }
+
+  std::sort(removed_active_indices_.begin(), removed_active_indices_.end());
+  auto removed_iter = removed_active_indices_.begin();
+  auto keep_iter = std::lower_bound(
+      active_vertices_index_.begin(), active_vertices_index_.end(), *removed_iter);
+  for (auto iter = keep_iter; iter != active_vertices_index_.end(); ++iter) {
+    while (removed_iter != removed_active_indices_.end() && *removed_iter < *iter) {
+      ++removed_iter;
+    }
+
+    if (removed_iter != removed_active_indices_.end() && *removed_iter == *iter) {
+      continue;
+    }
+
+    *keep_iter = *iter;
+    ++keep_iter;
+  }
+
+  active_vertices_index_.erase(keep_iter, active_vertices_index_.end());
+  removed_active_indices_.clear();
+}
+
+void VoxelClearingCompression::setBlockUpdateTime(
+    const voxblox::BlockIndex &block_index, double stamp_in_sec) {
+  auto iter = block_update_times_.find(block_index);
+  if (iter != block_update_times_.end() && iter->second == stamp_in_sec) {
+    return;
+  }
+
+  block_update_times_[block_index] = stamp_in_sec;
+  block_expiry_queue_.push({stamp_in_sec, num_block_updates_, block_index});
+  ++num_block_updates_;
 }
 
 void VoxelClearingCompression::pruneStoredMesh(const double &earliest_time_s) {
   BlockIndexList to_clear;
-  for (const auto &idx_time_pair : block_update_times_) {
-    if (idx_time_pair.second <= earliest_time_s) {
-      to_clear.push_back(idx_time_pair.first);
+  IndexSet queued;
+  while (!block_expiry_queue_.empty() &&
+         block_expiry_queue_.top().stamp_in_sec <= earliest_time_s) {
+    const BlockExpiry expiry = block_expiry_queue_.top();
+    block_expiry_queue_.pop();
+
+    // skip entries of blocks that were updated again or already archived
+    const auto iter = block_update_times_.find(expiry.block_index);
+    if (iter == block_update_times_.end() || iter->second != expiry.stamp_in_sec) {
+      continue;
+    }
+
+    if (queued.insert(expiry.block_index).second) {
+      to_clear.push_back(expiry.block_index);
     }
   }
 
@@ -94,6 +140,7 @@ void VoxelClearingCompression::pruneMeshBlocks(const BlockIndexList& to_clear) {
       // on archive (i.e. no more active blocks contain the vertex), we delete
       // the ref counts and then erase the voxel -> vertex association to
       // allow revisiting to make a new vertex
+      removed_active_indices_.push_back(mesh_idx);
       indices_to_active_refs_.erase(mesh_idx);
       indices_to_inactive_refs_.erase(mesh_idx);
       vertices_map_.erase(voxel);
@@ -135,7 +182,7 @@ void VoxelClearingCompression::updateRemapping(
 
   for (const auto &block : mesh.mesh_blocks) {
     BlockIndex block_index(block.index[0], block.index[1], block.index[2]);
-    block_update_times_[block_index] = stamp_in_sec;
+    setBlockUpdateTime(block_index, stamp_in_sec);
     remapping->insert(VoxbloxIndexPair(block_index, IndexMapping()));
 
     const size_t block_size = block.x.size();
@@ -162,6 +209,7 @@ void VoxelClearingCompression::updateRemapping(
         vertices_map_[vertex_index] = mesh_index;
         indices_to_active_refs_[mesh_index] = 0;
         indices_to_inactive_refs_[mesh_index] = 0;
+        active_vertices_index_.push_back(mesh_index);
         all_vertices_.push_back(p);
       }
 
@@ -198,6 +246,7 @@ void VoxelClearingCompression::updateRemapping(
 
       if (indices_to_inactive_refs_[mesh_index] == 0) {
         // no blocks point to the mesh point any more, so delete
+        removed_active_indices_.push_back(mesh_index);
         vertices_map_.erase(prev);
         indices_to_active_refs_.erase(mesh_index);
         indices_to_inactive_refs_.erase(mesh_index);
@@ -214,6 +263,7 @@ void VoxelClearingCompression::updateRemapping(
       // on archive (i.e. no more active blocks contain the vertex), we delete
       // the ref counts and then erase the voxel -> vertex association to allow
       // revisiting to make a new vertex
+      removed_active_indices_.push_back(mesh_index);
       indices_to_active_refs_.erase(mesh_index);
       indices_to_inactive_refs_.erase(mesh_index);
       vertices_map_.erase(prev);
@@ -223,4 +273,122 @@ void VoxelClearingCompression::updateRemapping(
   }
 }
 
-} // namespace kimera_pgmo
+void VoxelClearingCompression::saveState(BinaryWriter &writer) const {
+  saveBaseState(writer);
+  writePolygons(writer, archived_polygons_);
+
+  writer.write<uint64_t>(prev_meshes_.size());
+  for (const auto &idx_voxels_pair : prev_meshes_) {
+    writeVoxbloxIndex(writer, idx_voxels_pair.first);
+    writer.write<uint64_t>(idx_voxels_pair.second.size());
+    for (const auto &voxel : idx_voxels_pair.second) {
+      writeVoxbloxIndex(writer, voxel);
+    }
+  }
+
+  writer.write<uint64_t>(block_face_map_.size());
+  for (const auto &idx_faces_pair : block_face_map_) {
+    writeVoxbloxIndex(writer, idx_faces_pair.first);
+    writer.writeVector(idx_faces_pair.second);
+  }
+
+  writer.write<uint64_t>(block_update_times_.size());
+  for (const auto &idx_time_pair : block_update_times_) {
+    writeVoxbloxIndex(writer, idx_time_pair.first);
+    writer.write(idx_time_pair.second);
+  }
+
+  writer.write<uint64_t>(vertices_map_.size());
+  for (const auto &voxel_index_pair : vertices_map_) {
+    writeVoxbloxIndex(writer, voxel_index_pair.first);
+    writer.write<uint64_t>(voxel_index_pair.second);
+  }
+
+  for (const auto *refs : {&indices_to_active_refs_, &indices_to_inactive_refs_}) {
+    writer.write<uint64_t>(refs->size());
+    for (const auto &id_count_pair : *refs) {
+      writer.write<uint64_t>(id_count_pair.first);
+      writer.write<uint64_t>(id_count_pair.second);
+    }
+  }
+
+  writer.writeVector(empty_slots_);
+  writer.write<uint64_t>(max_index_);
+  writer.write<uint64_t>(archived_polygon_size_);
+}
+
+bool VoxelClearingCompression::loadState(BinaryReader &reader) {
+  if (!loadBaseState(reader) || !readPolygons(reader, archived_polygons_)) {
+    return false;
+  }
+
+  uint64_t size = 0;
+  prev_meshes_.clear();
+  reader.read(size);
+  for (size_t i = 0; i < size && reader.ok(); ++i) {
+    BlockIndex block_index;
+    uint64_t num_voxels = 0;
+    readVoxbloxIndex(reader, block_index);
+    reader.read(num_voxels);
+    auto &voxels = prev_meshes_[block_index];
+    for (size_t j = 0; j < num_voxels && reader.ok(); ++j) {
+      voxblox::LongIndex voxel;
+      readVoxbloxIndex(reader, voxel);
+      voxels.insert(voxel);
+    }
+  }
+
+  block_face_map_.clear();
+  reader.read(size);
+  for (size_t i = 0; i < size && reader.ok(); ++i) {
+    BlockIndex block_index;
+    readVoxbloxIndex(reader, block_index);
+    reader.readVector(block_face_map_[block_index]);
+  }
+
+  block_update_times_.clear();
+  block_expiry_queue_ = BlockExpiryQueue();
+  num_block_updates_ = 0;
+  reader.read(size);
+  for (size_t i = 0; i < size && reader.ok(); ++i) {
+    BlockIndex block_index;
+    double stamp_in_sec = 0.0;
+    readVoxbloxIndex(reader, block_index);
+    reader.read(stamp_in_sec);
+    setBlockUpdateTime(block_index, stamp_in_sec);
+  }
+
+  vertices_map_.clear();
+  reader.read(size);
+  for (size_t i = 0; i < size && reader.ok(); ++i) {
+    voxblox::LongIndex voxel;
+    uint64_t mesh_index = 0;
+    readVoxbloxIndex(reader, voxel);
+    reader.read(mesh_index);
+    vertices_map_[voxel] = mesh_index;
+  }
+
+  for (auto *refs : {&indices_to_active_refs_, &indices_to_inactive_refs_}) {
+    refs->clear();
+    reader.read(size);
+    for (size_t i = 0; i < size && reader.ok(); ++i) {
+      uint64_t mesh_index = 0;
+      uint64_t count = 0;
+      reader.read(mesh_index);
+      reader.read(count);
+      (*refs)[mesh_index] = count;
+    }
+  }
+
+  uint64_t max_index = 0;
+  uint64_t archived_polygon_size = 0;
+  removed_active_indices_.clear();
+  reader.readVector(empty_slots_);
+  reader.read(max_index);
+  reader.read(archived_polygon_size);
+  max_index_ = max_index;
+  archived_polygon_size_ = archived_polygon_size;
+  return reader.ok();
+}
+
+}  // namespace kimera_pgmo
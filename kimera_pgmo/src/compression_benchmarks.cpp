@@ -0,0 +1,474 @@
+/**
+ * @file   compression_benchmarks.cpp
+ * @brief  Throughput of the frontend mesh compressions on synthetic or recorded
+ * voxblox mesh streams
+ * @author Yun Chang
+ */
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <voxblox_msgs/Mesh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "kimera_pgmo/compression/DeltaCompression.h"
+#include "kimera_pgmo/compression/OctreeCompression.h"
+#include "kimera_pgmo/compression/VoxbloxCompression.h"
+#include "kimera_pgmo/compression/VoxelClearingCompression.h"
+#include "kimera_pgmo/utils/AllocationStats.h"
+#include "kimera_pgmo/utils/PerfCounters.h"
+#include "kimera_pgmo/utils/VoxbloxMsgInterface.h"
+
+namespace {
+
+using kimera_pgmo::AllocationCount;
+using kimera_pgmo::MeshCompression;
+using kimera_pgmo::PerfCounters;
+using kimera_pgmo::PerfCounts;
+
+constexpr float kBlockEdgeLength = 1.6f;
+constexpr double kMessagePeriod = 0.5;
+
+struct Stream {
+  std::string name;
+  // vertices carry semantic labels (only used by the delta compression)
+  bool semantics = false;
+  std::vector<voxblox_msgs::Mesh> messages;
+};
+
+// Synthetic robot driving along x over a wavy floor. Every message carries the
+// blocks of the floor within the window around the robot, as voxblox sends the
+// blocks updated by the latest scans.
+struct StreamConfig {
+  std::string name;
+  // blocks in each direction around the robot
+  int window;
+  // grid cells per block side (two triangles per cell)
+  int cells_per_block;
+  // only one in block_stride blocks of the window contains a surface
+  int block_stride;
+  // blocks travelled per message
+  double speed;
+  // the robot turns around halfway and drives over the mapped blocks again
+  bool revisit;
+};
+
+uint16_t Quantize(float block_coordinate) {
+  constexpr float scale = std::numeric_limits<uint16_t>::max() / 2.0f;
+  return static_cast<uint16_t>(std::round(block_coordinate * scale));
+}
+
+void AddVertex(int64_t bx,
+               int64_t by,
+               float u,
+               float v,
+               float phase,
+               voxblox_msgs::MeshBlock* block) {
+  const float x = (bx + u) * kBlockEdgeLength;
+  const float y = (by + v) * kBlockEdgeLength;
+  // re-integrating a block moves its surface slightly
+  const float height = 0.5f + 0.2f * std::sin(x) * std::cos(y) + 0.002f * phase;
+  block->x.push_back(Quantize(u));
+  block->y.push_back(Quantize(v));
+  block->z.push_back(Quantize(height));
+  block->r.push_back(static_cast<uint8_t>(127 + 127 * std::sin(x)));
+  block->g.push_back(static_cast<uint8_t>(127 + 127 * std::cos(y)));
+  block->b.push_back(static_cast<uint8_t>(height * 255));
+}
+
+voxblox_msgs::MeshBlock MakeBlock(int64_t bx, int64_t by, int cells, float phase) {
+  voxblox_msgs::MeshBlock block;
+  block.index = {bx, by, 0};
+  const float step = 1.0f / cells;
+  for (int i = 0; i < cells; ++i) {
+    for (int j = 0; j < cells; ++j) {
+      const float u = i * step;
+      const float v = j * step;
+      // voxblox blocks are triangle soups: three vertices per triangle
+      AddVertex(bx, by, u, v, phase, &block);
+      AddVertex(bx, by, u + step, v, phase, &block);
+      AddVertex(bx, by, u + step, v + step, phase, &block);
+      AddVertex(bx, by, u, v, phase, &block);
+      AddVertex(bx, by, u + step, v + step, phase, &block);
+      AddVertex(bx, by, u, v + step, phase, &block);
+    }
+  }
+  return block;
+}
+
+Stream MakeStream(const StreamConfig& config, size_t num_messages, bool semantics) {
+  Stream stream;
+  stream.name = config.name;
+  stream.semantics = semantics;
+  stream.messages.resize(num_messages);
+  for (size_t n = 0; n < num_messages; ++n) {
+    double travelled = config.speed * n;
+    if (config.revisit && n >= num_messages / 2) {
+      travelled = config.speed * (num_messages - 1 - n);
+    }
+    const int64_t robot_x = static_cast<int64_t>(std::floor(travelled));
+
+    voxblox_msgs::Mesh& msg = stream.messages[n];
+    msg.header.stamp.fromSec(kMessagePeriod * (n + 1));
+    msg.header.frame_id = "world";
+    msg.block_edge_length = kBlockEdgeLength;
+    for (int64_t bx = robot_x - config.window; bx <= robot_x + config.window; ++bx) {
+      for (int64_t by = -config.window; by <= config.window; ++by) {
+        const int64_t stride = config.block_stride;
+        if (((bx + by) % stride + stride) % stride != 0) {
+          continue;
+        }
+        msg.mesh_blocks.push_back(
+            MakeBlock(bx, by, config.cells_per_block, std::sin(0.1 * n)));
+      }
+    }
+  }
+  return stream;
+}
+
+// Recorded voxblox mesh messages, in order
+Stream ReadStream(const std::string& bag_path, const std::string& topic) {
+  Stream stream;
+  stream.name = "recorded";
+  rosbag::Bag bag;
+  bag.open(bag_path, rosbag::bagmode::Read);
+  rosbag::View view(bag, rosbag::TopicQuery(topic));
+  for (const rosbag::MessageInstance& instance : view) {
+    const voxblox_msgs::Mesh::ConstPtr msg = instance.instantiate<voxblox_msgs::Mesh>();
+    if (msg != nullptr) {
+      stream.messages.push_back(*msg);
+    }
+  }
+  bag.close();
+  return stream;
+}
+
+// Voxblox message with a semantic label per block
+class LabeledMsgInterface : public kimera_pgmo::VoxbloxMsgInterface {
+ public:
+  explicit LabeledMsgInterface(const voxblox_msgs::Mesh* const mesh)
+      : VoxbloxMsgInterface(mesh), label_(0) {}
+
+  void markBlockActive(const voxblox::BlockIndex& block) override {
+    VoxbloxMsgInterface::markBlockActive(block);
+    label_ = static_cast<uint32_t>(std::abs(7 * block.x() + 13 * block.y()) % 20);
+  }
+
+  bool hasSemantics() const override { return true; }
+
+  std::optional<uint32_t> getActiveSemantics(size_t) const override {
+    return label_;
+  }
+
+ private:
+  uint32_t label_;
+};
+
+size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  statm >> total_pages >> resident_pages;
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+size_t NumVertices(const voxblox_msgs::Mesh& msg) {
+  size_t num_vertices = 0;
+  for (const voxblox_msgs::MeshBlock& block : msg.mesh_blocks) {
+    num_vertices += block.x.size();
+  }
+  return num_vertices;
+}
+
+struct RunResult {
+  std::vector<double> latencies_us;
+  size_t input_vertices = 0;
+  size_t output_vertices = 0;
+  size_t peak_rss_growth = 0;
+  AllocationCount heap;
+  PerfCounts counters;
+};
+
+// Time every message of the stream, including the pruning of the time horizon
+// done by the frontend before compressing. Hardware counters are read around
+// the timed region if given.
+template <typename Step>
+RunResult RunStream(const Stream& stream,
+                    const PerfCounters* counters,
+                    const Step& step) {
+  RunResult result;
+  result.latencies_us.reserve(stream.messages.size());
+  const size_t start_rss = ResidentBytes();
+  for (const voxblox_msgs::Mesh& msg : stream.messages) {
+    const AllocationCount heap_start = kimera_pgmo::threadAllocationCount();
+    const PerfCounts counts_start = counters ? counters->read() : PerfCounts();
+    const auto start = std::chrono::high_resolution_clock::now();
+    result.output_vertices = step(msg);
+    const auto stop = std::chrono::high_resolution_clock::now();
+    if (counters) {
+      result.counters += counters->read() - counts_start;
+    }
+    const AllocationCount heap =
+        kimera_pgmo::threadAllocationCount() - heap_start;
+    result.heap.allocations += heap.allocations;
+    result.heap.bytes += heap.bytes;
+    result.latencies_us.push_back(
+        std::chrono::duration<double, std::micro>(stop - start).count());
+    result.input_vertices += NumVertices(msg);
+    const size_t rss = ResidentBytes();
+    result.peak_rss_growth =
+        std::max(result.peak_rss_growth, rss > start_rss ? rss - start_rss : 0);
+  }
+  return result;
+}
+
+RunResult RunMeshCompression(MeshCompression& compression,
+                             const Stream& stream,
+                             double time_horizon,
+                             const PerfCounters* counters) {
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr new_vertices(
+      new pcl::PointCloud<pcl::PointXYZRGBA>);
+  auto new_triangles = std::make_shared<std::vector<pcl::Vertices>>();
+  auto new_indices = std::make_shared<std::vector<size_t>>();
+  auto remapping = std::make_shared<kimera_pgmo::VoxbloxIndexMapping>();
+  return RunStream(stream, counters, [&](const voxblox_msgs::Mesh& msg) {
+    const double msg_time = msg.header.stamp.toSec();
+    compression.pruneStoredMesh(msg_time - time_horizon);
+    compression.compressAndIntegrate(
+        msg, new_vertices, new_triangles, new_indices, remapping, msg_time);
+    return compression.getNumVertices();
+  });
+}
+
+RunResult RunDeltaCompression(double resolution,
+                              const Stream& stream,
+                              double time_horizon,
+                              const PerfCounters* counters) {
+  kimera_pgmo::DeltaCompression compression(resolution);
+  kimera_pgmo::VoxbloxIndexMapping remapping;
+  const uint64_t horizon_ns = static_cast<uint64_t>(time_horizon * 1.0e9);
+  return RunStream(stream, counters, [&](const voxblox_msgs::Mesh& msg) {
+    const uint64_t msg_ns = msg.header.stamp.toNSec();
+    compression.pruneStoredMesh(msg_ns > horizon_ns ? msg_ns - horizon_ns : 0);
+    kimera_pgmo::MeshDelta::Ptr delta;
+    if (stream.semantics) {
+      LabeledMsgInterface interface(&msg);
+      delta = compression.update(interface, msg_ns, &remapping);
+    } else {
+      delta = compression.update(msg, msg_ns, &remapping);
+    }
+    return delta->vertex_start + delta->vertex_updates->size();
+  });
+}
+
+bool RunCompression(const std::string& name,
+                    double resolution,
+                    const Stream& stream,
+                    double time_horizon,
+                    const PerfCounters* counters,
+                    RunResult* result) {
+  std::unique_ptr<MeshCompression> compression;
+  if (name == "octree") {
+    compression.reset(new kimera_pgmo::OctreeCompression(resolution));
+  } else if (name == "voxblox") {
+    compression.reset(new kimera_pgmo::VoxbloxCompression(resolution));
+  } else if (name == "voxel_clearing") {
+    compression.reset(new kimera_pgmo::VoxelClearingCompression(resolution));
+  } else if (name == "delta") {
+    *result = RunDeltaCompression(resolution, stream, time_horizon, counters);
+    return true;
+  } else {
+    return false;
+  }
+  *result = RunMeshCompression(*compression, stream, time_horizon, counters);
+  return true;
+}
+
+// Nearest-rank percentile of sorted values
+double Percentile(const std::vector<double>& sorted, double percent) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+void WriteRun(std::ostream& out,
+              const std::string& compression,
+              double resolution,
+              double time_horizon,
+              const Stream& stream,
+              RunResult result) {
+  std::sort(result.latencies_us.begin(), result.latencies_us.end());
+  double total_us = 0.0;
+  for (const double latency : result.latencies_us) {
+    total_us += latency;
+  }
+  const size_t num_messages = result.latencies_us.size();
+  out << "    {\"stream\": \"" << stream.name << "\", \"semantics\": "
+      << (stream.semantics ? "true" : "false") << ", \"compression\": \""
+      << compression << "\", \"resolution\": " << resolution
+      << ", \"time_horizon\": " << time_horizon << ", \"messages\": " << num_messages
+      << ", \"input_vertices\": " << result.input_vertices
+      << ", \"output_vertices\": " << result.output_vertices
+      << ", \"latency_us\": {\"mean\": "
+      << (num_messages ? total_us / num_messages : 0.0)
+      << ", \"p50\": " << Percentile(result.latencies_us, 50)
+      << ", \"p90\": " << Percentile(result.latencies_us, 90)
+      << ", \"p99\": " << Percentile(result.latencies_us, 99)
+      << ", \"max\": " << Percentile(result.latencies_us, 100)
+      << "}, \"vertices_per_sec\": "
+      << (total_us > 0.0 ? 1.0e6 * result.input_vertices / total_us : 0.0)
+      << ", \"peak_rss_growth_bytes\": " << result.peak_rss_growth
+      << ", \"heap_allocations\": " << result.heap.allocations
+      << ", \"heap_bytes\": " << result.heap.bytes << ", \"counters\": ";
+  kimera_pgmo::writePerfCountsJson(out, result.counters);
+  out << "}";
+}
+
+template <typename T>
+std::vector<T> ParseList(const std::string& list) {
+  std::vector<T> values;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    std::stringstream item_stream(item);
+    T value;
+    if (item_stream >> value) {
+      values.push_back(value);
+    }
+  }
+  return values;
+}
+
+void PrintUsage(const char* name) {
+  std::cerr << "Usage: " << name << " [--bag <bag> [--topic <topic>]]"
+            << " [--messages <n>] [--resolutions <r1,r2,...>]"
+            << " [--horizons <s1,s2,...>] [--compressions <c1,c2,...>]"
+            << " [--perf-counters <0|1>] [--output <json>]\n"
+            << "compressions: octree, voxblox, voxel_clearing, delta" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string bag_path;
+  std::string topic = "/kimera_semantics_node/mesh";
+  std::string output_path;
+  size_t num_messages = 200;
+  bool use_perf_counters = false;
+  std::vector<double> resolutions{0.04, 0.1, 1.5};
+  std::vector<double> horizons{10.0, 30.0};
+  std::vector<std::string> compressions{"octree", "voxblox", "voxel_clearing", "delta"};
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--bag") {
+      bag_path = value;
+    } else if (arg == "--topic") {
+      topic = value;
+    } else if (arg == "--output") {
+      output_path = value;
+    } else if (arg == "--messages") {
+      num_messages = std::stoul(value);
+    } else if (arg == "--resolutions") {
+      resolutions = ParseList<double>(value);
+    } else if (arg == "--horizons") {
+      horizons = ParseList<double>(value);
+    } else if (arg == "--compressions") {
+      compressions = ParseList<std::string>(value);
+    } else if (arg == "--perf-counters") {
+      use_perf_counters = value == "1" || value == "true";
+    } else {
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // synthetic streams are generated one at a time to bound the memory used
+  const std::vector<StreamConfig> configs{{"exploration_dense", 3, 8, 1, 0.5, false},
+                                          {"exploration_sparse", 5, 2, 3, 0.5, false},
+                                          {"revisit_dense", 3, 8, 1, 0.5, true}};
+  const size_t num_streams = bag_path.empty() ? 2 * configs.size() : 1;
+  auto get_stream = [&](size_t i) {
+    if (!bag_path.empty()) {
+      return ReadStream(bag_path, topic);
+    }
+    return MakeStream(configs[i / 2], num_messages, i % 2 == 1);
+  };
+
+  std::ofstream output_file;
+  if (!output_path.empty()) {
+    output_file.open(output_path);
+    if (!output_file) {
+      std::cerr << "Cannot write " << output_path << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::ostream& out = output_path.empty() ? std::cout : output_file;
+
+  // Falls back to wall time only when perf events are not accessible
+  std::unique_ptr<PerfCounters> perf_counters;
+  if (use_perf_counters) {
+    perf_counters.reset(new PerfCounters());
+    if (!perf_counters->available()) {
+      std::cerr << "Hardware counters unavailable (" << perf_counters->error()
+                << "), reporting wall time only" << std::endl;
+    }
+  }
+  const PerfCounters* counters =
+      perf_counters && perf_counters->available() ? perf_counters.get() : nullptr;
+
+  out << "{\n  \"allocation_counting\": "
+      << (kimera_pgmo::allocationCountingEnabled() ? "true" : "false")
+      << ",\n  \"perf_counters\": " << (counters ? "true" : "false")
+      << ",\n  \"runs\": [\n";
+  bool first = true;
+  for (size_t i = 0; i < num_streams; ++i) {
+    const Stream stream = get_stream(i);
+    if (stream.messages.empty()) {
+      std::cerr << "No voxblox_msgs/Mesh on " << topic << " in " << bag_path
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (const std::string& compression : compressions) {
+      for (const double resolution : resolutions) {
+        for (const double horizon : horizons) {
+          std::cerr << stream.name << (stream.semantics ? " (semantics)" : "")
+                    << " | " << compression << " | resolution " << resolution
+                    << " | horizon " << horizon << std::endl;
+          RunResult result;
+          if (!RunCompression(
+                  compression, resolution, stream, horizon, counters, &result)) {
+            std::cerr << "Unknown compression " << compression << std::endl;
+            return EXIT_FAILURE;
+          }
+          out << (first ? "" : ",\n");
+          WriteRun(out, compression, resolution, horizon, stream, std::move(result));
+          first = false;
+        }
+      }
+    }
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in kilobytes
+  out << "\n  ],\n  \"max_rss_bytes\": " << 1024 * static_cast<size_t>(usage.ru_maxrss)
+      << "\n}" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,526 @@
+/**
+ * @file   graph_optimization_benchmark.cpp
+ * @brief  Scaling of the deformation graph optimization with the mission size,
+ * on synthetic trajectories and meshes
+ * @author Yun Chang
+ */
+#include <KimeraRPGO/SolverParams.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "kimera_pgmo/DeformationGraph.h"
+#include "kimera_pgmo/utils/CommonFunctions.h"
+#include "kimera_pgmo/utils/PerfCounters.h"
+
+namespace {
+
+using kimera_pgmo::DeformationGraph;
+using kimera_pgmo::PerfCounters;
+using kimera_pgmo::PerfCounts;
+using kimera_pgmo::Timestamp;
+
+// Covariances and solver parameters of the shipped configurations
+constexpr double kOdomVariance = 1.0e-2;
+constexpr double kLoopClosureVariance = 5.0e-2;
+constexpr double kPriorVariance = 1.0e-2;
+constexpr double kMeshMeshVariance = 1.0e-2;
+constexpr double kPoseMeshVariance = 1.0e-2;
+// poses per lap around the circuit
+constexpr size_t kMaxLapLength = 100;
+constexpr double kCircuitRadius = 10.0;
+constexpr Timestamp kPosePeriodNs = 100000000;
+
+struct GraphSize {
+  size_t num_robots;
+  size_t poses_per_robot;
+  // loop closures per robot
+  size_t loop_closures;
+  // mesh nodes per pose
+  size_t mesh_density;
+};
+
+struct BenchmarkConfig {
+  double outlier_ratio = 0.1;
+  double gnc_alpha = 0.99;
+  size_t update_period = 10;
+  // mesh nodes each pose is attached to
+  size_t valences = 3;
+  unsigned int seed = 0;
+};
+
+struct Timings {
+  size_t num_factors = 0;
+  size_t num_values = 0;
+  double build_ms = 0.0;
+  std::vector<double> update_ms;
+  double optimize_ms = 0.0;
+  double loop_closure_ms = 0.0;
+  double trajectory_ms = 0.0;
+  double save_ms = 0.0;
+  double load_ms = 0.0;
+  size_t file_bytes = 0;
+  // hardware counters of the timed sections (invalid if not captured)
+  PerfCounts update_counters;
+  PerfCounts optimize_counters;
+  PerfCounts loop_closure_counters;
+  PerfCounts trajectory_counters;
+  PerfCounts save_counters;
+  PerfCounts load_counters;
+};
+
+// Wall time and, if counters are given, hardware counters since construction
+class Stopwatch {
+ public:
+  explicit Stopwatch(const PerfCounters* counters = nullptr)
+      : counters_(counters),
+        start_counts_(counters ? counters->read() : PerfCounts()),
+        start_(std::chrono::high_resolution_clock::now()) {}
+
+  double elapsedMs() const {
+    const auto now = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(now - start_).count();
+  }
+
+  PerfCounts elapsedCounts() const {
+    return counters_ ? counters_->read() - start_counts_ : PerfCounts();
+  }
+
+ private:
+  const PerfCounters* counters_;
+  PerfCounts start_counts_;
+  std::chrono::high_resolution_clock::time_point start_;
+};
+
+KimeraRPGO::RobustSolverParams MakeSolverParams(const BenchmarkConfig& config) {
+  KimeraRPGO::RobustSolverParams params;
+  params.setPcmSimple3DParams(0.05, 0.01, -1, -1, KimeraRPGO::Verbosity::QUIET);
+  params.setLmDiagonalDamping(true);
+  if (config.gnc_alpha > 0 && config.gnc_alpha < 1) {
+    params.setGncInlierCostThresholdsAtProbability(
+        config.gnc_alpha, 100, 1.6, 1.0e-5, 1.0e-4, true);
+  }
+  return params;
+}
+
+// Robots drive laps around the same circuit (with different heights), so that
+// the same pose index of different laps and robots is at the same place
+gtsam::Pose3 GroundTruthPose(size_t robot, size_t index, size_t lap_length) {
+  const double angle = 2.0 * M_PI * (index % lap_length) / lap_length;
+  const gtsam::Rot3 rotation = gtsam::Rot3::Yaw(angle + M_PI / 2.0);
+  const gtsam::Point3 position(kCircuitRadius * std::cos(angle),
+                               kCircuitRadius * std::sin(angle),
+                               0.5 * robot);
+  return gtsam::Pose3(rotation, position);
+}
+
+gtsam::Pose3 Perturb(const gtsam::Pose3& pose,
+                     double translation_sigma,
+                     double rotation_sigma,
+                     std::mt19937& rng) {
+  std::normal_distribution<double> translation(0.0, translation_sigma);
+  std::normal_distribution<double> rotation(0.0, rotation_sigma);
+  gtsam::Vector6 delta;
+  delta << rotation(rng), rotation(rng), rotation(rng), translation(rng),
+      translation(rng), translation(rng);
+  return pose.compose(gtsam::Pose3::Expmap(delta));
+}
+
+gtsam::Pose3 RandomPose(std::mt19937& rng) {
+  std::uniform_real_distribution<double> position(-kCircuitRadius, kCircuitRadius);
+  std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+  return gtsam::Pose3(gtsam::Rot3::RzRyRx(angle(rng), angle(rng), angle(rng)),
+                      gtsam::Point3(position(rng), position(rng), position(rng)));
+}
+
+// Loop closures to add when each pose is reached: (from key, to key, measurement)
+struct LoopClosure {
+  gtsam::Key from;
+  gtsam::Key to;
+  gtsam::Pose3 measurement;
+};
+
+std::vector<std::vector<LoopClosure>> SampleLoopClosures(const GraphSize& size,
+                                                         const BenchmarkConfig& config,
+                                                         size_t lap_length,
+                                                         std::mt19937& rng) {
+  std::vector<std::vector<LoopClosure>> closures(size.poses_per_robot);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (size_t robot = 0; robot < size.num_robots; ++robot) {
+    const char prefix = kimera_pgmo::GetRobotPrefix(robot);
+    // intra-robot loop closures need a second lap, inter-robot ones a robot
+    // that drove before
+    std::vector<size_t> candidates;
+    for (size_t i = 1; i < size.poses_per_robot; ++i) {
+      if (i >= lap_length || robot > 0) {
+        candidates.push_back(i);
+      }
+    }
+    std::shuffle(candidates.begin(), candidates.end(), rng);
+    candidates.resize(std::min(candidates.size(), size.loop_closures));
+    for (const size_t i : candidates) {
+      const bool inter_robot = robot > 0 && (i < lap_length || uniform(rng) < 0.5);
+      const size_t from_robot = inter_robot ? robot - 1 : robot;
+      const size_t from_index = inter_robot ? i : i - lap_length;
+      LoopClosure closure;
+      closure.from = gtsam::Symbol(kimera_pgmo::GetRobotPrefix(from_robot), from_index);
+      closure.to = gtsam::Symbol(prefix, i);
+      if (uniform(rng) < config.outlier_ratio) {
+        closure.measurement = RandomPose(rng);
+      } else {
+        closure.measurement =
+            GroundTruthPose(from_robot, from_index, lap_length)
+                .between(GroundTruthPose(robot, i, lap_length));
+      }
+      closures[i].push_back(closure);
+    }
+  }
+  return closures;
+}
+
+gtsam::Point3 MeshNodePosition(const gtsam::Pose3& pose, size_t n, size_t density) {
+  const double offset = -1.0 + 2.0 * (n + 0.5) / density;
+  return pose.transformFrom(gtsam::Point3(0.0, offset, -1.0));
+}
+
+// Mesh nodes of a pose: a strip of points under the pose, each connected to the
+// previous node of the strip and to the same node of the previous pose (resent
+// with the new nodes, as the frontend does for the active mesh)
+void AddPoseMesh(DeformationGraph& graph,
+                 size_t robot,
+                 size_t index,
+                 const gtsam::Pose3& pose,
+                 const gtsam::Pose3& previous_pose,
+                 const GraphSize& size,
+                 const BenchmarkConfig& config) {
+  const size_t density = size.mesh_density;
+  if (density == 0) {
+    return;
+  }
+  const char prefix = kimera_pgmo::GetVertexPrefix(robot);
+  const size_t first_node = index * density;
+  gtsam::Values mesh_nodes;
+  std::unordered_map<gtsam::Key, Timestamp> node_stamps;
+  std::vector<std::pair<gtsam::Key, gtsam::Key>> mesh_edges;
+  for (size_t n = 0; n < density; ++n) {
+    const gtsam::Key key = gtsam::Symbol(prefix, first_node + n);
+    mesh_nodes.insert(
+        key, gtsam::Pose3(gtsam::Rot3(), MeshNodePosition(pose, n, density)));
+    node_stamps[key] = index * kPosePeriodNs;
+    if (n > 0) {
+      mesh_edges.push_back({key - 1, key});
+      mesh_edges.push_back({key, key - 1});
+    }
+    if (index > 0) {
+      const gtsam::Key previous_key = key - density;
+      mesh_nodes.insert(
+          previous_key,
+          gtsam::Pose3(gtsam::Rot3(), MeshNodePosition(previous_pose, n, density)));
+      node_stamps[previous_key] = (index - 1) * kPosePeriodNs;
+      mesh_edges.push_back({previous_key, key});
+      mesh_edges.push_back({key, previous_key});
+    }
+  }
+  std::vector<size_t> added_indices;
+  std::vector<Timestamp> added_stamps;
+  graph.addNewMeshEdgesAndNodes(mesh_edges,
+                                mesh_nodes,
+                                node_stamps,
+                                &added_indices,
+                                &added_stamps,
+                                kMeshMeshVariance);
+
+  kimera_pgmo::Vertices valences;
+  for (size_t n = 0; n < std::min(config.valences, density); ++n) {
+    valences.push_back(first_node + n);
+  }
+  graph.addNodeValence(gtsam::Symbol(kimera_pgmo::GetRobotPrefix(robot), index),
+                       valences,
+                       prefix,
+                       kPoseMeshVariance);
+}
+
+Timings RunBenchmark(const GraphSize& size,
+                     const BenchmarkConfig& config,
+                     const PerfCounters* counters) {
+  std::mt19937 rng(config.seed);
+  const size_t lap_length =
+      std::max<size_t>(2, std::min(kMaxLapLength, size.poses_per_robot / 2));
+  const auto loop_closures = SampleLoopClosures(size, config, lap_length, rng);
+
+  Timings timings;
+  DeformationGraph graph;
+  graph.initialize(MakeSolverParams(config));
+
+  // Poses are added in the order they are received from the robots, calling
+  // update every update_period poses like the backend does with the pose graph
+  // messages
+  std::vector<gtsam::Pose3> odometry_poses(size.num_robots);
+  const Stopwatch build_watch;
+  for (size_t i = 0; i < size.poses_per_robot; ++i) {
+    for (size_t robot = 0; robot < size.num_robots; ++robot) {
+      const gtsam::Key key = gtsam::Symbol(kimera_pgmo::GetRobotPrefix(robot), i);
+      const gtsam::Pose3 truth = GroundTruthPose(robot, i, lap_length);
+      const gtsam::Pose3 previous_pose = odometry_poses[robot];
+      if (i == 0) {
+        odometry_poses[robot] = truth;
+        graph.addNewNode(key, truth, true, kPriorVariance);
+      } else {
+        const gtsam::Pose3 odometry =
+            Perturb(GroundTruthPose(robot, i - 1, lap_length).between(truth),
+                    0.01,
+                    0.002,
+                    rng);
+        odometry_poses[robot] = odometry_poses[robot].compose(odometry);
+        graph.addNewBetween(
+            key - 1, key, odometry, odometry_poses[robot], kOdomVariance);
+      }
+      AddPoseMesh(
+          graph, robot, i, odometry_poses[robot], previous_pose, size, config);
+    }
+    for (const LoopClosure& closure : loop_closures[i]) {
+      graph.addNewBetween(closure.from,
+                          closure.to,
+                          closure.measurement,
+                          gtsam::Pose3(),
+                          kLoopClosureVariance);
+    }
+    if ((i + 1) % config.update_period == 0 || i + 1 == size.poses_per_robot) {
+      const Stopwatch update_watch(counters);
+      graph.update();
+      timings.update_ms.push_back(update_watch.elapsedMs());
+      timings.update_counters += update_watch.elapsedCounts();
+    }
+  }
+  timings.build_ms = build_watch.elapsedMs();
+
+  const Stopwatch optimize_watch(counters);
+  graph.optimize();
+  timings.optimize_ms = optimize_watch.elapsedMs();
+  timings.optimize_counters = optimize_watch.elapsedCounts();
+
+  // latency of a new loop closure at the end of the mission
+  if (size.poses_per_robot > lap_length) {
+    const size_t last = size.poses_per_robot - 1;
+    const char prefix = kimera_pgmo::GetRobotPrefix(0);
+    graph.addNewBetween(gtsam::Symbol(prefix, last - lap_length),
+                        gtsam::Symbol(prefix, last),
+                        gtsam::Pose3(),
+                        gtsam::Pose3(),
+                        kLoopClosureVariance);
+    const Stopwatch loop_closure_watch(counters);
+    graph.optimize();
+    timings.loop_closure_ms = loop_closure_watch.elapsedMs();
+    timings.loop_closure_counters = loop_closure_watch.elapsedCounts();
+  }
+
+  const Stopwatch trajectory_watch(counters);
+  for (size_t robot = 0; robot < size.num_robots; ++robot) {
+    graph.getOptimizedTrajectory(kimera_pgmo::GetRobotPrefix(robot));
+  }
+  timings.trajectory_ms = trajectory_watch.elapsedMs();
+  timings.trajectory_counters = trajectory_watch.elapsedCounts();
+
+  timings.num_factors = graph.getGtsamFactors().size();
+  timings.num_values = graph.getGtsamValues().size();
+
+  const std::string filename = "/tmp/graph_optimization_benchmark.dgrf";
+  const Stopwatch save_watch(counters);
+  graph.save(filename);
+  timings.save_ms = save_watch.elapsedMs();
+  timings.save_counters = save_watch.elapsedCounts();
+  std::ifstream saved(filename, std::ios::binary | std::ios::ate);
+  timings.file_bytes = saved ? static_cast<size_t>(saved.tellg()) : 0;
+
+  DeformationGraph loaded;
+  loaded.initialize(MakeSolverParams(config));
+  const Stopwatch load_watch(counters);
+  const bool load_success = loaded.load(filename);
+  timings.load_ms = load_watch.elapsedMs();
+  timings.load_counters = load_watch.elapsedCounts();
+  if (!load_success) {
+    std::cerr << "Cannot read " << filename << std::endl;
+  }
+  std::remove(filename.c_str());
+  return timings;
+}
+
+// Nearest-rank percentile of sorted values
+double Percentile(const std::vector<double>& sorted, double percent) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+void WriteRun(std::ostream& out,
+              const GraphSize& size,
+              const BenchmarkConfig& config,
+              Timings timings) {
+  std::sort(timings.update_ms.begin(), timings.update_ms.end());
+  double total_update_ms = 0.0;
+  for (const double update_ms : timings.update_ms) {
+    total_update_ms += update_ms;
+  }
+  out << "    {\"robots\": " << size.num_robots
+      << ", \"poses_per_robot\": " << size.poses_per_robot
+      << ", \"loop_closures_per_robot\": " << size.loop_closures
+      << ", \"outlier_ratio\": " << config.outlier_ratio
+      << ", \"mesh_nodes_per_pose\": " << size.mesh_density
+      << ", \"factors\": " << timings.num_factors
+      << ", \"values\": " << timings.num_values
+      << ", \"build_ms\": " << timings.build_ms << ", \"update_ms\": {\"count\": "
+      << timings.update_ms.size() << ", \"total\": " << total_update_ms
+      << ", \"p50\": " << Percentile(timings.update_ms, 50)
+      << ", \"p90\": " << Percentile(timings.update_ms, 90)
+      << ", \"max\": " << Percentile(timings.update_ms, 100)
+      << "}, \"optimize_ms\": " << timings.optimize_ms
+      << ", \"loop_closure_optimize_ms\": " << timings.loop_closure_ms
+      << ", \"trajectory_ms\": " << timings.trajectory_ms
+      << ", \"save_ms\": " << timings.save_ms << ", \"load_ms\": " << timings.load_ms
+      << ", \"file_bytes\": " << timings.file_bytes << ", \"counters\": ";
+  if (!timings.optimize_counters.valid()) {
+    out << "null}";
+    return;
+  }
+  const std::vector<std::pair<std::string, const PerfCounts*>> sections{
+      {"update", &timings.update_counters},
+      {"optimize", &timings.optimize_counters},
+      {"loop_closure_optimize", &timings.loop_closure_counters},
+      {"trajectory", &timings.trajectory_counters},
+      {"save", &timings.save_counters},
+      {"load", &timings.load_counters}};
+  out << "{";
+  for (size_t i = 0; i < sections.size(); ++i) {
+    out << (i == 0 ? "" : ", ") << "\"" << sections[i].first << "\": ";
+    kimera_pgmo::writePerfCountsJson(out, *sections[i].second);
+  }
+  out << "}}";
+}
+
+template <typename T>
+std::vector<T> ParseList(const std::string& list) {
+  std::vector<T> values;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    std::stringstream item_stream(item);
+    T value;
+    if (item_stream >> value) {
+      values.push_back(value);
+    }
+  }
+  return values;
+}
+
+void PrintUsage(const char* name) {
+  std::cerr << "Usage: " << name << " [--poses <n1,n2,...>] [--robots <n1,n2,...>]"
+            << " [--loop-closures <n1,n2,...>] [--mesh-density <n1,n2,...>]"
+            << " [--outlier-ratio <r>] [--gnc-alpha <a>] [--update-period <n>]"
+            << " [--valences <n>] [--seed <n>] [--perf-counters <0|1>]"
+            << " [--output <json>]" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> poses{250, 500, 1000, 2000};
+  std::vector<size_t> robots{1};
+  std::vector<size_t> loop_closures{20};
+  std::vector<size_t> mesh_densities{2};
+  BenchmarkConfig config;
+  std::string output_path;
+  bool use_perf_counters = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--poses") {
+      poses = ParseList<size_t>(value);
+    } else if (arg == "--robots") {
+      robots = ParseList<size_t>(value);
+    } else if (arg == "--loop-closures") {
+      loop_closures = ParseList<size_t>(value);
+    } else if (arg == "--mesh-density") {
+      mesh_densities = ParseList<size_t>(value);
+    } else if (arg == "--outlier-ratio") {
+      config.outlier_ratio = std::stod(value);
+    } else if (arg == "--gnc-alpha") {
+      config.gnc_alpha = std::stod(value);
+    } else if (arg == "--update-period") {
+      config.update_period = std::max<size_t>(1, std::stoul(value));
+    } else if (arg == "--valences") {
+      config.valences = std::stoul(value);
+    } else if (arg == "--seed") {
+      config.seed = std::stoul(value);
+    } else if (arg == "--perf-counters") {
+      use_perf_counters = value == "1" || value == "true";
+    } else if (arg == "--output") {
+      output_path = value;
+    } else {
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::ofstream output_file;
+  if (!output_path.empty()) {
+    output_file.open(output_path);
+    if (!output_file) {
+      std::cerr << "Cannot write " << output_path << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::ostream& out = output_path.empty() ? std::cout : output_file;
+
+  // Falls back to wall time only when perf events are not accessible
+  std::unique_ptr<PerfCounters> perf_counters;
+  if (use_perf_counters) {
+    perf_counters.reset(new PerfCounters());
+    if (!perf_counters->available()) {
+      std::cerr << "Hardware counters unavailable (" << perf_counters->error()
+                << "), reporting wall time only" << std::endl;
+    }
+  }
+  const PerfCounters* counters =
+      perf_counters && perf_counters->available() ? perf_counters.get() : nullptr;
+
+  // one run per size, ordered by the number of poses within each curve
+  out << "{\n  \"gnc_alpha\": " << config.gnc_alpha
+      << ",\n  \"update_period\": " << config.update_period
+      << ",\n  \"seed\": " << config.seed
+      << ",\n  \"perf_counters\": " << (counters ? "true" : "false")
+      << ",\n  \"runs\": [\n";
+  bool first = true;
+  for (const size_t num_robots : robots) {
+    for (const size_t mesh_density : mesh_densities) {
+      for (const size_t num_loop_closures : loop_closures) {
+        for (const size_t num_poses : poses) {
+          const GraphSize size{num_robots, num_poses, num_loop_closures, mesh_density};
+          std::cerr << "robots: " << num_robots << " | poses: " << num_poses
+                    << " | loop closures: " << num_loop_closures
+                    << " | mesh nodes per pose: " << mesh_density << std::endl;
+          out << (first ? "" : ",\n");
+          WriteRun(out, size, config, RunBenchmark(size, config, counters));
+          first = false;
+        }
+      }
+    }
+  }
+  out << "\n  ]\n}" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -26,5 +26,11 @@ int main(int argc, char* argv[]) {
 
   ros::spin();
 
+  // persist compression state so a restarted frontend keeps its indexing
+  const auto& state_path = mesh_frontend.getConfig().state_path;
+  if (!state_path.empty() && !mesh_frontend.saveState(state_path)) {
+    ROS_ERROR("Failed to save mesh frontend state to %s", state_path.c_str());
+  }
+
   return EXIT_SUCCESS;
 }
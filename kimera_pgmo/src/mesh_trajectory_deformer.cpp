@@ -26,8 +26,15 @@ class MeshTrajectoryDeformer : public KimeraPgmoInterface {
 
     original_mesh =
         PolygonMeshToPgmoMeshMsg(robot_id_, *mesh, mesh_vertex_stamps_, "world");
-    loadDeformationGraphFromFile(dgrf_path_, robot_id_);
+    if (!loadDeformationGraphFromFile(dgrf_path_, robot_id_)) {
+      ROS_ERROR("KimeraPgmo: Failed to load deformation graph.");
+      return false;
+    }
     loadPoseGraphSparseMapping(sparse_mapping_path_);
+    if (deformation_graph_->hasConvergedEstimate()) {
+      // the optimization with the trajectory starts from the saved solution
+      ROS_INFO("Loaded converged graph, skipped optimization on load");
+    }
 
     ROS_INFO("Load mesh and graph success");
 
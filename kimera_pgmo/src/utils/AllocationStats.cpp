@@ -0,0 +1,345 @@
+/**
+ * @file   AllocationStats.cpp
+ * @brief  Optional per-thread heap allocation counters
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/AllocationStats.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#ifdef KIMERA_PGMO_COUNT_ALLOCATIONS
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+namespace kimera_pgmo {
+
+namespace {
+thread_local AllocationCount thread_allocations;
+}  // namespace
+
+#ifdef KIMERA_PGMO_COUNT_ALLOCATIONS
+namespace {
+
+// Deeper zones are not tracked, so that the zone stack never allocates
+constexpr size_t kMaxZoneDepth = 32;
+
+struct ZoneFrame {
+  const char* name;
+  AllocationCount start;
+  AllocationCount children;
+  int64_t start_live;
+  int64_t peak_live;
+};
+
+struct ZoneStack {
+  ZoneFrame frames[kMaxZoneDepth];
+  size_t depth = 0;
+  // heap in use by the thread (allocated minus freed), used for the peaks
+  int64_t live_bytes = 0;
+  // set while the zone registry allocates, so it does not count itself
+  bool suspended = false;
+};
+
+thread_local ZoneStack zone_stack;
+
+class ZoneRegistry {
+ public:
+  void add(const ZoneFrame& frame, const AllocationCount& total) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ZoneAllocationStats& stats = stats_[frame.name];
+    ++stats.calls;
+    stats.total.allocations += total.allocations;
+    stats.total.bytes += total.bytes;
+    stats.self.allocations += total.allocations - frame.children.allocations;
+    stats.self.bytes += total.bytes - frame.children.bytes;
+    stats.peak_bytes = std::max<uint64_t>(stats.peak_bytes,
+                                          frame.peak_live - frame.start_live);
+  }
+
+  std::vector<ZoneAllocationStats> get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ZoneAllocationStats> result;
+    result.reserve(stats_.size());
+    for (const auto& name_stats : stats_) {
+      result.push_back(name_stats.second);
+      result.back().name = name_stats.first;
+    }
+    return result;
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.clear();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::map<std::string, ZoneAllocationStats> stats_;
+};
+
+void writeReportOnExit() {
+  if (allocationZoneStats().empty()) {
+    return;
+  }
+  const char* path = std::getenv("KIMERA_PGMO_ALLOCATION_REPORT");
+  std::ofstream file;
+  if (path) {
+    file.open(path);
+  }
+  writeAllocationZoneReport(file.is_open() ? file : std::cerr);
+}
+
+// Never destroyed, so that zones exiting during static destruction are safe
+ZoneRegistry& zoneRegistry() {
+  static ZoneRegistry* registry = [] {
+    std::atexit(writeReportOnExit);
+    return new ZoneRegistry();
+  }();
+  return *registry;
+}
+
+int64_t usableSize(void* ptr, std::size_t size) {
+#ifdef __GLIBC__
+  (void)size;
+  return static_cast<int64_t>(malloc_usable_size(ptr));
+#else
+  // without the allocator size, frees are not tracked and peaks are totals
+  (void)ptr;
+  return static_cast<int64_t>(size);
+#endif
+}
+
+}  // namespace
+
+bool allocationCountingEnabled() { return true; }
+
+namespace detail {
+
+// Returns null on failure, the throwing operators throw std::bad_alloc
+void* countedAllocate(std::size_t size, std::size_t alignment) {
+  void* ptr = nullptr;
+  if (alignment <= alignof(std::max_align_t)) {
+    ptr = std::malloc(size == 0 ? 1 : size);
+  } else if (posix_memalign(&ptr, alignment, size == 0 ? 1 : size) != 0) {
+    ptr = nullptr;
+  }
+  if (!ptr) {
+    return nullptr;
+  }
+  ZoneStack& stack = zone_stack;
+  stack.live_bytes += usableSize(ptr, size);
+  if (stack.suspended) {
+    return ptr;
+  }
+  ++thread_allocations.allocations;
+  thread_allocations.bytes += size;
+  if (stack.depth > 0 && stack.depth <= kMaxZoneDepth) {
+    ZoneFrame& frame = stack.frames[stack.depth - 1];
+    frame.peak_live = std::max(frame.peak_live, stack.live_bytes);
+  }
+  return ptr;
+}
+
+void countedFree(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+#ifdef __GLIBC__
+  zone_stack.live_bytes -= static_cast<int64_t>(malloc_usable_size(ptr));
+#endif
+  std::free(ptr);
+}
+
+}  // namespace detail
+
+AllocationZone::AllocationZone(const char* name) : active_(true) {
+  ZoneStack& stack = zone_stack;
+  ++stack.depth;
+  if (stack.depth > kMaxZoneDepth) {
+    active_ = false;
+    return;
+  }
+  stack.frames[stack.depth - 1] = {
+      name, thread_allocations, {}, stack.live_bytes, stack.live_bytes};
+}
+
+AllocationZone::~AllocationZone() {
+  ZoneStack& stack = zone_stack;
+  --stack.depth;
+  if (!active_) {
+    return;
+  }
+  const ZoneFrame& frame = stack.frames[stack.depth];
+  const AllocationCount total = thread_allocations - frame.start;
+  if (stack.depth > 0) {
+    ZoneFrame& parent = stack.frames[stack.depth - 1];
+    parent.children.allocations += total.allocations;
+    parent.children.bytes += total.bytes;
+    parent.peak_live = std::max(parent.peak_live, frame.peak_live);
+  }
+  stack.suspended = true;
+  zoneRegistry().add(frame, total);
+  stack.suspended = false;
+}
+
+std::vector<ZoneAllocationStats> allocationZoneStats() {
+  zone_stack.suspended = true;
+  auto stats = zoneRegistry().get();
+  zone_stack.suspended = false;
+  std::sort(stats.begin(),
+            stats.end(),
+            [](const ZoneAllocationStats& lhs, const ZoneAllocationStats& rhs) {
+              return lhs.self.bytes > rhs.self.bytes;
+            });
+  return stats;
+}
+
+void resetAllocationZoneStats() { zoneRegistry().reset(); }
+#else
+bool allocationCountingEnabled() { return false; }
+
+AllocationZone::AllocationZone(const char*) : active_(false) {}
+
+AllocationZone::~AllocationZone() = default;
+
+std::vector<ZoneAllocationStats> allocationZoneStats() { return {}; }
+
+void resetAllocationZoneStats() {}
+#endif
+
+AllocationCount threadAllocationCount() { return thread_allocations; }
+
+void writeAllocationZoneReport(std::ostream& out) {
+  const auto stats = allocationZoneStats();
+  out << "Heap allocations per zone (sorted by self bytes)\n"
+      << std::left << std::setw(48) << "zone" << std::right << std::setw(10)
+      << "calls" << std::setw(14) << "self allocs" << std::setw(16) << "self bytes"
+      << std::setw(14) << "total allocs" << std::setw(16) << "total bytes"
+      << std::setw(16) << "peak bytes" << "\n";
+  for (const auto& zone : stats) {
+    out << std::left << std::setw(48) << zone.name << std::right << std::setw(10)
+        << zone.calls << std::setw(14) << zone.self.allocations << std::setw(16)
+        << zone.self.bytes << std::setw(14) << zone.total.allocations
+        << std::setw(16) << zone.total.bytes << std::setw(16) << zone.peak_bytes
+        << "\n";
+  }
+  out << std::flush;
+}
+
+}  // namespace kimera_pgmo
+
+#ifdef KIMERA_PGMO_COUNT_ALLOCATIONS
+// Instrumented global allocation functions (only in profiling builds). All the
+// replaceable forms are defined, so that aligned and nothrow allocations are
+// counted too and never reach the default operators with a pointer they did
+// not allocate.
+namespace {
+
+constexpr std::size_t kDefaultAlignment = alignof(std::max_align_t);
+
+void* tryAllocate(std::size_t size, std::size_t alignment) noexcept {
+  return kimera_pgmo::detail::countedAllocate(size, alignment);
+}
+
+void* tryAllocate(std::size_t size, std::align_val_t alignment) noexcept {
+  return tryAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+template <typename Alignment>
+void* allocate(std::size_t size, Alignment alignment) {
+  void* ptr = tryAllocate(size, alignment);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) { return allocate(size, kDefaultAlignment); }
+
+void* operator new[](std::size_t size) { return allocate(size, kDefaultAlignment); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return allocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocate(size, alignment);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return tryAllocate(size, kDefaultAlignment);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return tryAllocate(size, kDefaultAlignment);
+}
+
+void* operator new(std::size_t size,
+                   std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return tryAllocate(size, alignment);
+}
+
+void* operator new[](std::size_t size,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return tryAllocate(size, alignment);
+}
+
+// malloc and posix_memalign memory is released with free, whatever the form
+void operator delete(void* ptr) noexcept { kimera_pgmo::detail::countedFree(ptr); }
+
+void operator delete[](void* ptr) noexcept { kimera_pgmo::detail::countedFree(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+  kimera_pgmo::detail::countedFree(ptr);
+}
+#endif
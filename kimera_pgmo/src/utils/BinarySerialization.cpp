@@ -0,0 +1,268 @@
+/**
+ * @file   BinarySerialization.cpp
+ * @brief  Compact binary writer / memory-mapped reader used for state files
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/BinarySerialization.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace kimera_pgmo {
+
+BinaryWriter::BinaryWriter(const std::string& filename)
+    : out_(filename, std::ios::out | std::ios::binary | std::ios::trunc) {}
+
+void BinaryWriter::writeBytes(const void* data, size_t num_bytes) {
+  if (num_bytes == 0) {
+    return;
+  }
+
+  out_.write(reinterpret_cast<const char*>(data), num_bytes);
+}
+
+void BinaryWriter::writeString(const std::string& value) {
+  write<uint64_t>(value.size());
+  writeBytes(value.data(), value.size());
+}
+
+BinaryReader::BinaryReader(const std::string& filename)
+    : data_(nullptr), size_(0), pos_(0), failed_(false), mapping_(nullptr) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    close(fd);
+    return;
+  }
+
+  void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return;
+  }
+
+  madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+  mapping_ = mapping;
+  data_ = static_cast<const uint8_t*>(mapping);
+  size_ = info.st_size;
+}
+
+BinaryReader::BinaryReader(const uint8_t* data, size_t num_bytes)
+    : data_(data), size_(num_bytes), pos_(0), failed_(false), mapping_(nullptr) {}
+
+BinaryReader::~BinaryReader() {
+  if (mapping_) {
+    munmap(mapping_, size_);
+  }
+}
+
+bool BinaryReader::readBytes(void* data, size_t num_bytes) {
+  if (!ok() || num_bytes > size_ - pos_) {
+    failed_ = true;
+    return false;
+  }
+
+  if (num_bytes > 0) {
+    std::memcpy(data, data_ + pos_, num_bytes);
+  }
+
+  pos_ += num_bytes;
+  return true;
+}
+
+bool BinaryReader::readString(std::string& value) {
+  uint64_t size;
+  if (!read(size) || size > remaining()) {
+    failed_ = true;
+    return false;
+  }
+
+  value.resize(size);
+  return readBytes(&value[0], size);
+}
+
+void writeCloud(BinaryWriter& writer, const pcl::PointCloud<pcl::PointXYZRGBA>& cloud) {
+  writer.write<uint64_t>(cloud.size());
+  for (const auto& p : cloud.points) {
+    const float xyz[3] = {p.x, p.y, p.z};
+    writer.writeBytes(xyz, sizeof(xyz));
+    writer.write<uint32_t>(p.rgba);
+  }
+}
+
+bool readCloud(BinaryReader& reader, pcl::PointCloud<pcl::PointXYZRGBA>& cloud) {
+  constexpr size_t point_size = 3 * sizeof(float) + sizeof(uint32_t);
+  uint64_t size;
+  if (!reader.read(size) || size > reader.remaining() / point_size) {
+    return false;
+  }
+
+  cloud.clear();
+  cloud.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    float xyz[3];
+    pcl::PointXYZRGBA p;
+    reader.readBytes(xyz, sizeof(xyz));
+    reader.read(p.rgba);
+    p.x = xyz[0];
+    p.y = xyz[1];
+    p.z = xyz[2];
+    cloud.push_back(p);
+  }
+
+  return reader.ok();
+}
+
+void writeCloud(BinaryWriter& writer, const pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  writer.write<uint64_t>(cloud.size());
+  for (const auto& p : cloud.points) {
+    const float xyz[3] = {p.x, p.y, p.z};
+    writer.writeBytes(xyz, sizeof(xyz));
+  }
+}
+
+bool readCloud(BinaryReader& reader, pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  constexpr size_t point_size = 3 * sizeof(float);
+  uint64_t size;
+  if (!reader.read(size) || size > reader.remaining() / point_size) {
+    return false;
+  }
+
+  cloud.clear();
+  cloud.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    float xyz[3];
+    reader.readBytes(xyz, sizeof(xyz));
+    cloud.push_back(pcl::PointXYZ(xyz[0], xyz[1], xyz[2]));
+  }
+
+  return reader.ok();
+}
+
+void writePolygons(BinaryWriter& writer, const std::vector<pcl::Vertices>& polygons) {
+  writer.write<uint64_t>(polygons.size());
+  for (const auto& polygon : polygons) {
+    writer.writeVector(polygon.vertices);
+  }
+}
+
+bool readPolygons(BinaryReader& reader, std::vector<pcl::Vertices>& polygons) {
+  uint64_t size;
+  if (!reader.read(size) || size > reader.remaining() / sizeof(uint64_t)) {
+    return false;
+  }
+
+  polygons.resize(size);
+  for (auto& polygon : polygons) {
+    if (!reader.readVector(polygon.vertices)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void writeLabelColumn(BinaryWriter& writer, const LabelColumn& labels) {
+  std::vector<LabelColumn::RunLength> run_lengths;
+  writer.write<uint8_t>(labels.wide());
+  if (labels.wide()) {
+    std::vector<uint32_t> run_labels;
+    labels.encodeRuns(&run_lengths, &run_labels);
+    writer.writeVector(run_lengths);
+    writer.writeVector(run_labels);
+    return;
+  }
+
+  std::vector<LabelColumn::LabelIndex> run_labels;
+  labels.encode(&run_lengths, &run_labels);
+  writer.writeVector(labels.dictionary());
+  writer.writeVector(run_lengths);
+  writer.writeVector(run_labels);
+}
+
+bool readLabelColumn(BinaryReader& reader, LabelColumn& labels) {
+  uint8_t wide = 0;
+  if (!reader.read(wide)) {
+    return false;
+  }
+
+  std::vector<LabelColumn::RunLength> run_lengths;
+  if (wide) {
+    std::vector<uint32_t> run_labels;
+    if (!reader.readVector(run_lengths) || !reader.readVector(run_labels)) {
+      return false;
+    }
+    return labels.decodeRuns(run_lengths, run_labels);
+  }
+
+  std::vector<uint32_t> dictionary;
+  std::vector<LabelColumn::LabelIndex> run_labels;
+  if (!reader.readVector(dictionary) || !reader.readVector(run_lengths) ||
+      !reader.readVector(run_labels)) {
+    return false;
+  }
+
+  return labels.decode(dictionary, run_lengths, run_labels);
+}
+
+void writeIndexMapping(BinaryWriter& writer, const IndexMapping& mapping) {
+  writer.write<uint64_t>(mapping.size());
+  for (const auto& key_value : mapping) {
+    writer.write<uint64_t>(key_value.first);
+    writer.write<uint64_t>(key_value.second);
+  }
+}
+
+bool readIndexMapping(BinaryReader& reader, IndexMapping& mapping) {
+  uint64_t size;
+  if (!reader.read(size) || size > reader.remaining() / (2 * sizeof(uint64_t))) {
+    return false;
+  }
+
+  mapping.clear();
+  mapping.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    uint64_t key, value;
+    reader.read(key);
+    reader.read(value);
+    mapping.emplace(key, value);
+  }
+
+  return reader.ok();
+}
+
+void writeVoxbloxIndexMapping(BinaryWriter& writer, const VoxbloxIndexMapping& mapping) {
+  writer.write<uint64_t>(mapping.size());
+  for (const auto& block_mapping : mapping) {
+    writeVoxbloxIndex(writer, block_mapping.first);
+    writeIndexMapping(writer, block_mapping.second);
+  }
+}
+
+bool readVoxbloxIndexMapping(BinaryReader& reader, VoxbloxIndexMapping& mapping) {
+  uint64_t size;
+  if (!reader.read(size)) {
+    return false;
+  }
+
+  mapping.clear();
+  for (size_t i = 0; i < size; ++i) {
+    voxblox::BlockIndex index;
+    if (!readVoxbloxIndex(reader, index) || !readIndexMapping(reader, mapping[index])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace kimera_pgmo
@@ -13,6 +13,7 @@
 #include <algorithm>
 #include <chrono>
 #include <limits>
+#include <unordered_map>
 
 namespace kimera_pgmo {
 
@@ -432,6 +433,70 @@ GraphMsgPtr GtsamGraphToRos(const gtsam::NonlinearFactorGraph& factors,
   return posegraph;
 }
 
+pose_graph_tools_msgs::PoseGraph MeshGraphToPoseGraph(
+    const KimeraPgmoMeshGraph& mesh_graph,
+    const pcl::PointCloud<pcl::PointXYZRGBA>& graph_vertices) {
+  pose_graph_tools_msgs::PoseGraph msg;
+  msg.header = mesh_graph.header;
+  const size_t num_nodes = mesh_graph.node_indices.size();
+  if (mesh_graph.node_positions.size() != 3 * num_nodes ||
+      mesh_graph.node_stamps.size() != num_nodes || mesh_graph.edges.size() % 2 != 0) {
+    ROS_ERROR("MeshGraphToPoseGraph: inconsistent array sizes in mesh graph msg.");
+    return msg;
+  }
+
+  std::unordered_map<uint64_t, gtsam::Point3> positions;
+  msg.nodes.resize(num_nodes);
+  for (size_t i = 0; i < num_nodes; i++) {
+    const float* position = &mesh_graph.node_positions[3 * i];
+    const gtsam::Point3 node_pos(position[0], position[1], position[2]);
+    positions[mesh_graph.node_indices[i]] = node_pos;
+
+    pose_graph_tools_msgs::PoseGraphNode& pg_node = msg.nodes[i];
+    pg_node.header = mesh_graph.header;
+    pg_node.header.stamp.fromNSec(mesh_graph.node_stamps[i]);
+    pg_node.robot_id = mesh_graph.robot_id;
+    pg_node.key = mesh_graph.node_indices[i];
+    pg_node.pose = GtsamToRos(gtsam::Pose3(gtsam::Rot3(), node_pos));
+  }
+
+  // Edges can connect new vertices to ones sent in earlier msgs
+  auto find_position = [&](uint64_t index, gtsam::Point3* position) {
+    const auto new_node = positions.find(index);
+    if (new_node != positions.end()) {
+      *position = new_node->second;
+      return true;
+    }
+    if (index >= graph_vertices.size()) {
+      return false;
+    }
+    *position = PclToGtsam<pcl::PointXYZRGBA>(graph_vertices.at(index));
+    return true;
+  };
+
+  msg.edges.reserve(mesh_graph.edges.size() / 2);
+  for (size_t i = 0; i + 1 < mesh_graph.edges.size(); i += 2) {
+    gtsam::Point3 from_pos, to_pos;
+    if (!find_position(mesh_graph.edges[i], &from_pos) ||
+        !find_position(mesh_graph.edges[i + 1], &to_pos)) {
+      ROS_WARN_STREAM("MeshGraphToPoseGraph: unknown vertex in edge "
+                      << mesh_graph.edges[i] << " - " << mesh_graph.edges[i + 1]);
+      continue;
+    }
+
+    pose_graph_tools_msgs::PoseGraphEdge pg_edge;
+    pg_edge.header = mesh_graph.header;
+    pg_edge.robot_from = mesh_graph.robot_id;
+    pg_edge.robot_to = mesh_graph.robot_id;
+    pg_edge.key_from = mesh_graph.edges[i];
+    pg_edge.key_to = mesh_graph.edges[i + 1];
+    pg_edge.type = pose_graph_tools_msgs::PoseGraphEdge::MESH;
+    pg_edge.pose = GtsamToRos(gtsam::Pose3(gtsam::Rot3(), to_pos - from_pos));
+    msg.edges.push_back(pg_edge);
+  }
+  return msg;
+}
+
 bool SurfaceExists(const pcl::Vertices& new_surface,
                    const std::map<size_t, std::vector<size_t>>& adjacent_surfaces,
                    const std::vector<pcl::Vertices>& surfaces) {
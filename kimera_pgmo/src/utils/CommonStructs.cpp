@@ -13,6 +13,8 @@
 #include <chrono>
 #include <numeric>
 
+#include "kimera_pgmo/utils/BinarySerialization.h"
+
 namespace kimera_pgmo {
 
 // Timestamps
@@ -164,4 +166,37 @@ void Graph::print(std::string header) const {
   std::cout << std::endl;
 }
 
+void Graph::save(BinaryWriter& writer) const {
+  writer.writeVector(vertices_);
+  writer.write<uint64_t>(edges_.size());
+  for (const auto& vertex_edges : edges_) {
+    writer.write<uint64_t>(vertex_edges.first);
+    writer.writeVector(vertex_edges.second);
+  }
+  writer.write<uint64_t>(max_vertex_);
+}
+
+bool Graph::load(BinaryReader& reader) {
+  vertices_.clear();
+  edges_.clear();
+  max_vertex_ = 0;
+  if (!reader.readVector(vertices_)) {
+    return false;
+  }
+
+  uint64_t num_entries;
+  if (!reader.read(num_entries)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < num_entries; ++i) {
+    Vertex v;
+    if (!reader.read(v) || !reader.readVector(edges_[v])) {
+      return false;
+    }
+  }
+
+  return reader.read(max_vertex_);
+}
+
 }  // namespace kimera_pgmo
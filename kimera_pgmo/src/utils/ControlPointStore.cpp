@@ -0,0 +1,128 @@
+/**
+ * @file   ControlPointStore.cpp
+ * @brief  Compact chunked storage for the deformation graph control points
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/ControlPointStore.h"
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace kimera_pgmo {
+
+using traits::Timestamp;
+
+ControlPointStore::ControlPointStore(const std::vector<gtsam::Point3>& positions,
+                                     const std::vector<Timestamp>& stamps) {
+  for (size_t i = 0; i < positions.size(); ++i) {
+    push_back(positions[i], stamps.empty() ? 0 : stamps.at(i));
+  }
+}
+
+void ControlPointStore::clear() {
+  chunks_.clear();
+  size_ = 0;
+}
+
+void ControlPointStore::push_back(const gtsam::Point3& position, Timestamp stamp) {
+  if (size_ % kChunkSize == 0) {
+    chunks_.emplace_back();
+    Chunk& chunk = chunks_.back();
+    chunk.origin = position;
+    chunk.first_stamp = stamp;
+    chunk.offsets.reserve(3 * kChunkSize);
+    chunk.stamp_us.reserve(kChunkSize);
+    chunk.stamp_ns.reserve(kChunkSize);
+  }
+
+  Chunk& chunk = chunks_.back();
+  const gtsam::Point3 offset = position - chunk.origin;
+  chunk.offsets.push_back(static_cast<float>(offset.x()));
+  chunk.offsets.push_back(static_cast<float>(offset.y()));
+  chunk.offsets.push_back(static_cast<float>(offset.z()));
+
+  // floor division so that the remainder is always in [0, 1000)
+  const int64_t delta =
+      static_cast<int64_t>(stamp) - static_cast<int64_t>(chunk.first_stamp);
+  int64_t delta_us = delta / 1000;
+  int64_t remainder_ns = delta % 1000;
+  if (remainder_ns < 0) {
+    remainder_ns += 1000;
+    --delta_us;
+  }
+
+  if (delta_us <= std::numeric_limits<int32_t>::min() ||
+      delta_us > std::numeric_limits<int32_t>::max()) {
+    chunk.stamp_us.push_back(kFarStamp);
+    chunk.stamp_ns.push_back(0);
+    chunk.far_stamps.push_back(stamp);
+  } else {
+    chunk.stamp_us.push_back(static_cast<int32_t>(delta_us));
+    chunk.stamp_ns.push_back(static_cast<uint16_t>(remainder_ns));
+  }
+
+  ++size_;
+}
+
+const ControlPointStore::Chunk& ControlPointStore::chunkAt(size_t index) const {
+  if (index >= size_) {
+    throw std::out_of_range("control point index " + std::to_string(index) +
+                            " out of range (size " + std::to_string(size_) + ")");
+  }
+
+  return chunks_[index / kChunkSize];
+}
+
+gtsam::Point3 ControlPointStore::position(size_t index) const {
+  const Chunk& chunk = chunkAt(index);
+  const float* offset = &chunk.offsets[3 * (index % kChunkSize)];
+  return chunk.origin + gtsam::Point3(offset[0], offset[1], offset[2]);
+}
+
+Timestamp ControlPointStore::stamp(size_t index) const {
+  const Chunk& chunk = chunkAt(index);
+  const size_t i = index % kChunkSize;
+  if (chunk.stamp_us[i] == kFarStamp) {
+    // far stamps are rare, count the ones before this point
+    size_t far_index = 0;
+    for (size_t j = 0; j < i; ++j) {
+      far_index += chunk.stamp_us[j] == kFarStamp ? 1 : 0;
+    }
+    return chunk.far_stamps[far_index];
+  }
+
+  const int64_t delta = static_cast<int64_t>(chunk.stamp_us[i]) * 1000 + chunk.stamp_ns[i];
+  return static_cast<Timestamp>(static_cast<int64_t>(chunk.first_stamp) + delta);
+}
+
+std::vector<gtsam::Point3> ControlPointStore::positions() const {
+  std::vector<gtsam::Point3> result;
+  result.reserve(size_);
+  for (size_t i = 0; i < size_; ++i) {
+    result.push_back(position(i));
+  }
+  return result;
+}
+
+std::vector<Timestamp> ControlPointStore::stamps() const {
+  std::vector<Timestamp> result;
+  result.reserve(size_);
+  for (size_t i = 0; i < size_; ++i) {
+    result.push_back(stamp(i));
+  }
+  return result;
+}
+
+size_t ControlPointStore::memoryUsage() const {
+  size_t num_bytes = sizeof(ControlPointStore);
+  for (const auto& chunk : chunks_) {
+    num_bytes += sizeof(Chunk) + chunk.offsets.capacity() * sizeof(float) +
+                 chunk.stamp_us.capacity() * sizeof(int32_t) +
+                 chunk.stamp_ns.capacity() * sizeof(uint16_t) +
+                 chunk.far_stamps.capacity() * sizeof(Timestamp);
+  }
+  return num_bytes;
+}
+
+}  // namespace kimera_pgmo
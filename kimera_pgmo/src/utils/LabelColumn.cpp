@@ -0,0 +1,220 @@
+/**
+ * @file   LabelColumn.cpp
+ * @brief  Run-length and dictionary encoded column of vertex labels
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/LabelColumn.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace kimera_pgmo {
+
+LabelColumn::LabelColumn(const std::vector<uint32_t>& labels) { *this = labels; }
+
+LabelColumn& LabelColumn::operator=(const std::vector<uint32_t>& labels) {
+  clear();
+  for (const auto label : labels) {
+    push_back(label);
+  }
+  return *this;
+}
+
+bool LabelColumn::dictionaryIndex(uint32_t label, LabelIndex* index) {
+  const auto iter = dictionary_lookup_.find(label);
+  if (iter != dictionary_lookup_.end()) {
+    *index = iter->second;
+    return true;
+  }
+
+  if (dictionary_.size() >= kMaxDictionarySize) {
+    return false;
+  }
+  *index = dictionary_.size();
+  dictionary_.push_back(label);
+  dictionary_lookup_.emplace(label, *index);
+  return true;
+}
+
+void LabelColumn::widen() {
+  wide_run_labels_.reserve(run_labels_.capacity());
+  for (size_t r = 0; r < run_labels_.size(); ++r) {
+    wide_run_labels_.push_back(dictionary_[run_labels_[r]]);
+  }
+  wide_ = true;
+  dictionary_ = std::vector<uint32_t>();
+  dictionary_lookup_ = std::unordered_map<uint32_t, LabelIndex>();
+  run_labels_ = std::vector<LabelIndex>();
+}
+
+void LabelColumn::push_back(uint32_t label) { appendRun(label, 1); }
+
+void LabelColumn::appendRun(uint32_t label, size_t length) {
+  const size_t start = size();
+  // Same label as the previous entry: only extend the last run
+  if (!run_ends_.empty() && runLabel(run_ends_.size() - 1) == label) {
+    run_ends_.back() += length;
+  } else {
+    LabelIndex index = 0;
+    if (!wide_ && !dictionaryIndex(label, &index)) {
+      widen();
+    }
+
+    if (wide_) {
+      wide_run_labels_.push_back(label);
+    } else {
+      run_labels_.push_back(index);
+    }
+    run_ends_.push_back(start + length);
+  }
+
+  // Index the run for every indexed entry it covers
+  for (size_t k = (start + kIndexStride - 1) / kIndexStride;
+       k * kIndexStride < start + length;
+       ++k) {
+    index_.push_back(run_ends_.size() - 1);
+  }
+}
+
+size_t LabelColumn::findRun(size_t i) const {
+  // At most kIndexStride runs start between two indexed entries
+  size_t run = index_[i / kIndexStride];
+  while (run_ends_[run] <= i) {
+    run++;
+  }
+  return run;
+}
+
+uint32_t LabelColumn::operator[](size_t i) const { return runLabel(findRun(i)); }
+
+uint32_t LabelColumn::at(size_t i) const {
+  if (i >= size()) {
+    throw std::out_of_range("label column index " + std::to_string(i) +
+                            " out of range (size " + std::to_string(size()) + ")");
+  }
+  return (*this)[i];
+}
+
+void LabelColumn::clear() {
+  dictionary_.clear();
+  dictionary_lookup_.clear();
+  run_ends_.clear();
+  run_labels_.clear();
+  wide_ = false;
+  wide_run_labels_.clear();
+  index_.clear();
+}
+
+void LabelColumn::reserve(size_t num_runs) {
+  run_ends_.reserve(num_runs);
+  if (wide_) {
+    wide_run_labels_.reserve(num_runs);
+  } else {
+    run_labels_.reserve(num_runs);
+  }
+}
+
+std::vector<uint32_t> LabelColumn::toVector() const {
+  std::vector<uint32_t> labels;
+  labels.reserve(size());
+  size_t start = 0;
+  for (size_t r = 0; r < run_ends_.size(); ++r) {
+    labels.insert(labels.end(), run_ends_[r] - start, runLabel(r));
+    start = run_ends_[r];
+  }
+  return labels;
+}
+
+bool LabelColumn::encode(std::vector<RunLength>* run_lengths,
+                         std::vector<LabelIndex>* run_labels) const {
+  if (wide_) {
+    run_lengths->clear();
+    run_labels->clear();
+    return false;
+  }
+
+  encodeRuns(run_lengths, nullptr);
+  *run_labels = run_labels_;
+  return true;
+}
+
+void LabelColumn::encodeRuns(std::vector<RunLength>* run_lengths,
+                             std::vector<uint32_t>* run_labels) const {
+  run_lengths->resize(run_ends_.size());
+  size_t start = 0;
+  for (size_t r = 0; r < run_ends_.size(); ++r) {
+    (*run_lengths)[r] = run_ends_[r] - start;
+    start = run_ends_[r];
+  }
+
+  if (run_labels) {
+    run_labels->resize(run_ends_.size());
+    for (size_t r = 0; r < run_ends_.size(); ++r) {
+      (*run_labels)[r] = runLabel(r);
+    }
+  }
+}
+
+bool LabelColumn::decode(const std::vector<uint32_t>& dictionary,
+                         const std::vector<RunLength>& run_lengths,
+                         const std::vector<LabelIndex>& run_labels) {
+  clear();
+  if (run_lengths.size() != run_labels.size()) {
+    return false;
+  }
+
+  reserve(run_lengths.size());
+  for (size_t r = 0; r < run_lengths.size(); ++r) {
+    if (run_lengths[r] == 0 || run_labels[r] >= dictionary.size()) {
+      clear();
+      return false;
+    }
+    // Re-appending the runs keeps the dictionary and index consistent even if
+    // the sender did not merge equal consecutive runs
+    appendRun(dictionary[run_labels[r]], run_lengths[r]);
+  }
+  return true;
+}
+
+bool LabelColumn::decodeRuns(const std::vector<RunLength>& run_lengths,
+                             const std::vector<uint32_t>& run_labels) {
+  clear();
+  if (run_lengths.size() != run_labels.size()) {
+    return false;
+  }
+
+  reserve(run_lengths.size());
+  for (size_t r = 0; r < run_lengths.size(); ++r) {
+    if (run_lengths[r] == 0) {
+      clear();
+      return false;
+    }
+    appendRun(run_labels[r], run_lengths[r]);
+  }
+  return true;
+}
+
+size_t LabelColumn::memoryUsage() const {
+  return dictionary_.capacity() * sizeof(uint32_t) +
+         dictionary_lookup_.size() * (sizeof(uint32_t) + sizeof(LabelIndex)) +
+         run_ends_.capacity() * sizeof(uint32_t) +
+         run_labels_.capacity() * sizeof(LabelIndex) +
+         wide_run_labels_.capacity() * sizeof(uint32_t) +
+         index_.capacity() * sizeof(uint32_t);
+}
+
+bool LabelColumn::operator==(const LabelColumn& other) const {
+  // Runs are always maximal, so equal columns have the same runs (but may have
+  // their dictionaries in a different order)
+  if (run_ends_ != other.run_ends_) {
+    return false;
+  }
+  for (size_t r = 0; r < run_ends_.size(); ++r) {
+    if (runLabel(r) != other.runLabel(r)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,493 @@
+/**
+ * @file   MeshDecimation.cpp
+ * @brief  Quadric error edge collapse simplification of meshes
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/MeshDecimation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+namespace kimera_pgmo {
+
+using traits::Face;
+using traits::Pos;
+
+namespace {
+
+using Quadric = Eigen::Matrix4d;
+
+inline uint64_t edgeKey(size_t a, size_t b) {
+  return a < b ? (static_cast<uint64_t>(a) << 32) | b
+               : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+inline Eigen::Vector4d plane(const Eigen::Vector3d& normal, const Eigen::Vector3d& p) {
+  Eigen::Vector4d plane;
+  plane << normal, -normal.dot(p);
+  return plane;
+}
+
+inline double planeDistance(const Eigen::Vector4d& plane, const Pos& p) {
+  return std::abs(plane.dot(Eigen::Vector4d(p.x(), p.y(), p.z(), 1.0)));
+}
+
+inline double quadricError(const Quadric& q, const Pos& p) {
+  const Eigen::Vector4d v(p.x(), p.y(), p.z(), 1.0);
+  return v.dot(q * v);
+}
+
+inline Eigen::Vector3d faceNormal(const Pos& p0, const Pos& p1, const Pos& p2) {
+  return (p1 - p0).cross(p2 - p0).cast<double>();
+}
+
+inline bool hasVertex(const Face& face, size_t v) {
+  return face[0] == v || face[1] == v || face[2] == v;
+}
+
+struct Collapse {
+  double cost;
+  size_t removed;  // vertex removed by the collapse
+  size_t target;   // vertex kept
+  uint32_t removed_version;
+  uint32_t target_version;
+
+  bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+using CollapseQueue =
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>;
+
+// State shared by all tiles: every tile only modifies its own vertices and
+// faces
+struct DecimationState {
+  const std::vector<Pos>& positions;
+  std::vector<Face> faces;
+  std::vector<char> face_removed;
+  std::vector<Quadric> quadrics;
+  std::vector<char> locked;
+  std::vector<char> removed;
+  std::vector<size_t> collapsed_to;
+  std::vector<uint32_t> versions;
+  std::vector<std::vector<size_t>> vertex_faces;
+  // planes of the original faces and borders, and the planes (sorted indices)
+  // of the surface collapsed into every vertex: only tracked with an error bound
+  std::vector<Eigen::Vector4d> planes;
+  std::vector<std::vector<uint32_t>> vertex_planes;
+
+  explicit DecimationState(const std::vector<Pos>& vertices) : positions(vertices) {}
+};
+
+struct Tile {
+  std::vector<size_t> vertices;
+  size_t target_vertices = 0;
+};
+
+void collectNeighbors(const DecimationState& state,
+                      size_t v,
+                      std::vector<size_t>* neighbors) {
+  neighbors->clear();
+  for (size_t f : state.vertex_faces[v]) {
+    if (state.face_removed[f]) {
+      continue;
+    }
+    for (size_t w : state.faces[f]) {
+      if (w != v) {
+        neighbors->push_back(w);
+      }
+    }
+  }
+  std::sort(neighbors->begin(), neighbors->end());
+  neighbors->erase(std::unique(neighbors->begin(), neighbors->end()),
+                   neighbors->end());
+}
+
+// Queue both ways of collapsing an edge: when the cheapest one is rejected the
+// other one may still be allowed
+void queueCollapses(const DecimationState& state,
+                    size_t a,
+                    size_t b,
+                    CollapseQueue* queue) {
+  const Quadric q = state.quadrics[a] + state.quadrics[b];
+  if (!state.locked[a]) {
+    queue->push({quadricError(q, state.positions[b]),
+                 a,
+                 b,
+                 state.versions[a],
+                 state.versions[b]});
+  }
+  if (!state.locked[b]) {
+    queue->push({quadricError(q, state.positions[a]),
+                 b,
+                 a,
+                 state.versions[b],
+                 state.versions[a]});
+  }
+}
+
+// Largest distance of the kept vertex to the planes of the surface collapsed
+// into the two vertices of the edge (the quadric cost is the sum of the squared
+// distances, so it only bounds this one from above)
+double collapseDistance(const DecimationState& state, const Collapse& collapse) {
+  const Pos& p = state.positions[collapse.target];
+  double distance = 0.0;
+  for (size_t v : {collapse.removed, collapse.target}) {
+    for (uint32_t i : state.vertex_planes[v]) {
+      distance = std::max(distance, planeDistance(state.planes[i], p));
+    }
+  }
+  return distance;
+}
+
+// Collapses that would fold a face over or pinch the surface are rejected
+bool collapseAllowed(const DecimationState& state,
+                     const Collapse& collapse,
+                     std::vector<size_t>* removed_neighbors,
+                     std::vector<size_t>* target_neighbors) {
+  const size_t u = collapse.removed;
+  const size_t v = collapse.target;
+
+  size_t num_shared_faces = 0;
+  for (size_t f : state.vertex_faces[u]) {
+    if (state.face_removed[f]) {
+      continue;
+    }
+    const Face& face = state.faces[f];
+    if (hasVertex(face, v)) {
+      num_shared_faces++;
+      continue;
+    }
+    Pos moved[3];
+    for (size_t i = 0; i < 3; ++i) {
+      moved[i] = state.positions[face[i] == u ? v : face[i]];
+    }
+    const Eigen::Vector3d before = faceNormal(state.positions[face[0]],
+                                              state.positions[face[1]],
+                                              state.positions[face[2]]);
+    const Eigen::Vector3d after = faceNormal(moved[0], moved[1], moved[2]);
+    if (after.squaredNorm() == 0.0 || before.dot(after) < 0.0) {
+      return false;
+    }
+  }
+
+  // link condition: the only common neighbors are the opposite vertices of
+  // the faces of the edge
+  collectNeighbors(state, u, removed_neighbors);
+  collectNeighbors(state, v, target_neighbors);
+  size_t num_common = 0;
+  auto it_u = removed_neighbors->begin();
+  auto it_v = target_neighbors->begin();
+  while (it_u != removed_neighbors->end() && it_v != target_neighbors->end()) {
+    if (*it_u < *it_v) {
+      ++it_u;
+    } else if (*it_v < *it_u) {
+      ++it_v;
+    } else {
+      num_common++;
+      ++it_u;
+      ++it_v;
+    }
+  }
+  return num_common == num_shared_faces;
+}
+
+void decimateTile(const Tile& tile, double max_distance, DecimationState* state) {
+  const double max_cost = max_distance * max_distance;
+  CollapseQueue queue;
+  for (size_t a : tile.vertices) {
+    for (size_t f : state->vertex_faces[a]) {
+      for (size_t b : state->faces[f]) {
+        if (a < b) {
+          queueCollapses(*state, a, b, &queue);
+        }
+      }
+    }
+  }
+
+  size_t num_vertices = tile.vertices.size();
+  std::vector<size_t> removed_neighbors;
+  std::vector<size_t> target_neighbors;
+  while (!queue.empty() && num_vertices > tile.target_vertices) {
+    const Collapse collapse = queue.top();
+    queue.pop();
+    const size_t u = collapse.removed;
+    const size_t v = collapse.target;
+    if (state->removed[u] || state->removed[v] ||
+        collapse.removed_version != state->versions[u] ||
+        collapse.target_version != state->versions[v]) {
+      continue;
+    }
+    if (collapse.cost > max_cost && collapseDistance(*state, collapse) > max_distance) {
+      continue;
+    }
+    if (!collapseAllowed(*state, collapse, &removed_neighbors, &target_neighbors)) {
+      continue;
+    }
+
+    for (size_t f : state->vertex_faces[u]) {
+      if (state->face_removed[f]) {
+        continue;
+      }
+      Face& face = state->faces[f];
+      if (hasVertex(face, v)) {
+        state->face_removed[f] = true;
+        continue;
+      }
+      for (auto& w : face) {
+        if (w == u) {
+          w = v;
+        }
+      }
+      state->vertex_faces[v].push_back(f);
+    }
+    state->vertex_faces[u].clear();
+    auto& v_faces = state->vertex_faces[v];
+    v_faces.erase(std::remove_if(v_faces.begin(),
+                                 v_faces.end(),
+                                 [&](size_t f) { return state->face_removed[f]; }),
+                  v_faces.end());
+
+    state->quadrics[v] += state->quadrics[u];
+    if (!state->planes.empty()) {
+      auto& v_planes = state->vertex_planes[v];
+      auto& u_planes = state->vertex_planes[u];
+      const size_t num_v_planes = v_planes.size();
+      v_planes.insert(v_planes.end(), u_planes.begin(), u_planes.end());
+      std::inplace_merge(
+          v_planes.begin(), v_planes.begin() + num_v_planes, v_planes.end());
+      v_planes.erase(std::unique(v_planes.begin(), v_planes.end()), v_planes.end());
+      u_planes.clear();
+    }
+    state->removed[u] = true;
+    state->collapsed_to[u] = v;
+    state->versions[v]++;
+    num_vertices--;
+
+    // The edges of the kept vertex changed cost, and the collapses around it
+    // that were rejected may be allowed now: queue the edges of its ring again
+    collectNeighbors(*state, v, &target_neighbors);
+    for (size_t w : target_neighbors) {
+      state->versions[w]++;
+    }
+    for (size_t w : target_neighbors) {
+      collectNeighbors(*state, w, &removed_neighbors);
+      for (size_t x : removed_neighbors) {
+        queueCollapses(*state, w, x, &queue);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+DecimationResult decimateMesh(const std::vector<Pos>& vertices,
+                              const std::vector<Face>& faces,
+                              const MeshDecimationConfig& config) {
+  const size_t num_vertices = vertices.size();
+  DecimationState state(vertices);
+  state.faces.reserve(faces.size());
+  for (const auto& face : faces) {
+    if (face[0] >= num_vertices || face[1] >= num_vertices ||
+        face[2] >= num_vertices || face[0] == face[1] || face[1] == face[2] ||
+        face[0] == face[2]) {
+      continue;
+    }
+    state.faces.push_back(face);
+  }
+  const size_t num_faces = state.faces.size();
+  state.face_removed.assign(num_faces, false);
+  state.quadrics.assign(num_vertices, Quadric::Zero());
+  state.locked.assign(num_vertices, false);
+  state.removed.assign(num_vertices, false);
+  state.versions.assign(num_vertices, 0);
+  state.vertex_faces.resize(num_vertices);
+  state.collapsed_to.resize(num_vertices);
+  for (size_t i = 0; i < num_vertices; ++i) {
+    state.collapsed_to[i] = i;
+  }
+  const bool track_planes = config.max_error > 0.0;
+  if (track_planes) {
+    state.vertex_planes.resize(num_vertices);
+  }
+  auto add_plane = [&](const Eigen::Vector4d& p, size_t a, size_t b, size_t c) {
+    if (!track_planes) {
+      return;
+    }
+    const uint32_t index = state.planes.size();
+    state.planes.push_back(p);
+    for (size_t v : {a, b, c}) {
+      // planes are added in increasing order, so the lists stay sorted
+      auto& v_planes = state.vertex_planes[v];
+      if (v_planes.empty() || v_planes.back() != index) {
+        v_planes.push_back(index);
+      }
+    }
+  };
+
+  // Quadrics of the face planes, and of planes orthogonal to the faces along
+  // the open edges to keep the mesh borders in place
+  std::unordered_map<uint64_t, uint32_t> edge_counts;
+  edge_counts.reserve(3 * num_faces);
+  for (const auto& face : state.faces) {
+    for (size_t i = 0; i < 3; ++i) {
+      edge_counts[edgeKey(face[i], face[(i + 1) % 3])]++;
+    }
+  }
+  for (const auto& face : state.faces) {
+    const Eigen::Vector3d normal =
+        faceNormal(vertices[face[0]], vertices[face[1]], vertices[face[2]]);
+    const double norm = normal.norm();
+    if (norm < 1.0e-12) {
+      continue;
+    }
+    const Eigen::Vector4d face_plane =
+        plane(normal / norm, vertices[face[0]].cast<double>());
+    const Quadric q = face_plane * face_plane.transpose();
+    add_plane(face_plane, face[0], face[1], face[2]);
+    for (size_t i = 0; i < 3; ++i) {
+      state.quadrics[face[i]] += q;
+      const size_t a = face[i];
+      const size_t b = face[(i + 1) % 3];
+      if (edge_counts.at(edgeKey(a, b)) != 1) {
+        continue;
+      }
+      const Eigen::Vector3d edge = (vertices[b] - vertices[a]).cast<double>();
+      const Eigen::Vector3d border = edge.cross(normal);
+      if (border.norm() < 1.0e-12) {
+        continue;
+      }
+      const Eigen::Vector4d border_plane =
+          plane(border.normalized(), vertices[a].cast<double>());
+      const Quadric border_q = border_plane * border_plane.transpose();
+      state.quadrics[a] += border_q;
+      state.quadrics[b] += border_q;
+      add_plane(border_plane, a, b, b);
+    }
+  }
+
+  // Split the mesh into tiles: columns over the xy plane, so that the ground and
+  // walls of a room do not get cut along some height
+  const double tile_size = config.tile_size > 0.0 ? config.tile_size
+                                                  : std::numeric_limits<double>::max();
+  std::unordered_map<uint64_t, size_t> tile_lookup;
+  std::vector<Tile> tiles;
+  std::vector<size_t> vertex_tile(num_vertices, DecimationResult::INVALID);
+  auto tile_of = [&](size_t v) {
+    if (vertex_tile[v] != DecimationResult::INVALID) {
+      return vertex_tile[v];
+    }
+    const Pos& p = vertices[v];
+    const uint64_t key =
+        static_cast<uint64_t>(static_cast<int32_t>(std::floor(p.x() / tile_size)))
+            << 32 |
+        static_cast<uint32_t>(static_cast<int32_t>(std::floor(p.y() / tile_size)));
+    const auto inserted = tile_lookup.emplace(key, tiles.size());
+    if (inserted.second) {
+      tiles.emplace_back();
+    }
+    vertex_tile[v] = inserted.first->second;
+    tiles[vertex_tile[v]].vertices.push_back(v);
+    return vertex_tile[v];
+  };
+
+  size_t num_used = 0;
+  for (size_t f = 0; f < num_faces; ++f) {
+    const Face& face = state.faces[f];
+    const size_t tile = tile_of(face[0]);
+    if (tile_of(face[1]) != tile || tile_of(face[2]) != tile) {
+      for (size_t v : face) {
+        state.locked[v] = true;
+      }
+      continue;
+    }
+    for (size_t v : face) {
+      state.vertex_faces[v].push_back(f);
+    }
+  }
+  for (const auto& tile : tiles) {
+    num_used += tile.vertices.size();
+  }
+
+  // The budget is split between tiles by their number of vertices
+  const bool has_budget = config.max_vertices > 0 && config.max_vertices < num_used;
+  const double max_distance = config.max_error > 0.0
+                                  ? config.max_error
+                                  : std::numeric_limits<double>::infinity();
+  if (has_budget || config.max_error > 0.0) {
+    for (auto& tile : tiles) {
+      tile.target_vertices =
+          has_budget ? static_cast<size_t>(std::ceil(
+                           static_cast<double>(config.max_vertices) *
+                           tile.vertices.size() / num_used))
+                     : 0;
+    }
+
+    size_t num_threads = config.num_threads;
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::max<size_t>(1, std::min(num_threads, tiles.size()));
+    std::atomic<size_t> next_tile(0);
+    auto worker = [&]() {
+      for (size_t t = next_tile++; t < tiles.size(); t = next_tile++) {
+        decimateTile(tiles[t], max_distance, &state);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  // Assemble the decimated mesh from the remaining faces and the vertices
+  // they use
+  std::vector<char> used(num_vertices, false);
+  for (size_t f = 0; f < num_faces; ++f) {
+    if (!state.face_removed[f]) {
+      for (size_t v : state.faces[f]) {
+        used[v] = true;
+      }
+    }
+  }
+
+  DecimationResult result;
+  result.vertex_map.assign(num_vertices, DecimationResult::INVALID);
+  for (size_t v = 0; v < num_vertices; ++v) {
+    if (used[v]) {
+      result.vertex_map[v] = result.vertices.size();
+      result.vertices.push_back(v);
+    }
+  }
+  for (size_t v = 0; v < num_vertices; ++v) {
+    if (!state.removed[v]) {
+      continue;
+    }
+    size_t root = state.collapsed_to[v];
+    while (state.removed[root]) {
+      root = state.collapsed_to[root];
+    }
+    result.vertex_map[v] = result.vertex_map[root];
+  }
+
+  result.faces.reserve(num_faces);
+  for (size_t f = 0; f < num_faces; ++f) {
+    if (state.face_removed[f]) {
+      continue;
+    }
+    const Face& face = state.faces[f];
+    result.faces.push_back({result.vertex_map[face[0]],
+                            result.vertex_map[face[1]],
+                            result.vertex_map[face[2]]});
+  }
+  return result;
+}
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,232 @@
+/**
+ * @file   MeshDeltaTransport.cpp
+ * @brief  Incremental transport of the full mesh from the frontend to the
+ * backend as mesh deltas
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/MeshDeltaTransport.h"
+
+#include <ros/ros.h>
+
+#include <optional>
+#include <stdexcept>
+
+#include "kimera_pgmo/MeshDelta.h"
+#include "kimera_pgmo/utils/AllocationStats.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+inline bool samePoint(const pcl::PointXYZRGBA& lhs, const pcl::PointXYZRGBA& rhs) {
+  return lhs.x == rhs.x && lhs.y == rhs.y && lhs.z == rhs.z && lhs.r == rhs.r &&
+         lhs.g == rhs.g && lhs.b == rhs.b && lhs.a == rhs.a;
+}
+
+}  // namespace
+
+MeshDeltaEncoder::MeshDeltaEncoder(double resync_period)
+    : resync_period_ns_(resync_period > 0.0 ? stampFromSec(resync_period) : 0),
+      resync_requested_(true),
+      last_resync_ns_(0),
+      sequence_(0),
+      num_prev_vertices_(0),
+      prev_vertex_offset_(0),
+      num_prev_faces_(0),
+      prev_face_offset_(0) {}
+
+size_t MeshDeltaEncoder::firstChangedVertex(
+    const pcl::PointCloud<pcl::PointXYZRGBA>& vertices,
+    const std::vector<Timestamp>& stamps,
+    const std::vector<int>& graph_indices,
+    size_t graph_start) const {
+  // everything before the offset was fixed when the last delta was sent
+  const size_t end = std::min(num_prev_vertices_, vertices.size());
+  for (size_t i = prev_vertex_offset_; i < end; ++i) {
+    const size_t prev = i - prev_vertex_offset_;
+    if (!samePoint(vertices.at(i), prev_vertices_.at(prev)) ||
+        stamps.at(i) != prev_stamps_[prev] ||
+        graph_indices.at(i - graph_start) != prev_graph_indices_[prev]) {
+      return i;
+    }
+  }
+  return end;
+}
+
+size_t MeshDeltaEncoder::firstChangedFace(
+    const std::vector<pcl::Vertices>& faces) const {
+  const size_t end = std::min(num_prev_faces_, faces.size());
+  for (size_t i = prev_face_offset_; i < end; ++i) {
+    if (faces[i].vertices != prev_faces_[i - prev_face_offset_].vertices) {
+      return i;
+    }
+  }
+  return end;
+}
+
+KimeraPgmoMeshDelta MeshDeltaEncoder::encode(
+    const pcl::PointCloud<pcl::PointXYZRGBA>& vertices,
+    const std::vector<Timestamp>& stamps,
+    const std::vector<pcl::Vertices>& faces,
+    const IndexMapping& graph_mapping,
+    size_t num_fixed_vertices,
+    size_t num_fixed_faces,
+    size_t first_remapped_vertex,
+    Timestamp stamp_ns) {
+  const size_t num_vertices = vertices.size();
+  const size_t num_faces = faces.size();
+  const bool resync =
+      resync_requested_ ||
+      (resync_period_ns_ > 0 && stamp_ns >= last_resync_ns_ + resync_period_ns_);
+
+  // Graph indices are only looked up for the vertices that may be compared,
+  // sent or kept for the next delta
+  const size_t first_mutable_vertex = std::min(num_fixed_vertices, num_vertices);
+  size_t graph_start = 0;
+  if (!resync) {
+    graph_start = std::min(
+        {prev_vertex_offset_, first_remapped_vertex, first_mutable_vertex});
+  }
+  std::vector<int> graph_indices(num_vertices - graph_start, -1);
+  for (size_t i = graph_start; i < num_vertices; ++i) {
+    const auto match = graph_mapping.find(i);
+    if (match != graph_mapping.end()) {
+      graph_indices[i - graph_start] = match->second;
+    }
+  }
+
+  size_t vertex_start = 0;
+  size_t face_start = 0;
+  if (resync) {
+    resync_requested_ = false;
+    last_resync_ns_ = stamp_ns;
+  } else {
+    vertex_start =
+        std::min(firstChangedVertex(vertices, stamps, graph_indices, graph_start),
+                 first_remapped_vertex);
+    face_start = firstChangedFace(faces);
+  }
+
+  MeshDelta delta(vertex_start, face_start);
+  delta.vertex_updates->reserve(num_vertices - vertex_start);
+  delta.stamp_updates.reserve(num_vertices - vertex_start);
+  for (size_t i = vertex_start; i < num_vertices; ++i) {
+    delta.addVertex(stamps.at(i), vertices.at(i));
+  }
+  delta.face_updates.reserve(num_faces - face_start);
+  for (size_t i = face_start; i < num_faces; ++i) {
+    delta.addFace(Face(faces[i].vertices.at(0),
+                       faces[i].vertices.at(1),
+                       faces[i].vertices.at(2)));
+  }
+
+  KimeraPgmoMeshDelta msg = delta.toRosMsg(stamp_ns);
+  msg.vertex_graph_indices.assign(graph_indices.begin() + (vertex_start - graph_start),
+                                  graph_indices.end());
+  msg.sequence = sequence_++;
+
+  // Keep the part of the mesh that can still change for the next delta
+  num_prev_vertices_ = num_vertices;
+  prev_vertex_offset_ = first_mutable_vertex;
+  prev_vertices_.clear();
+  prev_vertices_.reserve(num_vertices - first_mutable_vertex);
+  for (size_t i = first_mutable_vertex; i < num_vertices; ++i) {
+    prev_vertices_.push_back(vertices.at(i));
+  }
+  prev_stamps_.assign(stamps.begin() + first_mutable_vertex, stamps.end());
+  prev_graph_indices_.assign(
+      graph_indices.begin() + (first_mutable_vertex - graph_start),
+      graph_indices.end());
+
+  num_prev_faces_ = num_faces;
+  prev_face_offset_ = std::min(num_fixed_faces, num_faces);
+  prev_faces_.assign(faces.begin() + prev_face_offset_, faces.end());
+  return msg;
+}
+
+MeshDeltaMirror::MeshDeltaMirror()
+    : synced_(false), last_sequence_(0), first_changed_vertex_(0) {}
+
+void MeshDeltaMirror::clear() {
+  synced_ = false;
+  last_sequence_ = 0;
+  first_changed_vertex_ = 0;
+  vertices_.clear();
+  stamps_.clear();
+  faces_.clear();
+  graph_indices_.clear();
+}
+
+MeshDeltaMirror::Status MeshDeltaMirror::update(const KimeraPgmoMeshDelta& msg) {
+  AllocationZone allocation_zone("MeshDeltaMirror::update");
+  const bool whole_mesh = msg.vertex_start == 0 && msg.face_start == 0;
+  if (synced_ && msg.sequence != last_sequence_ + 1) {
+    ROS_WARN_STREAM("MeshDeltaMirror: missed mesh delta(s) "
+                    << last_sequence_ + 1 << " to " << msg.sequence - 1
+                    << ", waiting for the next full mesh");
+    synced_ = false;
+  }
+  last_sequence_ = msg.sequence;
+
+  if (!synced_ && !whole_mesh) {
+    return Status::OUT_OF_SYNC;
+  }
+
+  if (msg.vertex_start > vertices_.size() || msg.face_start > faces_.size()) {
+    ROS_ERROR_STREAM("MeshDeltaMirror: delta starts past the mirrored mesh (vertex "
+                     << msg.vertex_start << " / " << vertices_.size() << ", face "
+                     << msg.face_start << " / " << faces_.size() << ")");
+    synced_ = false;
+    return Status::OUT_OF_SYNC;
+  }
+
+  std::optional<MeshDelta> decoded;
+  try {
+    decoded.emplace(msg);
+  } catch (const std::invalid_argument& e) {
+    ROS_ERROR_STREAM("MeshDeltaMirror: " << e.what() << ", dropping the delta");
+    synced_ = false;
+    return Status::OUT_OF_SYNC;
+  }
+
+  const MeshDelta& delta = *decoded;
+  const size_t start = msg.vertex_start;
+  const size_t num_updates = delta.vertex_updates->size();
+  if (delta.stamp_updates.size() != num_updates ||
+      (!msg.vertex_graph_indices.empty() &&
+       msg.vertex_graph_indices.size() != num_updates)) {
+    ROS_ERROR("MeshDeltaMirror: inconsistent mesh delta sizes, dropping it");
+    synced_ = false;
+    return Status::OUT_OF_SYNC;
+  }
+
+  // Deltas (and especially full meshes) repeat vertices that did not change,
+  // only the ones that did have to be deformed again
+  const size_t overlap = std::min(vertices_.size(), start + num_updates);
+  size_t first_changed = overlap;
+  for (size_t i = start; i < overlap; ++i) {
+    const size_t j = i - start;
+    const int graph_index =
+        msg.vertex_graph_indices.empty() ? -1 : msg.vertex_graph_indices[j];
+    if (!samePoint(vertices_.at(i), delta.vertex_updates->at(j)) ||
+        stamps_[i] != delta.stamp_updates[j] || graph_indices_[i] != graph_index) {
+      first_changed = i;
+      break;
+    }
+  }
+
+  delta.updateMesh(vertices_, stamps_, faces_);
+  graph_indices_.resize(start);
+  graph_indices_.insert(graph_indices_.end(),
+                        msg.vertex_graph_indices.begin(),
+                        msg.vertex_graph_indices.end());
+  graph_indices_.resize(vertices_.size(), -1);
+
+  first_changed_vertex_ = std::min(first_changed_vertex_, first_changed);
+
+  const Status status = synced_ ? Status::APPLIED : Status::RESYNCED;
+  synced_ = true;
+  return status;
+}
+
+}  // namespace kimera_pgmo
@@ -52,8 +52,21 @@ void IOData::save(const std::string& filename) const {
     output_file.getElement("vertex").addProperty<uint32_t>("nsecs", stamps_nsec);
   }
 
-  if (!labels.empty()) {
-    output_file.getElement("vertex").addProperty<uint32_t>("label", labels);
+  std::vector<LabelColumn::RunLength> run_lengths;
+  std::vector<LabelColumn::LabelIndex> run_labels;
+  if (labels.wide()) {
+    // too many distinct labels for the dictionary: one label per vertex
+    output_file.getElement("vertex").addProperty<uint32_t>("label", labels.toVector());
+  } else if (labels.encode(&run_lengths, &run_labels)) {
+    // Labels are spatially coherent: write runs of equal labels instead of one
+    // label per vertex
+    output_file.addElement("label_dictionary", labels.dictionary().size());
+    output_file.getElement("label_dictionary")
+        .addProperty<uint32_t>("label", labels.dictionary());
+    output_file.addElement("label_run", run_lengths.size());
+    output_file.getElement("label_run").addProperty<uint32_t>("length", run_lengths);
+    output_file.getElement("label_run").addProperty<uint16_t>("label_index",
+                                                              run_labels);
   }
 
   output_file.addElement("face", faces.size());
@@ -90,7 +103,19 @@ IOData::Ptr IOData::load(const std::string& filename) {
   }
 
   try {
-    to_return->labels = ply_in.getElement("vertex").getProperty<uint32_t>("label");
+    if (ply_in.hasElement("label_run")) {
+      const auto dictionary =
+          ply_in.getElement("label_dictionary").getProperty<uint32_t>("label");
+      const auto run_lengths =
+          ply_in.getElement("label_run").getProperty<uint32_t>("length");
+      const auto run_labels =
+          ply_in.getElement("label_run").getProperty<uint16_t>("label_index");
+      to_return->labels.decode(dictionary, run_lengths, run_labels);
+    } else {
+      // files written with one label per vertex
+      to_return->labels =
+          ply_in.getElement("vertex").getProperty<uint32_t>("label");
+    }
   } catch (...) {
   }
 
@@ -0,0 +1,584 @@
+/**
+ * @file   MeshSpatialIndex.cpp
+ * @brief  Voxel bucket index over the faces of a mesh for spatial queries
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/MeshSpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace kimera_pgmo {
+
+using traits::Face;
+using traits::Pos;
+
+namespace {
+
+const size_t kInvalidIndex = std::numeric_limits<size_t>::max();
+
+// Offsets of the x, y and z fields of the vertices of a mesh cloud (false if
+// one is missing or not a float)
+bool findPositionOffsets(const pcl::PCLPointCloud2& cloud, uint32_t offsets[3]) {
+  const char* names[3] = {"x", "y", "z"};
+  for (int i = 0; i < 3; ++i) {
+    const auto field =
+        std::find_if(cloud.fields.begin(), cloud.fields.end(), [&](const auto& f) {
+          return f.name == names[i];
+        });
+    if (field == cloud.fields.end() || field->datatype != pcl::PCLPointField::FLOAT32) {
+      return false;
+    }
+    offsets[i] = field->offset;
+  }
+  return true;
+}
+
+Pos readPosition(const pcl::PCLPointCloud2& cloud,
+                 const uint32_t offsets[3],
+                 size_t index) {
+  const uint8_t* point = cloud.data.data() + index * cloud.point_step;
+  Pos position;
+  for (int i = 0; i < 3; ++i) {
+    std::memcpy(&position[i], point + offsets[i], sizeof(float));
+  }
+  return position;
+}
+
+// Triangles of a mesh polygon (non-triangles are kept as unindexed faces so
+// that face indices still match the polygons)
+Face toFace(const pcl::Vertices& polygon) {
+  if (polygon.vertices.size() != 3) {
+    return {kInvalidIndex, kInvalidIndex, kInvalidIndex};
+  }
+  return {polygon.vertices[0], polygon.vertices[1], polygon.vertices[2]};
+}
+
+// Closest point to p on triangle abc (Ericson, Real-Time Collision Detection)
+Pos closestPointOnTriangle(const Pos& p, const Pos& a, const Pos& b, const Pos& c) {
+  const Pos ab = b - a;
+  const Pos ac = c - a;
+  const Pos ap = p - a;
+  const float d1 = ab.dot(ap);
+  const float d2 = ac.dot(ap);
+  if (d1 <= 0.0f && d2 <= 0.0f) {
+    return a;
+  }
+
+  const Pos bp = p - b;
+  const float d3 = ab.dot(bp);
+  const float d4 = ac.dot(bp);
+  if (d3 >= 0.0f && d4 <= d3) {
+    return b;
+  }
+
+  const float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    return a + d1 / (d1 - d3) * ab;
+  }
+
+  const Pos cp = p - c;
+  const float d5 = ab.dot(cp);
+  const float d6 = ac.dot(cp);
+  if (d6 >= 0.0f && d5 <= d6) {
+    return c;
+  }
+
+  const float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    return a + d2 / (d2 - d6) * ac;
+  }
+
+  const float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+    return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+  }
+
+  const float sum = va + vb + vc;
+  if (sum == 0.0f) {
+    return a;  // degenerate triangle
+  }
+
+  return a + ab * (vb / sum) + ac * (vc / sum);
+}
+
+// Distance along the ray to triangle abc (Moller-Trumbore), negative if missed
+float intersectTriangle(const Pos& origin,
+                        const Pos& direction,
+                        const Pos& a,
+                        const Pos& b,
+                        const Pos& c) {
+  constexpr float eps = 1.0e-9f;
+  const Pos ab = b - a;
+  const Pos ac = c - a;
+  const Pos p = direction.cross(ac);
+  const float det = ab.dot(p);
+  if (std::abs(det) < eps) {
+    return -1.0f;
+  }
+
+  const float inv_det = 1.0f / det;
+  const Pos s = origin - a;
+  const float u = s.dot(p) * inv_det;
+  if (u < 0.0f || u > 1.0f) {
+    return -1.0f;
+  }
+
+  const Pos q = s.cross(ab);
+  const float v = direction.dot(q) * inv_det;
+  if (v < 0.0f || u + v > 1.0f) {
+    return -1.0f;
+  }
+
+  return ac.dot(q) * inv_det;
+}
+
+}  // namespace
+
+MeshSpatialIndex::MeshSpatialIndex(double resolution) : resolution_(resolution) {}
+
+void MeshSpatialIndex::clear() {
+  vertices_.clear();
+  faces_.clear();
+  face_ranges_.clear();
+  buckets_.clear();
+}
+
+Eigen::Vector3i MeshSpatialIndex::voxelIndex(const Pos& point) const {
+  // clamped to the range of the bucket keys so that the cast is defined (callers
+  // reject non-finite points)
+  constexpr double max_index = (1 << 20) - 1;
+  Eigen::Vector3i index;
+  for (int i = 0; i < 3; ++i) {
+    const double coordinate = std::floor(point[i] / resolution_);
+    index[i] = static_cast<int>(std::max(-max_index, std::min(max_index, coordinate)));
+  }
+  return index;
+}
+
+MeshSpatialIndex::BucketKey MeshSpatialIndex::bucketKey(const Eigen::Vector3i& index) {
+  // 21 bits per axis, offset so that negative indices stay distinct
+  constexpr int64_t offset = 1 << 20;
+  constexpr int64_t mask = (1 << 21) - 1;
+  return (((index.x() + offset) & mask) << 42) | (((index.y() + offset) & mask) << 21) |
+         ((index.z() + offset) & mask);
+}
+
+MeshSpatialIndex::VoxelRange MeshSpatialIndex::faceRange(const Face& face) const {
+  VoxelRange range;
+  for (const size_t v : face) {
+    if (v >= vertices_.size()) {
+      // empty range: face is not indexed
+      range.min.setConstant(1);
+      range.max.setConstant(0);
+      return range;
+    }
+  }
+
+  const Pos& a = vertices_[face[0]];
+  const Pos& b = vertices_[face[1]];
+  const Pos& c = vertices_[face[2]];
+  if (!a.allFinite() || !b.allFinite() || !c.allFinite()) {
+    range.min.setConstant(1);
+    range.max.setConstant(0);
+    return range;
+  }
+
+  range.min = voxelIndex(a.cwiseMin(b).cwiseMin(c));
+  range.max = voxelIndex(a.cwiseMax(b).cwiseMax(c));
+  if (((range.max - range.min).array() >= kMaxFaceVoxels).any()) {
+    // degenerate face (e.g. to a placeholder vertex) would fill many buckets
+    range.min.setConstant(1);
+    range.max.setConstant(0);
+  }
+  return range;
+}
+
+bool MeshSpatialIndex::updateFace(size_t f, bool existed) {
+  const VoxelRange range = faceRange(faces_[f]);
+  if (existed) {
+    if (range == face_ranges_[f]) {
+      return false;  // moved within the same buckets (or not at all)
+    }
+
+    removeFace(f, face_ranges_[f]);
+  }
+
+  insertFace(f, range);
+  face_ranges_[f] = range;
+  return true;
+}
+
+void MeshSpatialIndex::insertFace(size_t face, const VoxelRange& range) {
+  Eigen::Vector3i index;
+  for (index.x() = range.min.x(); index.x() <= range.max.x(); ++index.x()) {
+    for (index.y() = range.min.y(); index.y() <= range.max.y(); ++index.y()) {
+      for (index.z() = range.min.z(); index.z() <= range.max.z(); ++index.z()) {
+        buckets_[bucketKey(index)].push_back(face);
+      }
+    }
+  }
+}
+
+void MeshSpatialIndex::removeFace(size_t face, const VoxelRange& range) {
+  Eigen::Vector3i index;
+  for (index.x() = range.min.x(); index.x() <= range.max.x(); ++index.x()) {
+    for (index.y() = range.min.y(); index.y() <= range.max.y(); ++index.y()) {
+      for (index.z() = range.min.z(); index.z() <= range.max.z(); ++index.z()) {
+        auto bucket = buckets_.find(bucketKey(index));
+        if (bucket == buckets_.end()) {
+          continue;
+        }
+
+        auto& bucket_faces = bucket->second;
+        auto iter = std::find(bucket_faces.begin(), bucket_faces.end(), face);
+        if (iter != bucket_faces.end()) {
+          *iter = bucket_faces.back();
+          bucket_faces.pop_back();
+        }
+
+        if (bucket_faces.empty()) {
+          buckets_.erase(bucket);
+        }
+      }
+    }
+  }
+}
+
+size_t MeshSpatialIndex::update(const pcl::PolygonMesh& mesh) {
+  uint32_t offsets[3];
+  const size_t num_vertices = mesh.cloud.width * mesh.cloud.height;
+  std::vector<Pos> vertices;
+  if (findPositionOffsets(mesh.cloud, offsets)) {
+    vertices.reserve(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v) {
+      vertices.push_back(readPosition(mesh.cloud, offsets, v));
+    }
+  }
+
+  std::vector<Face> faces;
+  faces.reserve(mesh.polygons.size());
+  for (const auto& polygon : mesh.polygons) {
+    faces.push_back(toFace(polygon));
+  }
+
+  return update(vertices, faces);
+}
+
+size_t MeshSpatialIndex::update(const pcl::PolygonMesh& mesh,
+                                const std::vector<size_t>& moved,
+                                size_t start) {
+  uint32_t offsets[3];
+  const size_t num_vertices = mesh.cloud.width * mesh.cloud.height;
+  if (!findPositionOffsets(mesh.cloud, offsets)) {
+    return update(mesh);
+  }
+
+  // vertices that were not in the previous version are new
+  start = std::min(start, vertices_.size());
+  vertices_.resize(num_vertices);
+  std::vector<bool> changed(num_vertices, false);
+  for (const size_t v : moved) {
+    if (v < num_vertices) {
+      vertices_[v] = readPosition(mesh.cloud, offsets, v);
+      changed[v] = true;
+    }
+  }
+  for (size_t v = start; v < num_vertices; ++v) {
+    vertices_[v] = readPosition(mesh.cloud, offsets, v);
+    changed[v] = true;
+  }
+
+  // faces that no longer exist are removed with their previous range
+  const size_t num_faces = mesh.polygons.size();
+  for (size_t f = num_faces; f < faces_.size(); ++f) {
+    removeFace(f, face_ranges_[f]);
+  }
+
+  const size_t num_previous = std::min(faces_.size(), num_faces);
+  faces_.resize(num_faces);
+  face_ranges_.resize(num_faces);
+
+  size_t num_updated = 0;
+  for (size_t f = 0; f < num_faces; ++f) {
+    const Face face = toFace(mesh.polygons[f]);
+    const bool existed = f < num_previous;
+    if (existed && face == faces_[f]) {
+      const bool moved_face = std::any_of(face.begin(), face.end(), [&](size_t v) {
+        return v < num_vertices && changed[v];
+      });
+      if (!moved_face) {
+        continue;
+      }
+    }
+
+    faces_[f] = face;
+    if (updateFace(f, existed)) {
+      ++num_updated;
+    }
+  }
+
+  return num_updated;
+}
+
+size_t MeshSpatialIndex::update(const std::vector<Pos>& vertices,
+                                const std::vector<Face>& faces) {
+  // faces that no longer exist are removed with their previous range
+  for (size_t f = faces.size(); f < faces_.size(); ++f) {
+    removeFace(f, face_ranges_[f]);
+  }
+
+  vertices_ = vertices;
+  faces_ = faces;
+
+  const size_t num_previous = std::min(face_ranges_.size(), faces_.size());
+  face_ranges_.resize(faces_.size());
+
+  size_t num_updated = 0;
+  for (size_t f = 0; f < faces_.size(); ++f) {
+    if (updateFace(f, f < num_previous)) {
+      ++num_updated;
+    }
+  }
+
+  return num_updated;
+}
+
+std::vector<size_t> MeshSpatialIndex::facesInBox(const Pos& min, const Pos& max) const {
+  std::vector<size_t> candidates;
+  if (!min.allFinite() || !max.allFinite()) {
+    return candidates;
+  }
+
+  const Eigen::Vector3i range_min = voxelIndex(min);
+  const Eigen::Vector3i range_max = voxelIndex(max);
+  const Eigen::Vector3d extent = (range_max - range_min).cast<double>().array() + 1.0;
+  if ((extent.array() <= 0.0).any()) {
+    return candidates;
+  }
+
+  if (extent.prod() <= static_cast<double>(buckets_.size())) {
+    Eigen::Vector3i index;
+    for (index.x() = range_min.x(); index.x() <= range_max.x(); ++index.x()) {
+      for (index.y() = range_min.y(); index.y() <= range_max.y(); ++index.y()) {
+        for (index.z() = range_min.z(); index.z() <= range_max.z(); ++index.z()) {
+          const auto bucket = buckets_.find(bucketKey(index));
+          if (bucket != buckets_.end()) {
+            candidates.insert(
+                candidates.end(), bucket->second.begin(), bucket->second.end());
+          }
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+  } else {
+    // box covers more voxels than there are buckets: check every face
+    for (size_t f = 0; f < faces_.size(); ++f) {
+      if ((face_ranges_[f].min.array() <= face_ranges_[f].max.array()).all()) {
+        candidates.push_back(f);
+      }
+    }
+  }
+
+  std::vector<size_t> result;
+  for (const size_t f : candidates) {
+    const Pos& a = vertices_[faces_[f][0]];
+    const Pos& b = vertices_[faces_[f][1]];
+    const Pos& c = vertices_[faces_[f][2]];
+    const Pos face_min = a.cwiseMin(b).cwiseMin(c);
+    const Pos face_max = a.cwiseMax(b).cwiseMax(c);
+    if ((face_min.array() <= max.array()).all() &&
+        (face_max.array() >= min.array()).all()) {
+      result.push_back(f);
+    }
+  }
+
+  return result;
+}
+
+void MeshSpatialIndex::searchBucket(const Eigen::Vector3i& index,
+                                    const Pos& query,
+                                    SurfacePoint* best) const {
+  const auto bucket = buckets_.find(bucketKey(index));
+  if (bucket == buckets_.end()) {
+    return;
+  }
+
+  for (const uint32_t f : bucket->second) {
+    const Face& face = faces_[f];
+    const Pos point = closestPointOnTriangle(
+        query, vertices_[face[0]], vertices_[face[1]], vertices_[face[2]]);
+    const float distance = (point - query).norm();
+    if (distance < best->distance) {
+      best->point = point;
+      best->face = f;
+      best->distance = distance;
+    }
+  }
+}
+
+bool MeshSpatialIndex::closestPoint(const Pos& query,
+                                    double max_distance,
+                                    SurfacePoint* result) const {
+  if (buckets_.empty() || max_distance < 0.0 || !query.allFinite()) {
+    return false;
+  }
+
+  SurfacePoint best;
+  best.distance = std::numeric_limits<float>::infinity();
+
+  const Eigen::Vector3i center = voxelIndex(query);
+  const int max_ring = static_cast<int>(std::ceil(max_distance / resolution_));
+  for (int r = 0; r <= max_ring; ++r) {
+    // every voxel of ring r is at least (r - 1) voxels away from the query
+    if (best.distance <= (r - 1) * resolution_) {
+      break;
+    }
+
+    Eigen::Vector3i offset;
+    for (offset.x() = -r; offset.x() <= r; ++offset.x()) {
+      for (offset.y() = -r; offset.y() <= r; ++offset.y()) {
+        const bool on_shell = std::abs(offset.x()) == r || std::abs(offset.y()) == r;
+        // inner voxels of the ring only on the two z faces
+        const int z_step = on_shell ? 1 : std::max(2 * r, 1);
+        for (offset.z() = -r; offset.z() <= r; offset.z() += z_step) {
+          searchBucket(center + offset, query, &best);
+        }
+      }
+    }
+  }
+
+  if (best.distance > max_distance) {
+    return false;
+  }
+
+  *result = best;
+  return true;
+}
+
+bool MeshSpatialIndex::raycast(const Pos& origin,
+                               const Pos& direction,
+                               double max_range,
+                               RayHit* hit) const {
+  const float norm = direction.norm();
+  if (buckets_.empty() || norm == 0.0f || !origin.allFinite() ||
+      !std::isfinite(norm)) {
+    return false;
+  }
+
+  const Pos dir = direction / norm;
+  const float inf = std::numeric_limits<float>::infinity();
+
+  // Voxel traversal (Amanatides & Woo)
+  Eigen::Vector3i index = voxelIndex(origin);
+  Eigen::Vector3i step;
+  Eigen::Vector3f t_max;
+  Eigen::Vector3f t_delta;
+  for (int i = 0; i < 3; ++i) {
+    if (dir[i] > 0.0f) {
+      step[i] = 1;
+      t_max[i] = ((index[i] + 1) * resolution_ - origin[i]) / dir[i];
+      t_delta[i] = resolution_ / dir[i];
+    } else if (dir[i] < 0.0f) {
+      step[i] = -1;
+      t_max[i] = (index[i] * resolution_ - origin[i]) / dir[i];
+      t_delta[i] = -resolution_ / dir[i];
+    } else {
+      step[i] = 0;
+      t_max[i] = inf;
+      t_delta[i] = inf;
+    }
+  }
+
+  float best_range = inf;
+  size_t best_face = 0;
+  float t_enter = 0.0f;
+  while (t_enter <= max_range) {
+    const auto bucket = buckets_.find(bucketKey(index));
+    if (bucket != buckets_.end()) {
+      for (const uint32_t f : bucket->second) {
+        const Face& face = faces_[f];
+        const float t = intersectTriangle(
+            origin, dir, vertices_[face[0]], vertices_[face[1]], vertices_[face[2]]);
+        if (t >= 0.0f && t <= max_range && t < best_range) {
+          best_range = t;
+          best_face = f;
+        }
+      }
+    }
+
+    int axis;
+    const float t_exit = t_max.minCoeff(&axis);
+    if (best_range <= t_exit || t_exit == inf) {
+      break;  // nothing further along the ray can be closer
+    }
+
+    index[axis] += step[axis];
+    t_enter = t_exit;
+    t_max[axis] += t_delta[axis];
+  }
+
+  if (best_range == inf) {
+    return false;
+  }
+
+  hit->point = origin + best_range * dir;
+  hit->face = best_face;
+  hit->range = best_range;
+  return true;
+}
+
+pcl::PolygonMesh extractSubmesh(const pcl::PolygonMesh& mesh,
+                                const std::vector<size_t>& faces) {
+  pcl::PolygonMesh submesh;
+  submesh.header = mesh.header;
+
+  const auto& cloud = mesh.cloud;
+  auto& sub_cloud = submesh.cloud;
+  sub_cloud.header = cloud.header;
+  sub_cloud.fields = cloud.fields;
+  sub_cloud.is_bigendian = cloud.is_bigendian;
+  sub_cloud.is_dense = cloud.is_dense;
+  sub_cloud.point_step = cloud.point_step;
+  sub_cloud.height = 1;
+
+  // copy the raw point records so that all fields (color, etc.) are kept
+  const size_t num_points = cloud.width * cloud.height;
+  std::unordered_map<uint32_t, uint32_t> reindex;
+  for (const size_t f : faces) {
+    if (f >= mesh.polygons.size()) {
+      continue;
+    }
+
+    const auto& polygon = mesh.polygons[f];
+    const bool valid = std::all_of(polygon.vertices.begin(),
+                                   polygon.vertices.end(),
+                                   [&](uint32_t v) { return v < num_points; });
+    if (!valid) {
+      continue;
+    }
+
+    pcl::Vertices sub_polygon;
+    for (const uint32_t v : polygon.vertices) {
+      auto iter = reindex.find(v);
+      if (iter == reindex.end()) {
+        iter = reindex.emplace(v, reindex.size()).first;
+        const auto start =
+            cloud.data.begin() + static_cast<size_t>(v) * cloud.point_step;
+        sub_cloud.data.insert(sub_cloud.data.end(), start, start + cloud.point_step);
+      }
+      sub_polygon.vertices.push_back(iter->second);
+    }
+    submesh.polygons.push_back(sub_polygon);
+  }
+
+  sub_cloud.width = reindex.size();
+  sub_cloud.row_step = sub_cloud.width * sub_cloud.point_step;
+  return submesh;
+}
+
+}  // namespace kimera_pgmo
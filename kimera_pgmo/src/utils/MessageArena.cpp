@@ -0,0 +1,70 @@
+/**
+ * @file   MessageArena.cpp
+ * @brief  Monotonic arena for temporaries that only live for one message
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/MessageArena.h"
+
+namespace kimera_pgmo {
+
+MessageArena::MessageArena(size_t initial_capacity,
+                           size_t capacity_cap,
+                           size_t quiet_messages)
+    : capacity_cap_(capacity_cap),
+      quiet_messages_(quiet_messages),
+      num_quiet_(0),
+      buffer_(initial_capacity) {
+  overflow_.upstream = std::pmr::new_delete_resource();
+  monotonic_.emplace(buffer_.data(), buffer_.size(), &overflow_);
+  used_.upstream = &*monotonic_;
+}
+
+void MessageArena::reset() {
+  last_stats_.capacity = buffer_.size();
+  last_stats_.used_bytes = used_.bytes;
+  last_stats_.overflow_bytes = overflow_.bytes;
+  last_stats_.overflow_allocations = overflow_.allocations;
+
+  // return the overflow chunks before the buffer may move
+  monotonic_.reset();
+  if (overflow_.bytes > 0) {
+    buffer_.resize(buffer_.size() + overflow_.bytes);
+  }
+
+  // release a buffer grown by a burst once the messages fit in the cap again
+  if (buffer_.size() > capacity_cap_ && quiet_messages_ > 0) {
+    num_quiet_ = used_.bytes <= capacity_cap_ ? num_quiet_ + 1 : 0;
+    if (num_quiet_ >= quiet_messages_) {
+      std::vector<std::byte>(capacity_cap_).swap(buffer_);
+      num_quiet_ = 0;
+    }
+  } else {
+    num_quiet_ = 0;
+  }
+
+  overflow_.bytes = 0;
+  overflow_.allocations = 0;
+  used_.bytes = 0;
+  used_.allocations = 0;
+  monotonic_.emplace(buffer_.data(), buffer_.size(), &overflow_);
+  used_.upstream = &*monotonic_;
+}
+
+void* MessageArena::CountingResource::do_allocate(size_t bytes, size_t alignment) {
+  this->bytes += bytes;
+  ++allocations;
+  return upstream->allocate(bytes, alignment);
+}
+
+void MessageArena::CountingResource::do_deallocate(void* p,
+                                                   size_t bytes,
+                                                   size_t alignment) {
+  upstream->deallocate(p, bytes, alignment);
+}
+
+bool MessageArena::CountingResource::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,238 @@
+/**
+ * @file   PerfCounters.cpp
+ * @brief  Optional per-thread hardware performance counters (perf_event_open)
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/PerfCounters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace kimera_pgmo {
+
+bool PerfCounts::valid() const {
+  for (const auto has_event : has) {
+    if (has_event) {
+      return true;
+    }
+  }
+  return false;
+}
+
+PerfCounts PerfCounts::operator-(const PerfCounts& other) const {
+  PerfCounts diff;
+  for (size_t i = 0; i < NUM; ++i) {
+    diff.has[i] = has[i] && other.has[i];
+    diff.values[i] = diff.has[i] ? values[i] - other.values[i] : 0;
+  }
+  return diff;
+}
+
+PerfCounts& PerfCounts::operator+=(const PerfCounts& other) {
+  for (size_t i = 0; i < NUM; ++i) {
+    if (other.has[i]) {
+      has[i] = true;
+      values[i] += other.values[i];
+    }
+  }
+  return *this;
+}
+
+const char* perfEventName(PerfCounts::Event event) {
+  switch (event) {
+    case PerfCounts::CYCLES:
+      return "cycles";
+    case PerfCounts::INSTRUCTIONS:
+      return "instructions";
+    case PerfCounts::L1D_MISSES:
+      return "l1d_misses";
+    case PerfCounts::LLC_MISSES:
+      return "llc_misses";
+    case PerfCounts::BRANCH_MISSES:
+      return "branch_misses";
+    default:
+      return "unknown";
+  }
+}
+
+void writePerfCountsJson(std::ostream& out, const PerfCounts& counts) {
+  if (!counts.valid()) {
+    out << "null";
+    return;
+  }
+  out << "{";
+  bool first = true;
+  for (size_t i = 0; i < PerfCounts::NUM; ++i) {
+    if (!counts.has[i]) {
+      continue;
+    }
+    out << (first ? "" : ", ") << "\""
+        << perfEventName(static_cast<PerfCounts::Event>(i))
+        << "\": " << counts.values[i];
+    first = false;
+  }
+  const auto cycles = counts.values[PerfCounts::CYCLES];
+  if (counts.has[PerfCounts::CYCLES] && counts.has[PerfCounts::INSTRUCTIONS] &&
+      cycles > 0) {
+    out << ", \"ipc\": "
+        << static_cast<double>(counts.values[PerfCounts::INSTRUCTIONS]) / cycles;
+  }
+  out << "}";
+}
+
+#ifdef __linux__
+namespace {
+
+struct EventConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+EventConfig eventConfig(PerfCounts::Event event) {
+  switch (event) {
+    case PerfCounts::CYCLES:
+      return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+    case PerfCounts::INSTRUCTIONS:
+      return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS};
+    case PerfCounts::L1D_MISSES:
+      return {PERF_TYPE_HW_CACHE,
+              PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+    case PerfCounts::LLC_MISSES:
+      return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+    case PerfCounts::BRANCH_MISSES:
+    default:
+      return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+  }
+}
+
+int openEvent(PerfCounts::Event event, int group_fd) {
+  const auto config = eventConfig(event);
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING | PERF_FORMAT_ID;
+  // Calling thread on any cpu. Threads it spawns are not counted: inherit is
+  // not allowed together with PERF_FORMAT_GROUP reads
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+}  // namespace
+
+PerfCounters::PerfCounters() {
+  fds_.fill(-1);
+  ids_.fill(0);
+  leader_fd_ = openEvent(PerfCounts::CYCLES, -1);
+  if (leader_fd_ < 0) {
+    error_ = std::string("perf_event_open failed: ") + std::strerror(errno);
+    return;
+  }
+
+  fds_[PerfCounts::CYCLES] = leader_fd_;
+  for (size_t i = PerfCounts::CYCLES + 1; i < PerfCounts::NUM; ++i) {
+    // Unsupported events (e.g. no LLC event in a VM) are just left out
+    fds_[i] = openEvent(static_cast<PerfCounts::Event>(i), leader_fd_);
+  }
+
+  for (size_t i = 0; i < PerfCounts::NUM; ++i) {
+    if (fds_[i] >= 0 && ioctl(fds_[i], PERF_EVENT_IOC_ID, &ids_[i]) < 0) {
+      ids_[i] = 0;  // not reported, but the leader fd has to stay open
+    }
+  }
+
+  ioctl(leader_fd_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(leader_fd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters() {
+  for (const auto fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+PerfCounts PerfCounters::read() const {
+  PerfCounts counts;
+  if (leader_fd_ < 0) {
+    return counts;
+  }
+
+  // Layout: nr, time_enabled, time_running, then {value, id} per event
+  std::vector<uint64_t> buffer(3 + 2 * PerfCounts::NUM);
+  const auto bytes =
+      ::read(leader_fd_, buffer.data(), buffer.size() * sizeof(uint64_t));
+  if (bytes < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+    return counts;
+  }
+
+  const uint64_t num_events = buffer[0];
+  const uint64_t time_enabled = buffer[1];
+  const uint64_t time_running = buffer[2];
+  if (time_running == 0) {
+    // The group was never scheduled on a counter
+    return counts;
+  }
+  const double scale = static_cast<double>(time_enabled) / time_running;
+
+  for (uint64_t e = 0; e < num_events && e < PerfCounts::NUM; ++e) {
+    const uint64_t value = buffer[3 + 2 * e];
+    const uint64_t id = buffer[4 + 2 * e];
+    for (size_t i = 0; i < PerfCounts::NUM; ++i) {
+      if (fds_[i] >= 0 && ids_[i] != 0 && ids_[i] == id) {
+        counts.has[i] = true;
+        counts.values[i] = static_cast<uint64_t>(value * scale);
+      }
+    }
+  }
+  return counts;
+}
+#else
+PerfCounters::PerfCounters() : error_("perf_event_open is only available on Linux") {
+  fds_.fill(-1);
+  ids_.fill(0);
+}
+
+PerfCounters::~PerfCounters() = default;
+
+PerfCounts PerfCounters::read() const { return PerfCounts(); }
+#endif
+
+ScopedZone::ScopedZone(const PerfCounters* counters,
+                       ZoneStats* stats,
+                       const char* name)
+    : counters_(counters), stats_(stats) {
+  if (name) {
+    allocation_zone_.emplace(name);
+  }
+  start_allocations_ = threadAllocationCount();
+  if (counters_) {
+    start_counts_ = counters_->read();
+  }
+  start_ = std::chrono::steady_clock::now();
+}
+
+ScopedZone::~ScopedZone() {
+  const auto end = std::chrono::steady_clock::now();
+  if (counters_) {
+    stats_->counters += counters_->read() - start_counts_;
+  }
+  stats_->allocations += threadAllocationCount() - start_allocations_;
+  stats_->wall_ms += std::chrono::duration<double, std::milli>(end - start_).count();
+  ++stats_->count;
+}
+
+}  // namespace kimera_pgmo
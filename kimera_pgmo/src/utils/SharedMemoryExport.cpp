@@ -0,0 +1,161 @@
+/**
+ * @file   SharedMemoryExport.cpp
+ * @brief  Export of the optimized trajectory and mesh to shared memory
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/SharedMemoryExport.h"
+
+#include <gtsam/inference/Symbol.h>
+#include <pcl/common/io.h>
+#include <ros/console.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "kimera_pgmo/DeformationGraph.h"
+#include "kimera_pgmo/utils/CommonFunctions.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+using ArraySizes = std::array<size_t, kSharedSegmentArrays>;
+
+}  // namespace
+
+SharedMemoryExport::SharedMemoryExport(const std::string& prefix)
+    : trajectory_(prefix + "_trajectory"), mesh_(prefix + "_mesh") {
+  if (!ok()) {
+    ROS_ERROR_STREAM("SharedMemoryExport: failed to create shared memory segments "
+                     << prefix << "_trajectory and " << prefix << "_mesh");
+  }
+}
+
+bool SharedMemoryExport::writeTrajectory(const std::vector<gtsam::Pose3>& path,
+                                         const std::vector<Timestamp>& stamps,
+                                         size_t robot_id) {
+  const char prefix = GetRobotPrefix(robot_id);
+  const Timestamp stamp = stamps.empty() ? 0 : stamps.back();
+  ArraySizes counts{};
+  ArraySizes element_bytes{};
+  counts[SHARED_POSES] = path.size();
+  element_bytes[SHARED_POSES] = sizeof(SharedPose);
+
+  std::unique_lock<std::mutex> lock(trajectory_mutex_);
+  return trajectory_.write(
+      stamp, counts, element_bytes, [&](const auto& arrays, bool) {
+        auto* poses = reinterpret_cast<SharedPose*>(arrays[SHARED_POSES]);
+        for (size_t i = 0; i < path.size(); ++i) {
+          const gtsam::Pose3& pose = path[i];
+          const gtsam::Quaternion quaternion = pose.rotation().toQuaternion();
+          poses[i] = {i < stamps.size() ? stamps[i] : 0,
+                      gtsam::Symbol(prefix, i).key(),
+                      pose.x(),
+                      pose.y(),
+                      pose.z(),
+                      quaternion.w(),
+                      quaternion.x(),
+                      quaternion.y(),
+                      quaternion.z()};
+        }
+      });
+}
+
+bool SharedMemoryExport::writeMesh(const pcl::PolygonMesh& mesh,
+                                   const std::vector<Timestamp>& stamps,
+                                   uint64_t version,
+                                   const DeformedVertices* deformed) {
+  // Read the vertices straight from the serialized cloud
+  const pcl::PCLPointCloud2& cloud = mesh.cloud;
+  const size_t num_vertices = cloud.width * cloud.height;
+  const int x_idx = pcl::getFieldIndex(cloud, "x");
+  const int y_idx = pcl::getFieldIndex(cloud, "y");
+  const int z_idx = pcl::getFieldIndex(cloud, "z");
+  int color_idx = pcl::getFieldIndex(cloud, "rgba");
+  const bool has_alpha = color_idx >= 0;
+  if (!has_alpha) {
+    color_idx = pcl::getFieldIndex(cloud, "rgb");
+  }
+  if (x_idx < 0 || y_idx < 0 || z_idx < 0) {
+    return false;
+  }
+
+  size_t num_triangles = 0;
+  for (const auto& polygon : mesh.polygons) {
+    num_triangles += polygon.vertices.size() == 3 ? 1 : 0;
+  }
+
+  ArraySizes counts{};
+  ArraySizes element_bytes{};
+  counts[SHARED_VERTICES] = num_vertices;
+  element_bytes[SHARED_VERTICES] = sizeof(SharedVertex);
+  counts[SHARED_TRIANGLES] = num_triangles;
+  element_bytes[SHARED_TRIANGLES] = sizeof(SharedTriangle);
+  counts[SHARED_VERTEX_STAMPS] = stamps.size() == num_vertices ? num_vertices : 0;
+  element_bytes[SHARED_VERTEX_STAMPS] = sizeof(Timestamp);
+  const Timestamp stamp =
+      stamps.empty() ? 0 : *std::max_element(stamps.begin(), stamps.end());
+
+  const auto read_vertex = [&](size_t i) {
+    const uint8_t* point = &cloud.data[i * cloud.point_step];
+    SharedVertex vertex;
+    std::memcpy(&vertex.x, point + cloud.fields[x_idx].offset, sizeof(float));
+    std::memcpy(&vertex.y, point + cloud.fields[y_idx].offset, sizeof(float));
+    std::memcpy(&vertex.z, point + cloud.fields[z_idx].offset, sizeof(float));
+    uint8_t bgra[4] = {0, 0, 0, 255};
+    if (color_idx >= 0) {
+      std::memcpy(bgra, point + cloud.fields[color_idx].offset, has_alpha ? 4 : 3);
+    }
+    vertex.r = bgra[2];
+    vertex.g = bgra[1];
+    vertex.b = bgra[0];
+    vertex.a = bgra[3];
+    return vertex;
+  };
+
+  std::unique_lock<std::mutex> lock(mesh_mutex_);
+  if (has_mesh_ && version <= last_mesh_version_) {
+    return true;  // a newer mesh was already exported
+  }
+
+  // the deformation only describes the changes since the previous one
+  const bool follows_export = has_mesh_ && version == last_mesh_version_ + 1 &&
+                              deformed && last_deformation_ > 0 &&
+                              deformed->sequence == last_deformation_ + 1;
+  const bool written = mesh_.write(
+      stamp, counts, element_bytes, [&](const auto& arrays, bool previous_contents) {
+        auto* vertices = reinterpret_cast<SharedVertex*>(arrays[SHARED_VERTICES]);
+        if (previous_contents && follows_export && !deformed->full &&
+            deformed->num_vertices == num_vertices) {
+          // the other vertices did not move since the last export
+          for (const size_t i : deformed->indices()) {
+            vertices[i] = read_vertex(i);
+          }
+        } else {
+          for (size_t i = 0; i < num_vertices; ++i) {
+            vertices[i] = read_vertex(i);
+          }
+        }
+
+        auto* triangles = reinterpret_cast<SharedTriangle*>(arrays[SHARED_TRIANGLES]);
+        for (const auto& polygon : mesh.polygons) {
+          if (polygon.vertices.size() == 3) {
+            *triangles++ = {
+                {polygon.vertices[0], polygon.vertices[1], polygon.vertices[2]}};
+          }
+        }
+
+        if (counts[SHARED_VERTEX_STAMPS] > 0) {
+          std::memcpy(arrays[SHARED_VERTEX_STAMPS],
+                      stamps.data(),
+                      stamps.size() * sizeof(Timestamp));
+        }
+      });
+
+  has_mesh_ = written;
+  last_mesh_version_ = version;
+  last_deformation_ = deformed ? deformed->sequence : 0;
+  return written;
+}
+
+}  // namespace kimera_pgmo
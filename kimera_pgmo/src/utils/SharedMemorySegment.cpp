@@ -0,0 +1,273 @@
+/**
+ * @file   SharedMemorySegment.cpp
+ * @brief  Seqlock-protected POSIX shared memory segments to hand the optimized
+ * trajectory and mesh to processes on the same host without serialization
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/SharedMemorySegment.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+namespace kimera_pgmo {
+
+namespace {
+
+constexpr size_t kAlignment = 64;
+
+size_t alignUp(size_t bytes) {
+  return (bytes + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// Tell the readers of a segment left behind by a previous writer to reopen
+void retireSegment(const std::string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == 0 &&
+      static_cast<size_t>(info.st_size) >= sizeof(SharedSegmentHeader)) {
+    void* data = mmap(nullptr,
+                      sizeof(SharedSegmentHeader),
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED,
+                      fd,
+                      0);
+    if (data != MAP_FAILED) {
+      auto* header = static_cast<SharedSegmentHeader*>(data);
+      if (header->magic.load(std::memory_order_acquire) ==
+          SharedSegmentHeader::kMagic) {
+        header->stale.store(1, std::memory_order_release);
+      }
+      munmap(data, sizeof(SharedSegmentHeader));
+    }
+  }
+  ::close(fd);
+  shm_unlink(name.c_str());
+}
+
+}  // namespace
+
+SharedSegmentWriter::SharedSegmentWriter(const std::string& name, size_t initial_bytes)
+    : name_(name) {
+  retireSegment(name_);
+  fd_ = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd_ < 0) {
+    return;
+  }
+  if (!map(std::max(initial_bytes, alignUp(sizeof(SharedSegmentHeader))))) {
+    ::close(fd_);
+    fd_ = -1;
+    shm_unlink(name_.c_str());
+    return;
+  }
+
+  // fresh segments are zero-filled, which is a valid (empty) state
+  auto* header = new (header_) SharedSegmentHeader();
+  header->layout_version = SharedSegmentHeader::kLayoutVersion;
+  header->segment_bytes.store(mapped_bytes_, std::memory_order_relaxed);
+  for (size_t i = 0; i < kSharedSegmentArrays; ++i) {
+    header->offsets[i].store(alignUp(sizeof(SharedSegmentHeader)),
+                             std::memory_order_relaxed);
+  }
+  // readers only use the segment once the magic is set
+  header->magic.store(SharedSegmentHeader::kMagic, std::memory_order_release);
+}
+
+SharedSegmentWriter::~SharedSegmentWriter() {
+  if (header_) {
+    header_->stale.store(1, std::memory_order_release);
+    munmap(header_, mapped_bytes_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    shm_unlink(name_.c_str());
+  }
+}
+
+bool SharedSegmentWriter::map(size_t bytes) {
+  // growing keeps the contents, so the previous version stays readable
+  if (ftruncate(fd_, bytes) != 0) {
+    return false;
+  }
+  void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  if (header_) {
+    munmap(header_, mapped_bytes_);
+  }
+  header_ = static_cast<SharedSegmentHeader*>(data);
+  mapped_bytes_ = bytes;
+  return true;
+}
+
+bool SharedSegmentWriter::write(
+    uint64_t stamp_ns,
+    const std::array<size_t, kSharedSegmentArrays>& counts,
+    const std::array<size_t, kSharedSegmentArrays>& element_bytes,
+    const Fill& fill) {
+  if (!header_) {
+    return false;
+  }
+
+  std::array<size_t, kSharedSegmentArrays> offsets;
+  size_t end = alignUp(sizeof(SharedSegmentHeader));
+  for (size_t i = 0; i < kSharedSegmentArrays; ++i) {
+    offsets[i] = end;
+    end = alignUp(end + counts[i] * element_bytes[i]);
+  }
+  if (end > mapped_bytes_ && !map(std::max(end, 2 * mapped_bytes_))) {
+    return false;
+  }
+
+  // the offsets only depend on the counts, so equal counts mean the arrays
+  // still hold the previous version
+  bool previous_contents = has_contents_ && counts == last_counts_;
+  std::array<uint8_t*, kSharedSegmentArrays> arrays;
+  for (size_t i = 0; i < kSharedSegmentArrays; ++i) {
+    arrays[i] = reinterpret_cast<uint8_t*>(header_) + offsets[i];
+    previous_contents = previous_contents &&
+                        header_->element_bytes[i].load(std::memory_order_relaxed) ==
+                            element_bytes[i];
+  }
+
+  const uint64_t sequence = header_->sequence.load(std::memory_order_relaxed);
+  header_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  header_->segment_bytes.store(mapped_bytes_, std::memory_order_relaxed);
+  header_->stamp_ns.store(stamp_ns, std::memory_order_relaxed);
+  for (size_t i = 0; i < kSharedSegmentArrays; ++i) {
+    header_->counts[i].store(counts[i], std::memory_order_relaxed);
+    header_->element_bytes[i].store(element_bytes[i], std::memory_order_relaxed);
+    header_->offsets[i].store(offsets[i], std::memory_order_relaxed);
+  }
+  fill(arrays, previous_contents);
+  header_->version.fetch_add(1, std::memory_order_relaxed);
+
+  header_->sequence.store(sequence + 2, std::memory_order_release);
+  last_counts_ = counts;
+  has_contents_ = true;
+  return true;
+}
+
+SharedSegmentReader::SharedSegmentReader(const std::string& name) : name_(name) {}
+
+SharedSegmentReader::~SharedSegmentReader() { close(); }
+
+void SharedSegmentReader::close() {
+  if (header_) {
+    munmap(const_cast<SharedSegmentHeader*>(header_), mapped_bytes_);
+    header_ = nullptr;
+    mapped_bytes_ = 0;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool SharedSegmentReader::map(size_t bytes) {
+  void* data = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  if (header_) {
+    munmap(const_cast<SharedSegmentHeader*>(header_), mapped_bytes_);
+  }
+  header_ = static_cast<const SharedSegmentHeader*>(data);
+  mapped_bytes_ = bytes;
+  return true;
+}
+
+bool SharedSegmentReader::open() {
+  if (header_ && !header_->stale.load(std::memory_order_acquire)) {
+    return true;
+  }
+  close();
+
+  fd_ = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd_ < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd_, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(SharedSegmentHeader) ||
+      !map(info.st_size)) {
+    close();
+    return false;
+  }
+  // the writer may still be initializing the header
+  if (header_->magic.load(std::memory_order_acquire) != SharedSegmentHeader::kMagic ||
+      header_->layout_version != SharedSegmentHeader::kLayoutVersion) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool SharedSegmentReader::snapshot(Snapshot* snapshot, size_t max_attempts) {
+  for (size_t attempt = 0; attempt < max_attempts; ++attempt) {
+    if (!open()) {
+      return false;
+    }
+
+    const uint64_t sequence = header_->sequence.load(std::memory_order_acquire);
+    if (sequence % 2 == 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    snapshot->sequence = sequence;
+    snapshot->version = header_->version.load(std::memory_order_relaxed);
+    snapshot->stamp_ns = header_->stamp_ns.load(std::memory_order_relaxed);
+    std::array<size_t, kSharedSegmentArrays> offsets;
+    size_t end = 0;
+    for (size_t i = 0; i < kSharedSegmentArrays; ++i) {
+      snapshot->counts[i] = header_->counts[i].load(std::memory_order_relaxed);
+      snapshot->element_bytes[i] =
+          header_->element_bytes[i].load(std::memory_order_relaxed);
+      offsets[i] = header_->offsets[i].load(std::memory_order_relaxed);
+      end = std::max<size_t>(
+          end, offsets[i] + snapshot->counts[i] * snapshot->element_bytes[i]);
+    }
+    if (!valid(*snapshot)) {
+      continue;
+    }
+
+    if (end > mapped_bytes_) {
+      // the writer grew the segment since it was mapped
+      struct stat info;
+      if (fstat(fd_, &info) != 0 || static_cast<size_t>(info.st_size) < end ||
+          !map(info.st_size)) {
+        close();
+      }
+      continue;
+    }
+
+    const auto* base = reinterpret_cast<const uint8_t*>(header_);
+    for (size_t i = 0; i < kSharedSegmentArrays; ++i) {
+      snapshot->arrays[i] = base + offsets[i];
+    }
+    return true;
+  }
+  return false;
+}
+
+bool SharedSegmentReader::valid(const Snapshot& snapshot) const {
+  if (!header_) {
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return header_->sequence.load(std::memory_order_relaxed) == snapshot.sequence;
+}
+
+}  // namespace kimera_pgmo
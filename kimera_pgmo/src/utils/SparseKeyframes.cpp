@@ -0,0 +1,390 @@
+/**
+ * @file   SparseKeyframes.cpp
+ * @brief  Flat storage of the sparse keyframes of the pose graphs
+ * @author Yun Chang
+ */
+#include "kimera_pgmo/utils/SparseKeyframes.h"
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace kimera_pgmo {
+
+namespace {
+
+constexpr size_t kPoseSize = 7;
+
+// Poses are written as translation and quaternion (x, y, z, qw, qx, qy, qz)
+void appendPose(const gtsam::Pose3& pose, std::vector<double>* values) {
+  const gtsam::Point3& pos = pose.translation();
+  const gtsam::Quaternion& quat = pose.rotation().toQuaternion();
+  values->insert(values->end(),
+                 {pos.x(), pos.y(), pos.z(), quat.w(), quat.x(), quat.y(), quat.z()});
+}
+
+gtsam::Pose3 poseFromValues(const double* values) {
+  return gtsam::Pose3(gtsam::Rot3(values[3], values[4], values[5], values[6]),
+                      gtsam::Point3(values[0], values[1], values[2]));
+}
+
+inline std::array<gtsam::Key, 2> loopClosureKeys(gtsam::Key from, gtsam::Key to) {
+  return from < to ? std::array<gtsam::Key, 2>{from, to}
+                   : std::array<gtsam::Key, 2>{to, from};
+}
+
+}  // namespace
+
+const SparseKeyframes::RobotKeyframes* SparseKeyframes::findRobot(char prefix) const {
+  const auto iter = robots_.find(prefix);
+  return iter == robots_.end() ? nullptr : &iter->second;
+}
+
+const SparseKeyframes::Keyframe* SparseKeyframes::findKeyframe(
+    gtsam::Key sparse_key) const {
+  const gtsam::Symbol sparse_symb(sparse_key);
+  const RobotKeyframes* robot = findRobot(sparse_symb.chr());
+  if (robot == nullptr || sparse_symb.index() >= robot->keyframes.size()) {
+    return nullptr;
+  }
+  const Keyframe& keyframe = robot->keyframes[sparse_symb.index()];
+  return keyframe.valid() ? &keyframe : nullptr;
+}
+
+SparseKeyframes::Keyframe* SparseKeyframes::findKeyframe(gtsam::Key sparse_key) {
+  return const_cast<Keyframe*>(
+      static_cast<const SparseKeyframes*>(this)->findKeyframe(sparse_key));
+}
+
+SparseKeyframes::Keyframe& SparseKeyframes::getOrCreateKeyframe(
+    gtsam::Key sparse_key) {
+  const gtsam::Symbol sparse_symb(sparse_key);
+  auto& keyframes = robots_[sparse_symb.chr()].keyframes;
+  if (sparse_symb.index() >= keyframes.size()) {
+    keyframes.resize(sparse_symb.index() + 1);
+  }
+  Keyframe& keyframe = keyframes[sparse_symb.index()];
+  if (!keyframe.valid()) {
+    num_keyframes_++;
+  }
+  return keyframe;
+}
+
+void SparseKeyframes::setPose(gtsam::Key full_key,
+                              gtsam::Key sparse_key,
+                              const gtsam::Pose3& transform) {
+  const gtsam::Symbol full_symb(full_key);
+  const size_t index = full_symb.index();
+  RobotKeyframes& robot = robots_[full_symb.chr()];
+  if (index >= robot.pose_keyframes.size()) {
+    robot.pose_keyframes.resize(index + 1, kNoKeyframe);
+    robot.transforms.resize(index + 1);
+  }
+  robot.pose_keyframes[index] = gtsam::Symbol(sparse_key).index();
+  robot.transforms[index] = transform;
+
+  Keyframe& keyframe = robot.keyframes[robot.pose_keyframes[index]];
+  if (keyframe.valid()) {
+    keyframe.begin = std::min(keyframe.begin, index);
+    keyframe.end = std::max(keyframe.end, index + 1);
+  } else {
+    keyframe.begin = index;
+    keyframe.end = index + 1;
+  }
+  num_poses_++;
+}
+
+bool SparseKeyframes::addKeyframe(gtsam::Key sparse_key, gtsam::Key full_key) {
+  if (hasKeyframe(sparse_key) || hasPose(full_key)) {
+    return false;
+  }
+  return insert(full_key, sparse_key, gtsam::Pose3());
+}
+
+bool SparseKeyframes::addOdometry(gtsam::Key sparse_key,
+                                  gtsam::Key to_key,
+                                  const gtsam::Pose3& measure,
+                                  double trans_threshold,
+                                  double rot_threshold) {
+  Keyframe* keyframe = findKeyframe(sparse_key);
+  if (keyframe == nullptr) {
+    ROS_ERROR("Cannot add edge to unknown sparse key-frame.");
+    return false;
+  }
+  if (!keyframe->active) {
+    ROS_ERROR("Cannot add edge to inactive sparse key-frame.");
+    return false;
+  }
+
+  const gtsam::Symbol sparse_symb(sparse_key);
+  const gtsam::Symbol to_symb(to_key);
+  if (to_symb.chr() != sparse_symb.chr() || to_symb.index() != keyframe->end) {
+    ROS_ERROR("Attempting to insert non-consecutive nodes to sparse key-frame");
+    return false;
+  }
+
+  keyframe->current_transform = keyframe->current_transform.compose(measure);
+  const double dist_total = keyframe->current_transform.translation().norm();
+  const double rot_total = keyframe->current_transform.rotation().xyz().norm();
+  if (dist_total > trans_threshold || rot_total > rot_threshold) {
+    keyframe->active = false;
+    return false;
+  }
+  return true;
+}
+
+bool SparseKeyframes::absorbPose(gtsam::Key sparse_key, gtsam::Key full_key) {
+  const Keyframe* keyframe = findKeyframe(sparse_key);
+  if (keyframe == nullptr) {
+    return false;
+  }
+  const gtsam::Pose3 transform = keyframe->current_transform;
+  return insert(full_key, sparse_key, transform);
+}
+
+bool SparseKeyframes::insert(gtsam::Key full_key,
+                             gtsam::Key sparse_key,
+                             const gtsam::Pose3& transform) {
+  const gtsam::Symbol full_symb(full_key);
+  const gtsam::Symbol sparse_symb(sparse_key);
+  if (full_symb.chr() != sparse_symb.chr() || sparse_symb.index() >= kNoKeyframe) {
+    ROS_ERROR_STREAM("Invalid sparse key-frame "
+                     << gtsam::DefaultKeyFormatter(sparse_key) << " for pose "
+                     << gtsam::DefaultKeyFormatter(full_key));
+    return false;
+  }
+  if (hasPose(full_key)) {
+    return false;
+  }
+
+  getOrCreateKeyframe(sparse_key);
+  setPose(full_key, sparse_key, transform);
+  return true;
+}
+
+void SparseKeyframes::merge(const SparseKeyframes& other) {
+  for (const auto& other_robot : other.robots_) {
+    const char prefix = other_robot.first;
+    const RobotKeyframes& poses = other_robot.second;
+    for (size_t i = 0; i < poses.pose_keyframes.size(); ++i) {
+      if (poses.pose_keyframes[i] == kNoKeyframe) {
+        continue;
+      }
+      const gtsam::Key sparse_key = gtsam::Symbol(prefix, poses.pose_keyframes[i]);
+      const bool new_keyframe = !hasKeyframe(sparse_key);
+      if (!insert(gtsam::Symbol(prefix, i), sparse_key, poses.transforms[i]) ||
+          !new_keyframe) {
+        continue;
+      }
+      // Keyframes that were not known take the state they were saved with
+      const Keyframe& other_keyframe = poses.keyframes[poses.pose_keyframes[i]];
+      Keyframe* keyframe = findKeyframe(sparse_key);
+      keyframe->active = other_keyframe.active;
+      keyframe->current_transform = other_keyframe.current_transform;
+    }
+  }
+
+  std::vector<std::array<gtsam::Key, 2>> loop_closures;
+  loop_closures.reserve(loop_closures_.size() + other.loop_closures_.size());
+  std::set_union(loop_closures_.begin(),
+                 loop_closures_.end(),
+                 other.loop_closures_.begin(),
+                 other.loop_closures_.end(),
+                 std::back_inserter(loop_closures));
+  loop_closures_ = std::move(loop_closures);
+}
+
+bool SparseKeyframes::hasPose(gtsam::Key full_key) const {
+  const gtsam::Symbol full_symb(full_key);
+  const RobotKeyframes* robot = findRobot(full_symb.chr());
+  return robot != nullptr && full_symb.index() < robot->pose_keyframes.size() &&
+         robot->pose_keyframes[full_symb.index()] != kNoKeyframe;
+}
+
+bool SparseKeyframes::hasKeyframe(gtsam::Key sparse_key) const {
+  return findKeyframe(sparse_key) != nullptr;
+}
+
+gtsam::Key SparseKeyframes::getKeyframe(gtsam::Key full_key) const {
+  if (!hasPose(full_key)) {
+    throw std::out_of_range("unknown pose " + gtsam::DefaultKeyFormatter(full_key) +
+                            " in sparse key-frames");
+  }
+  const gtsam::Symbol full_symb(full_key);
+  return gtsam::Symbol(
+      full_symb.chr(),
+      robots_.at(full_symb.chr()).pose_keyframes[full_symb.index()]);
+}
+
+const gtsam::Pose3& SparseKeyframes::getTransform(gtsam::Key full_key) const {
+  if (!hasPose(full_key)) {
+    throw std::out_of_range("unknown pose " + gtsam::DefaultKeyFormatter(full_key) +
+                            " in sparse key-frames");
+  }
+  const gtsam::Symbol full_symb(full_key);
+  return robots_.at(full_symb.chr()).transforms[full_symb.index()];
+}
+
+const gtsam::Pose3& SparseKeyframes::getCurrentTransform(gtsam::Key sparse_key) const {
+  const Keyframe* keyframe = findKeyframe(sparse_key);
+  if (keyframe == nullptr) {
+    throw std::out_of_range("unknown sparse keyframe " +
+                            gtsam::DefaultKeyFormatter(sparse_key));
+  }
+  return keyframe->current_transform;
+}
+
+bool SparseKeyframes::isActive(gtsam::Key sparse_key) const {
+  const Keyframe* keyframe = findKeyframe(sparse_key);
+  return keyframe != nullptr && keyframe->active;
+}
+
+void SparseKeyframes::deactivate(gtsam::Key sparse_key) {
+  Keyframe* keyframe = findKeyframe(sparse_key);
+  if (keyframe != nullptr) {
+    keyframe->active = false;
+  }
+}
+
+bool SparseKeyframes::addLoopClosure(gtsam::Key from_sparse_key,
+                                     gtsam::Key to_sparse_key) {
+  const auto keys = loopClosureKeys(from_sparse_key, to_sparse_key);
+  const auto iter =
+      std::lower_bound(loop_closures_.begin(), loop_closures_.end(), keys);
+  if (iter != loop_closures_.end() && *iter == keys) {
+    return false;
+  }
+  loop_closures_.insert(iter, keys);
+  return true;
+}
+
+bool SparseKeyframes::hasLoopClosure(gtsam::Key from_sparse_key,
+                                     gtsam::Key to_sparse_key) const {
+  return std::binary_search(loop_closures_.begin(),
+                            loop_closures_.end(),
+                            loopClosureKeys(from_sparse_key, to_sparse_key));
+}
+
+void SparseKeyframes::clear() {
+  robots_.clear();
+  loop_closures_.clear();
+  num_poses_ = 0;
+  num_keyframes_ = 0;
+}
+
+size_t SparseKeyframes::memoryUsage() const {
+  size_t num_bytes = loop_closures_.capacity() * sizeof(std::array<gtsam::Key, 2>);
+  for (const auto& robot : robots_) {
+    num_bytes += robot.second.pose_keyframes.capacity() * sizeof(uint32_t) +
+                 robot.second.transforms.capacity() * sizeof(gtsam::Pose3) +
+                 robot.second.keyframes.capacity() * sizeof(Keyframe);
+  }
+  return num_bytes;
+}
+
+void SparseKeyframes::save(BinaryWriter& writer) const {
+  writer.write<uint64_t>(robots_.size());
+  for (const auto& robot : robots_) {
+    const RobotKeyframes& poses = robot.second;
+    writer.write<uint8_t>(robot.first);
+    writer.writeVector(poses.pose_keyframes);
+
+    std::vector<double> transforms;
+    transforms.reserve(poses.transforms.size() * kPoseSize);
+    for (const auto& transform : poses.transforms) {
+      appendPose(transform, &transforms);
+    }
+    writer.writeVector(transforms);
+
+    std::vector<uint64_t> ranges;
+    std::vector<uint8_t> active;
+    std::vector<double> current_transforms;
+    ranges.reserve(2 * poses.keyframes.size());
+    active.reserve(poses.keyframes.size());
+    current_transforms.reserve(poses.keyframes.size() * kPoseSize);
+    for (const auto& keyframe : poses.keyframes) {
+      ranges.push_back(keyframe.begin);
+      ranges.push_back(keyframe.end);
+      active.push_back(keyframe.active ? 1 : 0);
+      appendPose(keyframe.current_transform, &current_transforms);
+    }
+    writer.writeVector(ranges);
+    writer.writeVector(active);
+    writer.writeVector(current_transforms);
+  }
+  writer.writeVector(loop_closures_);
+}
+
+bool SparseKeyframes::load(BinaryReader& reader) {
+  clear();
+  uint64_t num_robots = 0;
+  if (!reader.read(num_robots)) {
+    return false;
+  }
+
+  for (uint64_t r = 0; r < num_robots; ++r) {
+    uint8_t prefix = 0;
+    std::vector<uint32_t> pose_keyframes;
+    std::vector<double> transforms;
+    std::vector<uint64_t> ranges;
+    std::vector<uint8_t> active;
+    std::vector<double> current_transforms;
+    reader.read(prefix);
+    reader.readVector(pose_keyframes);
+    reader.readVector(transforms);
+    reader.readVector(ranges);
+    reader.readVector(active);
+    reader.readVector(current_transforms);
+
+    const size_t num_keyframes = active.size();
+    if (!reader.ok() || robots_.count(prefix) ||
+        transforms.size() != pose_keyframes.size() * kPoseSize ||
+        ranges.size() != 2 * num_keyframes ||
+        current_transforms.size() != num_keyframes * kPoseSize) {
+      clear();
+      return false;
+    }
+
+    RobotKeyframes& robot = robots_[prefix];
+    robot.keyframes.resize(num_keyframes);
+    for (size_t k = 0; k < num_keyframes; ++k) {
+      Keyframe& keyframe = robot.keyframes[k];
+      keyframe.begin = ranges[2 * k];
+      keyframe.end = ranges[2 * k + 1];
+      keyframe.active = active[k] != 0;
+      keyframe.current_transform = poseFromValues(&current_transforms[k * kPoseSize]);
+      if (keyframe.begin > keyframe.end || keyframe.end > pose_keyframes.size()) {
+        clear();
+        return false;
+      }
+      num_keyframes_ += keyframe.valid() ? 1 : 0;
+    }
+
+    robot.transforms.reserve(pose_keyframes.size());
+    for (size_t i = 0; i < pose_keyframes.size(); ++i) {
+      robot.transforms.push_back(poseFromValues(&transforms[i * kPoseSize]));
+      const uint32_t k = pose_keyframes[i];
+      if (k == kNoKeyframe) {
+        continue;
+      }
+      // every pose lies in the range of its keyframe
+      if (k >= num_keyframes || i < robot.keyframes[k].begin ||
+          i >= robot.keyframes[k].end) {
+        clear();
+        return false;
+      }
+      num_poses_++;
+    }
+    robot.pose_keyframes = std::move(pose_keyframes);
+  }
+
+  if (!reader.readVector(loop_closures_) ||
+      !std::is_sorted(loop_closures_.begin(), loop_closures_.end())) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace kimera_pgmo
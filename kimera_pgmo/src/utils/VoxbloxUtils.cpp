@@ -16,6 +16,7 @@
 #include <algorithm>
 #include <chrono>
 #include <limits>
+#include <thread>
 
 #include "kimera_pgmo/utils/CommonFunctions.h"
 
@@ -69,6 +70,17 @@ pcl::PolygonMesh UpdateMeshFromVoxbloxMeshBlock(
   pcl::PointCloud<pcl::PointXYZRGBA> new_vertices;
   std::vector<size_t> updated_indices_partial;
 
+  // Positions of the vertices last seen in the block and of the vertices of the
+  // partial mesh (as the index in updated_indices_partial)
+  VertexPositionMap original_positions;
+  original_positions.reserve(original_indices.size());
+  for (size_t j : original_indices) {
+    original_positions.emplace(MakeVertexPositionKey(vertices->points[j]), j);
+  }
+  VertexPositionMap new_positions;
+  new_positions.reserve(mesh_block.x.size());
+  const size_t updated_offset = updated_indices->size();
+
   // Extract mesh block
   size_t vertex_index = vertices->points.size();
   size_t vertex_index_new = 0;
@@ -77,32 +89,26 @@ pcl::PolygonMesh UpdateMeshFromVoxbloxMeshBlock(
   pcl::Vertices triangle_new;  // triangle with indices for partial mesh
   for (size_t i = 0; i < mesh_block.x.size(); ++i) {
     pcl::PointXYZRGBA point = ExtractPoint(mesh_block, block_edge_length, i);
+    const VertexPositionKey key = MakeVertexPositionKey(point);
     // Search if vertex inserted
     size_t vidx;
     size_t vidx_new;  // idx for the partial mesh
     bool point_exists = false;
     bool point_exists_in_new = false;  // does point exist in the partial mesh
-    for (size_t j : original_indices) {
-      if (point.x == vertices->points[j].x && point.y == vertices->points[j].y &&
-          point.z == vertices->points[j].z) {
-        vidx = j;
-        point_exists = true;
-        break;
-      }
+    const auto original = original_positions.find(key);
+    if (original != original_positions.end()) {
+      vidx = original->second;
+      point_exists = true;
     }
 
     // Also check the new vertices
-    for (size_t j = 0; j < updated_indices->size(); j++) {
-      size_t k = updated_indices->at(j);
-      if (point.x == vertices->points[k].x && point.y == vertices->points[k].y &&
-          point.z == vertices->points[k].z) {
-        vidx = k;
-        // For partial mesh, the indices should start with 0
-        vidx_new = updated_indices_partial.at(j);
-        point_exists = true;
-        point_exists_in_new = true;
-        break;
-      }
+    const auto added = new_positions.find(key);
+    if (added != new_positions.end()) {
+      vidx = updated_indices->at(updated_offset + added->second);
+      // For partial mesh, the indices should start with 0
+      vidx_new = updated_indices_partial.at(added->second);
+      point_exists = true;
+      point_exists_in_new = true;
     }
 
     // if point exists prior to processing this mesh block
@@ -116,6 +122,7 @@ pcl::PolygonMesh UpdateMeshFromVoxbloxMeshBlock(
     if (!point_exists_in_new) {
       vidx_new = vertex_index_new++;
       new_vertices.push_back(point);
+      new_positions.emplace(key, updated_indices_partial.size());
       updated_indices->push_back(vidx);
       updated_indices_partial.push_back(vidx_new);
     }
@@ -179,13 +186,17 @@ pcl::PolygonMesh VoxbloxMeshBlockToPolygonMesh(
       new pcl::PointCloud<pcl::PointXYZRGBA>);
   std::shared_ptr<std::map<size_t, size_t> > msg_vertex_map =
       std::make_shared<std::map<size_t, size_t> >();
-  VoxbloxMeshBlockToPolygonMesh(
-      mesh_block,
-      block_edge_length,
-      vertices_cloud,
-      msg_vertex_map,
-      std::make_shared<std::vector<pcl::Vertices> >(new_mesh.polygons));
+  std::shared_ptr<std::vector<pcl::Vertices> > triangles =
+      std::make_shared<std::vector<pcl::Vertices> >();
+  VertexPositionMap vertex_positions;
+  VoxbloxMeshBlockToPolygonMesh(mesh_block,
+                                block_edge_length,
+                                vertices_cloud,
+                                msg_vertex_map,
+                                triangles,
+                                &vertex_positions);
 
+  new_mesh.polygons = std::move(*triangles);
   pcl::toPCLPointCloud2(*vertices_cloud, new_mesh.cloud);
   return new_mesh;
 }
@@ -198,33 +209,45 @@ void VoxbloxMeshBlockToPolygonMesh(
     std::shared_ptr<std::vector<pcl::Vertices> > triangles,
     const bool& check_duplicates_full) {
   assert(vertices != nullptr);
+  VertexPositionMap vertex_positions;
+  if (check_duplicates_full) {
+    vertex_positions.reserve(vertices->size() + mesh_block.x.size());
+    for (size_t k = 0; k < vertices->size(); k++) {
+      vertex_positions.emplace(MakeVertexPositionKey(vertices->points[k]), k);
+    }
+  }
+  VoxbloxMeshBlockToPolygonMesh(mesh_block,
+                                block_edge_length,
+                                vertices,
+                                msg_vertex_map,
+                                triangles,
+                                &vertex_positions);
+}
+
+void VoxbloxMeshBlockToPolygonMesh(
+    const voxblox_msgs::MeshBlock& mesh_block,
+    float block_edge_length,
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr vertices,
+    std::shared_ptr<std::map<size_t, size_t> > msg_vertex_map,
+    std::shared_ptr<std::vector<pcl::Vertices> > triangles,
+    VertexPositionMap* vertex_positions) {
+  assert(vertices != nullptr);
   assert(triangles != nullptr);
   assert(msg_vertex_map != nullptr);
-  // Extract mesh block
-  size_t vertex_index = vertices->size();
-  size_t first_index_to_check = (check_duplicates_full) ? 0 : vertices->size();
+  assert(vertex_positions != nullptr);
   // translate vertex data from message to voxblox mesh
   pcl::Vertices triangle;
   for (size_t i = 0; i < mesh_block.x.size(); ++i) {
     pcl::PointXYZRGBA point = ExtractPoint(mesh_block, block_edge_length, i);
 
     // Search if vertex inserted
-    size_t vidx;
-    bool point_exists = false;
-    // Check for duplicates.
-    for (size_t k = first_index_to_check; k < vertices->points.size(); k++) {
-      if (point.x == vertices->points[k].x && point.y == vertices->points[k].y &&
-          point.z == vertices->points[k].z) {
-        vidx = k;
-        point_exists = true;
-        vertices->points[k] = point;
-        break;
-      }
-    }
-
-    if (!point_exists) {
-      vidx = vertex_index++;
+    const auto inserted =
+        vertex_positions->emplace(MakeVertexPositionKey(point), vertices->size());
+    const size_t vidx = inserted.first->second;
+    if (inserted.second) {
       vertices->push_back(point);
+    } else {
+      vertices->points[vidx] = point;
     }
 
     triangle.vertices.push_back(vidx);
@@ -237,16 +260,92 @@ void VoxbloxMeshBlockToPolygonMesh(
   return;
 }
 
-pcl::PolygonMesh VoxbloxToPolygonMesh(const voxblox_msgs::Mesh::ConstPtr& voxblox_msg) {
+pcl::PolygonMesh VoxbloxToPolygonMesh(const voxblox_msgs::Mesh::ConstPtr& voxblox_msg,
+                                      size_t num_threads) {
+  const std::vector<voxblox_msgs::MeshBlock>& mesh_blocks = voxblox_msg->mesh_blocks;
+  const size_t num_blocks = mesh_blocks.size();
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::max<size_t>(1, std::min(num_threads, num_blocks));
+
+  // Convert the blocks independently, removing the duplicates within a block
+  std::vector<pcl::PointCloud<pcl::PointXYZRGBA> > block_vertices(num_blocks);
+  std::vector<std::vector<pcl::Vertices> > block_triangles(num_blocks);
+  auto convert_blocks = [&](size_t thread_idx) {
+    for (size_t b = thread_idx; b < num_blocks; b += num_threads) {
+      pcl::PointCloud<pcl::PointXYZRGBA>::Ptr vertices(
+          new pcl::PointCloud<pcl::PointXYZRGBA>);
+      auto msg_vertex_map = std::make_shared<std::map<size_t, size_t> >();
+      auto triangles = std::make_shared<std::vector<pcl::Vertices> >();
+      VertexPositionMap vertex_positions;
+      vertex_positions.reserve(mesh_blocks[b].x.size());
+      VoxbloxMeshBlockToPolygonMesh(mesh_blocks[b],
+                                    voxblox_msg->block_edge_length,
+                                    vertices,
+                                    msg_vertex_map,
+                                    triangles,
+                                    &vertex_positions);
+      block_vertices[b].swap(*vertices);
+      block_triangles[b] = std::move(*triangles);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < num_threads; t++) {
+    workers.emplace_back(convert_blocks, t);
+  }
+  convert_blocks(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  // Merge the blocks in order, as successive calls to CombineMeshes would
+  size_t total_vertices = 0;
+  size_t total_triangles = 0;
+  for (size_t b = 0; b < num_blocks; b++) {
+    total_vertices += block_vertices[b].size();
+    total_triangles += block_triangles[b].size();
+  }
+  pcl::PointCloud<pcl::PointXYZRGBA> vertices;
+  vertices.reserve(total_vertices);
+  VertexPositionMap vertex_positions;
+  vertex_positions.reserve(total_vertices);
   pcl::PolygonMesh new_mesh;
+  new_mesh.polygons.reserve(total_triangles);
+  std::vector<size_t> new_indices;
+  for (size_t b = 0; b < num_blocks; b++) {
+    // Blocks without faces are skipped by CombineMeshes
+    if (block_triangles[b].empty()) {
+      continue;
+    }
+    const size_t orig_num_vertices = vertices.size();
+    new_indices.resize(block_vertices[b].size());
+    for (size_t i = 0; i < block_vertices[b].size(); i++) {
+      const pcl::PointXYZRGBA& point = block_vertices[b].points[i];
+      const auto inserted =
+          vertex_positions.emplace(MakeVertexPositionKey(point), vertices.size());
+      new_indices[i] = inserted.first->second;
+      if (inserted.second) {
+        vertices.push_back(point);
+      } else {
+        vertices.points[new_indices[i]] = point;
+      }
+    }
 
-  // Extract mesh block
-  for (const voxblox_msgs::MeshBlock& mesh_block : voxblox_msg->mesh_blocks) {
-    pcl::PolygonMesh partial_mesh =
-        VoxbloxMeshBlockToPolygonMesh(mesh_block, voxblox_msg->block_edge_length);
-    new_mesh = CombineMeshes(new_mesh, partial_mesh);
+    // Faces only made of vertices of previous blocks were already added
+    for (const pcl::Vertices& tri : block_triangles[b]) {
+      pcl::Vertices new_triangle;
+      bool to_add = false;
+      for (size_t v : tri.vertices) {
+        new_triangle.vertices.push_back(new_indices.at(v));
+        if (new_indices.at(v) >= orig_num_vertices) to_add = true;
+      }
+      if (to_add) new_mesh.polygons.push_back(new_triangle);
+    }
   }
 
+  pcl::toPCLPointCloud2(vertices, new_mesh.cloud);
   return new_mesh;
 }
 
@@ -0,0 +1,104 @@
+/**
+ * @file   voxblox_mesh_benchmark.cpp
+ * @brief  Time the conversion of a recorded voxblox mesh to a polygon mesh
+ * @author Yun Chang
+ */
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <voxblox_msgs/Mesh.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "kimera_pgmo/utils/VoxbloxUtils.h"
+
+namespace {
+
+// The voxblox mesh topic only carries the updated blocks: keep the last
+// version of every block to get the full mesh at the end of the bag
+voxblox_msgs::Mesh::Ptr ReadFullMesh(const std::string& bag_path,
+                                     const std::string& topic) {
+  rosbag::Bag bag;
+  bag.open(bag_path, rosbag::bagmode::Read);
+  rosbag::View view(bag, rosbag::TopicQuery(topic));
+
+  voxblox_msgs::Mesh::Ptr full_mesh;
+  std::map<BlockIndex, voxblox_msgs::MeshBlock> blocks;
+  for (const rosbag::MessageInstance& instance : view) {
+    const voxblox_msgs::Mesh::ConstPtr msg = instance.instantiate<voxblox_msgs::Mesh>();
+    if (msg == nullptr) {
+      continue;
+    }
+    if (full_mesh == nullptr) {
+      full_mesh.reset(new voxblox_msgs::Mesh);
+    }
+    full_mesh->header = msg->header;
+    full_mesh->block_edge_length = msg->block_edge_length;
+    for (const voxblox_msgs::MeshBlock& block : msg->mesh_blocks) {
+      const BlockIndex index(block.index[0], block.index[1], block.index[2]);
+      if (block.x.empty()) {
+        blocks.erase(index);
+      } else {
+        blocks[index] = block;
+      }
+    }
+  }
+  bag.close();
+
+  if (full_mesh != nullptr) {
+    for (auto& index_block : blocks) {
+      full_mesh->mesh_blocks.push_back(std::move(index_block.second));
+    }
+  }
+  return full_mesh;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <bag> [topic] [repeats]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string bag_path = argv[1];
+  const std::string topic = argc > 2 ? argv[2] : "/kimera_semantics_node/mesh";
+  const int repeats = argc > 3 ? std::stoi(argv[3]) : 5;
+
+  const voxblox_msgs::Mesh::ConstPtr mesh = ReadFullMesh(bag_path, topic);
+  if (mesh == nullptr) {
+    std::cerr << "No voxblox_msgs/Mesh on " << topic << " in " << bag_path
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  size_t num_msg_vertices = 0;
+  for (const voxblox_msgs::MeshBlock& block : mesh->mesh_blocks) {
+    num_msg_vertices += block.x.size();
+  }
+  std::cout << "Mesh with " << mesh->mesh_blocks.size() << " blocks and "
+            << num_msg_vertices << " vertices" << std::endl;
+
+  const size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+    double total_ms = 0;
+    size_t num_vertices = 0;
+    size_t num_faces = 0;
+    for (int i = 0; i < repeats; i++) {
+      const auto start = std::chrono::high_resolution_clock::now();
+      const pcl::PolygonMesh result =
+          kimera_pgmo::VoxbloxToPolygonMesh(mesh, num_threads);
+      const auto end = std::chrono::high_resolution_clock::now();
+      total_ms += std::chrono::duration<double, std::milli>(end - start).count();
+      num_vertices = result.cloud.width * result.cloud.height;
+      num_faces = result.polygons.size();
+    }
+    std::cout << "threads: " << num_threads << " | vertices: " << num_vertices
+              << " | faces: " << num_faces
+              << " | mean time (ms): " << total_ms / std::max(repeats, 1)
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file   test_allocation_stats.cpp
+ * @brief  Unit-tests for the optional heap allocation counters and zones
+ * @author Yun Chang
+ */
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/AllocationStats.h"
+
+namespace kimera_pgmo {
+
+TEST(test_allocation_stats, countsAlignedAndNothrowAllocations) {
+  if (!allocationCountingEnabled()) {
+    EXPECT_EQ(0u, threadAllocationCount().allocations);
+    return;
+  }
+
+  struct alignas(64) Block {
+    char data[64];
+  };
+  const AllocationCount start = threadAllocationCount();
+  int* value = new (std::nothrow) int(1);
+  Block* block = new Block;
+  Block* blocks = new (std::nothrow) Block[2];
+  const AllocationCount used = threadAllocationCount() - start;
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(block) % alignof(Block));
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(blocks) % alignof(Block));
+  delete value;
+  delete block;
+  delete[] blocks;
+
+  EXPECT_EQ(3u, used.allocations);
+  EXPECT_LE(sizeof(int) + 3 * sizeof(Block), used.bytes);
+}
+
+TEST(test_allocation_stats, allocationZones) {
+  if (!allocationCountingEnabled()) {
+    // zones only record anything in profiling builds
+    AllocationZone zone("unused");
+    EXPECT_TRUE(allocationZoneStats().empty());
+    return;
+  }
+
+  resetAllocationZoneStats();
+  {
+    AllocationZone outer("outer");
+    std::vector<char> outer_buffer(1000);
+    for (size_t i = 0; i < 2; ++i) {
+      AllocationZone inner("inner");
+      std::vector<char> inner_buffer(400);
+    }
+  }
+
+  const auto stats = allocationZoneStats();
+  ASSERT_EQ(2u, stats.size());
+  // sorted by self bytes
+  EXPECT_EQ("outer", stats[0].name);
+  EXPECT_EQ(1u, stats[0].calls);
+  EXPECT_EQ(1u, stats[0].self.allocations);
+  EXPECT_EQ(1000u, stats[0].self.bytes);
+  EXPECT_EQ(3u, stats[0].total.allocations);
+  EXPECT_EQ(1800u, stats[0].total.bytes);
+  EXPECT_LE(1400u, stats[0].peak_bytes);
+
+  EXPECT_EQ("inner", stats[1].name);
+  EXPECT_EQ(2u, stats[1].calls);
+  EXPECT_EQ(2u, stats[1].self.allocations);
+  EXPECT_EQ(800u, stats[1].total.bytes);
+  EXPECT_LE(400u, stats[1].peak_bytes);
+  resetAllocationZoneStats();
+}
+
+}  // namespace kimera_pgmo
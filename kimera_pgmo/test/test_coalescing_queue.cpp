@@ -0,0 +1,65 @@
+/**
+ * @file   test_coalescing_queue.cpp
+ * @brief  Unit-tests for the full mesh hand-off queue
+ * @author Yun Chang
+ */
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/CoalescingQueue.h"
+
+namespace kimera_pgmo {
+
+TEST(test_coalescing_queue, parsePolicy) {
+  QueuePolicy policy = QueuePolicy::FIFO;
+  EXPECT_TRUE(parseQueuePolicy("latest", &policy));
+  EXPECT_EQ(QueuePolicy::LATEST, policy);
+  EXPECT_TRUE(parseQueuePolicy("fifo", &policy));
+  EXPECT_EQ(QueuePolicy::FIFO, policy);
+  EXPECT_FALSE(parseQueuePolicy("newest", &policy));
+  EXPECT_EQ(QueuePolicy::FIFO, policy);
+}
+
+TEST(test_coalescing_queue, latestOnly) {
+  CoalescingQueue<int> queue(QueuePolicy::LATEST, 10);
+  EXPECT_EQ(0u, queue.push(1));
+  EXPECT_EQ(1u, queue.push(2));
+  EXPECT_EQ(1u, queue.push(3));
+  EXPECT_EQ(1u, queue.size());
+
+  auto msg = queue.pop(std::chrono::milliseconds(10));
+  ASSERT_TRUE(msg);
+  EXPECT_EQ(3, *msg);
+  EXPECT_FALSE(queue.pop(std::chrono::milliseconds(1)));
+
+  const QueueStats stats = queue.stats();
+  EXPECT_EQ(3u, stats.received);
+  EXPECT_EQ(1u, stats.processed);
+  EXPECT_EQ(2u, stats.dropped);
+  EXPECT_GE(stats.max_latency_us, stats.last_latency_us);
+}
+
+TEST(test_coalescing_queue, fifoDropsOldest) {
+  CoalescingQueue<int> queue(QueuePolicy::FIFO, 2);
+  queue.push(1);
+  queue.push(2);
+  EXPECT_EQ(1u, queue.push(3));
+
+  EXPECT_EQ(2, *queue.pop(std::chrono::milliseconds(10)));
+  EXPECT_EQ(3, *queue.pop(std::chrono::milliseconds(10)));
+  EXPECT_EQ(1u, queue.stats().dropped);
+  EXPECT_EQ(2u, queue.stats().processed);
+}
+
+TEST(test_coalescing_queue, shutdownWakesConsumer) {
+  CoalescingQueue<int> queue;
+  std::thread consumer([&queue]() {
+    EXPECT_FALSE(queue.pop(std::chrono::seconds(10)));
+  });
+
+  queue.shutdown();
+  consumer.join();
+  EXPECT_TRUE(queue.isShutdown());
+}
+
+}  // namespace kimera_pgmo
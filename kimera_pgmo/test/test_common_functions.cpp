@@ -42,6 +42,50 @@ TEST(test_common_functions, PCLtoMeshMsg) {
   EXPECT_EQ(mesh->polygons[839].vertices[0], new_mesh.polygons[839].vertices[0]);
 }
 
+TEST(test_common_functions, AppendToMeshMsg) {
+  pcl::PolygonMeshPtr mesh(new pcl::PolygonMesh());
+  ReadMeshFromPly(std::string(DATASET_PATH) + "/sphere.ply", mesh);
+  pcl::PointCloud<pcl::PointXYZRGBA> vertices;
+  pcl::fromPCLPointCloud2(mesh->cloud, vertices);
+  const mesh_msgs::TriangleMesh expected = PolygonMeshToTriangleMeshMsg(*mesh);
+
+  // grow the mesh in two steps
+  pcl::PointCloud<pcl::PointXYZRGBA> partial_vertices;
+  partial_vertices.points.assign(vertices.points.begin(),
+                                 vertices.points.begin() + 200);
+  std::vector<pcl::Vertices> partial_faces;
+  for (const auto& face : mesh->polygons) {
+    if (*std::max_element(face.vertices.begin(), face.vertices.end()) < 200) {
+      partial_faces.push_back(face);
+    }
+  }
+  mesh_msgs::TriangleMesh triangle_mesh;
+  appendToTriangleMeshMsg(partial_vertices, partial_faces, triangle_mesh);
+  EXPECT_EQ(200u, triangle_mesh.vertices.size());
+  EXPECT_EQ(partial_faces.size(), triangle_mesh.triangles.size());
+
+  for (const auto& face : mesh->polygons) {
+    if (*std::max_element(face.vertices.begin(), face.vertices.end()) >= 200) {
+      partial_faces.push_back(face);
+    }
+  }
+  appendToTriangleMeshMsg(vertices, partial_faces, triangle_mesh);
+  ASSERT_EQ(expected.vertices.size(), triangle_mesh.vertices.size());
+  ASSERT_EQ(expected.vertex_colors.size(), triangle_mesh.vertex_colors.size());
+  ASSERT_EQ(expected.triangles.size(), triangle_mesh.triangles.size());
+  for (size_t i = 0; i < expected.vertices.size(); i++) {
+    EXPECT_EQ(expected.vertices[i].x, triangle_mesh.vertices[i].x);
+    EXPECT_EQ(expected.vertices[i].z, triangle_mesh.vertices[i].z);
+    EXPECT_EQ(expected.vertex_colors[i].g, triangle_mesh.vertex_colors[i].g);
+  }
+  for (size_t i = 0; i < partial_faces.size(); i++) {
+    EXPECT_EQ(partial_faces[i].vertices[0],
+              triangle_mesh.triangles[i].vertex_indices[0]);
+    EXPECT_EQ(partial_faces[i].vertices[2],
+              triangle_mesh.triangles[i].vertex_indices[2]);
+  }
+}
+
 TEST(test_common_functions, PolygonsEqual) {
   pcl::Vertices p0, p1, p2, p3;
 
@@ -318,4 +362,50 @@ TEST(test_common_functions, MeshSurfaceExist) {
   EXPECT_TRUE(SurfaceExists(poly_3, adj_surfaces, surfaces));
 }
 
+TEST(test_common_functions, MeshGraphToPoseGraph) {
+  pcl::PointCloud<pcl::PointXYZRGBA> graph_vertices;
+  graph_vertices.resize(6);
+  graph_vertices[1].x = 4.0;
+  graph_vertices[1].y = 2.0;
+  graph_vertices[5].x = 1.0;
+  graph_vertices[5].y = 2.0;
+  graph_vertices[5].z = 3.0;
+
+  KimeraPgmoMeshGraph mesh_graph;
+  mesh_graph.header.frame_id = "world";
+  mesh_graph.robot_id = 1;
+  mesh_graph.node_indices = {3, 5};
+  mesh_graph.node_positions = {0, 0, 0, 1, 2, 3};
+  mesh_graph.node_stamps = {1000, 2000};
+  mesh_graph.edges = {3, 5, 5, 3};
+
+  pose_graph_tools_msgs::PoseGraph msg =
+      MeshGraphToPoseGraph(mesh_graph, graph_vertices);
+  ASSERT_EQ(2u, msg.nodes.size());
+  ASSERT_EQ(2u, msg.edges.size());
+  EXPECT_EQ("world", msg.header.frame_id);
+  EXPECT_EQ(5u, msg.nodes[1].key);
+  EXPECT_EQ(1u, msg.nodes[1].robot_id);
+  EXPECT_EQ(2000u, msg.nodes[1].header.stamp.toNSec());
+  EXPECT_EQ(2.0, msg.nodes[1].pose.position.y);
+  EXPECT_EQ(5u, msg.edges[1].key_from);
+  EXPECT_EQ(3u, msg.edges[1].key_to);
+  EXPECT_EQ(pose_graph_tools_msgs::PoseGraphEdge::MESH, msg.edges[1].type);
+  EXPECT_EQ(-3.0, msg.edges[1].pose.position.z);
+
+  // Edge from a new vertex to one sent in an earlier msg
+  mesh_graph.edges = {5, 1, 3, 7};
+  msg = MeshGraphToPoseGraph(mesh_graph, graph_vertices);
+  ASSERT_EQ(1u, msg.edges.size());
+  EXPECT_EQ(5u, msg.edges[0].key_from);
+  EXPECT_EQ(1u, msg.edges[0].key_to);
+  EXPECT_EQ(3.0, msg.edges[0].pose.position.x);
+  EXPECT_EQ(0.0, msg.edges[0].pose.position.y);
+  EXPECT_EQ(-3.0, msg.edges[0].pose.position.z);
+
+  // Inconsistent sizes
+  mesh_graph.node_stamps.pop_back();
+  EXPECT_TRUE(MeshGraphToPoseGraph(mesh_graph, graph_vertices).nodes.empty());
+}
+
 }  // namespace kimera_pgmo
@@ -0,0 +1,100 @@
+/**
+ * @file   test_control_point_store.cpp
+ * @brief  Unit-tests for the compact control point store
+ * @author Yun Chang
+ */
+#include <random>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/ControlPointStore.h"
+
+namespace kimera_pgmo {
+
+using traits::Timestamp;
+
+TEST(test_control_point_store, empty) {
+  ControlPointStore store;
+  EXPECT_TRUE(store.empty());
+  EXPECT_EQ(0u, store.size());
+  EXPECT_EQ(0u, store.numChunks());
+  EXPECT_THROW(store.position(0), std::out_of_range);
+  EXPECT_THROW(store.stamp(0), std::out_of_range);
+}
+
+TEST(test_control_point_store, accuracy) {
+  // same points in the current (vector of doubles) representation
+  std::vector<gtsam::Point3> positions;
+  std::vector<Timestamp> stamps;
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> step(-0.5, 0.5);
+  std::uniform_int_distribution<Timestamp> stamp_step(0, 200000000);
+  gtsam::Point3 position(1000.0, -2000.0, 15.0);
+  Timestamp stamp = 1678000000123456789;
+  for (size_t i = 0; i < 2000; ++i) {
+    position += gtsam::Point3(step(gen), step(gen), step(gen));
+    stamp += stamp_step(gen);
+    positions.push_back(position);
+    stamps.push_back(stamp);
+  }
+
+  ControlPointStore store;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    store.push_back(positions[i], stamps[i]);
+  }
+
+  ASSERT_EQ(positions.size(), store.size());
+  EXPECT_EQ(8u, store.numChunks());
+  EXPECT_EQ(stamps.back(), store.lastStamp());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    EXPECT_LT((positions[i] - store.position(i)).norm(), 1.0e-4);
+    EXPECT_EQ(stamps[i], store.stamp(i));
+  }
+
+  const auto expanded_stamps = store.stamps();
+  EXPECT_EQ(stamps, expanded_stamps);
+  const auto expanded_positions = store.positions();
+  ASSERT_EQ(positions.size(), expanded_positions.size());
+  EXPECT_EQ(store.position(1234), expanded_positions[1234]);
+
+  // smaller than the double positions and full stamps
+  EXPECT_LT(store.memoryUsage(),
+            positions.size() * (sizeof(gtsam::Point3) + sizeof(Timestamp)));
+}
+
+TEST(test_control_point_store, unorderedAndFarStamps) {
+  // stamps going backwards or jumping by more than the delta range are exact
+  const Timestamp far = 1000000000000000;  // 1e6 seconds
+  const std::vector<Timestamp> stamps{100, 50, 0, far / 100, 7, far, far + 1};
+  ControlPointStore store;
+  for (size_t i = 0; i < stamps.size(); ++i) {
+    store.push_back(gtsam::Point3(i, 0, 0), stamps[i]);
+  }
+
+  ASSERT_EQ(stamps.size(), store.size());
+  for (size_t i = 0; i < stamps.size(); ++i) {
+    EXPECT_EQ(stamps[i], store.stamp(i));
+    EXPECT_EQ(gtsam::Point3(i, 0, 0), store.position(i));
+  }
+}
+
+TEST(test_control_point_store, fromVectors) {
+  const std::vector<gtsam::Point3> positions{gtsam::Point3(1, 2, 3),
+                                             gtsam::Point3(4, 5, 6)};
+  const ControlPointStore unstamped(positions, {});
+  ASSERT_EQ(2u, unstamped.size());
+  EXPECT_EQ(0u, unstamped.stamp(1));
+  EXPECT_EQ(positions[1], unstamped.position(1));
+
+  const ControlPointStore stamped(positions, {10, 20});
+  EXPECT_EQ(20u, stamped.lastStamp());
+
+  ControlPointStore cleared = stamped;
+  cleared.clear();
+  EXPECT_TRUE(cleared.empty());
+  cleared.push_back(positions[0], 5);
+  EXPECT_EQ(5u, cleared.stamp(0));
+  EXPECT_EQ(2u, stamped.size());
+}
+
+}  // namespace kimera_pgmo
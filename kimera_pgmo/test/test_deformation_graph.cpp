@@ -10,6 +10,9 @@
 #include <pcl/PolygonMesh.h>
 #include <pcl/conversions.h>
 
+#include <fstream>
+#include <sstream>
+
 #include "gtest/gtest.h"
 #include "kimera_pgmo/DeformationGraph.h"
 #include "kimera_pgmo/utils/CommonFunctions.h"
@@ -304,6 +307,45 @@ TEST(test_deformation_graph, deformMeshtranslation) {
   EXPECT_EQ(original_mesh.polygons[3].vertices, new_mesh.polygons[3].vertices);
 }
 
+TEST(test_deformation_graph, registeredPointSets) {
+  DeformationGraph graph;
+  SetUpDeformationGraph(&graph);
+  graph.setPointSetThreads(2);
+
+  std::vector<gtsam::Point3> points;
+  std::vector<Timestamp> stamps;
+  for (size_t i = 0; i < 5000; i++) {
+    points.push_back(gtsam::Point3(0.0002 * i, 0.5, 0.1));
+    stamps.push_back(0);
+  }
+  const PointSetHandle first = graph.registerPointSet('v', points, stamps, 2);
+  const PointSetHandle second =
+      graph.registerPointSet('v', {gtsam::Point3(1, 1, 0)}, {}, 2);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(2u, graph.numPointSets());
+
+  // same translation as deformMeshtranslation
+  geometry_msgs::Pose distortion;
+  distortion.position.x = 1.5;
+  graph.addMeasurement(1, distortion, 'v');
+  graph.optimize();
+
+  const std::vector<gtsam::Point3>& deformed = graph.getDeformedPointSet(first);
+  ASSERT_EQ(points.size(), deformed.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    EXPECT_NEAR(points[i].x() + 0.5, deformed[i].x(), 1e-6);
+    EXPECT_NEAR(points[i].y(), deformed[i].y(), 1e-6);
+    EXPECT_NEAR(points[i].z(), deformed[i].z(), 1e-6);
+  }
+  ASSERT_EQ(1u, graph.getDeformedPointSet(second).size());
+  EXPECT_NEAR(1.5, graph.getDeformedPointSet(second)[0].x(), 1e-6);
+
+  EXPECT_TRUE(graph.removePointSet(second));
+  EXPECT_FALSE(graph.removePointSet(second));
+  EXPECT_THROW(graph.getDeformedPointSet(second), std::out_of_range);
+  EXPECT_EQ(1u, graph.numPointSets());
+}
+
 TEST(test_deformation_graph, deformMesh) {
   pcl::PolygonMeshPtr cube_mesh(new pcl::PolygonMesh());
   ReadMeshFromPly(std::string(DATASET_PATH) + "/cube.ply", cube_mesh);
@@ -361,6 +403,75 @@ TEST(test_deformation_graph, deformMesh) {
   EXPECT_EQ(cube_mesh->polygons[3].vertices, new_mesh.polygons[3].vertices);
 }
 
+TEST(test_deformation_graph, deformMeshShared) {
+  DeformationGraph graph;
+  SetUpDeformationGraph(&graph);
+  pcl::PolygonMesh original_mesh;
+  std::vector<Timestamp> original_mesh_stamps;
+  std::vector<int> original_mesh_inds;
+  SetUpOriginalMesh(&original_mesh, &original_mesh_stamps, &original_mesh_inds);
+
+  geometry_msgs::Pose distortion;
+  distortion.position.x = 1.5;
+  graph.addMeasurement(1, distortion, 'v');
+  graph.optimize();
+  const uint64_t version = graph.getValuesVersion();
+
+  const DeformedMeshConstPtr deformed = graph.deformMeshShared(
+      original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 2);
+  ASSERT_TRUE(deformed);
+  EXPECT_NE(0u, graph.getLastDeformedVertices('v').size());
+
+  // same estimate and mesh: every consumer gets the same deformed mesh
+  EXPECT_EQ(deformed,
+            graph.deformMeshShared(
+                original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 2));
+  EXPECT_EQ(0u, graph.getLastDeformedVertices('v').size());
+  const pcl::PolygonMesh copy =
+      graph.deformMesh(original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 2);
+  EXPECT_EQ(deformed->cloud.data, copy.cloud.data);
+
+  // optimizing without new measurements keeps the estimate
+  graph.optimize();
+  EXPECT_EQ(version, graph.getValuesVersion());
+  EXPECT_EQ(deformed,
+            graph.deformMeshShared(
+                original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 2));
+
+  // different interpolation or mesh
+  EXPECT_NE(deformed,
+            graph.deformMeshShared(
+                original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 1));
+  const DeformedMeshConstPtr versioned = graph.deformMeshShared(
+      original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 1, 10.0, 7);
+  EXPECT_EQ(versioned,
+            graph.deformMeshShared(original_mesh,
+                                   original_mesh_stamps,
+                                   original_mesh_inds,
+                                   'v',
+                                   1,
+                                   10.0,
+                                   7));
+  pcl::PolygonMesh moved_mesh = original_mesh;
+  moved_mesh.cloud.data[0] ^= 1;
+  EXPECT_NE(versioned,
+            graph.deformMeshShared(
+                moved_mesh, original_mesh_stamps, original_mesh_inds, 'v', 1));
+
+  // a new estimate invalidates the cached mesh
+  graph.clearDeformedMeshCache();
+  const DeformedMeshConstPtr before = graph.deformMeshShared(
+      original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 2);
+  distortion.position.x = 2.5;
+  graph.addMeasurement(1, distortion, 'v');
+  graph.optimize();
+  EXPECT_LT(version, graph.getValuesVersion());
+  const DeformedMeshConstPtr after = graph.deformMeshShared(
+      original_mesh, original_mesh_stamps, original_mesh_inds, 'v', 2);
+  EXPECT_NE(before, after);
+  EXPECT_NE(before->cloud.data, after->cloud.data);
+}
+
 TEST(test_deformation_graph, updateMesh) {
   DeformationGraph graph;
   SetUpDeformationGraph(&graph);
@@ -478,6 +589,137 @@ TEST(test_deformation_graph, addNodeMeasurements) {
   EXPECT_NEAR(4, actual_vertices.points[2].x, 0.001);
 }
 
+TEST(test_deformation_graph, computeRegionOfInfluence) {
+  gtsam::Values before;
+  before.insert(gtsam::Symbol('a', 0), gtsam::Pose3());
+  before.insert(gtsam::Symbol('a', 1), gtsam::Pose3());
+  before.insert(gtsam::Symbol('v', 0), gtsam::Pose3());
+  before.insert(gtsam::Symbol('v', 1), gtsam::Pose3());
+
+  gtsam::Values after;
+  after.insert(gtsam::Symbol('a', 0),
+               gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(0.001, 0, 0)));
+  after.insert(gtsam::Symbol('a', 1),
+               gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(1, 0, 0)));
+  after.insert(gtsam::Symbol('a', 2), gtsam::Pose3());
+  after.insert(gtsam::Symbol('v', 0), gtsam::Pose3());
+  after.insert(gtsam::Symbol('v', 1),
+               gtsam::Pose3(gtsam::Rot3::Yaw(0.1), gtsam::Point3()));
+
+  const RegionOfInfluence region = computeRegionOfInfluence(before, after, 0.01, 0.01);
+  EXPECT_EQ(3u, region.num_poses);
+  EXPECT_EQ(2u, region.num_control_points);
+  // a1 moved and a2 is new
+  EXPECT_EQ(std::vector<gtsam::Key>({gtsam::Symbol('a', 1), gtsam::Symbol('a', 2)}),
+            region.moved_poses);
+  EXPECT_EQ(1u, region.numMovedControlPoints());
+  EXPECT_EQ(std::vector<size_t>({1}), region.moved_control_points.at('v'));
+
+  DeformedVertices deformed;
+  deformed.full = false;
+  deformed.moved = {1, 3};
+  deformed.start = 5;
+  deformed.num_vertices = 7;
+  EXPECT_EQ(4u, deformed.size());
+  EXPECT_EQ(std::vector<size_t>({1, 3, 5, 6}), deformed.indices());
+}
+
+TEST(test_deformation_graph, deformRegionOfInfluence) {
+  DeformationGraph graph;
+  SetUpDeformationGraph(&graph);
+  graph.setRegionOfInfluence(0.01, 0.01);
+  pcl::PolygonMesh simple_mesh = createMeshTriangle();
+  size_t num_vertices = simple_mesh.cloud.width * simple_mesh.cloud.height;
+  std::vector<Timestamp> simple_mesh_stamps(num_vertices, 0);
+  std::vector<int> simple_mesh_inds(num_vertices, -1);
+
+  graph.addNewNode(gtsam::Symbol('a', 0),
+                   gtsam::Pose3(gtsam::Rot3(0, 0, 0, 1), gtsam::Point3(2, 2, 2)),
+                   false);
+  graph.addNodeValence(gtsam::Symbol('a', 0), Vertices{0, 2}, 'v');
+  graph.addNodeMeasurements(
+      {{gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 2, 2))}});
+  graph.optimize();
+  graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  EXPECT_TRUE(graph.getLastDeformedVertices('v').full);
+
+  // nothing moved: nothing is deformed again
+  graph.optimize();
+  EXPECT_TRUE(graph.getLastRegionOfInfluence().moved_poses.empty());
+  graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  EXPECT_FALSE(graph.getLastDeformedVertices('v').full);
+  EXPECT_EQ(0u, graph.getLastDeformedVertices('v').size());
+
+  // moving the pose moves the control points attached to it
+  graph.removePriorsWithPrefix('a');
+  graph.optimize();
+  graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  graph.addNodeMeasurements(
+      {{gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(3, 2, 2))}});
+  graph.optimize();
+  const RegionOfInfluence& region = graph.getLastRegionOfInfluence();
+  EXPECT_EQ(1u, region.moved_poses.size());
+  EXPECT_LT(0u, region.numMovedControlPoints());
+  pcl::PolygonMesh region_mesh =
+      graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  const DeformedVertices& deformed = graph.getLastDeformedVertices('v');
+  EXPECT_FALSE(deformed.full);
+  EXPECT_LT(0u, deformed.size());
+
+  // same result as deforming the whole mesh
+  graph.setRecalculateVertices();
+  pcl::PolygonMesh full_mesh =
+      graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  EXPECT_TRUE(graph.getLastDeformedVertices('v').full);
+  pcl::PointCloud<pcl::PointXYZRGBA> region_vertices, full_vertices;
+  pcl::fromPCLPointCloud2(region_mesh.cloud, region_vertices);
+  pcl::fromPCLPointCloud2(full_mesh.cloud, full_vertices);
+  ASSERT_EQ(full_vertices.size(), region_vertices.size());
+  for (size_t i = 0; i < full_vertices.size(); i++) {
+    EXPECT_NEAR(full_vertices[i].x, region_vertices[i].x, 1.0e-4);
+    EXPECT_NEAR(full_vertices[i].y, region_vertices[i].y, 1.0e-4);
+    EXPECT_NEAR(full_vertices[i].z, region_vertices[i].z, 1.0e-4);
+  }
+}
+
+TEST(test_deformation_graph, deformRegionOfInfluenceAccumulates) {
+  DeformationGraph graph;
+  SetUpDeformationGraph(&graph);
+  graph.setRegionOfInfluence(0.5, 1.0);
+  pcl::PolygonMesh simple_mesh = createMeshTriangle();
+  size_t num_vertices = simple_mesh.cloud.width * simple_mesh.cloud.height;
+  std::vector<Timestamp> simple_mesh_stamps(num_vertices, 0);
+  std::vector<int> simple_mesh_inds(num_vertices, -1);
+
+  graph.addNewNode(gtsam::Symbol('a', 0),
+                   gtsam::Pose3(gtsam::Rot3(0, 0, 0, 1), gtsam::Point3(2, 2, 2)),
+                   false);
+  graph.addNodeValence(gtsam::Symbol('a', 0), Vertices{0, 2}, 'v');
+  graph.addNodeMeasurements(
+      {{gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 2, 2))}});
+  graph.optimize();
+  graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  EXPECT_TRUE(graph.getLastDeformedVertices('v').full);
+
+  // each step stays below the tolerance but the total motion does not
+  graph.removePriorsWithPrefix('a');
+  graph.addNodeMeasurements(
+      {{gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2.3, 2, 2))}});
+  graph.optimize();
+  graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  EXPECT_FALSE(graph.getLastDeformedVertices('v').full);
+  EXPECT_EQ(0u, graph.getLastDeformedVertices('v').size());
+
+  graph.removePriorsWithPrefix('a');
+  graph.addNodeMeasurements(
+      {{gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2.6, 2, 2))}});
+  graph.optimize();
+  graph.deformMesh(simple_mesh, simple_mesh_stamps, simple_mesh_inds, 'v', 1);
+  const DeformedVertices& deformed = graph.getLastDeformedVertices('v');
+  EXPECT_FALSE(deformed.full);
+  EXPECT_LT(0u, deformed.size());
+}
+
 TEST(test_deformation_graph, removePriorsWithPrefix) {
   DeformationGraph graph;
   SetUpDeformationGraph(&graph);
@@ -921,7 +1163,14 @@ TEST(test_deformation_graph, saveAndLoad) {
   graph.save(std::string(DATASET_PATH) + "/graph.dgrf");
   DeformationGraph new_graph;
   new_graph.initialize(graph.getParams());
-  new_graph.load(std::string(DATASET_PATH) + "/graph.dgrf");
+  const uint64_t version = new_graph.getValuesVersion();
+  // a missing file is reported and leaves the graph unchanged
+  EXPECT_FALSE(new_graph.load(std::string(DATASET_PATH) + "/missing.dgrf"));
+  EXPECT_EQ(version, new_graph.getValuesVersion());
+  EXPECT_EQ(size_t(0), new_graph.getGtsamValues().size());
+  EXPECT_TRUE(new_graph.load(std::string(DATASET_PATH) + "/graph.dgrf"));
+  // the loaded values are a new estimate
+  EXPECT_LT(version, new_graph.getValuesVersion());
 
   values = new_graph.getGtsamValues();
   factors = new_graph.getGtsamFactors();
@@ -938,4 +1187,197 @@ TEST(test_deformation_graph, saveAndLoad) {
   EXPECT_EQ(1, new_graph.getInitialPositionVertex('v', 2).y());
 }
 
+TEST(test_deformation_graph, readAndMergeFiles) {
+  DeformationGraph graph;
+  SetUpDeformationGraph(&graph);
+  graph.addNewNode(
+      gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 2, 2)), true);
+  graph.addNodeValence(gtsam::Symbol('a', 0), Vertices{0, 2}, 'v');
+  graph.addNewBetween(gtsam::Symbol('a', 0),
+                      gtsam::Symbol('a', 1),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(0, 1, 2)),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 3, 4)));
+  graph.optimize();
+  const std::string filename = std::string(DATASET_PATH) + "/merge_graph.dgrf";
+  graph.save(filename);
+  const size_t num_factors = graph.getGtsamFactors().size();
+  const size_t num_values = graph.getGtsamValues().size();
+
+  // the same session loaded as robot 0 and robot 1
+  DeformationGraphFile merged;
+  ASSERT_TRUE(ReadDeformationGraphFile(filename, &merged));
+  DeformationGraphFile other_robot;
+  ASSERT_TRUE(ReadDeformationGraphFile(filename, &other_robot, false, true, 1));
+  EXPECT_EQ(num_factors, other_robot.factors.size());
+  EXPECT_EQ(1u, other_robot.control_points.count('t'));
+  EXPECT_TRUE(merged.merge(other_robot));
+
+  // a session loaded twice under the same robot id is rejected
+  DeformationGraphFile same_robot;
+  ASSERT_TRUE(ReadDeformationGraphFile(filename, &same_robot));
+  const size_t num_merged_values = merged.values.size();
+  EXPECT_FALSE(merged.merge(same_robot));
+  EXPECT_EQ(num_merged_values, merged.values.size());
+  EXPECT_EQ(2 * num_factors, merged.factors.size());
+
+  DeformationGraph new_graph;
+  new_graph.initialize(graph.getParams());
+  new_graph.load(merged);
+  EXPECT_EQ(2 * num_factors, new_graph.getGtsamFactors().size());
+  EXPECT_EQ(2 * num_values, new_graph.getGtsamValues().size());
+  EXPECT_EQ(new_graph.getInitialPositionVertex('v', 2).y(),
+            new_graph.getInitialPositionVertex('t', 2).y());
+  EXPECT_TRUE(new_graph.hasPrefixPoses('b'));
+
+  EXPECT_TRUE(merged.converged);
+
+  DeformationGraphFile missing;
+  EXPECT_FALSE(ReadDeformationGraphFile(filename + ".missing", &missing));
+}
+
+
+TEST(test_deformation_graph, saveSolverState) {
+  DeformationGraph graph;
+  SetUpDeformationGraph(&graph);
+  graph.addNewNode(
+      gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 2, 2)), true);
+  graph.addNodeValence(gtsam::Symbol('a', 0), Vertices{0, 2}, 'v');
+  graph.addNewBetween(gtsam::Symbol('a', 0),
+                      gtsam::Symbol('a', 1),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(0, 1, 2)),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 3, 4)));
+  EXPECT_FALSE(graph.hasConvergedEstimate());
+  graph.optimize();
+  EXPECT_TRUE(graph.hasConvergedEstimate());
+  const std::string filename = std::string(DATASET_PATH) + "/solver_state.dgrf";
+  graph.save(filename);
+
+  DeformationGraphFile file;
+  ASSERT_TRUE(ReadDeformationGraphFile(filename, &file));
+  EXPECT_TRUE(file.converged);
+  EXPECT_TRUE(file.gnc_weights.size() == 0 ||
+              file.gnc_weights.size() == static_cast<int>(file.factors.size()));
+
+  // an unchanged graph is loaded without optimizing again
+  DeformationGraph loaded;
+  loaded.initialize(graph.getParams());
+  loaded.load(file);
+  EXPECT_TRUE(loaded.hasConvergedEstimate());
+  EXPECT_EQ(graph.getGtsamFactors().size(), loaded.getGtsamFactors().size());
+  // values are saved at full precision, so the converged estimate loads unchanged
+  EXPECT_TRUE(graph.getGtsamValues().equals(loaded.getGtsamValues(), 1.0e-12));
+
+  // new factors have to be optimized
+  loaded.addNewBetween(gtsam::Symbol('a', 1),
+                       gtsam::Symbol('a', 2),
+                       gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(0, 1, 2)),
+                       gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 4, 6)));
+  EXPECT_FALSE(loaded.hasConvergedEstimate());
+  loaded.optimize();
+  EXPECT_TRUE(loaded.hasConvergedEstimate());
+
+  // the saved state is ignored if the factors of the file changed
+  std::ifstream infile(filename);
+  std::stringstream edited;
+  std::string line;
+  bool removed = false;
+  while (std::getline(infile, line)) {
+    if (!removed && line.rfind("BETWEEN ", 0) == 0) {
+      removed = true;
+      continue;
+    }
+    edited << line << std::endl;
+  }
+  infile.close();
+  ASSERT_TRUE(removed);
+  std::ofstream outfile(filename);
+  outfile << edited.str();
+  outfile.close();
+
+  DeformationGraphFile edited_file;
+  ASSERT_TRUE(ReadDeformationGraphFile(filename, &edited_file));
+  EXPECT_FALSE(edited_file.converged);
+  EXPECT_EQ(0, edited_file.gnc_weights.size());
+  DeformationGraph reoptimized;
+  reoptimized.initialize(graph.getParams());
+  reoptimized.load(edited_file);
+  EXPECT_FALSE(reoptimized.hasConvergedEstimate());
+}
+
+
+TEST(test_deformation_graph, retireRejectedLoopClosures) {
+  DeformationGraph graph;
+  SetUpDeformationGraph(&graph);
+  KimeraRPGO::RobustSolverParams params = graph.getParams();
+  params.setGncInlierCostThresholdsAtProbability(0.01, 100, 1.4, 1.0e-5, 1.0e-4, false);
+  graph.setParams(params);
+  graph.setLoopClosureRetirement(2, 0.1);
+
+  graph.addNewNode(
+      gtsam::Symbol('a', 0), gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(2, 2, 2)), true);
+  graph.addNewBetween(gtsam::Symbol('a', 0),
+                      gtsam::Symbol('a', 1),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(1, 0, 0)),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(3, 2, 2)));
+  graph.addNewBetween(gtsam::Symbol('a', 1),
+                      gtsam::Symbol('a', 2),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(1, 0, 0)),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(4, 2, 2)));
+  // loop closure inconsistent with the odometry
+  graph.addNewBetween(gtsam::Symbol('a', 0),
+                      gtsam::Symbol('a', 2),
+                      gtsam::Pose3(gtsam::Rot3(), gtsam::Point3(50, 20, 0)));
+
+  // rejected once: still part of the solve
+  graph.optimize();
+  const size_t num_factors = graph.getGtsamFactors().size();
+  ASSERT_EQ(num_factors, static_cast<size_t>(graph.getGncWeights().size()));
+  EXPECT_TRUE(graph.getRetiredLoopClosures().empty());
+
+  // rejected twice: retired
+  graph.optimize();
+  ASSERT_EQ(1u, graph.getRetiredLoopClosures().size());
+  const RetiredLoopClosure& retired = graph.getRetiredLoopClosures().front();
+  EXPECT_EQ(gtsam::Symbol('a', 0).key(), retired.factor->front());
+  EXPECT_EQ(gtsam::Symbol('a', 2).key(), retired.factor->back());
+  EXPECT_EQ(2u, retired.num_rejections);
+  EXPECT_LT(retired.weight, 0.1);
+  EXPECT_EQ(num_factors - 1, graph.getGtsamFactors().size());
+  EXPECT_EQ(num_factors - 1, static_cast<size_t>(graph.getGncWeights().size()));
+  EXPECT_TRUE(graph.hasConvergedEstimate());
+  // odometry is never retired
+  graph.optimize();
+  graph.optimize();
+  EXPECT_EQ(1u, graph.getRetiredLoopClosures().size());
+  EXPECT_EQ(num_factors - 1, graph.getGtsamFactors().size());
+
+  // the archive is saved with the graph, outside of the solve
+  const std::string filename = std::string(DATASET_PATH) + "/retired_graph.dgrf";
+  graph.save(filename);
+  DeformationGraphFile file;
+  ASSERT_TRUE(ReadDeformationGraphFile(filename, &file));
+  EXPECT_EQ(num_factors - 1, file.factors.size());
+  ASSERT_EQ(1u, file.retired_loop_closures.size());
+  EXPECT_EQ(2u, file.retired_loop_closures.front().num_rejections);
+  EXPECT_TRUE(file.converged);
+
+  DeformationGraph loaded;
+  loaded.initialize(graph.getParams());
+  loaded.load(file);
+  EXPECT_EQ(num_factors - 1, loaded.getGtsamFactors().size());
+  EXPECT_EQ(1u, loaded.getRetiredLoopClosures().size());
+
+  // readmitted loop closures are part of the next solve again
+  EXPECT_FALSE(loaded.readmitLoopClosure(gtsam::Symbol('a', 0), gtsam::Symbol('a', 1)));
+  EXPECT_TRUE(loaded.readmitLoopClosure(gtsam::Symbol('a', 0), gtsam::Symbol('a', 2)));
+  EXPECT_TRUE(loaded.getRetiredLoopClosures().empty());
+  EXPECT_EQ(1u, loaded.getGtsamNewFactors().size());
+  loaded.optimize();
+  EXPECT_EQ(num_factors, loaded.getGtsamFactors().size());
+  EXPECT_TRUE(loaded.getRetiredLoopClosures().empty());
+
+  EXPECT_EQ(1u, graph.readmitLoopClosures());
+  EXPECT_TRUE(graph.getRetiredLoopClosures().empty());
+}
+
 }  // namespace kimera_pgmo
@@ -6,9 +6,11 @@
  */
 
 #include <chrono>
+#include <random>
 
 #include "gtest/gtest.h"
 #include "kimera_pgmo/compression/DeltaCompression.h"
+#include "kimera_pgmo/utils/VoxbloxMsgInterface.h"
 
 template <typename T>
 std::string mapToString(const T& map) {
@@ -321,6 +323,205 @@ TEST(test_delta_compression, vertexInfoCorrect) {
   EXPECT_TRUE(info.shouldArchive());
 }
 
+// DeltaCompression with the book-keeping used before only the dirty vertices and
+// blocks were visited: every active vertex and face goes through prev_to_curr
+class ReferenceDeltaCompression : public DeltaCompression {
+ public:
+  explicit ReferenceDeltaCompression(double resolution)
+      : DeltaCompression(resolution) {}
+
+  MeshDelta::Ptr referenceUpdate(const voxblox_msgs::Mesh& mesh,
+                                 uint64_t timestamp_ns,
+                                 VoxbloxIndexMapping* remapping) {
+    VoxbloxMsgInterface interface(&mesh);
+    while (timestamp_cache_.count(timestamp_ns)) {
+      ++timestamp_ns;
+    }
+    timestamp_cache_.insert(timestamp_ns);
+    if (archive_delta_) {
+      delta_ = archive_delta_;
+      archive_delta_.reset();
+    } else {
+      delta_.reset(new MeshDelta(num_archived_vertices_, num_archived_faces_));
+    }
+
+    archiveBlockFaces();
+    updateRemapping(interface, timestamp_ns);
+    addReferenceVertices(timestamp_ns);
+    addReferenceFaces(timestamp_ns, remapping);
+    updateAndAddArchivedFaces();
+    num_archived_vertices_ = delta_->getTotalArchivedVertices();
+    num_archived_faces_ = delta_->getTotalArchivedFaces();
+    return delta_;
+  }
+
+ private:
+  void addReferenceVertices(uint64_t timestamp_ns) {
+    for (auto& id_info_pair : vertices_map_) {
+      auto& info = id_info_pair.second;
+      const size_t mesh_index =
+          delta_->addVertex(info.timestamp_ns, info.point, info.label);
+      if (info.timestamp_ns == timestamp_ns) {
+        // the dirty slot caches the index of the vertex in the previous delta
+        auto& dirty = dirty_vertices_[info.mesh_index];
+        if (!info.is_new) {
+          delta_->prev_to_curr[dirty.prev_index] = mesh_index;
+        } else {
+          delta_->new_indices.insert(mesh_index);
+          info.is_new = false;
+        }
+        delta_->observed_indices.insert(mesh_index);
+        dirty.mesh_index = mesh_index;
+      } else {
+        delta_->prev_to_curr[info.mesh_index] = mesh_index;
+      }
+
+      info.mesh_index = mesh_index;
+    }
+  }
+
+  void addReferenceFaces(uint64_t timestamp_ns, VoxbloxIndexMapping* remapping) {
+    const auto& prev_to_curr = delta_->prev_to_curr;
+    std::map<size_t, std::set<size_t>> edges;
+    auto has_edge = [&](size_t source, size_t target) {
+      const auto iter = edges.find(source);
+      return iter != edges.end() && iter->second.count(target);
+    };
+
+    for (auto& id_info_pair : block_info_map_) {
+      auto& block_info = id_info_pair.second;
+      const bool was_updated = block_info.update_time == timestamp_ns;
+      IndexMapping* block_remap = nullptr;
+      if (remapping && was_updated) {
+        block_remap = &(remapping->insert({id_info_pair.first, {}}).first->second);
+      }
+
+      auto& indices = block_info.indices;
+      for (size_t i = 0; i < indices.size(); i += 3) {
+        for (size_t j = i; j < i + 3; ++j) {
+          indices[j] = was_updated ? dirty_vertices_[indices[j]].mesh_index
+                                   : prev_to_curr.at(indices[j]);
+          if (block_remap) {
+            block_remap->insert({j, indices[j]});
+          }
+        }
+
+        const Face face(indices, i);
+        if (!face.valid()) {
+          continue;
+        }
+
+        if (has_edge(face.v1, face.v2) && has_edge(face.v2, face.v3)) {
+          continue;
+        }
+
+        edges[face.v1].insert(face.v2);
+        edges[face.v2].insert(face.v3);
+        edges[face.v3].insert(face.v1);
+        delta_->addFace(face);
+      }
+    }
+  }
+};
+
+void expectSameFaces(const std::vector<Face>& expected,
+                     const std::vector<Face>& result) {
+  ASSERT_EQ(expected.size(), result.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i].v1, result[i].v1) << " @ " << i;
+    EXPECT_EQ(expected[i].v2, result[i].v2) << " @ " << i;
+    EXPECT_EQ(expected[i].v3, result[i].v3) << " @ " << i;
+  }
+}
+
+void expectSameDelta(const MeshDelta& expected, const MeshDelta& result) {
+  EXPECT_EQ(expected.vertex_start, result.vertex_start);
+  EXPECT_EQ(expected.face_start, result.face_start);
+  EXPECT_EQ(expected.getNumArchivedVertices(), result.getNumArchivedVertices());
+  EXPECT_EQ(expected.stamp_updates, result.stamp_updates);
+  ASSERT_EQ(expected.vertex_updates->size(), result.vertex_updates->size());
+  for (size_t i = 0; i < expected.vertex_updates->size(); ++i) {
+    const auto& lhs = expected.vertex_updates->at(i);
+    const auto& rhs = result.vertex_updates->at(i);
+    EXPECT_EQ(lhs.x, rhs.x) << " @ " << i;
+    EXPECT_EQ(lhs.y, rhs.y) << " @ " << i;
+    EXPECT_EQ(lhs.z, rhs.z) << " @ " << i;
+    EXPECT_EQ(lhs.rgba, rhs.rgba) << " @ " << i;
+  }
+
+  expectSameFaces(expected.face_updates, result.face_updates);
+  expectSameFaces(expected.face_archive_updates, result.face_archive_updates);
+  EXPECT_EQ(expected.prev_to_curr, result.prev_to_curr);
+  EXPECT_EQ(expected.deleted_indices, result.deleted_indices);
+  EXPECT_EQ(expected.observed_indices, result.observed_indices);
+  EXPECT_EQ(expected.new_indices, result.new_indices);
+}
+
+TEST(test_delta_compression, sameDeltasAsReference) {
+  // random faces between corners of a coarse lattice, so that neighboring blocks
+  // share the vertices on their boundaries
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> block_coord(-2, 2);
+  std::uniform_int_distribution<int> lattice(0, 4);
+  std::uniform_int_distribution<int> num_faces(0, 4);
+  std::uniform_int_distribution<int> num_blocks(1, 5);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  auto random_block = [&]() {
+    BlockConfig config;
+    config.index = {block_coord(rng), block_coord(rng), 0};
+    const int faces = num_faces(rng);
+    for (int f = 0; f < faces; ++f) {
+      BlockConfig::FaceCoordinates face;
+      for (auto& point : face) {
+        for (size_t d = 0; d < 3; ++d) {
+          point[d] = config.index[d] + 0.25f * lattice(rng);
+        }
+      }
+      config.faces.push_back(face);
+    }
+    return config;
+  };
+
+  DeltaCompression compression(1.0e-3);
+  ReferenceDeltaCompression reference(1.0e-3);
+  BlockConfig::resetIndex();
+  uint64_t stamp_ns = 100'000'000'000;
+  for (size_t update = 0; update < 200; ++update) {
+    if (update > 0 && percent(rng) < 20) {
+      const uint64_t prune_ns = stamp_ns - 1'000'000'000 * (1 + percent(rng) % 5);
+      compression.pruneStoredMesh(prune_ns);
+      reference.pruneStoredMesh(prune_ns);
+    }
+
+    voxblox_msgs::Mesh mesh;
+    mesh.block_edge_length = 1.0;
+    const int blocks = num_blocks(rng);
+    for (int b = 0; b < blocks; ++b) {
+      mesh.mesh_blocks.push_back(random_block().instantiate());
+      if (percent(rng) < 5) {
+        // the same block sent twice in one message
+        mesh.mesh_blocks.push_back(mesh.mesh_blocks.back());
+      }
+    }
+
+    // repeated stamps are bumped to the next free stamp by the compression
+    if (percent(rng) >= 10) {
+      stamp_ns += 1'000'000'000;
+    }
+
+    VoxbloxIndexMapping expected_remapping;
+    VoxbloxIndexMapping remapping;
+    const auto expected =
+        reference.referenceUpdate(mesh, stamp_ns, &expected_remapping);
+    const auto result = compression.update(mesh, stamp_ns, &remapping);
+    ASSERT_TRUE(expected && result);
+    SCOPED_TRACE("update " + std::to_string(update));
+    expectSameDelta(*expected, *result);
+    EXPECT_EQ(expected_remapping, remapping);
+  }
+}
+
 }  // namespace kimera_pgmo
 
 using namespace std::chrono_literals;
@@ -4,6 +4,7 @@
  * @author Yun Chang
  */
 #include <algorithm>
+#include <cstdio>
 #include <numeric>
 #include "gtest/gtest.h"
 
@@ -11,6 +12,7 @@
 #include <pcl/conversions.h>
 #include <pcl/point_types.h>
 
+#include "kimera_pgmo/utils/BinarySerialization.h"
 #include "kimera_pgmo/utils/CommonStructs.h"
 #include "test_config.h"
 
@@ -186,4 +188,39 @@ TEST(test_graph, addPointsAndSurfaces) {
   EXPECT_EQ(Edge(4, 0), graph.getEdges()[15]);
 }
 
+TEST(test_graph, saveLoad) {
+  Graph graph;
+  graph.addEdgeAndVertices(Edge(0, 1));
+  graph.addEdgeAndVertices(Edge(1, 2));
+  graph.addEdgeAndVertices(Edge(2, 0));
+  graph.addVertex(5);
+
+  const std::string filename = std::string(DATASET_PATH) + "/graph.state";
+  {
+    BinaryWriter writer(filename);
+    graph.save(writer);
+    ASSERT_TRUE(writer.ok());
+  }
+
+  Graph loaded;
+  {
+    BinaryReader reader(filename);
+    ASSERT_TRUE(loaded.load(reader));
+  }
+  std::remove(filename.c_str());
+
+  EXPECT_EQ(graph.getVertices(), loaded.getVertices());
+  EXPECT_EQ(graph.getEdges(), loaded.getEdges());
+
+  // max vertex is restored, so re-adding an existing vertex is still a no-op
+  loaded.addVertex(2);
+  EXPECT_EQ(graph.getVertices(), loaded.getVertices());
+
+  // truncated data is rejected
+  std::vector<uint8_t> truncated(4, 0);
+  BinaryReader bad_reader(truncated.data(), truncated.size());
+  Graph bad;
+  EXPECT_FALSE(bad.load(bad_reader));
+}
+
 }  // namespace kimera_pgmo
@@ -0,0 +1,61 @@
+/**
+ * @file   test_grid_mesh.h
+ * @brief  Regular grid meshes used in unittests
+ * @author Yun Chang
+ */
+#pragma once
+
+#include <vector>
+
+#include "kimera_pgmo/MeshTypes.h"
+
+namespace kimera_pgmo {
+
+/*! \brief Grid of 2 triangles per cell in the xy plane, with z = height(x, y)
+ *  - num_cells: number of cells along each side
+ *  - cell_size: side length of the cells
+ *  - height: height of the grid at (x, y)
+ *  - vertices: vertices of the grid (cleared first)
+ *  - faces: faces of the grid (cleared first)
+ */
+template <typename Height>
+void makeGrid(size_t num_cells,
+              float cell_size,
+              const Height& height,
+              std::vector<traits::Pos>* vertices,
+              std::vector<traits::Face>* faces) {
+  vertices->clear();
+  faces->clear();
+  const size_t num_side = num_cells + 1;
+  for (size_t i = 0; i < num_side; ++i) {
+    for (size_t j = 0; j < num_side; ++j) {
+      const float x = i * cell_size;
+      const float y = j * cell_size;
+      vertices->emplace_back(x, y, height(x, y));
+    }
+  }
+
+  for (size_t i = 0; i < num_cells; ++i) {
+    for (size_t j = 0; j < num_cells; ++j) {
+      const size_t v0 = i * num_side + j;
+      const size_t v1 = (i + 1) * num_side + j;
+      const size_t v2 = (i + 1) * num_side + j + 1;
+      const size_t v3 = i * num_side + j + 1;
+      faces->push_back({v0, v1, v2});
+      faces->push_back({v0, v2, v3});
+    }
+  }
+}
+
+/*! \brief Flat grid in the z = height plane (see makeGrid)
+ */
+inline void makeFlatGrid(size_t num_cells,
+                         float cell_size,
+                         float height,
+                         std::vector<traits::Pos>* vertices,
+                         std::vector<traits::Face>* faces) {
+  makeGrid(
+      num_cells, cell_size, [height](float, float) { return height; }, vertices, faces);
+}
+
+}  // namespace kimera_pgmo
@@ -404,6 +404,52 @@ TEST_F(KimeraPgmoTest, fullMeshCallback) {
   EXPECT_NE(3, optimized_vertices.points[4].z);
 }
 
+TEST_F(KimeraPgmoTest, sharedFullMesh) {
+  ros::NodeHandle nh;
+  pgmo_.initialize(nh);
+  OctreeCompressionPtr compression(new OctreeCompression(0.5));
+  Graph graph_struct;
+
+  pose_graph_tools_msgs::PoseGraph::Ptr inc_graph(new pose_graph_tools_msgs::PoseGraph);
+  *inc_graph = SingleOdomGraph(ros::Time(10.2), 0);
+  IncrementalPoseGraphCallback(inc_graph);
+
+  pcl::PolygonMesh mesh1 = createMesh(0, 0, 0);
+  pose_graph_tools_msgs::PoseGraph::Ptr mesh_graph_msg(new pose_graph_tools_msgs::PoseGraph);
+  *mesh_graph_msg =
+      processMeshToGraph(mesh1, 0, ros::Time(12.5), compression, &graph_struct);
+  IncrementalMeshGraphCallback(mesh_graph_msg);
+
+  *inc_graph = OdomLoopclosureGraph(ros::Time(12.8), 0);
+  IncrementalPoseGraphCallback(inc_graph);
+
+  pcl::PolygonMesh full_mesh = createMesh(2, 2, 2);
+  KimeraPgmoMesh::Ptr full_mesh_msg(new kimera_pgmo::KimeraPgmoMesh);
+  std::vector<Timestamp> full_vertex_stamps(
+      full_mesh.cloud.width * full_mesh.cloud.height, stampFromSec(13.0));
+  *full_mesh_msg = PolygonMeshToPgmoMeshMsg(0, full_mesh, full_vertex_stamps, "world");
+  full_mesh_msg->header.stamp = ros::Time(13.0);
+  FullMeshCallback(full_mesh_msg);
+
+  // the mesh deformed by the callback is shared with every other consumer
+  std::vector<Timestamp> stamps;
+  const DeformedMeshConstPtr first = pgmo_.deformFullMesh(*full_mesh_msg, &stamps);
+  ASSERT_TRUE(first);
+  const DeformationGraphPtr graph = pgmo_.getDeformationGraphPtr();
+  EXPECT_EQ(0u, graph->getLastDeformedVertices(GetVertexPrefix(0)).size());
+  EXPECT_EQ(first, pgmo_.deformFullMesh(*full_mesh_msg, &stamps));
+  EXPECT_EQ(getOptimizedMesh().cloud.data, first->cloud.data);
+  EXPECT_EQ(full_vertex_stamps, stamps);
+
+  // a new mesh is deformed again
+  KimeraPgmoMesh::Ptr new_mesh_msg(new kimera_pgmo::KimeraPgmoMesh(*full_mesh_msg));
+  new_mesh_msg->header.stamp = ros::Time(13.5);
+  const DeformedMeshConstPtr second = pgmo_.deformFullMesh(*new_mesh_msg, &stamps);
+  ASSERT_TRUE(second);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(second, pgmo_.deformFullMesh(*new_mesh_msg, &stamps));
+}
+
 TEST_F(KimeraPgmoTest, optimizedPathCallback) {
   ros::NodeHandle nh;
   pgmo_.initialize(nh);
@@ -0,0 +1,160 @@
+/**
+ * @file   test_label_column.cpp
+ * @brief  Unit-tests for the run-length encoded label column
+ * @author Yun Chang
+ */
+#include <cstdio>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/BinarySerialization.h"
+#include "kimera_pgmo/utils/LabelColumn.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+// Blocks of equal labels of varying length, like the labels of a mesh
+std::vector<uint32_t> makeLabels(size_t num_labels) {
+  std::vector<uint32_t> labels;
+  uint32_t label = 7;
+  while (labels.size() < num_labels) {
+    const size_t length = 1 + (label * 37) % 500;
+    for (size_t i = 0; i < length && labels.size() < num_labels; ++i) {
+      labels.push_back(label % 13);
+    }
+    label++;
+  }
+  return labels;
+}
+
+}  // namespace
+
+TEST(test_label_column, pushAndAccess) {
+  LabelColumn column;
+  EXPECT_TRUE(column.empty());
+
+  column.push_back(3);
+  column.push_back(3);
+  column.push_back(5);
+  column.push_back(3);
+  EXPECT_EQ(4u, column.size());
+  EXPECT_EQ(3u, column.numRuns());
+  EXPECT_EQ(std::vector<uint32_t>({3, 5}), column.dictionary());
+  EXPECT_EQ(3u, column[0]);
+  EXPECT_EQ(3u, column[1]);
+  EXPECT_EQ(5u, column[2]);
+  EXPECT_EQ(3u, column.at(3));
+  EXPECT_THROW(column.at(4), std::out_of_range);
+  EXPECT_EQ(std::vector<uint32_t>({3, 3, 5, 3}), column.toVector());
+
+  column.clear();
+  EXPECT_TRUE(column.empty());
+  EXPECT_TRUE(column.dictionary().empty());
+}
+
+TEST(test_label_column, randomAccess) {
+  const auto labels = makeLabels(20000);
+  LabelColumn column(labels);
+  ASSERT_EQ(labels.size(), column.size());
+  EXPECT_LE(column.dictionary().size(), 13u);
+  for (size_t i = 0; i < labels.size(); ++i) {
+    ASSERT_EQ(labels[i], column[i]) << "at " << i;
+  }
+  EXPECT_EQ(labels, column.toVector());
+
+  // much smaller than one label per entry
+  EXPECT_LT(column.memoryUsage(), labels.size() * sizeof(uint32_t) / 10);
+}
+
+TEST(test_label_column, encodeDecode) {
+  const auto labels = makeLabels(5000);
+  const LabelColumn column(labels);
+
+  std::vector<LabelColumn::RunLength> run_lengths;
+  std::vector<LabelColumn::LabelIndex> run_labels;
+  column.encode(&run_lengths, &run_labels);
+  EXPECT_EQ(column.numRuns(), run_lengths.size());
+
+  LabelColumn decoded;
+  ASSERT_TRUE(decoded.decode(column.dictionary(), run_lengths, run_labels));
+  EXPECT_EQ(column, decoded);
+  EXPECT_EQ(labels, decoded.toVector());
+
+  // runs that are not merged by the sender are merged again
+  ASSERT_TRUE(decoded.decode({4, 2}, {3, 2, 1}, {1, 1, 0}));
+  EXPECT_EQ(2u, decoded.numRuns());
+  EXPECT_EQ(std::vector<uint32_t>({2, 2, 2, 2, 2, 4}), decoded.toVector());
+
+  // inconsistent encodings
+  EXPECT_FALSE(decoded.decode({4}, {3, 2}, {0}));
+  EXPECT_FALSE(decoded.decode({4}, {3}, {1}));
+  EXPECT_FALSE(decoded.decode({4}, {0}, {0}));
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST(test_label_column, dictionaryLimit) {
+  LabelColumn column;
+  std::vector<uint32_t> labels;
+  for (size_t i = 0; i < LabelColumn::kMaxDictionarySize; ++i) {
+    labels.push_back(i);
+  }
+  labels.push_back(0);
+  column = labels;
+  EXPECT_FALSE(column.wide());
+
+  // one more distinct label switches to storing the label of every run
+  labels.push_back(LabelColumn::kMaxDictionarySize);
+  labels.push_back(LabelColumn::kMaxDictionarySize);
+  column.push_back(LabelColumn::kMaxDictionarySize);
+  column.push_back(LabelColumn::kMaxDictionarySize);
+  EXPECT_TRUE(column.wide());
+  EXPECT_TRUE(column.dictionary().empty());
+  EXPECT_EQ(labels.size() - 1, column.numRuns());
+  EXPECT_EQ(labels, column.toVector());
+  EXPECT_EQ(7u, column.at(7));
+  EXPECT_EQ(LabelColumn(labels), column);
+
+  std::vector<LabelColumn::RunLength> run_lengths;
+  std::vector<LabelColumn::LabelIndex> run_labels;
+  EXPECT_FALSE(column.encode(&run_lengths, &run_labels));
+
+  std::vector<uint32_t> wide_labels;
+  column.encodeRuns(&run_lengths, &wide_labels);
+  LabelColumn decoded;
+  ASSERT_TRUE(decoded.decodeRuns(run_lengths, wide_labels));
+  EXPECT_EQ(column, decoded);
+
+  // binary files keep wide columns
+  const std::string filename = "/tmp/test_label_column_wide.bin";
+  {
+    BinaryWriter writer(filename);
+    writeLabelColumn(writer, column);
+    ASSERT_TRUE(writer.ok());
+  }
+
+  BinaryReader reader(filename);
+  LabelColumn loaded;
+  ASSERT_TRUE(readLabelColumn(reader, loaded));
+  EXPECT_TRUE(loaded.wide());
+  EXPECT_EQ(column, loaded);
+  std::remove(filename.c_str());
+}
+
+TEST(test_label_column, binarySerialization) {
+  const LabelColumn column(makeLabels(3000));
+  const std::string filename = "/tmp/test_label_column.bin";
+  {
+    BinaryWriter writer(filename);
+    writeLabelColumn(writer, column);
+    ASSERT_TRUE(writer.ok());
+  }
+
+  BinaryReader reader(filename);
+  LabelColumn loaded;
+  ASSERT_TRUE(readLabelColumn(reader, loaded));
+  EXPECT_EQ(column, loaded);
+  std::remove(filename.c_str());
+}
+
+}  // namespace kimera_pgmo
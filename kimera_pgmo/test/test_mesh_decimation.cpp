@@ -0,0 +1,199 @@
+/**
+ * @file   test_mesh_decimation.cpp
+ * @brief  Unit-tests for the quadric error mesh decimation
+ * @author Yun Chang
+ */
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/PclMeshTraits.h"
+#include "kimera_pgmo/utils/MeshDecimation.h"
+#include "test_grid_mesh.h"
+
+namespace kimera_pgmo {
+
+using traits::Face;
+using traits::Pos;
+
+namespace {
+
+float flat(float, float) { return 0.0f; }
+
+float wavy(float x, float y) { return 0.5f * std::sin(2.0f * x) * std::cos(2.0f * y); }
+
+void expectValid(const DecimationResult& result, const std::vector<Pos>& vertices) {
+  for (const auto& face : result.faces) {
+    for (size_t v : face) {
+      ASSERT_LT(v, result.vertices.size());
+    }
+    EXPECT_NE(face[0], face[1]);
+    EXPECT_NE(face[1], face[2]);
+    EXPECT_NE(face[0], face[2]);
+    // orientation is preserved
+    const Pos& p0 = vertices[result.vertices[face[0]]];
+    const Pos& p1 = vertices[result.vertices[face[1]]];
+    const Pos& p2 = vertices[result.vertices[face[2]]];
+    EXPECT_GE((p1 - p0).cross(p2 - p0).z(), 0.0f);
+  }
+  ASSERT_EQ(vertices.size(), result.vertex_map.size());
+  for (size_t i = 0; i < result.vertices.size(); ++i) {
+    EXPECT_EQ(i, result.vertex_map[result.vertices[i]]);
+  }
+}
+
+}  // namespace
+
+TEST(test_mesh_decimation, vertexBudget) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeGrid(20, 0.25, flat, &vertices, &faces);
+
+  MeshDecimationConfig config;
+  config.max_vertices = 50;
+  config.num_threads = 1;
+  const auto result = decimateMesh(vertices, faces, config);
+  expectValid(result, vertices);
+  EXPECT_LE(result.vertices.size(), 50u);
+  EXPECT_GT(result.faces.size(), 0u);
+
+  // the corners of the plane are kept
+  for (size_t corner : {size_t(0), size_t(20), size_t(420), size_t(440)}) {
+    EXPECT_NE(DecimationResult::INVALID, result.vertex_map[corner]);
+    EXPECT_EQ(corner, result.vertices[result.vertex_map[corner]]);
+  }
+
+  // the decimated mesh still covers the whole plane
+  double area = 0.0;
+  for (const auto& face : result.faces) {
+    const Pos& p0 = vertices[result.vertices[face[0]]];
+    const Pos& p1 = vertices[result.vertices[face[1]]];
+    const Pos& p2 = vertices[result.vertices[face[2]]];
+    area += 0.5 * (p1 - p0).cross(p2 - p0).norm();
+  }
+  EXPECT_NEAR(25.0, area, 1.0e-3);
+}
+
+TEST(test_mesh_decimation, errorBound) {
+  std::vector<Pos> plane_vertices;
+  std::vector<Face> plane_faces;
+  makeGrid(20, 0.25, flat, &plane_vertices, &plane_faces);
+  std::vector<Pos> wavy_vertices;
+  std::vector<Face> wavy_faces;
+  makeGrid(20, 0.25, wavy, &wavy_vertices, &wavy_faces);
+
+  MeshDecimationConfig config;
+  config.max_error = 0.01;
+  const auto plane = decimateMesh(plane_vertices, plane_faces, config);
+  const auto curved = decimateMesh(wavy_vertices, wavy_faces, config);
+  expectValid(plane, plane_vertices);
+  expectValid(curved, wavy_vertices);
+
+  // a plane can be decimated without error
+  EXPECT_LT(plane.vertices.size(), 50u);
+  EXPECT_LT(plane.vertices.size(), curved.vertices.size());
+  EXPECT_LT(curved.vertices.size(), wavy_vertices.size());
+
+  // removed vertices stay close to the decimated surface
+  for (size_t v = 0; v < wavy_vertices.size(); ++v) {
+    const Pos& kept = wavy_vertices[curved.vertices[curved.vertex_map[v]]];
+    EXPECT_LT((kept - wavy_vertices[v]).norm(), 1.0);
+  }
+
+  // the bound is a distance: every kept vertex is within max_error of the
+  // planes of the original faces of the vertices collapsed into it
+  for (const auto& face : wavy_faces) {
+    const Pos& p0 = wavy_vertices[face[0]];
+    const Eigen::Vector3f normal =
+        (wavy_vertices[face[1]] - p0).cross(wavy_vertices[face[2]] - p0).normalized();
+    for (size_t v : face) {
+      const Pos& kept = wavy_vertices[curved.vertices[curved.vertex_map[v]]];
+      EXPECT_LE(std::abs(normal.dot(kept - p0)), config.max_error + 1.0e-5);
+    }
+  }
+
+  // no target: nothing to do
+  const auto unchanged =
+      decimateMesh(wavy_vertices, wavy_faces, MeshDecimationConfig());
+  EXPECT_EQ(wavy_vertices.size(), unchanged.vertices.size());
+  EXPECT_EQ(wavy_faces.size(), unchanged.faces.size());
+}
+
+TEST(test_mesh_decimation, parallelTiles) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeGrid(40, 0.25, wavy, &vertices, &faces);
+
+  MeshDecimationConfig config;
+  config.max_vertices = 400;
+  config.tile_size = 5.0;
+  config.num_threads = 1;
+  const auto sequential = decimateMesh(vertices, faces, config);
+  config.num_threads = 4;
+  const auto parallel = decimateMesh(vertices, faces, config);
+  expectValid(parallel, vertices);
+
+  // tiles are decimated independently of the number of threads
+  EXPECT_EQ(sequential.vertices, parallel.vertices);
+  EXPECT_EQ(sequential.faces, parallel.faces);
+  // the vertices on the seams between tiles are kept, so the budget is only met
+  // away from the seams
+  EXPECT_LT(parallel.vertices.size(), 600u);
+  const size_t seam = 20 * 41 + 17;  // x = 5
+  EXPECT_EQ(seam, parallel.vertices[parallel.vertex_map[seam]]);
+}
+
+TEST(test_mesh_decimation, carryAttributes) {
+  std::vector<Pos> grid_vertices;
+  std::vector<Face> grid_faces;
+  makeGrid(10, 0.5, flat, &grid_vertices, &grid_faces);
+
+  pcl::PointCloud<pcl::PointXYZRGBA> cloud;
+  std::vector<pcl::Vertices> polygons;
+  for (size_t i = 0; i < grid_vertices.size(); ++i) {
+    pcl::PointXYZRGBA p;
+    p.x = grid_vertices[i].x();
+    p.y = grid_vertices[i].y();
+    p.z = grid_vertices[i].z();
+    p.r = i % 256;
+    p.a = 255;
+    cloud.push_back(p);
+  }
+  for (const auto& face : grid_faces) {
+    pcl::Vertices polygon;
+    polygon.vertices = {static_cast<uint32_t>(face[0]),
+                        static_cast<uint32_t>(face[1]),
+                        static_cast<uint32_t>(face[2])};
+    polygons.push_back(polygon);
+  }
+
+  MeshDecimationConfig config;
+  config.max_vertices = 30;
+  const auto result = decimateMesh(cloud, polygons, config);
+
+  pcl::PointCloud<pcl::PointXYZRGBA> decimated_cloud;
+  std::vector<pcl::Vertices> decimated_polygons;
+  extractDecimatedMesh(result, cloud, decimated_cloud, decimated_polygons);
+  ASSERT_EQ(result.vertices.size(), decimated_cloud.size());
+  ASSERT_EQ(result.faces.size(), decimated_polygons.size());
+  for (size_t i = 0; i < result.vertices.size(); ++i) {
+    EXPECT_EQ(cloud[result.vertices[i]].x, decimated_cloud[i].x);
+    EXPECT_EQ(cloud[result.vertices[i]].r, decimated_cloud[i].r);
+  }
+  EXPECT_EQ(result.faces[3][1], decimated_polygons[3].vertices[1]);
+
+  // attributes outside of the traits (graph indices) carry over the same way
+  std::vector<int> graph_indices(cloud.size());
+  for (size_t i = 0; i < graph_indices.size(); ++i) {
+    graph_indices[i] = 2 * i + 1;
+  }
+  const auto decimated_indices = extractDecimatedValues(result, graph_indices);
+  ASSERT_EQ(result.vertices.size(), decimated_indices.size());
+  for (size_t i = 0; i < result.vertices.size(); ++i) {
+    EXPECT_EQ(graph_indices[result.vertices[i]], decimated_indices[i]);
+  }
+}
+
+}  // namespace kimera_pgmo
@@ -111,4 +111,171 @@ TEST(test_common_functions, deformPointsWithTimeCheck) {
   }
 }
 
+TEST(test_common_functions, deformPointsDoublePrecision) {
+  typedef pcl::PointXYZ Point;
+  typedef pcl::PointCloud<Point> PointCloud;
+
+  // a far away control point without a value followed by control points whose
+  // positions do not fit in single precision relative to it
+  std::vector<gtsam::Point3> control_points{gtsam::Point3(-1.0e5, 0.0, 0.0)};
+  gtsam::Values optimized_values;
+  char prefix = 'a';
+  for (size_t i = 1; i <= 10; i++) {
+    const gtsam::Point3 position(i + 0.1, 0.3, 0.0);
+    control_points.push_back(position);
+    optimized_values.insert(
+        gtsam::Symbol(prefix, i),
+        gtsam::Pose3(gtsam::Rot3(), position + gtsam::Point3(0.0, 1.0, 0.0)));
+  }
+
+  PointCloud original_points;
+  for (size_t i = 1; i <= 10; i++) {
+    original_points.push_back(Point(static_cast<double>(i), 0.0, 0.0));
+  }
+
+  PointCloud new_points = original_points;
+  std::vector<std::set<size_t>> control_point_map;
+  deformation::deformPoints(new_points,
+                            control_point_map,
+                            original_points,
+                            prefix,
+                            control_points,
+                            {},
+                            optimized_values);
+
+  // every control point moved by the same translation
+  ASSERT_EQ(10, new_points.size());
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_NEAR(original_points.points[i].x, new_points.points[i].x, 1.0e-6);
+    EXPECT_NEAR(1.0, new_points.points[i].y, 1.0e-6);
+    EXPECT_NEAR(0.0, new_points.points[i].z, 1.0e-6);
+  }
+}
+
+TEST(test_common_functions, interpolationWeights) {
+  typedef pcl::PointXYZ Point;
+  typedef pcl::PointCloud<Point> PointCloud;
+
+  PointCloud original_points;
+  std::vector<gtsam::Point3> points;
+  std::vector<Timestamp> stamps;
+  ControlPointStore control_points;
+  gtsam::Values optimized_values;
+  char prefix = 'a';
+  for (size_t i = 0; i < 100; i++) {
+    const double x = static_cast<double>(i);
+    original_points.push_back(Point(x, 0.3 * std::sin(x), 0.0));
+    points.push_back(gtsam::Point3(x, 0.3 * std::sin(x), 0.0));
+    stamps.push_back(stampFromSec(0.2 * x));
+    if (i % 10 == 0) {
+      control_points.push_back(gtsam::Point3(x, 0.0, 0.0), stampFromSec(0.2 * x));
+      optimized_values.insert(
+          gtsam::Symbol(prefix, i / 10),
+          gtsam::Pose3(gtsam::Rot3::Ypr(0.01 * x, 0.0, 0.0),
+                       gtsam::Point3(x + 0.1, 1.0, 0.01 * x)));
+    }
+  }
+
+  for (const bool use_stamps : {false, true}) {
+    PointCloud expected = original_points;
+    std::vector<std::set<size_t>> control_point_map;
+    if (use_stamps) {
+      const ConstStampedCloud<pcl::PointXYZ> cloud{original_points, stamps};
+      deformation::deformPoints(expected,
+                                control_point_map,
+                                cloud,
+                                prefix,
+                                control_points,
+                                optimized_values,
+                                3,
+                                5.0);
+    } else {
+      deformation::deformPoints(expected,
+                                control_point_map,
+                                original_points,
+                                prefix,
+                                control_points,
+                                optimized_values,
+                                3);
+    }
+
+    const auto weights =
+        deformation::computeInterpolationWeights(points,
+                                                 use_stamps ? stamps
+                                                            : std::vector<Timestamp>(),
+                                                 prefix,
+                                                 control_points,
+                                                 optimized_values,
+                                                 3,
+                                                 5.0);
+    ASSERT_EQ(100u, weights.size());
+    EXPECT_TRUE(weights.complete());
+
+    // deforming in two ranges gives the same points as deforming the whole cloud
+    std::vector<gtsam::Point3> deformed(points.size());
+    deformation::interpolatePoints(
+        weights, points, prefix, optimized_values, 0, 40, deformed);
+    deformation::interpolatePoints(
+        weights, points, prefix, optimized_values, 40, 100, deformed);
+    for (size_t i = 0; i < 100; i++) {
+      EXPECT_NEAR(expected.points[i].x, deformed[i].x(), 1.0e-4);
+      EXPECT_NEAR(expected.points[i].y, deformed[i].y(), 1.0e-4);
+      EXPECT_NEAR(expected.points[i].z, deformed[i].z(), 1.0e-4);
+    }
+  }
+
+  // Not enough control points: points are not moved
+  const auto weights = deformation::computeInterpolationWeights(
+      points, {}, prefix, ControlPointStore(), optimized_values, 3);
+  EXPECT_FALSE(weights.complete());
+  std::vector<gtsam::Point3> deformed(points.size());
+  deformation::interpolatePoints(
+      weights, points, prefix, optimized_values, 0, points.size(), deformed);
+  EXPECT_NEAR(points[7].y(), deformed[7].y(), 1.0e-9);
+
+  // Completing the weights once there are control points finds the same weights
+  auto completed = weights;
+  EXPECT_EQ(100u,
+            deformation::completeInterpolationWeights(
+                completed, points, {}, prefix, control_points, optimized_values, 3));
+  const auto expected = deformation::computeInterpolationWeights(
+      points, {}, prefix, control_points, optimized_values, 3);
+  EXPECT_TRUE(completed.complete());
+  EXPECT_EQ(expected.offsets, completed.offsets);
+  EXPECT_EQ(expected.control_points, completed.control_points);
+  EXPECT_EQ(expected.weights, completed.weights);
+
+  // Only the points without control points are interpolated again
+  deformation::InterpolationWeights partial;
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (i < 10 || i % 3 != 0) {
+      for (size_t j = expected.offsets[i]; j < expected.offsets[i + 1]; ++j) {
+        partial.control_points.push_back(expected.control_points[j]);
+        partial.weights.push_back(expected.weights[j]);
+        partial.relative_points.push_back(expected.relative_points[j]);
+      }
+    }
+    partial.offsets.push_back(partial.control_points.size());
+  }
+
+  EXPECT_FALSE(partial.complete());
+  EXPECT_EQ(30u,
+            deformation::completeInterpolationWeights(
+                partial, points, {}, prefix, control_points, optimized_values, 3));
+  EXPECT_EQ(expected.offsets, partial.offsets);
+  EXPECT_EQ(expected.control_points, partial.control_points);
+  EXPECT_EQ(expected.weights, partial.weights);
+
+  // Points that already have control points are kept
+  EXPECT_EQ(0u,
+            deformation::completeInterpolationWeights(completed,
+                                                      points,
+                                                      {},
+                                                      prefix,
+                                                      ControlPointStore(),
+                                                      optimized_values,
+                                                      3));
+  EXPECT_EQ(expected.control_points, completed.control_points);
+}
+
 }  // namespace kimera_pgmo
@@ -5,6 +5,8 @@
  */
 #include <gtest/gtest.h>
 
+#include <stdexcept>
+
 #include "kimera_pgmo/MeshDelta.h"
 
 namespace kimera_pgmo {
@@ -101,4 +103,57 @@ TEST(test_mesh_delta, archiveFacesCorrect) {
   EXPECT_EQ(delta.getNumArchivedFaces(), 2u);
 }
 
+TEST(test_mesh_delta, semanticsRosMsg) {
+  MeshDelta delta;
+  const std::vector<uint32_t> labels{5, 5, 5, 2, 2, 5};
+  for (size_t i = 0; i < labels.size(); ++i) {
+    delta.addVertex(100 + i, TestPoint{1.0, 2.0, 3.0, 0, 0, 0}, labels[i]);
+  }
+  ASSERT_TRUE(delta.hasSemantics());
+
+  // labels are sent as runs
+  const auto msg = delta.toRosMsg(100);
+  EXPECT_TRUE(msg.semantic_updates.empty());
+  EXPECT_EQ(std::vector<uint32_t>({3, 2, 1}), msg.semantic_run_lengths);
+
+  const MeshDelta received(msg);
+  ASSERT_TRUE(received.hasSemantics());
+  EXPECT_EQ(labels, received.semantic_updates.toVector());
+
+  // messages with one label per vertex are still accepted
+  auto plain_msg = msg;
+  plain_msg.semantic_dictionary.clear();
+  plain_msg.semantic_run_lengths.clear();
+  plain_msg.semantic_run_labels.clear();
+  plain_msg.semantic_updates = labels;
+  const MeshDelta plain_received(plain_msg);
+
+  TestMesh result;
+  std::vector<uint32_t> result_labels;
+  plain_received.updateMesh(result.vertices, result.stamps, result.faces, &result_labels);
+  EXPECT_EQ(labels, result_labels);
+
+  // invalid run-length encoding
+  auto invalid_msg = msg;
+  invalid_msg.semantic_run_labels.back() = 7;
+  EXPECT_THROW(MeshDelta invalid(invalid_msg), std::invalid_argument);
+}
+
+TEST(test_mesh_delta, manySemanticLabels) {
+  // more distinct labels than the dictionary holds are sent one per vertex
+  MeshDelta delta;
+  std::vector<uint32_t> labels;
+  for (size_t i = 0; i <= LabelColumn::kMaxDictionarySize; ++i) {
+    labels.push_back(i);
+    delta.addVertex(100, TestPoint{1.0, 2.0, 3.0, 0, 0, 0}, labels.back());
+  }
+  ASSERT_TRUE(delta.hasSemantics());
+
+  const auto msg = delta.toRosMsg(100);
+  EXPECT_TRUE(msg.semantic_run_lengths.empty());
+  EXPECT_EQ(labels, msg.semantic_updates);
+  const MeshDelta received(msg);
+  EXPECT_EQ(labels, received.semantic_updates.toVector());
+}
+
 }  // namespace kimera_pgmo
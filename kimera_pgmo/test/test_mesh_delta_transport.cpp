@@ -0,0 +1,192 @@
+/**
+ * @file   test_mesh_delta_transport.cpp
+ * @brief  Unit-tests for the mesh delta encoder and mirror
+ * @author Yun Chang
+ */
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/MeshDeltaTransport.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+struct TestMesh {
+  pcl::PointCloud<pcl::PointXYZRGBA> vertices;
+  std::vector<Timestamp> stamps;
+  std::vector<pcl::Vertices> faces;
+  IndexMapping graph_mapping;
+
+  // strip of triangles along x
+  void extend(size_t num_vertices, Timestamp stamp) {
+    for (size_t i = 0; i < num_vertices; ++i) {
+      const size_t index = vertices.size();
+      pcl::PointXYZRGBA point;
+      point.x = 0.5f * (index / 2);
+      point.y = index % 2;
+      point.z = 0.0f;
+      point.a = 255;
+      vertices.push_back(point);
+      stamps.push_back(stamp);
+      if (index % 3 == 0) {
+        graph_mapping[index] = index / 3;
+      }
+      if (index >= 2) {
+        pcl::Vertices face;
+        face.vertices = {static_cast<uint32_t>(index - 2),
+                         static_cast<uint32_t>(index - 1),
+                         static_cast<uint32_t>(index)};
+        faces.push_back(face);
+      }
+    }
+  }
+};
+
+void expectMirrorEqual(const TestMesh& mesh, const MeshDeltaMirror& mirror) {
+  ASSERT_EQ(mesh.vertices.size(), mirror.numVertices());
+  ASSERT_EQ(mesh.faces.size(), mirror.faces().size());
+  EXPECT_EQ(mesh.stamps, mirror.stamps());
+  for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+    EXPECT_EQ(mesh.vertices.at(i).x, mirror.vertices().at(i).x);
+    EXPECT_EQ(mesh.vertices.at(i).y, mirror.vertices().at(i).y);
+    EXPECT_EQ(mesh.vertices.at(i).z, mirror.vertices().at(i).z);
+    const int graph_index =
+        mesh.graph_mapping.count(i) ? static_cast<int>(mesh.graph_mapping.at(i)) : -1;
+    EXPECT_EQ(graph_index, mirror.graphIndices().at(i));
+  }
+  for (size_t i = 0; i < mesh.faces.size(); ++i) {
+    EXPECT_EQ(mesh.faces[i].vertices, mirror.faces()[i].vertices);
+  }
+}
+
+}  // namespace
+
+TEST(test_mesh_delta_transport, appendOnly) {
+  TestMesh mesh;
+  mesh.extend(10, 100);
+
+  MeshDeltaEncoder encoder(0.0);
+  MeshDeltaMirror mirror;
+  auto msg = encoder.encode(mesh.vertices,
+                            mesh.stamps,
+                            mesh.faces,
+                            mesh.graph_mapping,
+                            mesh.vertices.size(),
+                            mesh.faces.size());
+  // the first delta carries the whole mesh
+  EXPECT_EQ(0u, msg.vertex_start);
+  EXPECT_EQ(10u, msg.vertex_updates.size());
+  EXPECT_EQ(MeshDeltaMirror::Status::RESYNCED, mirror.update(msg));
+  expectMirrorEqual(mesh, mirror);
+  EXPECT_EQ(0u, mirror.firstChangedVertex());
+  mirror.clearChanges();
+
+  // only the appended vertices and faces are sent
+  mesh.extend(5, 200);
+  msg = encoder.encode(mesh.vertices,
+                       mesh.stamps,
+                       mesh.faces,
+                       mesh.graph_mapping,
+                       mesh.vertices.size(),
+                       mesh.faces.size());
+  EXPECT_EQ(1u, msg.sequence);
+  EXPECT_EQ(10u, msg.vertex_start);
+  EXPECT_EQ(5u, msg.vertex_updates.size());
+  EXPECT_EQ(8u, msg.face_start);
+  EXPECT_EQ(5u, msg.face_updates.size());
+  EXPECT_EQ(MeshDeltaMirror::Status::APPLIED, mirror.update(msg));
+  expectMirrorEqual(mesh, mirror);
+  EXPECT_EQ(10u, mirror.firstChangedVertex());
+
+  // nothing changed
+  mirror.clearChanges();
+  msg = encoder.encode(mesh.vertices,
+                       mesh.stamps,
+                       mesh.faces,
+                       mesh.graph_mapping,
+                       mesh.vertices.size(),
+                       mesh.faces.size());
+  EXPECT_TRUE(msg.vertex_updates.empty());
+  EXPECT_TRUE(msg.face_updates.empty());
+  EXPECT_EQ(MeshDeltaMirror::Status::APPLIED, mirror.update(msg));
+  EXPECT_EQ(15u, mirror.firstChangedVertex());
+}
+
+TEST(test_mesh_delta_transport, mutableSuffix) {
+  TestMesh mesh;
+  mesh.extend(20, 100);
+
+  MeshDeltaEncoder encoder(0.0);
+  MeshDeltaMirror mirror;
+  // the last 8 vertices and the last 4 faces can still change
+  mirror.update(encoder.encode(
+      mesh.vertices, mesh.stamps, mesh.faces, mesh.graph_mapping, 12, 14));
+  mirror.clearChanges();
+
+  mesh.vertices[15].z = 1.0f;
+  mesh.faces[16].vertices = {19, 18, 17};
+  mesh.graph_mapping[13] = 42;
+  const auto msg = encoder.encode(mesh.vertices,
+                                  mesh.stamps,
+                                  mesh.faces,
+                                  mesh.graph_mapping,
+                                  12,
+                                  14,
+                                  13);
+  // the remapped vertex comes before the moved one
+  EXPECT_EQ(13u, msg.vertex_start);
+  EXPECT_EQ(16u, msg.face_start);
+  EXPECT_EQ(MeshDeltaMirror::Status::APPLIED, mirror.update(msg));
+  expectMirrorEqual(mesh, mirror);
+  EXPECT_EQ(13u, mirror.firstChangedVertex());
+}
+
+TEST(test_mesh_delta_transport, recoverFromDroppedDelta) {
+  TestMesh mesh;
+  mesh.extend(10, 100);
+
+  MeshDeltaEncoder encoder(5.0);
+  MeshDeltaMirror mirror;
+  const auto encode = [&](Timestamp stamp) {
+    return encoder.encode(mesh.vertices,
+                          mesh.stamps,
+                          mesh.faces,
+                          mesh.graph_mapping,
+                          mesh.vertices.size(),
+                          mesh.faces.size(),
+                          std::numeric_limits<size_t>::max(),
+                          stamp);
+  };
+
+  EXPECT_EQ(MeshDeltaMirror::Status::RESYNCED,
+            mirror.update(encode(stampFromSec(1.0))));
+  mirror.clearChanges();
+
+  // dropped delta
+  mesh.extend(4, 200);
+  encode(stampFromSec(2.0));
+  mesh.extend(4, 300);
+  EXPECT_EQ(MeshDeltaMirror::Status::OUT_OF_SYNC,
+            mirror.update(encode(stampFromSec(3.0))));
+  EXPECT_FALSE(mirror.synced());
+  EXPECT_EQ(10u, mirror.numVertices());
+
+  // the periodic resync sends the whole mesh
+  mesh.extend(4, 400);
+  const auto resync = encode(stampFromSec(6.5));
+  EXPECT_EQ(0u, resync.vertex_start);
+  EXPECT_EQ(0u, resync.face_start);
+  EXPECT_EQ(MeshDeltaMirror::Status::RESYNCED, mirror.update(resync));
+  EXPECT_TRUE(mirror.synced());
+  expectMirrorEqual(mesh, mirror);
+  // vertices that were already mirrored do not need to be deformed again
+  EXPECT_EQ(10u, mirror.firstChangedVertex());
+
+  // and the next one is a regular delta again
+  mesh.extend(2, 500);
+  const auto delta = encode(stampFromSec(7.0));
+  EXPECT_EQ(22u, delta.vertex_start);
+  EXPECT_EQ(MeshDeltaMirror::Status::APPLIED, mirror.update(delta));
+  expectMirrorEqual(mesh, mirror);
+}
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,212 @@
+/**
+ * @file   test_mesh_spatial_index.cpp
+ * @brief  Unit-tests for the spatial index over the optimized mesh
+ * @author Yun Chang
+ */
+#include <limits>
+#include <random>
+
+#include <pcl/conversions.h>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/MeshSpatialIndex.h"
+#include "test_grid_mesh.h"
+
+namespace kimera_pgmo {
+
+using traits::Face;
+using traits::Pos;
+
+namespace {
+
+pcl::PolygonMesh toMesh(const std::vector<Pos>& vertices,
+                        const std::vector<Face>& faces) {
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (const auto& v : vertices) {
+    cloud.points.push_back(pcl::PointXYZ(v.x(), v.y(), v.z()));
+  }
+  pcl::PolygonMesh mesh;
+  pcl::toPCLPointCloud2(cloud, mesh.cloud);
+  for (const auto& f : faces) {
+    pcl::Vertices polygon;
+    polygon.vertices.assign(f.begin(), f.end());
+    mesh.polygons.push_back(polygon);
+  }
+  return mesh;
+}
+
+}  // namespace
+
+TEST(test_mesh_spatial_index, facesInBox) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeFlatGrid(10, 0.5, 0.0, &vertices, &faces);
+
+  MeshSpatialIndex index(1.0);
+  EXPECT_EQ(faces.size(), index.update(vertices, faces));
+  EXPECT_EQ(200u, index.numFaces());
+
+  // only the two faces of the cell [1, 1.5] x [1, 1.5]
+  const auto inside = index.facesInBox(Pos(1.1, 1.1, -0.1), Pos(1.4, 1.4, 0.1));
+  ASSERT_EQ(2u, inside.size());
+  EXPECT_EQ(2u * (2 * 10 + 2), inside[0]);
+
+  // the box covers everything
+  EXPECT_EQ(200u, index.facesInBox(Pos(-1, -1, -1), Pos(10, 10, 1)).size());
+  // above the plane
+  EXPECT_TRUE(index.facesInBox(Pos(0, 0, 0.5), Pos(5, 5, 1)).empty());
+}
+
+TEST(test_mesh_spatial_index, closestPointMatchesBruteForce) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeFlatGrid(20, 0.25, 0.0, &vertices, &faces);
+  // make the surface non-planar
+  for (auto& v : vertices) {
+    v.z() = 0.3f * std::sin(v.x()) * std::cos(v.y());
+  }
+
+  MeshSpatialIndex index(0.5);
+  index.update(vertices, faces);
+
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<float> coord(-1.0, 6.0);
+  for (size_t i = 0; i < 100; ++i) {
+    const Pos query(coord(gen), coord(gen), coord(gen) - 2.5f);
+
+    // a single bucket holding every face checks all of them
+    MeshSpatialIndex single(100.0);
+    single.update(vertices, faces);
+    MeshSpatialIndex::SurfacePoint expected;
+    ASSERT_TRUE(single.closestPoint(query, 1000.0, &expected));
+
+    MeshSpatialIndex::SurfacePoint result;
+    if (!index.closestPoint(query, 3.0, &result)) {
+      EXPECT_GT(expected.distance, 3.0);
+      continue;
+    }
+    EXPECT_NEAR(expected.distance, result.distance, 1.0e-5);
+  }
+}
+
+TEST(test_mesh_spatial_index, raycast) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeFlatGrid(10, 1.0, 2.0, &vertices, &faces);
+
+  MeshSpatialIndex index(1.0);
+  index.update(vertices, faces);
+
+  MeshSpatialIndex::RayHit hit;
+  ASSERT_TRUE(index.raycast(Pos(3.3, 4.6, 10.0), Pos(0, 0, -2), 20.0, &hit));
+  EXPECT_NEAR(8.0, hit.range, 1.0e-5);
+  EXPECT_NEAR(2.0, hit.point.z(), 1.0e-5);
+  EXPECT_NEAR(3.3, hit.point.x(), 1.0e-5);
+
+  // oblique ray from below
+  ASSERT_TRUE(index.raycast(Pos(0.5, 0.5, 0.0), Pos(1, 1, 1), 20.0, &hit));
+  EXPECT_NEAR(2.5, hit.point.x(), 1.0e-5);
+  EXPECT_NEAR(2.0, hit.point.z(), 1.0e-5);
+
+  // too short, pointing away and parallel
+  EXPECT_FALSE(index.raycast(Pos(3.3, 4.6, 10.0), Pos(0, 0, -1), 7.0, &hit));
+  EXPECT_FALSE(index.raycast(Pos(3.3, 4.6, 10.0), Pos(0, 0, 1), 20.0, &hit));
+  EXPECT_FALSE(index.raycast(Pos(3.3, 4.6, 10.0), Pos(1, 0, 0), 20.0, &hit));
+}
+
+TEST(test_mesh_spatial_index, incrementalUpdate) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeFlatGrid(10, 0.5, 0.0, &vertices, &faces);
+
+  MeshSpatialIndex index(1.0);
+  index.update(vertices, faces);
+
+  // small deformation keeps every face in its buckets
+  for (auto& v : vertices) {
+    v.z() += 0.01f;
+  }
+  EXPECT_EQ(0u, index.update(vertices, faces));
+  MeshSpatialIndex::SurfacePoint point;
+  ASSERT_TRUE(index.closestPoint(Pos(2.2, 2.2, 1.0), 2.0, &point));
+  EXPECT_NEAR(0.99, point.distance, 1.0e-5);
+
+  // lifting the mesh moves every face to new buckets
+  for (auto& v : vertices) {
+    v.z() += 5.0f;
+  }
+  EXPECT_EQ(faces.size(), index.update(vertices, faces));
+  EXPECT_TRUE(index.facesInBox(Pos(0, 0, -0.5), Pos(5, 5, 0.5)).empty());
+  EXPECT_EQ(faces.size(), index.facesInBox(Pos(0, 0, 4.5), Pos(5, 5, 5.5)).size());
+
+  // new faces are inserted and removed faces dropped
+  vertices.emplace_back(20, 20, 0);
+  vertices.emplace_back(21, 20, 0);
+  vertices.emplace_back(20, 21, 0);
+  faces.push_back({vertices.size() - 3, vertices.size() - 2, vertices.size() - 1});
+  EXPECT_EQ(1u, index.update(vertices, faces));
+  EXPECT_EQ(1u, index.facesInBox(Pos(19, 19, -1), Pos(22, 22, 1)).size());
+
+  faces.pop_back();
+  index.update(vertices, faces);
+  EXPECT_TRUE(index.facesInBox(Pos(19, 19, -1), Pos(22, 22, 1)).empty());
+  EXPECT_FALSE(index.closestPoint(Pos(20.2, 20.2, 0.0), 2.0, &point));
+}
+
+TEST(test_mesh_spatial_index, updateChangedVertices) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeFlatGrid(10, 0.5, 0.0, &vertices, &faces);
+
+  MeshSpatialIndex index(1.0);
+  EXPECT_EQ(faces.size(), index.update(toMesh(vertices, faces)));
+
+  // only the faces using the lifted vertex move (vertex 0 is in 2 faces)
+  vertices[0].z() = 3.0f;
+  EXPECT_EQ(2u, index.update(toMesh(vertices, faces), {0}, vertices.size()));
+  EXPECT_EQ(2u, index.facesInBox(Pos(-1, -1, 2.5), Pos(1, 1, 3.5)).size());
+
+  // vertices that were not reported as changed are kept
+  vertices[1].z() = 3.0f;
+  EXPECT_EQ(0u, index.update(toMesh(vertices, faces), {}, vertices.size()));
+  EXPECT_EQ(0.0f, index.vertices()[1].z());
+
+  // new vertices and faces
+  vertices.emplace_back(20, 20, 0);
+  vertices.emplace_back(21, 20, 0);
+  vertices.emplace_back(20, 21, 0);
+  faces.push_back({vertices.size() - 3, vertices.size() - 2, vertices.size() - 1});
+  EXPECT_EQ(1u, index.update(toMesh(vertices, faces), {}, vertices.size() - 3));
+  EXPECT_EQ(1u, index.facesInBox(Pos(19, 19, -1), Pos(22, 22, 1)).size());
+  EXPECT_EQ(faces.size(), index.numFaces());
+}
+
+TEST(test_mesh_spatial_index, degenerateFaces) {
+  std::vector<Pos> vertices;
+  std::vector<Face> faces;
+  makeFlatGrid(2, 0.5, 0.0, &vertices, &faces);
+  MeshSpatialIndex grid_index(0.1);
+  grid_index.update(vertices, faces);
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  // a face to a far placeholder vertex and a face with a non-finite vertex
+  vertices.emplace_back(1.0e6, 0, 0);
+  faces.push_back({0, 1, vertices.size() - 1});
+  vertices.emplace_back(nan, 0, 0);
+  faces.push_back({0, 1, vertices.size() - 1});
+
+  MeshSpatialIndex index(0.1);
+  index.update(vertices, faces);
+  EXPECT_EQ(faces.size(), index.numFaces());
+  EXPECT_EQ(grid_index.numBuckets(), index.numBuckets());
+  EXPECT_EQ(8u, index.facesInBox(Pos(-1, -1, -1), Pos(2, 2, 1)).size());
+
+  // non-finite queries
+  MeshSpatialIndex::SurfacePoint point;
+  EXPECT_FALSE(index.closestPoint(Pos(nan, 0, 0), 1.0, &point));
+  MeshSpatialIndex::RayHit hit;
+  EXPECT_FALSE(index.raycast(Pos(0.2, 0.2, 1.0), Pos(0, 0, nan), 5.0, &hit));
+  EXPECT_TRUE(index.facesInBox(Pos(nan, 0, 0), Pos(1, 1, 1)).empty());
+}
+
+}  // namespace kimera_pgmo
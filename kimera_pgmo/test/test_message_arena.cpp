@@ -0,0 +1,91 @@
+/**
+ * @file   test_message_arena.cpp
+ * @brief  Unit-tests for the per-message scratch arena
+ * @author Yun Chang
+ */
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/AllocationStats.h"
+#include "kimera_pgmo/utils/MessageArena.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+void processMessage(MessageArena& arena, size_t num_elements) {
+  MessageArenaScope scope(arena);
+  std::pmr::vector<size_t> values(arena.resource());
+  std::pmr::unordered_map<size_t, std::pmr::vector<size_t> > map(arena.resource());
+  for (size_t i = 0; i < num_elements; ++i) {
+    values.push_back(i);
+    map[i].push_back(2 * i);
+  }
+
+  ASSERT_EQ(num_elements, values.size());
+  for (size_t i = 0; i < num_elements; ++i) {
+    EXPECT_EQ(i, values[i]);
+    EXPECT_EQ(2 * i, map.at(i).front());
+  }
+}
+
+}  // namespace
+
+TEST(test_message_arena, smallMessageFits) {
+  MessageArena arena(64 * 1024);
+  processMessage(arena, 10);
+
+  const MessageArena::Stats& stats = arena.lastStats();
+  EXPECT_EQ(64u * 1024u, stats.capacity);
+  EXPECT_EQ(0u, stats.overflow_bytes);
+  EXPECT_EQ(0u, stats.overflow_allocations);
+}
+
+TEST(test_message_arena, growsToHighWaterMark) {
+  MessageArena arena(256);
+  processMessage(arena, 1000);
+  EXPECT_LT(0u, arena.lastStats().overflow_allocations);
+  EXPECT_LT(0u, arena.lastStats().overflow_bytes);
+
+  // a message of the same size is now served from the buffer
+  const AllocationCount start = threadAllocationCount();
+  processMessage(arena, 1000);
+  const AllocationCount used = threadAllocationCount() - start;
+  EXPECT_EQ(0u, arena.lastStats().overflow_allocations);
+  EXPECT_LT(256u, arena.lastStats().capacity);
+  // heap allocations are only counted when built with
+  // KIMERA_PGMO_COUNT_ALLOCATIONS
+  if (allocationCountingEnabled()) {
+    EXPECT_EQ(0u, used.allocations);
+  }
+}
+
+TEST(test_message_arena, releasesAfterQuietPeriod) {
+  MessageArena arena(256, 1024, 3);
+  processMessage(arena, 1000);
+  EXPECT_LT(0u, arena.lastStats().used_bytes);
+  const size_t grown = arena.capacity();
+  EXPECT_LT(1024u, grown);
+
+  // a large message in between restarts the quiet period
+  processMessage(arena, 10);
+  processMessage(arena, 10);
+  processMessage(arena, 1000);
+  EXPECT_EQ(grown, arena.capacity());
+  EXPECT_EQ(0u, arena.lastStats().overflow_allocations);
+
+  processMessage(arena, 10);
+  processMessage(arena, 10);
+  EXPECT_EQ(grown, arena.capacity());
+  EXPECT_GE(1024u, arena.lastStats().used_bytes);
+
+  // the buffer is back to the cap after the third small message in a row
+  processMessage(arena, 10);
+  EXPECT_EQ(1024u, arena.capacity());
+  processMessage(arena, 10);
+  EXPECT_EQ(1024u, arena.lastStats().capacity);
+  EXPECT_EQ(0u, arena.lastStats().overflow_allocations);
+}
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,104 @@
+/**
+ * @file   test_perf_counters.cpp
+ * @brief  Unit-tests for the optional hardware performance counters
+ * @author Yun Chang
+ */
+#include <sstream>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/PerfCounters.h"
+
+namespace kimera_pgmo {
+
+TEST(test_perf_counters, countsArithmetic) {
+  PerfCounts start;
+  start.has[PerfCounts::CYCLES] = true;
+  start.values[PerfCounts::CYCLES] = 100;
+  PerfCounts end = start;
+  end.values[PerfCounts::CYCLES] = 250;
+  end.has[PerfCounts::INSTRUCTIONS] = true;
+  end.values[PerfCounts::INSTRUCTIONS] = 300;
+
+  // Only events counted at both ends are part of the difference
+  const PerfCounts diff = end - start;
+  EXPECT_TRUE(diff.valid());
+  EXPECT_EQ(150u, diff[PerfCounts::CYCLES]);
+  EXPECT_FALSE(diff.has[PerfCounts::INSTRUCTIONS]);
+
+  PerfCounts total;
+  EXPECT_FALSE(total.valid());
+  total += diff;
+  total += diff;
+  EXPECT_EQ(300u, total[PerfCounts::CYCLES]);
+  EXPECT_FALSE(total.has[PerfCounts::LLC_MISSES]);
+}
+
+TEST(test_perf_counters, json) {
+  std::stringstream invalid;
+  writePerfCountsJson(invalid, PerfCounts());
+  EXPECT_EQ("null", invalid.str());
+
+  PerfCounts counts;
+  counts.has[PerfCounts::CYCLES] = true;
+  counts.values[PerfCounts::CYCLES] = 200;
+  counts.has[PerfCounts::INSTRUCTIONS] = true;
+  counts.values[PerfCounts::INSTRUCTIONS] = 100;
+  counts.has[PerfCounts::BRANCH_MISSES] = true;
+  counts.values[PerfCounts::BRANCH_MISSES] = 3;
+  std::stringstream json;
+  writePerfCountsJson(json, counts);
+  EXPECT_EQ(
+      "{\"cycles\": 200, \"instructions\": 100, \"branch_misses\": 3, \"ipc\": 0.5}",
+      json.str());
+}
+
+TEST(test_perf_counters, scopedZone) {
+  // perf events are usually not accessible in CI containers, in which case the
+  // zone only records wall time
+  PerfCounters counters;
+  if (!counters.available()) {
+    EXPECT_FALSE(counters.error().empty());
+    EXPECT_FALSE(counters.read().valid());
+  }
+
+  ZoneStats stats;
+  volatile double sum = 0.0;
+  for (size_t i = 0; i < 2; ++i) {
+    ScopedZone zone(counters.available() ? &counters : nullptr, &stats);
+    for (size_t j = 0; j < 100000; ++j) {
+      sum = sum + 0.5 * j;
+    }
+  }
+  EXPECT_EQ(2u, stats.count);
+  EXPECT_GT(stats.wall_ms, 0.0);
+  if (stats.counters.has[PerfCounts::INSTRUCTIONS]) {
+    EXPECT_GT(stats.counters[PerfCounts::INSTRUCTIONS], 100000u);
+  }
+}
+
+TEST(test_perf_counters, scopedZoneAllocations) {
+  resetAllocationZoneStats();
+  ZoneStats stats;
+  {
+    ScopedZone zone(nullptr, &stats, "scoped");
+    std::vector<char> buffer(1000);
+  }
+  EXPECT_EQ(1u, stats.count);
+  if (!allocationCountingEnabled()) {
+    EXPECT_EQ(0u, stats.allocations.allocations);
+    EXPECT_TRUE(allocationZoneStats().empty());
+    return;
+  }
+
+  // the same allocations are in the zone stats and in the allocation report
+  EXPECT_EQ(1u, stats.allocations.allocations);
+  EXPECT_EQ(1000u, stats.allocations.bytes);
+  const auto zones = allocationZoneStats();
+  ASSERT_EQ(1u, zones.size());
+  EXPECT_EQ("scoped", zones[0].name);
+  EXPECT_EQ(1000u, zones[0].total.bytes);
+  resetAllocationZoneStats();
+}
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,216 @@
+/**
+ * @file   test_shared_memory_segment.cpp
+ * @brief  Unit-tests for the seqlock-protected shared memory segments
+ * @author Yun Chang
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pcl/conversions.h>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/DeformationGraph.h"
+#include "kimera_pgmo/utils/SharedMemoryExport.h"
+#include "kimera_pgmo/utils/SharedMemorySegment.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+std::string segmentName(const std::string& test) {
+  return "/kimera_pgmo_test_" + test + "_" + std::to_string(getpid());
+}
+
+// Writes count copies of value to the first array
+bool writeValues(SharedSegmentWriter& writer,
+                 uint64_t stamp,
+                 size_t count,
+                 uint64_t value,
+                 bool* previous_contents = nullptr) {
+  return writer.write(stamp,
+                      {count, 0, 0, 0},
+                      {sizeof(uint64_t), 0, 0, 0},
+                      [&](const auto& arrays, bool previous) {
+                        auto* values = reinterpret_cast<uint64_t*>(arrays[0]);
+                        std::fill(values, values + count, value);
+                        if (previous_contents) {
+                          *previous_contents = previous;
+                        }
+                      });
+}
+
+pcl::PolygonMesh makeTriangle(float x) {
+  pcl::PointCloud<pcl::PointXYZRGBA> vertices;
+  vertices.points.resize(3);
+  for (size_t i = 0; i < 3; ++i) {
+    vertices.points[i].x = x + i;
+  }
+  pcl::PolygonMesh mesh;
+  pcl::toPCLPointCloud2(vertices, mesh.cloud);
+  pcl::Vertices face;
+  face.vertices = {0, 1, 2};
+  mesh.polygons.push_back(face);
+  return mesh;
+}
+
+}  // namespace
+
+TEST(test_shared_memory_segment, writeRead) {
+  const std::string name = segmentName("write_read");
+  SharedSegmentReader reader(name);
+  SharedSegmentReader::Snapshot snapshot;
+  EXPECT_FALSE(reader.snapshot(&snapshot));
+
+  SharedSegmentWriter writer(name, 128);
+  ASSERT_TRUE(writer.ok());
+  // nothing written yet
+  ASSERT_TRUE(reader.snapshot(&snapshot));
+  EXPECT_EQ(0u, snapshot.version);
+  EXPECT_EQ(0u, snapshot.counts[0]);
+
+  bool previous_contents = true;
+  EXPECT_TRUE(writeValues(writer, 10, 5, 7, &previous_contents));
+  EXPECT_FALSE(previous_contents);
+  ASSERT_TRUE(reader.snapshot(&snapshot));
+  EXPECT_EQ(1u, snapshot.version);
+  EXPECT_EQ(10u, snapshot.stamp_ns);
+  ASSERT_EQ(5u, snapshot.counts[0]);
+  const uint64_t* values = snapshot.array<uint64_t>(0);
+  ASSERT_TRUE(values != nullptr);
+  EXPECT_EQ(7u, values[4]);
+  EXPECT_TRUE(reader.valid(snapshot));
+  // elements of another type are rejected
+  EXPECT_TRUE(snapshot.array<uint32_t>(0) == nullptr);
+
+  // same layout: the previous version is still there
+  EXPECT_TRUE(writeValues(writer, 20, 5, 8, &previous_contents));
+  EXPECT_TRUE(previous_contents);
+  EXPECT_FALSE(reader.valid(snapshot));
+
+  // growing past the initial size remaps both sides
+  std::vector<uint64_t> copied;
+  uint64_t version = 0;
+  EXPECT_TRUE(writeValues(writer, 30, 1000, 9, &previous_contents));
+  EXPECT_FALSE(previous_contents);
+  ASSERT_TRUE(reader.copy(0, &copied, &version));
+  EXPECT_EQ(3u, version);
+  EXPECT_EQ(std::vector<uint64_t>(1000, 9), copied);
+}
+
+TEST(test_shared_memory_segment, writerReplaced) {
+  const std::string name = segmentName("writer_replaced");
+  SharedSegmentReader reader(name);
+  std::vector<uint64_t> copied;
+  {
+    SharedSegmentWriter writer(name);
+    writeValues(writer, 1, 3, 1);
+    writeValues(writer, 2, 3, 2);
+    ASSERT_TRUE(reader.copy(0, &copied));
+    EXPECT_EQ(std::vector<uint64_t>(3, 2), copied);
+
+    // a restarted writer replaces the segment, readers follow
+    SharedSegmentWriter restarted(name);
+    writeValues(restarted, 3, 2, 3);
+    uint64_t version = 0;
+    ASSERT_TRUE(reader.copy(0, &copied, &version));
+    EXPECT_EQ(1u, version);
+    EXPECT_EQ(std::vector<uint64_t>(2, 3), copied);
+  }
+
+  // removed with the writer
+  SharedSegmentReader::Snapshot snapshot;
+  EXPECT_FALSE(reader.snapshot(&snapshot));
+}
+
+TEST(test_shared_memory_segment, concurrentReads) {
+  const std::string name = segmentName("concurrent_reads");
+  SharedSegmentWriter writer(name, 256);
+  ASSERT_TRUE(writer.ok());
+  writeValues(writer, 0, 1, 1);
+
+  std::atomic<bool> done(false);
+  size_t num_reads = 0;
+  size_t num_torn = 0;
+  std::thread reader_thread([&]() {
+    SharedSegmentReader reader(name);
+    std::vector<uint64_t> copied;
+    while (!done) {
+      if (!reader.copy(0, &copied)) {
+        continue;
+      }
+      ++num_reads;
+      // every version is filled with its size
+      for (const uint64_t value : copied) {
+        if (value != copied.size()) {
+          ++num_torn;
+          break;
+        }
+      }
+    }
+  });
+
+  for (size_t i = 1; i < 2000; ++i) {
+    const size_t count = i % 500 + 1;
+    writeValues(writer, i, count, count);
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  done = true;
+  reader_thread.join();
+  EXPECT_LT(0u, num_reads);
+  EXPECT_EQ(0u, num_torn);
+}
+
+TEST(test_shared_memory_segment, exportMeshVersions) {
+  const std::string prefix = segmentName("export");
+  SharedMemoryExport shared_export(prefix);
+  ASSERT_TRUE(shared_export.ok());
+  SharedSegmentReader reader(prefix + "_mesh");
+  const std::vector<Timestamp> stamps{1, 2, 3};
+  std::vector<SharedVertex> vertices;
+
+  DeformedVertices deformed;
+  deformed.num_vertices = 3;
+  deformed.sequence = 1;
+  ASSERT_TRUE(shared_export.writeMesh(makeTriangle(0.0), stamps, 1, &deformed));
+
+  // a deformation was not exported: only vertex 2 moved in the last one, but
+  // the whole mesh changed since the last export
+  deformed.full = false;
+  deformed.moved = {2};
+  deformed.start = 3;
+  deformed.sequence = 3;
+  ASSERT_TRUE(shared_export.writeMesh(makeTriangle(10.0), stamps, 2, &deformed));
+  ASSERT_TRUE(reader.copy(SHARED_VERTICES, &vertices));
+  ASSERT_EQ(3u, vertices.size());
+  EXPECT_EQ(10.0f, vertices[0].x);
+  EXPECT_EQ(12.0f, vertices[2].x);
+
+  // the next deformation only rewrites the vertices it moved
+  deformed.sequence = 4;
+  ASSERT_TRUE(shared_export.writeMesh(makeTriangle(20.0), stamps, 3, &deformed));
+  ASSERT_TRUE(reader.copy(SHARED_VERTICES, &vertices));
+  EXPECT_EQ(10.0f, vertices[0].x);
+  EXPECT_EQ(22.0f, vertices[2].x);
+
+  // an older mesh exported late is skipped
+  uint64_t version = 0;
+  ASSERT_TRUE(reader.copy(SHARED_VERTICES, &vertices, &version));
+  EXPECT_TRUE(shared_export.writeMesh(makeTriangle(30.0), stamps, 2, nullptr));
+  uint64_t new_version = 0;
+  ASSERT_TRUE(reader.copy(SHARED_VERTICES, &vertices, &new_version));
+  EXPECT_EQ(version, new_version);
+  EXPECT_EQ(22.0f, vertices[2].x);
+
+  // a replaced mesh is always written in full
+  ASSERT_TRUE(shared_export.writeMesh(makeTriangle(40.0), stamps, 4, nullptr));
+  ASSERT_TRUE(reader.copy(SHARED_VERTICES, &vertices));
+  EXPECT_EQ(40.0f, vertices[0].x);
+}
+
+}  // namespace kimera_pgmo
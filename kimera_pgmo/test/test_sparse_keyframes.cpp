@@ -0,0 +1,174 @@
+/**
+ * @file   test_sparse_keyframes.cpp
+ * @brief  Unit-tests for the flat sparse keyframe storage
+ * @author Yun Chang
+ */
+#include <cstdio>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/SparseKeyframes.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+const gtsam::Pose3 kStep(gtsam::Rot3(), gtsam::Point3(0.4, 0, 0));
+
+// Robot a moving 0.4 per pose, with keyframes absorbing poses within 1.0 of them
+SparseKeyframes makeKeyframes(size_t num_poses) {
+  SparseKeyframes keyframes;
+  gtsam::Key sparse_key = gtsam::Symbol('a', 0);
+  keyframes.addKeyframe(sparse_key, gtsam::Symbol('a', 0));
+  for (size_t i = 1; i < num_poses; ++i) {
+    const gtsam::Key to_key = gtsam::Symbol('a', i);
+    if (keyframes.addOdometry(sparse_key, to_key, kStep, 1.0, 1.0)) {
+      keyframes.absorbPose(sparse_key, to_key);
+    } else {
+      sparse_key++;
+      keyframes.addKeyframe(sparse_key, to_key);
+    }
+  }
+  return keyframes;
+}
+
+}  // namespace
+
+TEST(test_sparse_keyframes, absorbOdometry) {
+  const SparseKeyframes keyframes = makeKeyframes(10);
+  EXPECT_EQ(10u, keyframes.numPoses());
+  // poses 0-2, 3-5, 6-8, 9
+  EXPECT_EQ(4u, keyframes.numKeyframes());
+
+  EXPECT_TRUE(keyframes.hasPose(gtsam::Symbol('a', 9)));
+  EXPECT_FALSE(keyframes.hasPose(gtsam::Symbol('a', 10)));
+  EXPECT_FALSE(keyframes.hasPose(gtsam::Symbol('b', 0)));
+  EXPECT_TRUE(keyframes.hasKeyframe(gtsam::Symbol('a', 3)));
+  EXPECT_FALSE(keyframes.hasKeyframe(gtsam::Symbol('a', 4)));
+  EXPECT_EQ(gtsam::Symbol('a', 1).key(), keyframes.getKeyframe(gtsam::Symbol('a', 5)));
+  const gtsam::Pose3& transform = keyframes.getTransform(gtsam::Symbol('a', 5));
+  EXPECT_NEAR(0.8, transform.translation().x(), 1e-9);
+  EXPECT_THROW(keyframes.getKeyframe(gtsam::Symbol('a', 10)), std::out_of_range);
+
+  // the odometry that closed a keyframe is part of its transform
+  EXPECT_FALSE(keyframes.isActive(gtsam::Symbol('a', 0)));
+  const gtsam::Pose3& odometry = keyframes.getCurrentTransform(gtsam::Symbol('a', 0));
+  EXPECT_NEAR(1.2, odometry.translation().x(), 1e-9);
+  EXPECT_TRUE(keyframes.isActive(gtsam::Symbol('a', 3)));
+
+  std::vector<gtsam::Key> poses;
+  auto add_pose = [&](gtsam::Key key, const gtsam::Pose3&) { poses.push_back(key); };
+  keyframes.forEachPose(gtsam::Symbol('a', 2), add_pose);
+  EXPECT_EQ(std::vector<gtsam::Key>({gtsam::Symbol('a', 6),
+                                     gtsam::Symbol('a', 7),
+                                     gtsam::Symbol('a', 8)}),
+            poses);
+  EXPECT_THROW(keyframes.forEachPose(gtsam::Symbol('a', 4),
+                                     [](gtsam::Key, const gtsam::Pose3&) {}),
+               std::out_of_range);
+}
+
+TEST(test_sparse_keyframes, invalidOdometry) {
+  SparseKeyframes keyframes = makeKeyframes(4);
+  const gtsam::Key sparse_key = gtsam::Symbol('a', 1);
+  const gtsam::Key next_key = gtsam::Symbol('a', 4);
+  // not following the last pose of the keyframe
+  EXPECT_FALSE(
+      keyframes.addOdometry(sparse_key, gtsam::Symbol('a', 5), kStep, 1.0, 1.0));
+  EXPECT_FALSE(
+      keyframes.addOdometry(sparse_key, gtsam::Symbol('b', 4), kStep, 1.0, 1.0));
+  // unknown or inactive keyframe
+  EXPECT_FALSE(keyframes.addOdometry(gtsam::Symbol('a', 2), next_key, kStep, 1.0, 1.0));
+  keyframes.deactivate(sparse_key);
+  EXPECT_FALSE(keyframes.addOdometry(sparse_key, next_key, kStep, 1.0, 1.0));
+  // existing keyframes and poses
+  EXPECT_FALSE(keyframes.addKeyframe(sparse_key, next_key));
+  EXPECT_FALSE(keyframes.addKeyframe(gtsam::Symbol('a', 2), gtsam::Symbol('a', 3)));
+  EXPECT_FALSE(keyframes.insert(next_key, gtsam::Symbol('b', 2), kStep));
+  EXPECT_EQ(4u, keyframes.numPoses());
+}
+
+TEST(test_sparse_keyframes, loopClosures) {
+  SparseKeyframes keyframes;
+  const gtsam::Key a0 = gtsam::Symbol('a', 0);
+  const gtsam::Key a3 = gtsam::Symbol('a', 3);
+  const gtsam::Key b1 = gtsam::Symbol('b', 1);
+  EXPECT_TRUE(keyframes.addLoopClosure(a3, a0));
+  EXPECT_TRUE(keyframes.addLoopClosure(a0, b1));
+  EXPECT_FALSE(keyframes.addLoopClosure(a0, a3));
+  EXPECT_FALSE(keyframes.addLoopClosure(b1, a0));
+  EXPECT_TRUE(keyframes.hasLoopClosure(a0, a3));
+  EXPECT_FALSE(keyframes.hasLoopClosure(a3, b1));
+  EXPECT_EQ(2u, keyframes.numLoopClosures());
+}
+
+TEST(test_sparse_keyframes, merge) {
+  SparseKeyframes keyframes = makeKeyframes(5);
+  keyframes.addLoopClosure(gtsam::Symbol('a', 0), gtsam::Symbol('a', 1));
+
+  SparseKeyframes other;
+  other.insert(gtsam::Symbol('a', 4), gtsam::Symbol('a', 3), gtsam::Pose3());
+  other.insert(gtsam::Symbol('a', 5), gtsam::Symbol('a', 3), kStep);
+  other.insert(gtsam::Symbol('b', 0), gtsam::Symbol('b', 0), gtsam::Pose3());
+  other.addLoopClosure(gtsam::Symbol('a', 3), gtsam::Symbol('b', 0));
+  other.addLoopClosure(gtsam::Symbol('a', 1), gtsam::Symbol('a', 0));
+
+  keyframes.merge(other);
+  EXPECT_EQ(7u, keyframes.numPoses());
+  EXPECT_EQ(4u, keyframes.numKeyframes());
+  // existing poses are kept
+  const gtsam::Pose3& transform = keyframes.getTransform(gtsam::Symbol('a', 4));
+  EXPECT_NEAR(0.4, transform.translation().x(), 1e-9);
+  EXPECT_EQ(gtsam::Symbol('a', 3).key(), keyframes.getKeyframe(gtsam::Symbol('a', 5)));
+  EXPECT_EQ(2u, keyframes.numLoopClosures());
+}
+
+TEST(test_sparse_keyframes, flatStorage) {
+  const SparseKeyframes keyframes = makeKeyframes(30000);
+  EXPECT_EQ(30000u, keyframes.numPoses());
+  // one transform and keyframe index per pose (up to the vector growth), no
+  // per-pose allocations
+  const size_t flat_size = 30000u * (sizeof(gtsam::Pose3) + sizeof(uint32_t)) +
+                           10000u * (sizeof(gtsam::Pose3) + 3 * sizeof(size_t));
+  EXPECT_LT(keyframes.memoryUsage(), 2 * flat_size);
+}
+
+TEST(test_sparse_keyframes, binarySerialization) {
+  SparseKeyframes keyframes = makeKeyframes(20);
+  keyframes.insert(gtsam::Symbol('b', 2), gtsam::Symbol('b', 1), kStep);
+  keyframes.addLoopClosure(gtsam::Symbol('a', 2), gtsam::Symbol('b', 1));
+
+  const std::string filename = "/tmp/test_sparse_keyframes.bin";
+  {
+    BinaryWriter writer(filename);
+    keyframes.save(writer);
+    ASSERT_TRUE(writer.ok());
+  }
+
+  BinaryReader reader(filename);
+  SparseKeyframes loaded;
+  ASSERT_TRUE(loaded.load(reader));
+  std::remove(filename.c_str());
+
+  EXPECT_EQ(keyframes.numPoses(), loaded.numPoses());
+  EXPECT_EQ(keyframes.numKeyframes(), loaded.numKeyframes());
+  EXPECT_TRUE(loaded.hasLoopClosure(gtsam::Symbol('b', 1), gtsam::Symbol('a', 2)));
+  EXPECT_FALSE(loaded.hasPose(gtsam::Symbol('b', 1)));
+  for (size_t i = 0; i < 20; ++i) {
+    const gtsam::Key key = gtsam::Symbol('a', i);
+    EXPECT_EQ(keyframes.getKeyframe(key), loaded.getKeyframe(key));
+    EXPECT_TRUE(keyframes.getTransform(key).equals(loaded.getTransform(key)));
+  }
+  const gtsam::Key last_keyframe = keyframes.getKeyframe(gtsam::Symbol('a', 19));
+  EXPECT_EQ(keyframes.isActive(last_keyframe), loaded.isActive(last_keyframe));
+  EXPECT_TRUE(keyframes.getCurrentTransform(gtsam::Symbol('a', 0))
+                  .equals(loaded.getCurrentTransform(gtsam::Symbol('a', 0))));
+
+  // truncated data
+  const uint8_t truncated[] = {1, 0, 0, 0, 0, 0, 0, 0, 'a'};
+  BinaryReader bad_reader(truncated, sizeof(truncated));
+  EXPECT_FALSE(loaded.load(bad_reader));
+  EXPECT_TRUE(loaded.empty());
+}
+
+}  // namespace kimera_pgmo
@@ -0,0 +1,212 @@
+/**
+ * @file   test_voxblox_utils.cpp
+ * @brief  Unit-tests for the voxblox mesh conversion utilities
+ * @author Yun Chang
+ */
+#include <pcl/conversions.h>
+
+#include <random>
+
+#include "gtest/gtest.h"
+#include "kimera_pgmo/utils/VoxbloxUtils.h"
+
+namespace kimera_pgmo {
+
+namespace {
+
+void addVertex(voxblox_msgs::MeshBlock* block, uint16_t x, uint16_t y, uint16_t z) {
+  block->x.push_back(x);
+  block->y.push_back(y);
+  block->z.push_back(z);
+  block->r.push_back(x % 256);
+  block->g.push_back(y % 256);
+  block->b.push_back(z % 256);
+}
+
+// Triangles with vertices on a coarse lattice so that vertices repeat, within
+// a block and between blocks with the same index
+voxblox_msgs::Mesh::Ptr makeMesh(size_t num_blocks, size_t num_triangles) {
+  voxblox_msgs::Mesh::Ptr mesh(new voxblox_msgs::Mesh);
+  mesh->block_edge_length = 1.6;
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> coord(0, 7);
+  std::uniform_int_distribution<int> block_coord(0, 2);
+  for (size_t b = 0; b < num_blocks; b++) {
+    voxblox_msgs::MeshBlock block;
+    block.index = {block_coord(gen), block_coord(gen), 0};
+    for (size_t i = 0; i < 3 * num_triangles; i++) {
+      addVertex(&block, 8000 * coord(gen), 8000 * coord(gen), 8000 * coord(gen));
+    }
+    mesh->mesh_blocks.push_back(block);
+  }
+  return mesh;
+}
+
+// Previous implementation: linear scan of the vertices of the mesh for each
+// vertex of the block
+void convertByScan(const voxblox_msgs::MeshBlock& mesh_block,
+                   float block_edge_length,
+                   pcl::PointCloud<pcl::PointXYZRGBA>* vertices,
+                   std::vector<pcl::Vertices>* triangles) {
+  pcl::Vertices triangle;
+  for (size_t i = 0; i < mesh_block.x.size(); ++i) {
+    pcl::PointXYZRGBA point = ExtractPoint(mesh_block, block_edge_length, i);
+    size_t vidx = vertices->size();
+    for (size_t k = 0; k < vertices->size(); k++) {
+      if (point.x == vertices->points[k].x && point.y == vertices->points[k].y &&
+          point.z == vertices->points[k].z) {
+        vidx = k;
+        break;
+      }
+    }
+    if (vidx == vertices->size()) {
+      vertices->push_back(point);
+    } else {
+      vertices->points[vidx] = point;
+    }
+    triangle.vertices.push_back(vidx);
+    if (triangle.vertices.size() == 3) {
+      triangles->push_back(triangle);
+      triangle = pcl::Vertices();
+    }
+  }
+}
+
+void expectVerticesEqual(const pcl::PointCloud<pcl::PointXYZRGBA>& expected,
+                         const pcl::PointCloud<pcl::PointXYZRGBA>& result) {
+  ASSERT_EQ(expected.size(), result.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected.points[i].x, result.points[i].x);
+    EXPECT_EQ(expected.points[i].y, result.points[i].y);
+    EXPECT_EQ(expected.points[i].z, result.points[i].z);
+    EXPECT_EQ(expected.points[i].r, result.points[i].r);
+  }
+}
+
+}  // namespace
+
+TEST(test_voxblox_utils, meshBlockToPolygonMesh) {
+  voxblox_msgs::MeshBlock block;
+  block.index = {1, 0, 0};
+  addVertex(&block, 0, 0, 0);
+  addVertex(&block, 100, 0, 0);
+  addVertex(&block, 0, 100, 0);
+  addVertex(&block, 100, 0, 0);
+  addVertex(&block, 100, 100, 0);
+  addVertex(&block, 0, 100, 0);
+
+  const pcl::PolygonMesh mesh = VoxbloxMeshBlockToPolygonMesh(block, 0.5);
+  pcl::PointCloud<pcl::PointXYZRGBA> vertices;
+  pcl::fromPCLPointCloud2(mesh.cloud, vertices);
+  EXPECT_EQ(4u, vertices.size());
+  ASSERT_EQ(2u, mesh.polygons.size());
+  EXPECT_EQ(std::vector<uint32_t>({0, 1, 2}), mesh.polygons[0].vertices);
+  EXPECT_EQ(std::vector<uint32_t>({1, 3, 2}), mesh.polygons[1].vertices);
+  EXPECT_FLOAT_EQ(0.5, vertices.points[0].x);
+}
+
+TEST(test_voxblox_utils, checkDuplicatesFull) {
+  const auto msg = makeMesh(2, 50);
+  const float edge = msg->block_edge_length;
+
+  pcl::PointCloud<pcl::PointXYZRGBA> expected_vertices;
+  std::vector<pcl::Vertices> expected_triangles;
+  convertByScan(msg->mesh_blocks[0], edge, &expected_vertices, &expected_triangles);
+  convertByScan(msg->mesh_blocks[1], edge, &expected_vertices, &expected_triangles);
+
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr vertices(
+      new pcl::PointCloud<pcl::PointXYZRGBA>);
+  auto triangles = std::make_shared<std::vector<pcl::Vertices> >();
+  auto msg_vertex_map = std::make_shared<std::map<size_t, size_t> >();
+  VoxbloxMeshBlockToPolygonMesh(
+      msg->mesh_blocks[0], edge, vertices, msg_vertex_map, triangles, true);
+  msg_vertex_map->clear();
+  VoxbloxMeshBlockToPolygonMesh(
+      msg->mesh_blocks[1], edge, vertices, msg_vertex_map, triangles, true);
+
+  expectVerticesEqual(expected_vertices, *vertices);
+  ASSERT_EQ(expected_triangles.size(), triangles->size());
+  for (size_t i = 0; i < triangles->size(); i++) {
+    EXPECT_EQ(expected_triangles[i].vertices, triangles->at(i).vertices);
+  }
+  EXPECT_EQ(triangles->back().vertices.back(), msg_vertex_map->at(149));
+
+  // without the full check only the vertices of the block are deduplicated
+  const size_t num_first = vertices->size();
+  VoxbloxMeshBlockToPolygonMesh(
+      msg->mesh_blocks[0], edge, vertices, msg_vertex_map, triangles, false);
+  EXPECT_GT(vertices->size(), num_first);
+}
+
+TEST(test_voxblox_utils, voxbloxToPolygonMesh) {
+  const auto msg = makeMesh(40, 30);
+
+  // every vertex is checked against all the previous ones
+  pcl::PointCloud<pcl::PointXYZRGBA> expected_vertices;
+  std::vector<pcl::Vertices> all_triangles;
+  for (const auto& block : msg->mesh_blocks) {
+    convertByScan(block, msg->block_edge_length, &expected_vertices, &all_triangles);
+  }
+
+  for (size_t num_threads : {1, 4}) {
+    const pcl::PolygonMesh mesh = VoxbloxToPolygonMesh(msg, num_threads);
+    pcl::PointCloud<pcl::PointXYZRGBA> vertices;
+    pcl::fromPCLPointCloud2(mesh.cloud, vertices);
+    expectVerticesEqual(expected_vertices, vertices);
+    // faces only made of vertices of earlier blocks are dropped
+    EXPECT_LT(mesh.polygons.size(), all_triangles.size());
+    EXPECT_EQ(all_triangles.front().vertices, mesh.polygons.front().vertices);
+    for (const auto& tri : mesh.polygons) {
+      EXPECT_NE(all_triangles.end(),
+                std::find_if(all_triangles.begin(),
+                             all_triangles.end(),
+                             [&](const pcl::Vertices& other) {
+                               return other.vertices == tri.vertices;
+                             }));
+    }
+  }
+
+  EXPECT_EQ(VoxbloxToPolygonMesh(msg, 1).polygons.size(),
+            VoxbloxToPolygonMesh(msg, 3).polygons.size());
+}
+
+TEST(test_voxblox_utils, updateMeshFromMeshBlock) {
+  voxblox_msgs::MeshBlock block;
+  block.index = {0, 0, 0};
+  addVertex(&block, 0, 0, 0);
+  addVertex(&block, 100, 0, 0);
+  addVertex(&block, 0, 100, 0);
+
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr vertices(
+      new pcl::PointCloud<pcl::PointXYZRGBA>);
+  auto triangles = std::make_shared<std::vector<pcl::Vertices> >();
+  auto adjacent_surfaces =
+      std::make_shared<std::map<size_t, std::vector<pcl::Vertices> > >();
+  auto updated_indices = std::make_shared<std::vector<size_t> >();
+  UpdateMeshFromVoxbloxMeshBlock(
+      block, 1.0, vertices, triangles, {}, updated_indices, adjacent_surfaces);
+  EXPECT_EQ(3u, vertices->size());
+  EXPECT_EQ(std::vector<size_t>({0, 1, 2}), *updated_indices);
+
+  // the block grows by a triangle sharing an edge with the first one
+  addVertex(&block, 100, 0, 0);
+  addVertex(&block, 100, 100, 0);
+  addVertex(&block, 0, 100, 0);
+  const std::vector<size_t> original_indices = *updated_indices;
+  updated_indices->clear();
+  const pcl::PolygonMesh partial = UpdateMeshFromVoxbloxMeshBlock(block,
+                                                                  1.0,
+                                                                  vertices,
+                                                                  triangles,
+                                                                  original_indices,
+                                                                  updated_indices,
+                                                                  adjacent_surfaces);
+  EXPECT_EQ(4u, vertices->size());
+  EXPECT_EQ(std::vector<size_t>({0, 1, 2, 3}), *updated_indices);
+  ASSERT_EQ(2u, triangles->size());
+  EXPECT_EQ(std::vector<uint32_t>({1, 3, 2}), triangles->at(1).vertices);
+  ASSERT_EQ(2u, partial.polygons.size());
+  EXPECT_EQ(std::vector<uint32_t>({1, 3, 2}), partial.polygons[1].vertices);
+}
+
+}  // namespace kimera_pgmo
@@ -5,8 +5,11 @@
  * @author Nathan Hughes
  */
 
+#include <cstdio>
+
 #include "gtest/gtest.h"
 #include "kimera_pgmo/compression/VoxelClearingCompression.h"
+#include "test_config.h"
 
 namespace kimera_pgmo {
 
@@ -388,4 +391,147 @@ TEST(test_voxel_clearing_compression, pruningCorrectMultiblock) {
   }
 }
 
+class VoxelClearingCompressionTest : public ::testing::Test {
+ protected:
+  VoxelClearingCompressionTest() : compression(compression_factor) {}
+
+  void integrate(const std::vector<BlockConfig> &configs, double stamp_in_sec) {
+    CompressionInputs input;
+    compression.compressAndIntegrate(createMesh(configs),
+                                     input.vertices,
+                                     input.triangles,
+                                     input.indices,
+                                     input.remappings,
+                                     stamp_in_sec);
+  }
+
+  // the active indices should always match the vertices with active references
+  void checkActiveIndices(const std::vector<size_t> &expected) const {
+    std::vector<size_t> active_refs;
+    for (const auto &index_count_pair : compression.indices_to_active_refs_) {
+      active_refs.push_back(index_count_pair.first);
+    }
+
+    EXPECT_EQ(active_refs, compression.getActiveVerticesIndex());
+    EXPECT_EQ(expected, compression.getActiveVerticesIndex());
+  }
+
+  bool isTracked(const BlockConfig &config) const {
+    const voxblox::BlockIndex block_index(
+        config.index[0], config.index[1], config.index[2]);
+    return compression.block_update_times_.count(block_index) &&
+           compression.prev_meshes_.count(block_index);
+  }
+
+  VoxelClearingCompression compression;
+};
+
+TEST_F(VoxelClearingCompressionTest, updatePruneRevisit) {
+  integrate({block1_test1}, 100.0);
+  integrate({block2_test1}, 102.0);
+  checkActiveIndices({0, 1, 2, 3, 4, 5, 6, 7, 8});
+
+  // the newer update of the first block should keep it from being archived
+  integrate({block1_test1}, 106.0);
+  compression.pruneStoredMesh(103.0);
+  EXPECT_TRUE(isTracked(block1_test1));
+  EXPECT_FALSE(isTracked(block2_test1));
+  EXPECT_EQ(2u, compression.getNumFixedPolygons());
+  checkActiveIndices({0, 1, 2, 3, 4, 5});
+
+  // revisiting the archived block makes new vertices for the archived voxels only
+  integrate({block2_test1}, 107.0);
+  EXPECT_TRUE(isTracked(block2_test1));
+  EXPECT_EQ(2u, compression.getNumFixedPolygons());
+  checkActiveIndices({0, 1, 2, 3, 4, 5, 9, 10, 11});
+
+  {  // limit temporary scopes
+    CompressionOutput output(compression);
+    EXPECT_EQ(12u, output.vertices->points.size());
+    EXPECT_EQ(0u, output.invalidated.size());
+    EXPECT_EQ(output.vertices->size(), output.timestamps->size());
+    EXPECT_TRUE(checkTriangles({{6, 7, 8}, {3, 4, 5}, {9, 10, 11}, {0, 1, 2}},
+                               *output.triangles));
+  }
+
+  // the first block is archived once its latest update is old enough
+  compression.pruneStoredMesh(106.0);
+  EXPECT_FALSE(isTracked(block1_test1));
+  EXPECT_TRUE(isTracked(block2_test1));
+  EXPECT_EQ(5u, compression.getNumFixedPolygons());
+  checkActiveIndices({3, 4, 5, 9, 10, 11});
+
+  // stale entries of already archived blocks should not archive anything else
+  compression.pruneStoredMesh(106.5);
+  EXPECT_TRUE(isTracked(block2_test1));
+  EXPECT_EQ(5u, compression.getNumFixedPolygons());
+  checkActiveIndices({3, 4, 5, 9, 10, 11});
+}
+
+TEST(test_voxel_clearing_compression, saveLoadState) {
+  const std::string state_file = std::string(DATASET_PATH) + "/voxel_clearing.state";
+  VoxelClearingCompression compression(compression_factor);
+
+  {  // limit temporary scopes
+    CompressionInputs input;
+    auto mesh = createMesh({block1_test1});
+    compression.compressAndIntegrate(
+        mesh, input.vertices, input.triangles, input.indices, input.remappings, 100.0);
+    mesh = createMesh({block2_test1});
+    compression.compressAndIntegrate(
+        mesh, input.vertices, input.triangles, input.indices, input.remappings, 102.0);
+    compression.pruneStoredMesh(101.0);
+  }
+
+  {  // limit temporary scopes
+    BinaryWriter writer(state_file);
+    compression.saveState(writer);
+    ASSERT_TRUE(writer.ok());
+  }
+
+  VoxelClearingCompression restored(compression_factor);
+  {  // limit temporary scopes
+    BinaryReader reader(state_file);
+    ASSERT_TRUE(restored.loadState(reader));
+    EXPECT_EQ(0u, reader.remaining());
+  }
+
+  {  // limit temporary scopes
+    CompressionOutput expected(compression);
+    CompressionOutput result(restored);
+    EXPECT_EQ(expected.vertices->size(), result.vertices->size());
+    EXPECT_EQ(*expected.timestamps, *result.timestamps);
+    EXPECT_EQ(expected.active_indices, result.active_indices);
+    EXPECT_EQ(expected.invalidated, result.invalidated);
+    EXPECT_EQ(expected.triangles->size(), result.triangles->size());
+  }
+
+  // both compressors should keep indexing identically after the restore
+  auto mesh = createMesh({block1_empty, block2_empty});
+  for (auto* to_update : {&compression, &restored}) {
+    CompressionInputs input;
+    to_update->compressAndIntegrate(
+        mesh, input.vertices, input.triangles, input.indices, input.remappings, 105.0);
+  }
+
+  mesh = createMesh({block1_test1});
+  for (auto* to_update : {&compression, &restored}) {
+    CompressionInputs input;
+    to_update->compressAndIntegrate(
+        mesh, input.vertices, input.triangles, input.indices, input.remappings, 105.0);
+  }
+
+  CompressionOutput output(restored);
+  EXPECT_EQ(15u, output.vertices->points.size());
+  EXPECT_EQ(3u, output.invalidated.size());
+  EXPECT_TRUE(checkTriangles({{0, 1, 2}, {3, 4, 5}, {9, 10, 11}, {12, 13, 14}},
+                             *output.triangles));
+
+  // a compressor with a different resolution must refuse the state
+  VoxelClearingCompression mismatched(2.0 * compression_factor);
+  BinaryReader reader(state_file);
+  EXPECT_FALSE(mismatched.loadState(reader));
+  std::remove(state_file.c_str());
+}
+
 }  // namespace kimera_pgmo